@@ -0,0 +1,1651 @@
+// Microbenchmark harness for `make bench`. Embeds the vendored Lua and the
+// rift sources and prints one JSON document with a result per case:
+//
+//   bin/bench [event-log]
+//
+// With an event log (from client:record), the decode cases also run on every
+// recorded payload. BENCH_TIME_MS sets the time budget per case (default 200).
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+
+#include "../src/clock.h"
+#include "../src/eventlog.h"
+#include "../src/socket.h"
+#include "../src/parsing.h"
+#include "../src/tape.h"
+#include "../src/alloc.h"
+#include "../src/select.h"
+#include "../src/columns.h"
+#include "server.h"
+
+int luaopen_rift(lua_State *L);
+
+static const size_t bench_sizes[] = {
+    1024,
+    16 * 1024,
+    256 * 1024,
+    4 * 1024 * 1024,
+};
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} bench_buf_t;
+
+typedef struct {
+    const char *name;
+    const char *payload;
+    const char *json;
+    size_t bytes;
+    void *ctx;
+    const char *extra;
+} bench_case_t;
+
+typedef bool (*bench_fn)(bench_case_t *bench_case);
+
+static uint64_t bench_budget_ns = 200000000ull;
+static bool bench_first_result = true;
+
+static void bench_buf_append(bench_buf_t *buf, const char *s, size_t len) {
+    if (buf->len + len + 1 > buf->cap) {
+        size_t cap = buf->cap ? buf->cap : 4096;
+        while (cap < buf->len + len + 1) cap *= 2;
+        buf->data = (char*)realloc(buf->data, cap);
+        if (!buf->data) {
+            fprintf(stderr, "bench: out of memory\n");
+            exit(1);
+        }
+        buf->cap = cap;
+    }
+    memcpy(buf->data + buf->len, s, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+}
+
+// A windows_changed event with as many windows as fit in `target` bytes.
+static char* bench_synthetic_event(size_t target, size_t *out_len) {
+    bench_buf_t buf = {0};
+    const char *head = "{\"type\":\"windows_changed\",\"space_id\":3,\"workspace\":{\"id\":3,\"name\":\"main\"},\"windows\":[";
+    bench_buf_append(&buf, head, strlen(head));
+
+    char window[512];
+    for (int i = 0; buf.len + 2 < target || i == 0; ++i) {
+        int n = snprintf(window, sizeof(window),
+            "%s{\"id\":%d,\"title\":\"Window %d \\u2014 document.txt\",\"app\":\"Editor\",\"pid\":%d,"
+            "\"frame\":{\"x\":%d.5,\"y\":%d.25,\"w\":1280,\"h\":800},\"focused\":%s,\"floating\":false,"
+            "\"tags\":[\"work\",\"code\"],\"opacity\":0.95}",
+            i ? "," : "", i, i, 1000 + i, i * 8, i * 4, i == 0 ? "true" : "false");
+        bench_buf_append(&buf, window, (size_t)n);
+    }
+    bench_buf_append(&buf, "]}", 2);
+    *out_len = buf.len;
+    return buf.data;
+}
+
+// Geometry-heavy layout event: mostly numbers, fractional frames as a
+// Retina display reports them, plus large ids.
+static char* bench_numeric_event(size_t target, size_t *out_len) {
+    bench_buf_t buf = {0};
+    const char *head = "{\"type\":\"layout_changed\",\"space_id\":3,\"windows\":[";
+    bench_buf_append(&buf, head, strlen(head));
+
+    char window[256];
+    for (int i = 0; buf.len + 2 < target || i == 0; ++i) {
+        int n = snprintf(window, sizeof(window),
+            "%s{\"id\":%lld,\"frame\":[%d.5,%d.25,%d.75,%d],\"scale\":2,\"weight\":%d.%03d,"
+            "\"opacity\":0.95,\"ratio\":1.6e-1}",
+            i ? "," : "", 4294967296ll + i, i * 8, i * 4, 640 + i % 640, 400 + i % 400, i % 7, (i * 37) % 1000);
+        bench_buf_append(&buf, window, (size_t)n);
+    }
+    bench_buf_append(&buf, "]}", 2);
+    *out_len = buf.len;
+    return buf.data;
+}
+
+static void bench_report(const bench_case_t *bench_case, uint64_t iterations, uint64_t elapsed_ns) {
+    double ns_per_op = iterations ? (double)elapsed_ns / (double)iterations : 0;
+    double mb_per_s = elapsed_ns ? (double)bench_case->bytes * (double)iterations / ((double)elapsed_ns / 1e9) / 1e6 : 0;
+    printf("%s\n    {\"name\":\"%s\",\"payload\":\"%s\",\"bytes\":%zu,\"iterations\":%llu,"
+           "\"ns_per_op\":%.1f,\"mb_per_s\":%.2f%s}",
+           bench_first_result ? "" : ",", bench_case->name, bench_case->payload, bench_case->bytes,
+           (unsigned long long)iterations, ns_per_op, mb_per_s, bench_case->extra ? bench_case->extra : "");
+    bench_first_result = false;
+    fflush(stdout);
+}
+
+// Returns the number of timed calls, or 0 on failure; `fn` runs one more
+// time than that as a warm-up.
+static uint64_t bench_measure(bench_case_t *bench_case, bench_fn fn, uint64_t *elapsed_ns) {
+    // One warm-up call, then batches that double until the budget is spent.
+    if (!fn(bench_case)) {
+        fprintf(stderr, "bench: %s (%s, %zu bytes) failed\n", bench_case->name, bench_case->payload, bench_case->bytes);
+        return 0;
+    }
+
+    uint64_t iterations = 0;
+    uint64_t batch = 1;
+    uint64_t start = rift_now_ns();
+    uint64_t elapsed = 0;
+    while (elapsed < bench_budget_ns) {
+        for (uint64_t i = 0; i < batch; ++i) {
+            if (!fn(bench_case)) {
+                fprintf(stderr, "bench: %s failed mid-run\n", bench_case->name);
+                return 0;
+            }
+        }
+        iterations += batch;
+        elapsed = rift_now_ns() - start;
+        if (batch < (1u << 20)) batch *= 2;
+    }
+    *elapsed_ns = elapsed;
+    return iterations;
+}
+
+static void bench_run(bench_case_t *bench_case, bench_fn fn) {
+    uint64_t elapsed = 0;
+    uint64_t iterations = bench_measure(bench_case, fn, &elapsed);
+    if (iterations) bench_report(bench_case, iterations, elapsed);
+}
+
+static bool bench_decode(bench_case_t *bench_case) {
+    lua_State *L = (lua_State*)bench_case->ctx;
+    if (!json_to_lua_table(L, bench_case->json)) return false;
+    lua_pop(L, 1);
+    return true;
+}
+
+static bool bench_tape_materialize(bench_case_t *bench_case) {
+    lua_State *L = (lua_State*)bench_case->ctx;
+    cJSON *root = cJSON_Parse(bench_case->json);
+    rift_tape_t tape = {0};
+    bool ok = root && rift_tape_encode(&tape, root) && rift_tape_to_lua_table(L, &tape);
+    cJSON_Delete(root);
+    rift_tape_free(&tape);
+    if (ok) lua_pop(L, 1);
+    return ok;
+}
+
+// The dispatch path has to parse the whole event before it knows its type.
+static bool bench_sniff_type(bench_case_t *bench_case) {
+    cJSON *root = cJSON_Parse(bench_case->json);
+    const cJSON *type = cJSON_GetObjectItemCaseSensitive(root, "type");
+    bool ok = cJSON_IsString(type);
+    cJSON_Delete(root);
+    return ok;
+}
+
+typedef struct {
+    lua_State *L;
+    const rift_select_t *sel;
+    rift_select_stats_t stats;
+} bench_select_t;
+
+// Projection a window list consumer typically asks for.
+static const char *bench_select_paths = "return {'space_id', 'windows.id', 'windows.title'}";
+
+static bool bench_decode_select(bench_case_t *bench_case) {
+    bench_select_t *ctx = (bench_select_t*)bench_case->ctx;
+    if (!rift_select_decode(ctx->L, ctx->sel, bench_case->json, bench_case->bytes, &ctx->stats)) return false;
+    lua_pop(ctx->L, 1);
+    return true;
+}
+
+// Same payload as decode_json_to_lua, so the two ns_per_op compare directly.
+static void bench_select_case(bench_case_t *bench_case, lua_State *L) {
+    if (luaL_dostring(L, bench_select_paths) != LUA_OK) return;
+    bench_select_t ctx = {L, rift_select_push(L, -1), {0}};
+    bench_case_t select_case = *bench_case;
+    select_case.name = "decode_select";
+    select_case.ctx = &ctx;
+    uint64_t elapsed = 0;
+    uint64_t iterations = bench_measure(&select_case, bench_decode_select, &elapsed);
+    if (iterations) {
+        double decodes = (double)ctx.stats.decodes;
+        char extra[160];
+        snprintf(extra, sizeof(extra), ",\"skipped_values\":%.0f,\"skipped_fraction\":%.3f",
+                 (double)ctx.stats.skipped_values / decodes,
+                 (double)ctx.stats.skipped_bytes / decodes / (double)bench_case->bytes);
+        select_case.extra = extra;
+        bench_report(&select_case, iterations, elapsed);
+    }
+    lua_pop(L, 2);
+}
+
+static bool bench_push_columns(lua_State *L, const char *json) {
+    cJSON *root = cJSON_Parse(json);
+    rift_tape_t tape = {0};
+    bool ok = root && rift_tape_encode(&tape, root) && rift_columns_push(L, &tape);
+    cJSON_Delete(root);
+    rift_tape_free(&tape);
+    return ok;
+}
+
+static bool bench_decode_columns(bench_case_t *bench_case) {
+    lua_State *L = (lua_State*)bench_case->ctx;
+    if (!bench_push_columns(L, bench_case->json)) return false;
+    lua_pop(L, 1);
+    return true;
+}
+
+static size_t bench_lua_heap(lua_State *L) {
+    return (size_t)lua_gc(L, LUA_GCCOUNT, 0) * 1024 + (size_t)lua_gc(L, LUA_GCCOUNTB, 0);
+}
+
+// Lua heap held by one decoded payload, and how long a full collection
+// takes while it is live.
+static void bench_footprint(lua_State *L, const char *json, bool columns, size_t *bytes, double *gc_ns) {
+    lua_gc(L, LUA_GCCOLLECT, 0);
+    size_t before = bench_lua_heap(L);
+    bool ok = columns ? bench_push_columns(L, json) : json_to_lua_table(L, json);
+    if (!ok) {
+        *bytes = 0;
+        *gc_ns = 0;
+        return;
+    }
+    lua_gc(L, LUA_GCCOLLECT, 0);
+    *bytes = bench_lua_heap(L) - before;
+    uint64_t start = rift_now_ns();
+    for (int i = 0; i < 8; ++i) lua_gc(L, LUA_GCCOLLECT, 0);
+    *gc_ns = (double)(rift_now_ns() - start) / 8.0;
+    lua_pop(L, 1);
+}
+
+// {as = "columns"}: parse, tape and views, against the table decode. Both
+// footprints go in the extra fields.
+static void bench_columns_case(bench_case_t *bench_case, lua_State *L) {
+    bench_case_t columns_case = *bench_case;
+    columns_case.name = "decode_columns";
+    columns_case.ctx = L;
+    uint64_t elapsed = 0;
+    uint64_t iterations = bench_measure(&columns_case, bench_decode_columns, &elapsed);
+    if (!iterations) return;
+    size_t table_bytes = 0;
+    size_t columns_bytes = 0;
+    double table_gc_ns = 0;
+    double columns_gc_ns = 0;
+    bench_footprint(L, bench_case->json, false, &table_bytes, &table_gc_ns);
+    bench_footprint(L, bench_case->json, true, &columns_bytes, &columns_gc_ns);
+    char extra[200];
+    snprintf(extra, sizeof(extra),
+             ",\"table_bytes\":%zu,\"columns_bytes\":%zu,\"table_gc_ns\":%.0f,\"columns_gc_ns\":%.0f",
+             table_bytes, columns_bytes, table_gc_ns, columns_gc_ns);
+    columns_case.extra = extra;
+    bench_report(&columns_case, iterations, elapsed);
+}
+
+#define BENCH_TITLE_EVENTS 256
+
+typedef struct {
+    lua_State *L;
+    char *events[BENCH_TITLE_EVENTS];
+} bench_titles_t;
+
+// A stream of window_title_changed events like a browser or terminal sends:
+// titles of 20 to 200 bytes, mostly ASCII, some UTF-8 and a few escapes.
+static void bench_title_events(bench_titles_t *titles, size_t *bytes) {
+    static const char *const words[] = {
+        "main.c", "Inbox", "(3)", "\\u2014", "Pull request", "#1824", "\xc2\xb7", "caf\xc3\xa9",
+        "Terminal", "\\\"draft\\\"", "\xe2\x80\x94", "Mozilla Firefox", "~/src/rift.lua", "Zoom Meeting",
+    };
+    *bytes = 0;
+    for (int i = 0; i < BENCH_TITLE_EVENTS; ++i) {
+        bench_buf_t buf = {0};
+        char head[128];
+        int n = snprintf(head, sizeof(head), "{\"type\":\"window_title_changed\",\"window_id\":%d,\"title\":\"", 100 + i % 32);
+        bench_buf_append(&buf, head, (size_t)n);
+        size_t target = 20 + (size_t)(i * 37) % 180;
+        for (size_t start = buf.len, w = (size_t)i; buf.len - start < target; w += 5) {
+            const char *word = words[w % (sizeof(words) / sizeof(words[0]))];
+            // Escapes are rare in real titles; keep one in four.
+            if (strchr(word, '\\') && (w / 5) % 4) word = "\xe2\x80\x94";
+            bench_buf_append(&buf, word, strlen(word));
+            bench_buf_append(&buf, " ", 1);
+        }
+        bench_buf_append(&buf, "\",\"app\":\"Firefox\"}", 18);
+        titles->events[i] = buf.data;
+        *bytes += buf.len;
+    }
+}
+
+static bool bench_parse_titles(bench_case_t *bench_case) {
+    bench_titles_t *titles = (bench_titles_t*)bench_case->ctx;
+    for (int i = 0; i < BENCH_TITLE_EVENTS; ++i) {
+        cJSON *root = cJSON_Parse(titles->events[i]);
+        if (!root) return false;
+        cJSON_Delete(root);
+    }
+    return true;
+}
+
+static bool bench_decode_titles(bench_case_t *bench_case) {
+    bench_titles_t *titles = (bench_titles_t*)bench_case->ctx;
+    for (int i = 0; i < BENCH_TITLE_EVENTS; ++i) {
+        if (!json_to_lua_table(titles->L, titles->events[i])) return false;
+        lua_pop(titles->L, 1);
+    }
+    return true;
+}
+
+static void bench_title_cases(lua_State *L) {
+    bench_titles_t titles;
+    titles.L = L;
+    size_t bytes = 0;
+    bench_title_events(&titles, &bytes);
+
+    bench_case_t bench_case = {"parse_titles", "window_title_changed", NULL, bytes, &titles, NULL};
+    bench_run(&bench_case, bench_parse_titles);
+    bench_case.name = "decode_titles";
+    bench_run(&bench_case, bench_decode_titles);
+    for (int i = 0; i < BENCH_TITLE_EVENTS; ++i) free(titles.events[i]);
+}
+
+typedef struct {
+    int fd;
+    bool echo;
+} bench_peer_t;
+
+// Stand-in server: drains frames, echoing the ones that want a reply.
+static void* bench_peer_main(void *arg) {
+    bench_peer_t *peer = (bench_peer_t*)arg;
+    while (1) {
+        uint32_t id = 0;
+        size_t len = 0;
+        rift_socket_status_t status;
+        char *frame = rift_socket_recv_frame(peer->fd, -1, &id, &len, &status);
+        if (!frame) break;
+        if (peer->echo && id != 0 && !rift_socket_send_frame(peer->fd, id, frame, len)) {
+            free(frame);
+            break;
+        }
+        free(frame);
+    }
+    return NULL;
+}
+
+typedef struct {
+    int fd;
+    uint32_t next_id;
+} bench_socket_ctx_t;
+
+static bool bench_send_frame(bench_case_t *bench_case) {
+    bench_socket_ctx_t *ctx = (bench_socket_ctx_t*)bench_case->ctx;
+    return rift_socket_send_frame(ctx->fd, 0, bench_case->json, bench_case->bytes);
+}
+
+static bool bench_round_trip(bench_case_t *bench_case) {
+    bench_socket_ctx_t *ctx = (bench_socket_ctx_t*)bench_case->ctx;
+    if (++ctx->next_id == 0) ctx->next_id = 1;
+    char *reply = rift_socket_request_internal(ctx->fd, ctx->next_id, bench_case->json, NULL);
+    if (!reply) return false;
+    free(reply);
+    return true;
+}
+
+static void bench_socket_cases(bench_case_t *bench_case, bool echo) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        fprintf(stderr, "bench: socketpair failed\n");
+        return;
+    }
+
+    bench_peer_t peer = {fds[1], echo};
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, bench_peer_main, &peer) != 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return;
+    }
+
+    bench_socket_ctx_t ctx = {fds[0], 0};
+    bench_case->ctx = &ctx;
+    bench_case->name = echo ? "round_trip" : "request_framing";
+    bench_run(bench_case, echo ? bench_round_trip : bench_send_frame);
+
+    shutdown(fds[0], SHUT_RDWR);
+    pthread_join(thread, NULL);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+typedef struct {
+    lua_State *L;
+    const char *log_path;
+} bench_dispatch_ctx_t;
+
+static const char *bench_dispatch_script =
+    "local rift, path = ...\n"
+    "local client = assert(rift.replay(path))\n"
+    "local count = 0\n"
+    "client:subscribe({ 'windows_changed' }, function(env) count = count + #env.DATA.windows end)\n"
+    "while client:pump(0) do end\n"
+    "client:disconnect()\n"
+    "return count\n";
+
+// Replays a log of `events` copies of the payload through rift.replay with one
+// subscribed callback: receive, parse, filter, materialize and call.
+static bool bench_dispatch(bench_case_t *bench_case) {
+    bench_dispatch_ctx_t *ctx = (bench_dispatch_ctx_t*)bench_case->ctx;
+    lua_State *L = ctx->L;
+    if (luaL_loadstring(L, bench_dispatch_script) != LUA_OK) return false;
+    luaL_requiref(L, "rift", luaopen_rift, 0);
+    lua_pushstring(L, ctx->log_path);
+    if (lua_pcall(L, 2, 1, 0) != LUA_OK) {
+        fprintf(stderr, "bench: %s\n", lua_tostring(L, -1));
+        lua_pop(L, 1);
+        return false;
+    }
+    lua_pop(L, 1);
+    return true;
+}
+
+// Writes a log of copies of the payload to a fresh path: enough events that
+// per-replay setup is noise, without writing GBs. With `other` (a payload of
+// the same length), every fourth event is that one instead. Returns the
+// number of events, or 0.
+static int bench_dispatch_log(const bench_case_t *bench_case, const char *other, char path[BENCH_PATH_MAX]) {
+    if (!bench_temp_path(path)) return 0;
+    int events = (int)(4 * 1024 * 1024 / bench_case->bytes);
+    if (events < 4) events = 4;
+    if (events > 1000) events = 1000;
+
+    FILE *log = rift_recorder_open(path);
+    if (!log) {
+        bench_temp_remove(path);
+        return 0;
+    }
+    for (int i = 0; i < events; ++i) {
+        const char *json = other && i % 4 == 0 ? other : bench_case->json;
+        rift_recorder_write(log, (uint64_t)i, json, bench_case->bytes);
+    }
+    fclose(log);
+    return events;
+}
+
+static void bench_dispatch_case(bench_case_t *bench_case, lua_State *L) {
+    char path[BENCH_PATH_MAX];
+    int events = bench_dispatch_log(bench_case, NULL, path);
+    if (!events) return;
+
+    bench_dispatch_ctx_t ctx = {L, path};
+    bench_case_t replay_case = *bench_case;
+    replay_case.name = "dispatch_replay";
+    replay_case.bytes = bench_case->bytes * (size_t)events;
+    replay_case.ctx = &ctx;
+    bench_run(&replay_case, bench_dispatch);
+    bench_temp_remove(path);
+}
+
+typedef struct {
+    lua_State *L;
+    const char *log_path;
+    bool where;
+    lua_Integer calls;
+    lua_Integer matched;
+} bench_where_ctx_t;
+
+// The same subscription, filtering on space_id in the callback or with where.
+static const char *bench_where_script =
+    "local rift, path, where = ...\n"
+    "local client = assert(rift.replay(path))\n"
+    "local calls, matched = 0, 0\n"
+    "if where then\n"
+    "  client:subscribe({ 'windows_changed' }, function(env)\n"
+    "    calls = calls + 1\n"
+    "    matched = matched + #env.DATA.windows\n"
+    "  end, { where = { space_id = 1 } })\n"
+    "else\n"
+    "  client:subscribe({ 'windows_changed' }, function(env)\n"
+    "    calls = calls + 1\n"
+    "    if env.DATA.space_id == 1 then matched = matched + #env.DATA.windows end\n"
+    "  end)\n"
+    "end\n"
+    "while client:pump(0) do end\n"
+    "client:disconnect()\n"
+    "return calls, matched\n";
+
+static bool bench_where(bench_case_t *bench_case) {
+    bench_where_ctx_t *ctx = (bench_where_ctx_t*)bench_case->ctx;
+    lua_State *L = ctx->L;
+    if (luaL_loadstring(L, bench_where_script) != LUA_OK) return false;
+    luaL_requiref(L, "rift", luaopen_rift, 0);
+    lua_pushstring(L, ctx->log_path);
+    lua_pushboolean(L, ctx->where);
+    if (lua_pcall(L, 3, 2, 0) != LUA_OK) {
+        fprintf(stderr, "bench: %s\n", lua_tostring(L, -1));
+        lua_pop(L, 1);
+        return false;
+    }
+    ctx->calls = lua_tointeger(L, -2);
+    ctx->matched = lua_tointeger(L, -1);
+    lua_pop(L, 2);
+    return true;
+}
+
+// dispatch_replay over a log where one event in four is on space 1, once
+// filtering in the callback and once with {where = {space_id = 1}}. Both
+// count the same windows; `callbacks` is how many calls one replay made.
+static void bench_where_cases(bench_case_t *bench_case, lua_State *L) {
+    const char *space = strstr(bench_case->json, "\"space_id\":3");
+    if (!space) return;
+    char *other = (char*)malloc(bench_case->bytes + 1);
+    if (!other) return;
+    memcpy(other, bench_case->json, bench_case->bytes + 1);
+    other[space - bench_case->json + strlen("\"space_id\":")] = '1';
+
+    char path[BENCH_PATH_MAX];
+    int events = bench_dispatch_log(bench_case, other, path);
+    free(other);
+    if (!events) return;
+
+    for (int where = 0; where <= 1; ++where) {
+        bench_where_ctx_t ctx = {L, path, where, 0, 0};
+        bench_case_t replay_case = *bench_case;
+        replay_case.name = where ? "dispatch_where" : "dispatch_where_lua";
+        replay_case.bytes = bench_case->bytes * (size_t)events;
+        replay_case.ctx = &ctx;
+
+        uint64_t elapsed = 0;
+        uint64_t iterations = bench_measure(&replay_case, bench_where, &elapsed);
+        if (!iterations) continue;
+        char extra[160];
+        snprintf(extra, sizeof(extra), ",\"events\":%d,\"callbacks\":%lld,\"matched_windows\":%lld,\"ns_per_event\":%.1f",
+                 events, (long long)ctx.calls, (long long)ctx.matched,
+                 (double)elapsed / (double)iterations / (double)events);
+        replay_case.extra = extra;
+        bench_report(&replay_case, iterations, elapsed);
+    }
+    bench_temp_remove(path);
+}
+
+static const char *const bench_empty_types[] = {
+    "workspace_changed",
+    "windows_changed",
+    "window_title_changed",
+    "stacks_changed",
+};
+#define BENCH_EMPTY_TYPES (sizeof(bench_empty_types) / sizeof(bench_empty_types[0]))
+#define BENCH_EMPTY_EVENTS 1000
+
+// One empty callback per event type, so every event calls exactly one.
+static const char *bench_empty_script =
+    "local rift, path = ...\n"
+    "local client = assert(rift.replay(path))\n"
+    "for _, event in ipairs({ 'workspace_changed', 'windows_changed', 'window_title_changed', 'stacks_changed' }) do\n"
+    "  client:subscribe({ event }, function(env) end)\n"
+    "end\n"
+    "while client:pump(0) do end\n"
+    "client:disconnect()\n";
+
+static bool bench_empty_dispatch(bench_case_t *bench_case) {
+    bench_dispatch_ctx_t *ctx = (bench_dispatch_ctx_t*)bench_case->ctx;
+    lua_State *L = ctx->L;
+    if (luaL_loadstring(L, bench_empty_script) != LUA_OK) return false;
+    luaL_requiref(L, "rift", luaopen_rift, 0);
+    lua_pushstring(L, ctx->log_path);
+    if (lua_pcall(L, 2, 0, 0) != LUA_OK) {
+        fprintf(stderr, "bench: %s\n", lua_tostring(L, -1));
+        lua_pop(L, 1);
+        return false;
+    }
+    return true;
+}
+
+typedef struct {
+    lua_State *L;
+    int ref;
+    size_t next;
+} bench_lookup_ctx_t;
+
+// The callback lookup as it was before the lists moved to registry refs: the
+// store by string key, the client's list by lightuserdata, then the events
+// set and the callback by name in every entry.
+static bool bench_lookup_string(bench_case_t *bench_case) {
+    bench_lookup_ctx_t *ctx = (bench_lookup_ctx_t*)bench_case->ctx;
+    lua_State *L = ctx->L;
+    const char *type = bench_empty_types[ctx->next++ % BENCH_EMPTY_TYPES];
+
+    lua_pushstring(L, "rift_callbacks");
+    lua_gettable(L, LUA_REGISTRYINDEX);
+    lua_pushlightuserdata(L, ctx);
+    lua_gettable(L, -2);
+    lua_remove(L, -2);
+    lua_Integer count = (lua_Integer)lua_rawlen(L, -1);
+    for (lua_Integer i = 1; i <= count; ++i) {
+        lua_rawgeti(L, -1, i);
+        lua_getfield(L, -1, "events");
+        lua_pushstring(L, "*");
+        lua_gettable(L, -2);
+        bool hit = lua_toboolean(L, -1);
+        lua_pop(L, 1);
+        if (!hit) {
+            lua_pushstring(L, type);
+            lua_gettable(L, -2);
+            hit = lua_toboolean(L, -1);
+            lua_pop(L, 1);
+        }
+        lua_pop(L, 1);
+        if (!hit) {
+            lua_pop(L, 1);
+            continue;
+        }
+        lua_getfield(L, -1, "callback");
+        lua_createtable(L, 0, 3);
+        if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
+            lua_settop(L, 0);
+            return false;
+        }
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+    return true;
+}
+
+// The same lookup through the client's ref and the precompiled type mask.
+static bool bench_lookup_ref(bench_case_t *bench_case) {
+    bench_lookup_ctx_t *ctx = (bench_lookup_ctx_t*)bench_case->ctx;
+    lua_State *L = ctx->L;
+    const char *type = bench_empty_types[ctx->next++ % BENCH_EMPTY_TYPES];
+    lua_Integer event_mask = 0;
+    for (size_t i = 0; i < BENCH_EMPTY_TYPES; ++i) {
+        if (strcmp(type, bench_empty_types[i]) == 0) {
+            event_mask = (lua_Integer)1 << (i + 1);
+            break;
+        }
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ctx->ref);
+    lua_Integer count = (lua_Integer)lua_rawlen(L, -1);
+    for (lua_Integer i = 1; i <= count; ++i) {
+        lua_rawgeti(L, -1, i);
+        lua_rawgeti(L, -1, 3);
+        lua_Integer mask = lua_tointeger(L, -1);
+        lua_pop(L, 1);
+        if (!(mask & event_mask)) {
+            lua_pop(L, 1);
+            continue;
+        }
+        lua_rawgeti(L, -1, 1);
+        lua_createtable(L, 0, 3);
+        if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
+            lua_settop(L, 0);
+            return false;
+        }
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+    return true;
+}
+
+// Per-event dispatch overhead with empty callbacks. dispatch_empty_callback
+// replays small events of four types to one subscription per type.
+// dispatch_lookup_string and dispatch_lookup_ref isolate finding and calling
+// the subscriptions for an event, with the string-keyed registry lookup the
+// module used to do (rebuilt here) and with the registry refs it uses now.
+static void bench_empty_callback_cases(void) {
+    char path[BENCH_PATH_MAX];
+    if (!bench_temp_path(path)) return;
+    FILE *log = rift_recorder_open(path);
+    if (!log) {
+        bench_temp_remove(path);
+        return;
+    }
+    size_t bytes = 0;
+    for (int i = 0; i < BENCH_EMPTY_EVENTS; ++i) {
+        char json[128];
+        int n = snprintf(json, sizeof(json), "{\"type\":\"%s\",\"space_id\":%d,\"window_id\":%d}",
+                         bench_empty_types[(size_t)i % BENCH_EMPTY_TYPES], i % 3, i);
+        rift_recorder_write(log, (uint64_t)i, json, (size_t)n);
+        bytes += (size_t)n;
+    }
+    fclose(log);
+
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    bench_dispatch_ctx_t dispatch_ctx = {L, path};
+    bench_case_t bench_case = {"dispatch_empty_callback", "small_events", NULL, bytes, &dispatch_ctx, NULL};
+    uint64_t elapsed = 0;
+    uint64_t iterations = bench_measure(&bench_case, bench_empty_dispatch, &elapsed);
+    if (iterations) {
+        char extra[96];
+        snprintf(extra, sizeof(extra), ",\"events\":%d,\"ns_per_event\":%.1f",
+                 BENCH_EMPTY_EVENTS, (double)elapsed / (double)iterations / BENCH_EMPTY_EVENTS);
+        bench_case.extra = extra;
+        bench_report(&bench_case, iterations, elapsed);
+    }
+    bench_temp_remove(path);
+
+    // Both layouts of the same four subscriptions, side by side in one state.
+    bench_lookup_ctx_t lookup_ctx = {L, LUA_NOREF, 0};
+    luaL_dostring(L, "return function(env) end");
+    int callback = lua_gettop(L);
+    lua_createtable(L, (int)BENCH_EMPTY_TYPES, 0);
+    lua_createtable(L, (int)BENCH_EMPTY_TYPES, 0);
+    for (size_t i = 0; i < BENCH_EMPTY_TYPES; ++i) {
+        lua_createtable(L, 0, 2);
+        lua_createtable(L, 0, 1);
+        lua_pushboolean(L, 1);
+        lua_setfield(L, -2, bench_empty_types[i]);
+        lua_setfield(L, -2, "events");
+        lua_pushvalue(L, callback);
+        lua_setfield(L, -2, "callback");
+        lua_rawseti(L, -3, (lua_Integer)i + 1);
+
+        lua_createtable(L, 3, 0);
+        lua_pushvalue(L, callback);
+        lua_rawseti(L, -2, 1);
+        lua_pushinteger(L, (lua_Integer)1 << (i + 1));
+        lua_rawseti(L, -2, 3);
+        lua_rawseti(L, -2, (lua_Integer)i + 1);
+    }
+    lookup_ctx.ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    lua_createtable(L, 0, 1);
+    lua_pushlightuserdata(L, &lookup_ctx);
+    lua_pushvalue(L, -3);
+    lua_settable(L, -3);
+    lua_setfield(L, LUA_REGISTRYINDEX, "rift_callbacks");
+    lua_settop(L, 0);
+
+    bench_case_t lookup_case = {"dispatch_lookup_string", "4_subscriptions", NULL, 0, &lookup_ctx, NULL};
+    bench_run(&lookup_case, bench_lookup_string);
+    lookup_case.name = "dispatch_lookup_ref";
+    bench_run(&lookup_case, bench_lookup_ref);
+    lua_close(L);
+}
+
+// dispatch_replay in a fresh state behind the rift allocator, once counting
+// only and once with the free lists, with allocations and GC cycles per event.
+static void bench_alloc_cases(bench_case_t *bench_case) {
+    char path[BENCH_PATH_MAX];
+    int events = bench_dispatch_log(bench_case, NULL, path);
+    if (!events) return;
+
+    for (int pooled = 0; pooled <= 1; ++pooled) {
+        lua_State *L = luaL_newstate();
+        luaL_openlibs(L);
+        rift_alloc_t *alloc = rift_alloc_install(L, pooled);
+        if (!alloc) {
+            lua_close(L);
+            break;
+        }
+        rift_alloc_reset(alloc);
+
+        bench_dispatch_ctx_t ctx = {L, path};
+        bench_case_t replay_case = *bench_case;
+        replay_case.name = pooled ? "dispatch_replay_pooled" : "dispatch_replay_counted";
+        replay_case.bytes = bench_case->bytes * (size_t)events;
+        replay_case.ctx = &ctx;
+
+        uint64_t elapsed = 0;
+        uint64_t iterations = bench_measure(&replay_case, bench_dispatch, &elapsed);
+        if (iterations) {
+            // The counters also cover the warm-up call.
+            double total = (double)(iterations + 1) * (double)events;
+            char extra[256];
+            snprintf(extra, sizeof(extra),
+                     ",\"events\":%d,\"allocs_per_event\":%.1f,\"bytes_per_event\":%.0f,"
+                     "\"gc_cycles_per_event\":%.3f,\"pool_hit_rate\":%.3f",
+                     events, (double)alloc->allocs / total, (double)alloc->allocated_bytes / total,
+                     (double)alloc->gc_cycles / total,
+                     alloc->allocs ? (double)alloc->pool_hits / (double)alloc->allocs : 0.0);
+            replay_case.extra = extra;
+            bench_report(&replay_case, iterations, elapsed);
+        }
+        lua_close(L);
+    }
+    bench_temp_remove(path);
+}
+
+// Only INFO is read, so the copy of the body into Lua is what differs
+// between Lua 5.4 and 5.5.
+static const char *bench_info_script =
+    "local rift, path = ...\n"
+    "local client = assert(rift.replay(path))\n"
+    "local bytes = 0\n"
+    "client:subscribe({ 'windows_changed' }, function(env) bytes = bytes + #env.INFO end)\n"
+    "while client:pump(0) do end\n"
+    "local info = client:stats().info or {}\n"
+    "client:disconnect()\n"
+    "return info.copied_bytes or 0, info.external or 0\n";
+
+typedef struct {
+    lua_State *L;
+    const char *log_path;
+    lua_Integer copied;
+    lua_Integer external;
+} bench_info_ctx_t;
+
+static bool bench_info(bench_case_t *bench_case) {
+    bench_info_ctx_t *ctx = (bench_info_ctx_t*)bench_case->ctx;
+    lua_State *L = ctx->L;
+    if (luaL_loadstring(L, bench_info_script) != LUA_OK) return false;
+    luaL_requiref(L, "rift", luaopen_rift, 0);
+    lua_pushstring(L, ctx->log_path);
+    if (lua_pcall(L, 2, 2, 0) != LUA_OK) {
+        fprintf(stderr, "bench: %s\n", lua_tostring(L, -1));
+        lua_pop(L, 1);
+        return false;
+    }
+    ctx->copied += lua_tointeger(L, -2);
+    ctx->external += lua_tointeger(L, -1);
+    lua_pop(L, 2);
+    return true;
+}
+
+// dispatch_replay reading only env.INFO, behind the counting allocator:
+// bytes copied into INFO strings and Lua heap bytes allocated per event.
+static void bench_info_case(bench_case_t *bench_case) {
+    char path[BENCH_PATH_MAX];
+    int events = bench_dispatch_log(bench_case, NULL, path);
+    if (!events) return;
+
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    rift_alloc_t *alloc = rift_alloc_install(L, false);
+    if (alloc) {
+        rift_alloc_reset(alloc);
+        bench_info_ctx_t ctx = {L, path, 0, 0};
+        bench_case_t replay_case = *bench_case;
+        replay_case.name = "dispatch_info";
+        replay_case.bytes = bench_case->bytes * (size_t)events;
+        replay_case.ctx = &ctx;
+
+        uint64_t elapsed = 0;
+        uint64_t iterations = bench_measure(&replay_case, bench_info, &elapsed);
+        if (iterations) {
+            double total = (double)(iterations + 1) * (double)events;
+            char extra[256];
+            snprintf(extra, sizeof(extra),
+                     ",\"events\":%d,\"copied_bytes_per_event\":%.0f,\"external_per_event\":%.2f,\"bytes_per_event\":%.0f",
+                     events, (double)ctx.copied / total, (double)ctx.external / total,
+                     (double)alloc->allocated_bytes / total);
+            replay_case.extra = extra;
+            bench_report(&replay_case, iterations, elapsed);
+        }
+    }
+    lua_close(L);
+    bench_temp_remove(path);
+}
+
+typedef struct {
+    lua_State *L;
+    const char *log_path;
+    bool dedupe;
+    lua_Integer suppressed;
+    lua_Integer checked;
+} bench_dedupe_ctx_t;
+
+static const char *bench_dedupe_script =
+    "local rift, path, dedupe = ...\n"
+    "local client = assert(rift.replay(path))\n"
+    "client:subscribe({ '*' }, function(env) end, { dedupe = dedupe })\n"
+    "while client:pump(0) do end\n"
+    "local stats = client:stats().dedupe\n"
+    "client:disconnect()\n"
+    "return stats and stats.suppressed or 0, stats and stats.checked or 0\n";
+
+static bool bench_dedupe(bench_case_t *bench_case) {
+    bench_dedupe_ctx_t *ctx = (bench_dedupe_ctx_t*)bench_case->ctx;
+    lua_State *L = ctx->L;
+    if (luaL_loadstring(L, bench_dedupe_script) != LUA_OK) return false;
+    luaL_requiref(L, "rift", luaopen_rift, 0);
+    lua_pushstring(L, ctx->log_path);
+    lua_pushboolean(L, ctx->dedupe);
+    if (lua_pcall(L, 3, 2, 0) != LUA_OK) {
+        fprintf(stderr, "bench: %s\n", lua_tostring(L, -1));
+        lua_pop(L, 1);
+        return false;
+    }
+    ctx->suppressed = lua_tointeger(L, -2);
+    ctx->checked = lua_tointeger(L, -1);
+    lua_pop(L, 2);
+    return true;
+}
+
+// Replays a recorded log to one subscription on every event, without and
+// with {dedupe = true}; repeated bodies then skip parse and dispatch.
+static void bench_dedupe_cases(lua_State *L, const char *path, size_t events, size_t bytes) {
+    for (int dedupe = 0; dedupe <= 1; ++dedupe) {
+        bench_dedupe_ctx_t ctx = {L, path, dedupe, 0, 0};
+        bench_case_t replay_case = {dedupe ? "dispatch_dedupe" : "dispatch_all", "recorded_log", NULL, bytes, &ctx, NULL};
+        uint64_t elapsed = 0;
+        uint64_t iterations = bench_measure(&replay_case, bench_dedupe, &elapsed);
+        if (!iterations) continue;
+        char extra[160];
+        snprintf(extra, sizeof(extra), ",\"events\":%zu,\"ns_per_event\":%.1f,\"suppressed_fraction\":%.3f",
+                 events, (double)elapsed / (double)iterations / (double)events,
+                 ctx.checked ? (double)ctx.suppressed / (double)ctx.checked : 0.0);
+        replay_case.extra = extra;
+        bench_report(&replay_case, iterations, elapsed);
+    }
+}
+
+#define BENCH_DIFF_WINDOWS 300
+#define BENCH_DIFF_EVENTS 200
+
+// A recorded-session stand-in for the diff cases: windows_changed events that
+// each list all BENCH_DIFF_WINDOWS windows, where one to three titles change
+// per event and every 20th event closes one window and opens another.
+static bool bench_diff_log(char path[BENCH_PATH_MAX]) {
+    if (!bench_temp_path(path)) return false;
+    FILE *log = rift_recorder_open(path);
+    if (!log) {
+        bench_temp_remove(path);
+        return false;
+    }
+
+    int ids[BENCH_DIFF_WINDOWS];
+    unsigned titles[BENCH_DIFF_WINDOWS];
+    for (int i = 0; i < BENCH_DIFF_WINDOWS; ++i) {
+        ids[i] = i + 1;
+        titles[i] = 0;
+    }
+    int next_id = BENCH_DIFF_WINDOWS + 1;
+    unsigned seed = 7;
+    char window[512];
+    for (int e = 0; e < BENCH_DIFF_EVENTS; ++e) {
+        for (int n = 1 + (int)((seed = seed * 1103515245u + 12345u) >> 16) % 3; n > 0; --n) {
+            titles[((seed = seed * 1103515245u + 12345u) >> 16) % BENCH_DIFF_WINDOWS]++;
+        }
+        if (e % 20 == 19) {
+            int slot = (int)(((seed = seed * 1103515245u + 12345u) >> 16) % BENCH_DIFF_WINDOWS);
+            ids[slot] = next_id++;
+            titles[slot] = 0;
+        }
+
+        bench_buf_t buf = {0};
+        const char *head = "{\"type\":\"windows_changed\",\"windows\":[";
+        bench_buf_append(&buf, head, strlen(head));
+        for (int i = 0; i < BENCH_DIFF_WINDOWS; ++i) {
+            int n = snprintf(window, sizeof(window),
+                "%s{\"id\":%d,\"title\":\"Window %d \\u2014 rev %u\",\"app\":\"Editor\",\"pid\":%d,"
+                "\"frame\":{\"x\":%d.5,\"y\":%d.25,\"w\":1280,\"h\":800},\"focused\":false,\"floating\":false,"
+                "\"space_id\":%d}",
+                i ? "," : "", ids[i], ids[i], titles[i], 1000 + ids[i], i * 8, i * 4, 1 + i % 4);
+            bench_buf_append(&buf, window, (size_t)n);
+        }
+        bench_buf_append(&buf, "]}", 2);
+        rift_recorder_write(log, (uint64_t)e, buf.data, buf.len);
+        free(buf.data);
+    }
+    fclose(log);
+    return true;
+}
+
+// The same consumer both ways: keep id -> title for every window and count
+// what changed. Without {diff = true} it has to walk the full list itself.
+static const char *bench_diff_script =
+    "local rift, path, diff = ...\n"
+    "local client = assert(rift.replay(path))\n"
+    "local known, touched = {}, 0\n"
+    "client:subscribe({ 'windows_changed' }, function(env)\n"
+    "  local data = env.DATA\n"
+    "  if diff then\n"
+    "    for _, w in ipairs(data.added) do known[w.id] = w.title; touched = touched + 1 end\n"
+    "    for _, w in ipairs(data.changed) do known[w.id] = w.title; touched = touched + 1 end\n"
+    "    for _, id in ipairs(data.removed) do known[id] = nil; touched = touched + 1 end\n"
+    "    return\n"
+    "  end\n"
+    "  local seen = {}\n"
+    "  for _, w in ipairs(data.windows) do\n"
+    "    seen[w.id] = true\n"
+    "    if known[w.id] ~= w.title then known[w.id] = w.title; touched = touched + 1 end\n"
+    "  end\n"
+    "  for id in pairs(known) do\n"
+    "    if not seen[id] then known[id] = nil; touched = touched + 1 end\n"
+    "  end\n"
+    "end, { diff = diff })\n"
+    "while client:pump(0) do end\n"
+    "client:disconnect()\n"
+    "return touched\n";
+
+typedef struct {
+    lua_State *L;
+    const char *log_path;
+    bool diff;
+    lua_Integer touched;
+} bench_diff_ctx_t;
+
+static bool bench_diff(bench_case_t *bench_case) {
+    bench_diff_ctx_t *ctx = (bench_diff_ctx_t*)bench_case->ctx;
+    lua_State *L = ctx->L;
+    if (luaL_loadstring(L, bench_diff_script) != LUA_OK) return false;
+    luaL_requiref(L, "rift", luaopen_rift, 0);
+    lua_pushstring(L, ctx->log_path);
+    lua_pushboolean(L, ctx->diff);
+    if (lua_pcall(L, 3, 1, 0) != LUA_OK) {
+        fprintf(stderr, "bench: %s\n", lua_tostring(L, -1));
+        lua_pop(L, 1);
+        return false;
+    }
+    ctx->touched = lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    return true;
+}
+
+// The 300-window session delivered in full and with {diff = true}, each in a
+// fresh state behind the counting allocator.
+static void bench_diff_cases(void) {
+    char path[BENCH_PATH_MAX];
+    if (!bench_diff_log(path)) return;
+    FILE *log = fopen(path, "rb");
+    size_t bytes = 0;
+    if (log) {
+        fseek(log, 0, SEEK_END);
+        bytes = (size_t)ftell(log);
+        fclose(log);
+    }
+
+    for (int diff = 0; diff <= 1; ++diff) {
+        lua_State *L = luaL_newstate();
+        luaL_openlibs(L);
+        rift_alloc_t *alloc = rift_alloc_install(L, false);
+        if (!alloc) {
+            lua_close(L);
+            break;
+        }
+        rift_alloc_reset(alloc);
+
+        bench_diff_ctx_t ctx = {L, path, diff, 0};
+        bench_case_t replay_case = {diff ? "session_diff" : "session_full", "windows_300", NULL, bytes, &ctx, NULL};
+        uint64_t elapsed = 0;
+        uint64_t iterations = bench_measure(&replay_case, bench_diff, &elapsed);
+        if (iterations) {
+            double total = (double)(iterations + 1) * BENCH_DIFF_EVENTS;
+            char extra[256];
+            snprintf(extra, sizeof(extra),
+                     ",\"events\":%d,\"ns_per_event\":%.1f,\"allocs_per_event\":%.1f,\"bytes_per_event\":%.0f,"
+                     "\"touched_per_event\":%.2f",
+                     BENCH_DIFF_EVENTS, (double)elapsed / (double)iterations / BENCH_DIFF_EVENTS,
+                     (double)alloc->allocs / total, (double)alloc->allocated_bytes / total,
+                     (double)ctx.touched / BENCH_DIFF_EVENTS);
+            replay_case.extra = extra;
+            bench_report(&replay_case, iterations, elapsed);
+        }
+        lua_close(L);
+    }
+    bench_temp_remove(path);
+}
+
+// Each event is handled the way a bar with a few widgets would: two widgets
+// ask for the same workspaces, others for windows and displays.
+static const char *bench_cache_script =
+    "local rift, path, events, cached = ...\n"
+    "local client = assert(rift.connect({ socket = path }))\n"
+    "client:set_cache(cached)\n"
+    "local seen = 0\n"
+    "assert(client:subscribe({ '*' }, function(env)\n"
+    "    seen = seen + 1\n"
+    "    client:send_request('{\"get_workspaces\":{\"space_id\":null}}')\n"
+    "    client:send_request('{\"get_workspaces\":{\"space_id\":null}}')\n"
+    "    client:send_request('{\"get_windows\":{}}')\n"
+    "    client:send_request('{\"get_displays\":{}}')\n"
+    "    if seen < events then client:send_request('{\"bench_next\":{}}', false) end\n"
+    "end))\n"
+    "local function run()\n"
+    "    seen = 0\n"
+    "    client:send_request('{\"bench_next\":{}}', false)\n"
+    "    while seen < events do\n"
+    "        local n, err = client:pump(1000)\n"
+    "        if not n or n == 0 then error(err or 'event stream stalled') end\n"
+    "    end\n"
+    "end\n"
+    "local function stats()\n"
+    "    local cache = client:stats().cache or {}\n"
+    "    return cache.hits or 0, cache.misses or 0, cache.invalidations or 0\n"
+    "end\n"
+    "return run, stats\n";
+
+static bool bench_cache_session(bench_case_t *bench_case) {
+    lua_State *L = (lua_State*)bench_case->ctx;
+    lua_pushvalue(L, 1);
+    if (lua_pcall(L, 0, 0, 0) != LUA_OK) {
+        fprintf(stderr, "bench: %s\n", lua_tostring(L, -1));
+        lua_pop(L, 1);
+        return false;
+    }
+    return true;
+}
+
+// Replays a session of events against the stand-in server with the response
+// cache off and on, reporting get_* round trips per event.
+static void bench_cache_cases(const char *payload, char **events, size_t *lens, size_t count) {
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; ++i) bytes += lens[i];
+    size_t response_len = 0;
+    char *response = bench_synthetic_event(4096, &response_len);
+
+    for (int cached = 0; cached <= 1; ++cached) {
+        bench_server_t server;
+        if (!bench_server_open(&server, events, lens, count, response)) break;
+
+        lua_State *L = luaL_newstate();
+        luaL_openlibs(L);
+        bool ready = luaL_loadstring(L, bench_cache_script) == LUA_OK;
+        if (ready) {
+            luaL_requiref(L, "rift", luaopen_rift, 0);
+            lua_pushstring(L, server.path);
+            lua_pushinteger(L, (lua_Integer)count);
+            lua_pushboolean(L, cached);
+            ready = lua_pcall(L, 4, 2, 0) == LUA_OK;
+        }
+        if (!ready) fprintf(stderr, "bench: %s\n", lua_tostring(L, -1));
+
+        bench_case_t session = {cached ? "session_queries_cached" : "session_queries", payload, NULL, bytes, L, NULL};
+        uint64_t elapsed = 0;
+        uint64_t iterations = ready ? bench_measure(&session, bench_cache_session, &elapsed) : 0;
+        if (iterations) {
+            lua_pushvalue(L, 2);
+            lua_call(L, 0, 3);
+            // The counters also cover the warm-up session.
+            double total = (double)(iterations + 1) * (double)count;
+            char extra[256];
+            snprintf(extra, sizeof(extra),
+                     ",\"events\":%zu,\"requests_per_event\":4,\"round_trips_per_event\":%.2f,"
+                     "\"hits_per_event\":%.2f,\"misses_per_event\":%.2f,\"invalidations_per_event\":%.2f",
+                     count, (double)server.round_trips / total, (double)lua_tointeger(L, -3) / total,
+                     (double)lua_tointeger(L, -2) / total, (double)lua_tointeger(L, -1) / total);
+            session.extra = extra;
+            bench_report(&session, iterations, elapsed);
+        }
+        lua_close(L);
+        bench_server_stop(&server);
+    }
+    free(response);
+}
+
+// A session mix where title changes dominate, as they do in practice.
+static void bench_synthetic_session(void) {
+    static const char *const small[] = {
+        "{\"type\":\"window_title_changed\",\"window_id\":1,\"title\":\"document.txt \\u2014 Editor\"}",
+        "{\"type\":\"workspace_changed\",\"workspace\":{\"id\":3,\"name\":\"main\"}}",
+        "{\"type\":\"stacks_changed\",\"space_id\":3,\"stacks\":[{\"id\":1,\"windows\":[1,2]}]}",
+    };
+    static const int mix[] = {0, 0, -1, 0, 1, 0, -1, 2};
+    size_t count = sizeof(mix) / sizeof(mix[0]);
+    char *events[sizeof(mix) / sizeof(mix[0])];
+    size_t lens[sizeof(mix) / sizeof(mix[0])];
+    for (size_t i = 0; i < count; ++i) {
+        if (mix[i] < 0) {
+            events[i] = bench_synthetic_event(1024, &lens[i]);
+        } else {
+            events[i] = strdup(small[mix[i]]);
+            lens[i] = strlen(small[mix[i]]);
+        }
+    }
+    bench_cache_cases("synthetic_session", events, lens, count);
+    for (size_t i = 0; i < count; ++i) free(events[i]);
+}
+
+#define BENCH_BURST_EVENTS 4000
+#define BENCH_BURST_INTERVAL_NS 50000ull
+#define BENCH_BURST_QUEUE_BYTES (128u * 1024u)
+
+// A consumer that spends `cost_us` on every list event and can't keep up
+// with the burst. With catch-up on, lists replaced later in a batch are
+// dropped before they reach the callback.
+static const char *bench_burst_script =
+    "local rift, path, catchup, cost_us = ...\n"
+    "local client = assert(rift.connect({ socket = path }))\n"
+    "client:set_catchup(catchup)\n"
+    "local delivered, done = 0, false\n"
+    "assert(client:subscribe({ 'windows_changed', 'window_title_changed', 'stacks_changed', 'bench_done' }, function(env)\n"
+    "    if env.EVENT == 'bench_done' then done = true return end\n"
+    "    delivered = delivered + 1\n"
+    "    if env.EVENT == 'window_title_changed' then return end\n"
+    "    local until_ns = rift.now_ns() + cost_us * 1000\n"
+    "    while rift.now_ns() < until_ns do end\n"
+    "end))\n"
+    "client:send_request('{\"bench_burst\":{}}', false)\n"
+    "while not done do\n"
+    "    local n, err = client:pump(1000)\n"
+    "    if not n then error(err) end\n"
+    "end\n"
+    "local backlog = client:stats().backlog or {}\n"
+    "client:disconnect()\n"
+    "return delivered, backlog.high_water or 0, backlog.coalesced or 0, backlog.catchup_entries or 0\n";
+
+// Window lists for four spaces, stacks and title changes.
+static void bench_burst_events(char **events, size_t *lens) {
+    static const int spaces[8] = {1, 0, 2, 0, 3, -1, 4, 0};
+    char window[256];
+    for (int i = 0; i < 8; ++i) {
+        bench_buf_t buf = {0};
+        int n;
+        if (spaces[i] > 0) {
+            n = snprintf(window, sizeof(window), "{\"type\":\"windows_changed\",\"space_id\":%d,\"windows\":[", spaces[i]);
+            bench_buf_append(&buf, window, (size_t)n);
+            for (int w = 0; w < 16; ++w) {
+                n = snprintf(window, sizeof(window),
+                    "%s{\"id\":%d,\"title\":\"Window %d\",\"app\":\"Editor\",\"frame\":{\"x\":%d,\"y\":0,\"w\":800,\"h\":600}}",
+                    w ? "," : "", spaces[i] * 100 + w, w, w * 10);
+                bench_buf_append(&buf, window, (size_t)n);
+            }
+            bench_buf_append(&buf, "]}", 2);
+        } else if (spaces[i] < 0) {
+            n = snprintf(window, sizeof(window), "{\"type\":\"stacks_changed\",\"space_id\":1,\"stacks\":[{\"id\":1,\"windows\":[100,101]}]}");
+            bench_buf_append(&buf, window, (size_t)n);
+        } else {
+            n = snprintf(window, sizeof(window), "{\"type\":\"window_title_changed\",\"window_id\":%d,\"title\":\"document %d.txt\"}", 100 + i, i);
+            bench_buf_append(&buf, window, (size_t)n);
+        }
+        events[i] = buf.data;
+        lens[i] = buf.len;
+    }
+}
+
+// The burst events sent faster than the consumer handles them; reports what
+// the stand-in server had to drop.
+static void bench_burst_cases(void) {
+    char *events[8];
+    size_t lens[8];
+    bench_burst_events(events, lens);
+
+    for (int catchup = 0; catchup <= 1; ++catchup) {
+        bench_server_t server;
+        if (!bench_server_open(&server, events, lens, 8, "{}")) break;
+        server.burst_count = BENCH_BURST_EVENTS;
+        server.burst_interval_ns = BENCH_BURST_INTERVAL_NS;
+        server.queue_limit = BENCH_BURST_QUEUE_BYTES;
+
+        lua_State *L = luaL_newstate();
+        luaL_openlibs(L);
+        uint64_t start = rift_now_ns();
+        bool ok = luaL_loadstring(L, bench_burst_script) == LUA_OK;
+        if (ok) {
+            luaL_requiref(L, "rift", luaopen_rift, 0);
+            lua_pushstring(L, server.path);
+            lua_pushboolean(L, catchup);
+            lua_pushinteger(L, 100);
+            ok = lua_pcall(L, 4, 4, 0) == LUA_OK;
+        }
+        uint64_t elapsed = rift_now_ns() - start;
+        if (!ok) {
+            fprintf(stderr, "bench: %s\n", lua_tostring(L, -1));
+        } else {
+            bench_case_t burst = {catchup ? "burst_catchup" : "burst_plain", "slow_consumer", NULL, 0, NULL, NULL};
+            for (int i = 0; i < 8; ++i) burst.bytes += lens[i];
+            burst.bytes = burst.bytes * BENCH_BURST_EVENTS / 8;
+            char extra[256];
+            snprintf(extra, sizeof(extra),
+                     ",\"events\":%d,\"sent\":%llu,\"dropped\":%llu,\"delivered\":%lld,\"coalesced\":%lld,"
+                     "\"high_water\":%lld,\"catchup_entries\":%lld",
+                     BENCH_BURST_EVENTS, (unsigned long long)server.sent, (unsigned long long)server.dropped,
+                     (long long)lua_tointeger(L, -4), (long long)lua_tointeger(L, -2),
+                     (long long)lua_tointeger(L, -3), (long long)lua_tointeger(L, -1));
+            burst.extra = extra;
+            bench_report(&burst, 1, elapsed);
+        }
+        lua_close(L);
+        bench_server_stop(&server);
+    }
+    for (int i = 0; i < 8; ++i) free(events[i]);
+}
+
+#define BENCH_IDLE_MS 1000
+#define BENCH_WAKE_EVENTS 100
+#define BENCH_WAKE_INTERVAL_NS 10000000ull
+#define BENCH_PUMP_TIMEOUT_MS 10
+
+// `idle` waits out a window with no events; `wake` asks for stamped events
+// and returns percentiles of the time from send to callback. rift.run blocks
+// in epoll/kqueue until something is due; the other mode is the loop a host
+// without rift.run writes, client:pump(timeout) with a short timeout.
+static const char *bench_idle_script =
+    "local rift, path, use_run, pump_ms = ...\n"
+    "local client = assert(rift.connect({ socket = path }))\n"
+    "local latencies, done = {}, false\n"
+    "assert(client:subscribe({ 'windows_changed', 'bench_done' }, function(env)\n"
+    "    if env.EVENT == 'bench_done' then\n"
+    "        done = true\n"
+    "        if use_run then rift.stop() end\n"
+    "        return\n"
+    "    end\n"
+    "    latencies[#latencies + 1] = rift.now_ns() - env.DATA.sent_ns\n"
+    "end))\n"
+    "local function idle(ms)\n"
+    "    if use_run then\n"
+    "        rift.after(ms, rift.stop)\n"
+    "        rift.run()\n"
+    "        return\n"
+    "    end\n"
+    "    local deadline = rift.now_ns() + ms * 1000000\n"
+    "    while rift.now_ns() < deadline do assert(client:pump(pump_ms)) end\n"
+    "end\n"
+    "local function wake()\n"
+    "    client:send_request('{\"bench_burst\":{}}', false)\n"
+    "    if use_run then\n"
+    "        rift.run()\n"
+    "    else\n"
+    "        while not done do assert(client:pump(pump_ms)) end\n"
+    "    end\n"
+    "    client:disconnect()\n"
+    "    table.sort(latencies)\n"
+    "    local n = #latencies\n"
+    "    if n == 0 then return 0, 0, 0, 0 end\n"
+    "    return n, latencies[(n + 1) // 2], latencies[math.ceil(n * 0.99)], latencies[n]\n"
+    "end\n"
+    "return idle, wake\n";
+
+static uint64_t bench_thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Idle CPU time of the Lua thread over BENCH_IDLE_MS with no events, then
+// the latency from send to callback for events BENCH_WAKE_INTERVAL_NS apart,
+// for rift.run and for a client:pump(BENCH_PUMP_TIMEOUT_MS) loop.
+static void bench_idle_cases(void) {
+    char *events[1] = {"{}"};
+    size_t lens[1] = {2};
+    for (int use_run = 1; use_run >= 0; --use_run) {
+        bench_server_t server;
+        if (!bench_server_open(&server, events, lens, 1, "{}")) break;
+        server.burst_count = BENCH_WAKE_EVENTS;
+        server.burst_interval_ns = BENCH_WAKE_INTERVAL_NS;
+        server.queue_limit = SIZE_MAX;
+        server.stamp = true;
+
+        lua_State *L = luaL_newstate();
+        luaL_openlibs(L);
+        bool ok = luaL_loadstring(L, bench_idle_script) == LUA_OK;
+        if (ok) {
+            luaL_requiref(L, "rift", luaopen_rift, 0);
+            lua_pushstring(L, server.path);
+            lua_pushboolean(L, use_run);
+            lua_pushinteger(L, BENCH_PUMP_TIMEOUT_MS);
+            ok = lua_pcall(L, 4, 2, 0) == LUA_OK;
+        }
+        uint64_t idle_cpu = 0;
+        if (ok) {
+            lua_pushvalue(L, -2);
+            lua_pushinteger(L, BENCH_IDLE_MS);
+            uint64_t cpu = bench_thread_cpu_ns();
+            ok = lua_pcall(L, 1, 0, 0) == LUA_OK;
+            idle_cpu = bench_thread_cpu_ns() - cpu;
+        }
+        uint64_t start = rift_now_ns();
+        if (ok) ok = lua_pcall(L, 0, 4, 0) == LUA_OK;
+        uint64_t elapsed = rift_now_ns() - start;
+        if (!ok) {
+            fprintf(stderr, "bench: %s\n", lua_tostring(L, -1));
+        } else {
+            lua_Integer count = lua_tointeger(L, -4);
+            bench_case_t idle_case = {use_run ? "idle_wake_run" : "idle_wake_pump", "stamped_events", NULL, 0, NULL, NULL};
+            char extra[320];
+            snprintf(extra, sizeof(extra),
+                     ",\"idle_ms\":%d,\"idle_cpu_us\":%.1f,\"events\":%lld,"
+                     "\"wake_p50_us\":%.1f,\"wake_p99_us\":%.1f,\"wake_max_us\":%.1f",
+                     BENCH_IDLE_MS, (double)idle_cpu / 1e3, (long long)count,
+                     (double)lua_tointeger(L, -3) / 1e3, (double)lua_tointeger(L, -2) / 1e3,
+                     (double)lua_tointeger(L, -1) / 1e3);
+            idle_case.extra = extra;
+            bench_report(&idle_case, count > 0 ? (uint64_t)count : 1, elapsed);
+        }
+        lua_close(L);
+        bench_server_stop(&server);
+    }
+}
+
+#define BENCH_CONTROL_EVENTS 4000
+#define BENCH_CONTROL_INTERVAL_NS 20000ull
+
+// Toggles a subscription as fast as replies come back while the burst
+// streams on the same connection, so every reply is interleaved with events.
+static const char *bench_control_script =
+    "local rift, path, worker = ...\n"
+    "local client = assert(rift.connect({ socket = path }))\n"
+    "local delivered, done = 0, false\n"
+    "assert(client:subscribe({ 'windows_changed', 'window_title_changed', 'stacks_changed', 'bench_done' }, function(env)\n"
+    "    if env.EVENT == 'bench_done' then done = true else delivered = delivered + 1 end\n"
+    "end))\n"
+    "client:set_worker(worker)\n"
+    "client:send_request('{\"bench_burst\":{}}', false)\n"
+    "local requests = 0\n"
+    "while not done do\n"
+    "    assert(client:subscribe('workspace_changed'))\n"
+    "    assert(client:unsubscribe('workspace_changed'))\n"
+    "    requests = requests + 2\n"
+    "    local n, err = client:pump(0)\n"
+    "    if not n then error(err) end\n"
+    "end\n"
+    "local interleaved = client:stats().interleaved or 0\n"
+    "client:disconnect()\n"
+    "return delivered, requests, interleaved\n";
+
+// Events must all arrive however many subscription changes are in flight.
+static void bench_control_cases(void) {
+    char *events[8];
+    size_t lens[8];
+    bench_burst_events(events, lens);
+
+    for (int worker = 0; worker <= 1; ++worker) {
+        bench_server_t server;
+        if (!bench_server_open(&server, events, lens, 8, "{}")) break;
+        server.burst_count = BENCH_CONTROL_EVENTS;
+        server.burst_interval_ns = BENCH_CONTROL_INTERVAL_NS;
+        server.queue_limit = SIZE_MAX;
+
+        lua_State *L = luaL_newstate();
+        luaL_openlibs(L);
+        uint64_t start = rift_now_ns();
+        bool ok = luaL_loadstring(L, bench_control_script) == LUA_OK;
+        if (ok) {
+            luaL_requiref(L, "rift", luaopen_rift, 0);
+            lua_pushstring(L, server.path);
+            lua_pushboolean(L, worker);
+            ok = lua_pcall(L, 3, 3, 0) == LUA_OK;
+        }
+        uint64_t elapsed = rift_now_ns() - start;
+        if (!ok) {
+            fprintf(stderr, "bench: %s\n", lua_tostring(L, -1));
+        } else {
+            bench_case_t control = {"control_storm", worker ? "worker" : "inline", NULL, 0, NULL, NULL};
+            lua_Integer delivered = lua_tointeger(L, -3);
+            char extra[256];
+            snprintf(extra, sizeof(extra),
+                     ",\"sent\":%llu,\"delivered\":%lld,\"lost\":%lld,\"control_requests\":%lld,\"interleaved\":%lld",
+                     (unsigned long long)server.sent, (long long)delivered, (long long)server.sent - (long long)delivered,
+                     (long long)lua_tointeger(L, -2), (long long)lua_tointeger(L, -1));
+            control.extra = extra;
+            bench_report(&control, 1, elapsed);
+        }
+        lua_close(L);
+        bench_server_stop(&server);
+    }
+    for (int i = 0; i < 8; ++i) free(events[i]);
+}
+
+#define BENCH_TEMPLATE_BATCH 1000
+
+// The same parameterized request built in Lua and sent with send_request,
+// or sent from a compiled template. Awaited requests get "{}" back; the
+// others are fire-and-forget and the server drops them.
+static const char *bench_template_script =
+    "local rift, path, mode, await = ...\n"
+    "local client = assert(rift.connect({ socket = path }))\n"
+    "local app = 'Firefox'\n"
+    "local name = await and 'get_windows' or 'bench_post'\n"
+    "local template = rift.template('{\"' .. name .. '\":{\"space_id\":%d,\"app\":%s}}', await)\n"
+    "local format = '{\"' .. name .. '\":{\"space_id\":%d,\"app\":\"%s\"}}'\n"
+    "local head = '{\"' .. name .. '\":{\"space_id\":'\n"
+    "return function(n)\n"
+    "    if mode == 'template' then\n"
+    "        for i = 1, n do assert(client:send_template(template, i % 4, app)) end\n"
+    "    elseif mode == 'format' then\n"
+    "        for i = 1, n do assert(client:send_request(string.format(format, i % 4, app), await)) end\n"
+    "    else\n"
+    "        for i = 1, n do assert(client:send_request(head .. i % 4 .. ',\"app\":\"' .. app .. '\"}}', await)) end\n"
+    "    end\n"
+    "end\n";
+
+static bool bench_template(bench_case_t *bench_case) {
+    lua_State *L = (lua_State*)bench_case->ctx;
+    lua_pushvalue(L, 1);
+    lua_pushinteger(L, BENCH_TEMPLATE_BATCH);
+    if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
+        fprintf(stderr, "bench: %s\n", lua_tostring(L, -1));
+        lua_pop(L, 1);
+        return false;
+    }
+    return true;
+}
+
+// Requests per second for each way of building a request, awaited and
+// fire-and-forget, each in a fresh state behind the counting allocator.
+static void bench_template_cases(void) {
+    static const char *const modes[] = {"concat", "format", "template"};
+    for (int await = 1; await >= 0; --await) {
+        for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); ++m) {
+            bench_server_t server;
+            if (!bench_server_open(&server, NULL, NULL, 0, "{}")) return;
+
+            lua_State *L = luaL_newstate();
+            luaL_openlibs(L);
+            rift_alloc_t *alloc = rift_alloc_install(L, false);
+            bool ready = alloc && luaL_loadstring(L, bench_template_script) == LUA_OK;
+            if (ready) {
+                luaL_requiref(L, "rift", luaopen_rift, 0);
+                lua_pushstring(L, server.path);
+                lua_pushstring(L, modes[m]);
+                lua_pushboolean(L, await);
+                ready = lua_pcall(L, 4, 1, 0) == LUA_OK;
+            }
+            if (!ready) fprintf(stderr, "bench: %s\n", lua_tostring(L, -1));
+
+            char name[32];
+            snprintf(name, sizeof(name), "%s_%s", await ? "request" : "post", modes[m]);
+            // {"get_windows":{"space_id":1,"app":"Firefox"}}
+            size_t request_bytes = 47;
+            bench_case_t bench_case = {name, await ? "get_windows" : "fire_and_forget", NULL,
+                                       request_bytes * BENCH_TEMPLATE_BATCH, L, NULL};
+            if (ready) rift_alloc_reset(alloc);
+            uint64_t elapsed = 0;
+            uint64_t iterations = ready ? bench_measure(&bench_case, bench_template, &elapsed) : 0;
+            if (iterations) {
+                double requests = (double)(iterations + 1) * BENCH_TEMPLATE_BATCH;
+                char extra[256];
+                snprintf(extra, sizeof(extra),
+                         ",\"requests_per_s\":%.0f,\"allocs_per_request\":%.2f,\"bytes_per_request\":%.1f",
+                         (double)iterations * BENCH_TEMPLATE_BATCH / ((double)elapsed / 1e9),
+                         (double)alloc->allocs / requests, (double)alloc->allocated_bytes / requests);
+                bench_case.extra = extra;
+                bench_report(&bench_case, iterations, elapsed);
+            }
+            lua_close(L);
+            bench_server_stop(&server);
+        }
+    }
+}
+
+static void bench_payload(lua_State *L, const char *payload, const char *json, size_t len, bool full) {
+    bench_case_t bench_case = {NULL, payload, json, len, L, NULL};
+
+    bench_case.name = "decode_json_to_lua";
+    bench_case.ctx = L;
+    bench_run(&bench_case, bench_decode);
+
+    bench_select_case(&bench_case, L);
+    bench_columns_case(&bench_case, L);
+
+    bench_case.name = "decode_tape_to_lua";
+    bench_case.ctx = L;
+    bench_run(&bench_case, bench_tape_materialize);
+
+    bench_case.name = "sniff_type";
+    bench_run(&bench_case, bench_sniff_type);
+
+    if (!full) return;
+    bench_socket_cases(&bench_case, false);
+    bench_socket_cases(&bench_case, true);
+    bench_dispatch_case(&bench_case, L);
+    bench_where_cases(&bench_case, L);
+    bench_info_case(&bench_case);
+    // Setup dominates the per-event counts when a log holds only a few events.
+    if (len <= 64 * 1024) bench_alloc_cases(&bench_case);
+}
+
+static void bench_recorded(lua_State *L, const char *path) {
+    const char *err = NULL;
+    rift_replay_t *replay = rift_replay_open(path, false, &err);
+    if (!replay) {
+        fprintf(stderr, "bench: %s\n", err ? err : "failed to open event log");
+        return;
+    }
+
+    char **events = NULL;
+    size_t *lens = NULL;
+    size_t count = 0;
+    while (1) {
+        char *json = NULL;
+        size_t len = 0;
+        if (rift_replay_next(replay, 0, &json, &len) != RIFT_REPLAY_RECORD) break;
+        char name[64];
+        snprintf(name, sizeof(name), "recorded#%zu", count);
+        bench_payload(L, name, json, len, false);
+
+        char **grown_events = (char**)realloc(events, (count + 1) * sizeof(char*));
+        if (grown_events) events = grown_events;
+        size_t *grown_lens = (size_t*)realloc(lens, (count + 1) * sizeof(size_t));
+        if (grown_lens) lens = grown_lens;
+        if (!grown_events || !grown_lens) {
+            free(json);
+            break;
+        }
+        events[count] = json;
+        lens[count++] = len;
+    }
+    rift_replay_close(replay);
+
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; ++i) bytes += lens[i];
+    if (count) bench_dedupe_cases(L, path, count, bytes);
+    if (count) bench_cache_cases("recorded_session", events, lens, count);
+    for (size_t i = 0; i < count; ++i) free(events[i]);
+    free(events);
+    free(lens);
+}
+
+int main(int argc, char **argv) {
+    const char *budget = getenv("BENCH_TIME_MS");
+    if (budget && atoi(budget) > 0) bench_budget_ns = (uint64_t)atoi(budget) * 1000000ull;
+
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+
+    printf("{\n  \"lua\": \"%s\",\n  \"budget_ms\": %llu,\n  \"results\": [",
+           LUA_RELEASE, (unsigned long long)(bench_budget_ns / 1000000ull));
+
+    for (size_t i = 0; i < sizeof(bench_sizes) / sizeof(bench_sizes[0]); ++i) {
+        size_t len = 0;
+        char *json = bench_synthetic_event(bench_sizes[i], &len);
+        bench_payload(L, "synthetic", json, len, true);
+        free(json);
+    }
+    for (size_t i = 1; i < 3; ++i) {
+        size_t len = 0;
+        char *json = bench_numeric_event(bench_sizes[i], &len);
+        bench_payload(L, "numeric", json, len, false);
+        free(json);
+    }
+    bench_title_cases(L);
+    bench_empty_callback_cases();
+
+    bench_synthetic_session();
+    bench_diff_cases();
+    bench_burst_cases();
+    bench_idle_cases();
+    bench_control_cases();
+    bench_template_cases();
+    if (argc > 1) bench_recorded(L, argv[1]);
+
+    printf("\n  ]\n}\n");
+    lua_close(L);
+    return 0;
+}
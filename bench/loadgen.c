@@ -0,0 +1,514 @@
+// Stand-in Rift server for load tests over the socket transport.
+//
+//   bin/loadgen [-r rate] [-n count] [-w windows] [-s bytes] [-l ms] [-d seconds] socket-path
+//
+//   -r  events per second per subscribed connection (default 1000)
+//   -n  stop each connection's stream after this many events (default: no limit)
+//   -w  windows per windows_changed event (default 8)
+//   -s  approximate size of get_* responses in bytes (default 4096)
+//   -l  delay before answering each request, in ms (default 0)
+//   -d  exit after this many seconds (default: run until SIGINT/SIGTERM)
+//
+// Speaks the same framing and JSON requests as the socket transport. Every
+// event carries `seq` (per connection, starting at 1) and `sent_ns` (the
+// sender's rift_now_ns clock, which rift.now_ns() reads on the same host), so
+// clients can measure loss, reordering and end-to-end latency. The
+// `{"get_loadgen_stats":{}}` request returns per-connection and total counters,
+// and on exit the same report is printed as JSON.
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "../src/clock.h"
+#include "../src/socket.h"
+#include "../src/cJSON.h"
+
+#define LOADGEN_EVENT_TYPES 4
+
+static const char *const loadgen_event_names[LOADGEN_EVENT_TYPES] = {
+    "windows_changed",
+    "window_title_changed",
+    "stacks_changed",
+    "workspace_changed",
+};
+
+typedef struct {
+    double rate;
+    uint64_t count;
+    int windows;
+    size_t response_bytes;
+    int latency_ms;
+    int duration_s;
+} loadgen_options_t;
+
+typedef struct loadgen_conn {
+    struct loadgen_conn *next;
+    int id;
+    int fd;
+    pthread_t reader;
+    pthread_t emitter;
+    bool emitter_started;
+    pthread_mutex_t write_lock;
+    pthread_mutex_t state_lock;
+    pthread_cond_t state_cond;
+    bool closed;
+    bool subscribed[LOADGEN_EVENT_TYPES];
+    uint64_t next_seq;
+    uint64_t events_sent[LOADGEN_EVENT_TYPES];
+    uint64_t event_bytes;
+    uint64_t requests;
+    uint64_t response_bytes;
+    uint64_t blocked_ns;
+    uint64_t first_event_ns;
+    uint64_t last_event_ns;
+} loadgen_conn_t;
+
+static loadgen_options_t loadgen_options = {1000.0, 0, 8, 4096, 0, 0};
+static loadgen_conn_t *loadgen_conns = NULL;
+static pthread_mutex_t loadgen_conns_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile sig_atomic_t loadgen_stopping = 0;
+
+static void loadgen_on_signal(int sig) {
+    (void)sig;
+    loadgen_stopping = 1;
+}
+
+static bool loadgen_any_subscribed(loadgen_conn_t *conn) {
+    for (int i = 0; i < LOADGEN_EVENT_TYPES; ++i) {
+        if (conn->subscribed[i]) return true;
+    }
+    return false;
+}
+
+static bool loadgen_send(loadgen_conn_t *conn, uint32_t id, const char *json, uint64_t *blocked_ns) {
+    uint64_t start = rift_now_ns();
+    pthread_mutex_lock(&conn->write_lock);
+    bool ok = rift_socket_send_frame(conn->fd, id, json, strlen(json));
+    pthread_mutex_unlock(&conn->write_lock);
+    if (blocked_ns) *blocked_ns += rift_now_ns() - start;
+    return ok;
+}
+
+static cJSON* loadgen_window(int id, int space_id) {
+    char title[64];
+    snprintf(title, sizeof(title), "Window %d - document.txt", id);
+
+    cJSON *window = cJSON_CreateObject();
+    cJSON_AddNumberToObject(window, "id", id);
+    cJSON_AddStringToObject(window, "title", title);
+    cJSON_AddStringToObject(window, "app", "Editor");
+    cJSON_AddNumberToObject(window, "space_id", space_id);
+    cJSON_AddBoolToObject(window, "focused", id == 1);
+    cJSON *frame = cJSON_AddObjectToObject(window, "frame");
+    cJSON_AddNumberToObject(frame, "x", id * 16);
+    cJSON_AddNumberToObject(frame, "y", id * 8);
+    cJSON_AddNumberToObject(frame, "w", 1280);
+    cJSON_AddNumberToObject(frame, "h", 800);
+    return window;
+}
+
+static char* loadgen_event_json(int type, uint64_t seq) {
+    const loadgen_options_t *opt = &loadgen_options;
+    int space_id = (int)(seq % 4) + 1;
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "type", loadgen_event_names[type]);
+    cJSON_AddNumberToObject(root, "seq", (double)seq);
+    cJSON_AddNumberToObject(root, "sent_ns", (double)rift_now_ns());
+    cJSON_AddNumberToObject(root, "space_id", space_id);
+
+    switch (type) {
+        case 0: {
+            cJSON *windows = cJSON_AddArrayToObject(root, "windows");
+            for (int i = 1; i <= opt->windows; ++i) cJSON_AddItemToArray(windows, loadgen_window(i, space_id));
+            break;
+        }
+        case 1: {
+            char title[64];
+            snprintf(title, sizeof(title), "Window %d - edit %llu", (int)(seq % (uint64_t)opt->windows) + 1,
+                     (unsigned long long)seq);
+            cJSON_AddNumberToObject(root, "window_id", (double)(seq % (uint64_t)opt->windows) + 1);
+            cJSON_AddStringToObject(root, "title", title);
+            break;
+        }
+        case 2: {
+            cJSON *stacks = cJSON_AddArrayToObject(root, "stacks");
+            cJSON *stack = cJSON_CreateObject();
+            cJSON_AddNumberToObject(stack, "id", space_id);
+            cJSON *ids = cJSON_AddArrayToObject(stack, "window_ids");
+            for (int i = 1; i <= opt->windows; ++i) cJSON_AddItemToArray(ids, cJSON_CreateNumber(i));
+            cJSON_AddItemToArray(stacks, stack);
+            break;
+        }
+        default: {
+            cJSON *workspace = cJSON_AddObjectToObject(root, "workspace");
+            cJSON_AddNumberToObject(workspace, "id", space_id);
+            cJSON_AddStringToObject(workspace, "name", "main");
+            break;
+        }
+    }
+
+    char *json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return json;
+}
+
+static void* loadgen_emitter_main(void *arg) {
+    loadgen_conn_t *conn = (loadgen_conn_t*)arg;
+    const loadgen_options_t *opt = &loadgen_options;
+    uint64_t interval_ns = (uint64_t)(1e9 / opt->rate);
+    uint64_t start = rift_now_ns();
+    uint64_t sent = 0;
+    int next_type = 0;
+
+    while (!loadgen_stopping) {
+        if (opt->count && sent >= opt->count) break;
+
+        // Paced against the start time, so a slow reader shows up as a burst
+        // of catch-up sends instead of a lower rate.
+        uint64_t due = start + sent * interval_ns;
+        uint64_t now = rift_now_ns();
+        if (due > now) rift_sleep_ns(due - now);
+
+        pthread_mutex_lock(&conn->state_lock);
+        bool closed = conn->closed;
+        int type = -1;
+        for (int i = 0; i < LOADGEN_EVENT_TYPES && type < 0; ++i) {
+            int candidate = (next_type + i) % LOADGEN_EVENT_TYPES;
+            if (conn->subscribed[candidate]) type = candidate;
+        }
+        uint64_t seq = type >= 0 ? ++conn->next_seq : 0;
+        pthread_mutex_unlock(&conn->state_lock);
+        if (closed) break;
+        if (type < 0) {
+            // Everything was unsubscribed; wait for the next subscribe.
+            pthread_mutex_lock(&conn->state_lock);
+            while (!conn->closed && !loadgen_stopping && !loadgen_any_subscribed(conn)) {
+                pthread_cond_wait(&conn->state_cond, &conn->state_lock);
+            }
+            pthread_mutex_unlock(&conn->state_lock);
+            start = rift_now_ns() - sent * interval_ns;
+            continue;
+        }
+        next_type = (type + 1) % LOADGEN_EVENT_TYPES;
+
+        char *json = loadgen_event_json(type, seq);
+        if (!json) break;
+        uint64_t blocked = 0;
+        bool ok = loadgen_send(conn, 0, json, &blocked);
+        size_t len = strlen(json);
+        cJSON_free(json);
+        if (!ok) break;
+
+        pthread_mutex_lock(&conn->state_lock);
+        conn->events_sent[type]++;
+        conn->event_bytes += len;
+        conn->blocked_ns += blocked;
+        if (!conn->first_event_ns) conn->first_event_ns = rift_now_ns();
+        conn->last_event_ns = rift_now_ns();
+        pthread_mutex_unlock(&conn->state_lock);
+        sent++;
+    }
+    return NULL;
+}
+
+// Caller holds state_lock.
+static cJSON* loadgen_conn_stats(loadgen_conn_t *conn) {
+    cJSON *stats = cJSON_CreateObject();
+    uint64_t total = 0;
+    cJSON *by_type = cJSON_AddObjectToObject(stats, "events_by_type");
+    for (int i = 0; i < LOADGEN_EVENT_TYPES; ++i) {
+        cJSON_AddNumberToObject(by_type, loadgen_event_names[i], (double)conn->events_sent[i]);
+        total += conn->events_sent[i];
+    }
+    cJSON_AddNumberToObject(stats, "connection", conn->id);
+    cJSON_AddNumberToObject(stats, "events_sent", (double)total);
+    cJSON_AddNumberToObject(stats, "last_seq", (double)conn->next_seq);
+    cJSON_AddNumberToObject(stats, "event_bytes", (double)conn->event_bytes);
+    cJSON_AddNumberToObject(stats, "requests", (double)conn->requests);
+    cJSON_AddNumberToObject(stats, "response_bytes", (double)conn->response_bytes);
+    cJSON_AddNumberToObject(stats, "send_blocked_ns", (double)conn->blocked_ns);
+    uint64_t span = conn->last_event_ns > conn->first_event_ns ? conn->last_event_ns - conn->first_event_ns : 0;
+    cJSON_AddNumberToObject(stats, "events_per_second", span ? (double)(total - 1) * 1e9 / (double)span : 0);
+    return stats;
+}
+
+// Events go out on the client's subscription connection, not the one asking,
+// so the stats request reports every connection plus the totals.
+static cJSON* loadgen_all_stats(int requester) {
+    cJSON *stats = cJSON_CreateObject();
+    cJSON_AddNumberToObject(stats, "requester", requester);
+    cJSON *list = cJSON_AddArrayToObject(stats, "connections");
+    double events = 0;
+    double bytes = 0;
+
+    pthread_mutex_lock(&loadgen_conns_lock);
+    for (loadgen_conn_t *conn = loadgen_conns; conn; conn = conn->next) {
+        pthread_mutex_lock(&conn->state_lock);
+        cJSON *item = loadgen_conn_stats(conn);
+        pthread_mutex_unlock(&conn->state_lock);
+        events += cJSON_GetObjectItemCaseSensitive(item, "events_sent")->valuedouble;
+        bytes += cJSON_GetObjectItemCaseSensitive(item, "event_bytes")->valuedouble;
+        cJSON_AddItemToArray(list, item);
+    }
+    pthread_mutex_unlock(&loadgen_conns_lock);
+
+    cJSON_AddNumberToObject(stats, "events_sent", events);
+    cJSON_AddNumberToObject(stats, "event_bytes", bytes);
+    return stats;
+}
+
+static int loadgen_event_index(const char *name) {
+    for (int i = 0; i < LOADGEN_EVENT_TYPES; ++i) {
+        if (strcmp(name, loadgen_event_names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+static char* loadgen_handle_subscription(loadgen_conn_t *conn, const cJSON *body, bool subscribe) {
+    const cJSON *event = cJSON_GetObjectItemCaseSensitive(body, "event");
+    if (!cJSON_IsString(event)) return strdup("{\"error\":\"missing event\"}");
+
+    bool all = strcmp(event->valuestring, "*") == 0;
+    int index = all ? -1 : loadgen_event_index(event->valuestring);
+    if (!all && index < 0) return strdup("{\"error\":\"unknown event\"}");
+
+    pthread_mutex_lock(&conn->state_lock);
+    for (int i = 0; i < LOADGEN_EVENT_TYPES; ++i) {
+        if (all || i == index) conn->subscribed[i] = subscribe;
+    }
+    bool start_emitter = subscribe && !conn->emitter_started;
+    if (start_emitter) conn->emitter_started = true;
+    pthread_cond_broadcast(&conn->state_cond);
+    pthread_mutex_unlock(&conn->state_lock);
+
+    if (start_emitter && pthread_create(&conn->emitter, NULL, loadgen_emitter_main, conn) != 0) {
+        pthread_mutex_lock(&conn->state_lock);
+        conn->emitter_started = false;
+        pthread_mutex_unlock(&conn->state_lock);
+        return strdup("{\"error\":\"failed to start event stream\"}");
+    }
+    return strdup("{\"ok\":true}");
+}
+
+// `get_*` queries answer with a list of windows padded to the configured size.
+static char* loadgen_handle_query(const char *name) {
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "query", name);
+    cJSON *data = cJSON_AddArrayToObject(root, "data");
+    cJSON *sample = loadgen_window(1, 1);
+    char *sample_json = cJSON_PrintUnformatted(sample);
+    size_t per_window = sample_json ? strlen(sample_json) + 1 : 128;
+    cJSON_free(sample_json);
+    cJSON_Delete(sample);
+    int count = (int)(loadgen_options.response_bytes / per_window);
+    if (count < 1) count = 1;
+    for (int i = 1; i <= count; ++i) cJSON_AddItemToArray(data, loadgen_window(i, (i % 4) + 1));
+    char *json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return json;
+}
+
+static char* loadgen_handle_request(loadgen_conn_t *conn, const char *payload) {
+    cJSON *request = cJSON_Parse(payload);
+    const cJSON *body = request ? request->child : NULL;
+    char *reply = NULL;
+
+    if (!body || !body->string) {
+        reply = strdup("{\"error\":\"malformed request\"}");
+    } else if (strcmp(body->string, "subscribe") == 0) {
+        reply = loadgen_handle_subscription(conn, body, true);
+    } else if (strcmp(body->string, "unsubscribe") == 0) {
+        reply = loadgen_handle_subscription(conn, body, false);
+    } else if (strcmp(body->string, "get_loadgen_stats") == 0) {
+        cJSON *stats = loadgen_all_stats(conn->id);
+        reply = cJSON_PrintUnformatted(stats);
+        cJSON_Delete(stats);
+    } else if (strncmp(body->string, "get_", 4) == 0) {
+        reply = loadgen_handle_query(body->string);
+    } else {
+        reply = strdup("{\"error\":\"unknown request\"}");
+    }
+
+    cJSON_Delete(request);
+    return reply;
+}
+
+static void* loadgen_reader_main(void *arg) {
+    loadgen_conn_t *conn = (loadgen_conn_t*)arg;
+
+    while (!loadgen_stopping) {
+        uint32_t id = 0;
+        rift_socket_status_t status;
+        char *payload = rift_socket_recv_frame(conn->fd, 200, &id, NULL, &status);
+        if (!payload) {
+            if (status == RIFT_SOCKET_TIMEOUT) continue;
+            break;
+        }
+
+        char *reply = loadgen_handle_request(conn, payload);
+        free(payload);
+        if (loadgen_options.latency_ms > 0) rift_sleep_ns((uint64_t)loadgen_options.latency_ms * 1000000ull);
+
+        pthread_mutex_lock(&conn->state_lock);
+        conn->requests++;
+        if (reply && id != 0) conn->response_bytes += strlen(reply);
+        pthread_mutex_unlock(&conn->state_lock);
+
+        bool ok = !reply || id == 0 || loadgen_send(conn, id, reply, NULL);
+        free(reply);
+        if (!ok) break;
+    }
+
+    pthread_mutex_lock(&conn->state_lock);
+    conn->closed = true;
+    pthread_cond_broadcast(&conn->state_cond);
+    pthread_mutex_unlock(&conn->state_lock);
+    // Unblocks an emitter stuck in send() on a client that stopped reading.
+    shutdown(conn->fd, SHUT_RDWR);
+    return NULL;
+}
+
+static int loadgen_listen(const char *path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "loadgen: socket path too long\n");
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+        fprintf(stderr, "loadgen: failed to listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void loadgen_accept(int listen_fd, int id) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) return;
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+
+    loadgen_conn_t *conn = (loadgen_conn_t*)calloc(1, sizeof(loadgen_conn_t));
+    if (!conn) {
+        close(fd);
+        return;
+    }
+    conn->id = id;
+    conn->fd = fd;
+    pthread_mutex_init(&conn->write_lock, NULL);
+    pthread_mutex_init(&conn->state_lock, NULL);
+    pthread_cond_init(&conn->state_cond, NULL);
+    if (pthread_create(&conn->reader, NULL, loadgen_reader_main, conn) != 0) {
+        close(fd);
+        free(conn);
+        return;
+    }
+
+    pthread_mutex_lock(&loadgen_conns_lock);
+    conn->next = loadgen_conns;
+    loadgen_conns = conn;
+    pthread_mutex_unlock(&loadgen_conns_lock);
+}
+
+static void loadgen_report(uint64_t elapsed_ns) {
+    cJSON *report = loadgen_all_stats(0);
+    cJSON_AddNumberToObject(report, "elapsed_ns", (double)elapsed_ns);
+    cJSON_AddNumberToObject(report, "rate", loadgen_options.rate);
+
+    char *json = cJSON_Print(report);
+    printf("%s\n", json);
+    cJSON_free(json);
+    cJSON_Delete(report);
+}
+
+static void loadgen_usage(void) {
+    fprintf(stderr, "usage: loadgen [-r rate] [-n count] [-w windows] [-s bytes] [-l ms] [-d seconds] socket-path\n");
+}
+
+int main(int argc, char **argv) {
+    loadgen_options_t *opt = &loadgen_options;
+    const char *path = NULL;
+    for (int i = 1; i < argc; ++i) {
+        const char *flag = argv[i];
+        if (flag[0] == '-' && flag[1] && !flag[2] && i + 1 < argc) {
+            const char *value = argv[++i];
+            switch (flag[1]) {
+                case 'r': opt->rate = atof(value); break;
+                case 'n': opt->count = (uint64_t)strtoull(value, NULL, 10); break;
+                case 'w': opt->windows = atoi(value); break;
+                case 's': opt->response_bytes = (size_t)strtoull(value, NULL, 10); break;
+                case 'l': opt->latency_ms = atoi(value); break;
+                case 'd': opt->duration_s = atoi(value); break;
+                default:
+                    loadgen_usage();
+                    return 2;
+            }
+        } else if (!path && flag[0] != '-') {
+            path = flag;
+        } else {
+            loadgen_usage();
+            return 2;
+        }
+    }
+    if (!path || opt->rate <= 0 || opt->windows < 1) {
+        loadgen_usage();
+        return 2;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, loadgen_on_signal);
+    signal(SIGTERM, loadgen_on_signal);
+
+    int listen_fd = loadgen_listen(path);
+    if (listen_fd < 0) return 1;
+    fprintf(stderr, "loadgen: listening on %s (%.0f events/s per subscriber)\n", path, opt->rate);
+
+    uint64_t start = rift_now_ns();
+    uint64_t deadline = opt->duration_s > 0 ? start + (uint64_t)opt->duration_s * 1000000000ull : 0;
+    int next_id = 1;
+    while (!loadgen_stopping) {
+        if (deadline && rift_now_ns() >= deadline) break;
+        if (rift_socket_wait_readable(listen_fd, 100) == RIFT_SOCKET_FRAME) loadgen_accept(listen_fd, next_id++);
+    }
+    loadgen_stopping = 1;
+    uint64_t elapsed = rift_now_ns() - start;
+
+    close(listen_fd);
+    unlink(path);
+    for (loadgen_conn_t *conn = loadgen_conns; conn; conn = conn->next) {
+        shutdown(conn->fd, SHUT_RDWR);
+        pthread_mutex_lock(&conn->state_lock);
+        pthread_cond_broadcast(&conn->state_cond);
+        bool emitter = conn->emitter_started;
+        pthread_mutex_unlock(&conn->state_lock);
+        pthread_join(conn->reader, NULL);
+        if (emitter) pthread_join(conn->emitter, NULL);
+    }
+
+    loadgen_report(elapsed);
+
+    while (loadgen_conns) {
+        loadgen_conn_t *next = loadgen_conns->next;
+        close(loadgen_conns->fd);
+        pthread_mutex_destroy(&loadgen_conns->write_lock);
+        pthread_mutex_destroy(&loadgen_conns->state_lock);
+        pthread_cond_destroy(&loadgen_conns->state_cond);
+        free(loadgen_conns);
+        loadgen_conns = next;
+    }
+    return 0;
+}
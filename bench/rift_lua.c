@@ -0,0 +1,6 @@
+// The vendored `lua` interpreter with the rift allocator installed in its
+// state (`make rift-lua`). rift.alloc_stats() reports its counters;
+// RIFT_ALLOC_POOL=0 keeps the counters but turns the free lists off.
+#include "../src/alloc.h"
+#define luaL_newstate rift_alloc_newstate
+#include "lua.c"
@@ -0,0 +1,264 @@
+#pragma once
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/clock.h"
+#include "../src/socket.h"
+
+// Scratch paths and the stand-in Rift server shared by bench/bench.c and
+// test/test.c.
+
+#define BENCH_PATH_MAX 64
+
+// A fresh path for a log or a socket: a file name in a private directory
+// from mkdtemp, so nobody else can take the name before it is used.
+// bench_temp_remove deletes both.
+static bool bench_temp_path(char path[BENCH_PATH_MAX]) {
+    char dir[] = "/tmp/rift-bench-XXXXXX";
+    if (!mkdtemp(dir)) return false;
+    snprintf(path, BENCH_PATH_MAX, "%s/file", dir);
+    return true;
+}
+
+static void bench_temp_remove(char path[BENCH_PATH_MAX]) {
+    remove(path);
+    char *slash = strrchr(path, '/');
+    if (!slash) return;
+    *slash = '\0';
+    rmdir(path);
+    *slash = '/';
+}
+
+// Stand-in server. It answers every request and sends the next event of the
+// session only when asked with a fire-and-forget bench_next, so the client
+// handles one event at a time and no cache hit is bypassed. get_* round trips
+// are counted. Tests script it further with fire-and-forget requests:
+//   {"bench_emit":EVENT}      sends EVENT on the event stream
+//   {"bench_respond":JSON}    answers get_* requests with JSON from now on
+//   {"bench_hangup":true}     shuts the event stream down, so the client sees EOF
+typedef struct {
+    char **events;
+    size_t *lens;
+    size_t count;
+    size_t next;
+    const char *response;
+    // The last bench_respond body, which `response` then points at.
+    char *owned_response;
+    char path[BENCH_PATH_MAX];
+    int listen_fd;
+    int event_fd;
+    int fds[8];
+    pthread_t threads[8];
+    int conn_count;
+    uint64_t round_trips;
+    // bench_burst: `burst_count` events `burst_interval_ns` apart, dropped
+    // instead of sent while the client has `queue_limit` bytes unread.
+    size_t burst_count;
+    uint64_t burst_interval_ns;
+    size_t queue_limit;
+    // Send small events stamped with their send time instead of `events`.
+    bool stamp;
+    uint64_t sent;
+    uint64_t dropped;
+    volatile bool stopping;
+    pthread_mutex_t lock;
+    pthread_t acceptor;
+} bench_server_t;
+
+typedef struct {
+    bench_server_t *server;
+    int fd;
+} bench_server_conn_t;
+
+static bool bench_server_send(bench_server_t *server, int fd, uint32_t id, const char *json, size_t len) {
+    pthread_mutex_lock(&server->lock);
+    bool ok = rift_socket_send_frame(fd, id, json, len);
+    pthread_mutex_unlock(&server->lock);
+    return ok;
+}
+
+// Bytes the peer hasn't read yet: the stand-in for a Mach port's message
+// count. 0 where the platform can't tell, so nothing is dropped there.
+static size_t bench_unread_bytes(int fd) {
+    int bytes = 0;
+#if defined(SO_NWRITE)
+    socklen_t len = sizeof(bytes);
+    if (getsockopt(fd, SOL_SOCKET, SO_NWRITE, &bytes, &len) != 0) bytes = 0;
+#elif defined(TIOCOUTQ)
+    if (ioctl(fd, TIOCOUTQ, &bytes) != 0) bytes = 0;
+#endif
+    return bytes > 0 ? (size_t)bytes : 0;
+}
+
+// Sends the events on a fixed schedule whether or not the client keeps up,
+// the way Rift does with a zero send timeout, then a bench_done event.
+static bool bench_server_burst(bench_server_t *server) {
+    pthread_mutex_lock(&server->lock);
+    int event_fd = server->event_fd;
+    pthread_mutex_unlock(&server->lock);
+    if (event_fd < 0) return false;
+
+    uint64_t start = rift_now_ns();
+    for (size_t i = 0; i < server->burst_count; ++i) {
+        uint64_t due = start + (uint64_t)i * server->burst_interval_ns;
+        uint64_t now = rift_now_ns();
+        if (due > now) rift_sleep_ns(due - now);
+        size_t index = i % server->count;
+        const char *json = server->events[index];
+        size_t len = server->lens[index];
+        char stamped[96];
+        if (server->stamp) {
+            int n = snprintf(stamped, sizeof(stamped), "{\"type\":\"windows_changed\",\"sent_ns\":%llu}",
+                             (unsigned long long)rift_now_ns());
+            json = stamped;
+            len = (size_t)n;
+        }
+        if (bench_unread_bytes(event_fd) + len > server->queue_limit) {
+            server->dropped++;
+            continue;
+        }
+        if (!bench_server_send(server, event_fd, 0, json, len)) return false;
+        server->sent++;
+    }
+    static const char done[] = "{\"type\":\"bench_done\"}";
+    return bench_server_send(server, event_fd, 0, done, sizeof(done) - 1);
+}
+
+static void* bench_server_conn_main(void *arg) {
+    bench_server_conn_t conn = *(bench_server_conn_t*)arg;
+    bench_server_t *server = conn.server;
+    free(arg);
+    while (1) {
+        uint32_t id = 0;
+        size_t len = 0;
+        rift_socket_status_t status;
+        char *frame = rift_socket_recv_frame(conn.fd, -1, &id, &len, &status);
+        if (!frame) break;
+
+        bool ok = true;
+        if (strncmp(frame, "{\"bench_next\"", 13) == 0) {
+            pthread_mutex_lock(&server->lock);
+            size_t index = server->next++ % server->count;
+            int event_fd = server->event_fd;
+            pthread_mutex_unlock(&server->lock);
+            ok = event_fd < 0 || bench_server_send(server, event_fd, 0, server->events[index], server->lens[index]);
+        } else if (strncmp(frame, "{\"bench_burst\"", 14) == 0) {
+            ok = bench_server_burst(server);
+        } else if (len > 15 && strncmp(frame, "{\"bench_emit\":", 14) == 0) {
+            pthread_mutex_lock(&server->lock);
+            int event_fd = server->event_fd;
+            pthread_mutex_unlock(&server->lock);
+            ok = event_fd < 0 || bench_server_send(server, event_fd, 0, frame + 14, len - 15);
+        } else if (strncmp(frame, "{\"bench_hangup\"", 15) == 0) {
+            pthread_mutex_lock(&server->lock);
+            if (server->event_fd >= 0) shutdown(server->event_fd, SHUT_RDWR);
+            server->event_fd = -1;
+            pthread_mutex_unlock(&server->lock);
+        } else if (len > 18 && strncmp(frame, "{\"bench_respond\":", 17) == 0) {
+            char *response = (char*)malloc(len - 17);
+            if (response) {
+                memcpy(response, frame + 17, len - 18);
+                response[len - 18] = '\0';
+                pthread_mutex_lock(&server->lock);
+                free(server->owned_response);
+                server->owned_response = response;
+                server->response = response;
+                pthread_mutex_unlock(&server->lock);
+            }
+        } else if (id != 0 && strncmp(frame, "{\"get_", 6) == 0) {
+            // Sent under the lock, so bench_respond can't free the response
+            // meanwhile.
+            pthread_mutex_lock(&server->lock);
+            server->round_trips++;
+            ok = rift_socket_send_frame(conn.fd, id, server->response, strlen(server->response));
+            pthread_mutex_unlock(&server->lock);
+        } else if (id != 0) {
+            if (strncmp(frame, "{\"subscribe\"", 12) == 0) {
+                pthread_mutex_lock(&server->lock);
+                server->event_fd = conn.fd;
+                pthread_mutex_unlock(&server->lock);
+            }
+            ok = bench_server_send(server, conn.fd, id, "{\"ok\":true}", 11);
+        }
+        free(frame);
+        if (!ok) break;
+    }
+    return NULL;
+}
+
+static void* bench_server_accept_main(void *arg) {
+    bench_server_t *server = (bench_server_t*)arg;
+    while (!server->stopping) {
+        if (rift_socket_wait_readable(server->listen_fd, 50) != RIFT_SOCKET_FRAME) continue;
+        int fd = accept(server->listen_fd, NULL, NULL);
+        if (fd < 0) continue;
+        bench_server_conn_t *conn = (bench_server_conn_t*)malloc(sizeof(bench_server_conn_t));
+        if (!conn || server->conn_count == (int)(sizeof(server->fds) / sizeof(server->fds[0]))) {
+            free(conn);
+            close(fd);
+            continue;
+        }
+        conn->server = server;
+        conn->fd = fd;
+        if (pthread_create(&server->threads[server->conn_count], NULL, bench_server_conn_main, conn) != 0) {
+            free(conn);
+            close(fd);
+            continue;
+        }
+        server->fds[server->conn_count++] = fd;
+    }
+    return NULL;
+}
+
+// Starts a server on a fresh socket path (server->path) that sends `events`
+// and answers get_* requests with `response`. The burst settings can be set
+// afterwards; they are only read when the client asks for a burst.
+static bool bench_server_open(bench_server_t *server, char **events, size_t *lens, size_t count, const char *response) {
+    memset(server, 0, sizeof(bench_server_t));
+    server->events = events;
+    server->lens = lens;
+    server->count = count;
+    server->response = response;
+    server->event_fd = -1;
+    if (!bench_temp_path(server->path)) return false;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", server->path);
+    server->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server->listen_fd < 0) {
+        bench_temp_remove(server->path);
+        return false;
+    }
+    if (bind(server->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(server->listen_fd, 4) != 0) {
+        close(server->listen_fd);
+        bench_temp_remove(server->path);
+        return false;
+    }
+    pthread_mutex_init(&server->lock, NULL);
+    if (pthread_create(&server->acceptor, NULL, bench_server_accept_main, server) != 0) {
+        close(server->listen_fd);
+        pthread_mutex_destroy(&server->lock);
+        bench_temp_remove(server->path);
+        return false;
+    }
+    return true;
+}
+
+static void bench_server_stop(bench_server_t *server) {
+    server->stopping = true;
+    pthread_join(server->acceptor, NULL);
+    for (int i = 0; i < server->conn_count; ++i) {
+        shutdown(server->fds[i], SHUT_RDWR);
+        pthread_join(server->threads[i], NULL);
+        close(server->fds[i]);
+    }
+    close(server->listen_fd);
+    pthread_mutex_destroy(&server->lock);
+    free(server->owned_response);
+    bench_temp_remove(server->path);
+}
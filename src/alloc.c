@@ -0,0 +1,197 @@
+#include "alloc.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    rift_alloc_t *alloc;
+} rift_alloc_box_t;
+
+static int rift_alloc_class(size_t size) {
+    int index = 0;
+    size_t limit = 16;
+    while (size > limit && index < RIFT_ALLOC_CLASSES - 1) {
+        limit <<= 1;
+        index++;
+    }
+    return index;
+}
+
+static void rift_alloc_drain(rift_alloc_t *alloc) {
+    for (size_t size = 0; size <= RIFT_ALLOC_POOL_MAX; ++size) {
+        void *block = alloc->pool[size];
+        while (block) {
+            void *next = *(void**)block;
+            alloc->base(alloc->base_ud, block, size, 0);
+            block = next;
+        }
+        alloc->pool[size] = NULL;
+        alloc->pool_depth[size] = 0;
+    }
+    alloc->pool_bytes = 0;
+}
+
+static void* rift_alloc_fn(void *ud, void *ptr, size_t osize, size_t nsize) {
+    rift_alloc_t *alloc = (rift_alloc_t*)ud;
+
+    if (nsize == 0) {
+        if (!ptr) return NULL;
+        alloc->frees++;
+        alloc->classes[rift_alloc_class(osize)].frees++;
+        if (alloc->pooled && osize >= sizeof(void*) && osize <= RIFT_ALLOC_POOL_MAX &&
+            alloc->pool_depth[osize] < RIFT_ALLOC_POOL_DEPTH &&
+            alloc->pool_bytes + osize <= RIFT_ALLOC_POOL_BYTES) {
+            *(void**)ptr = alloc->pool[osize];
+            alloc->pool[osize] = ptr;
+            alloc->pool_depth[osize]++;
+            alloc->pool_bytes += osize;
+            return NULL;
+        }
+        return alloc->base(alloc->base_ud, ptr, osize, 0);
+    }
+
+    if (!ptr) {
+        // For new blocks Lua passes the object type in osize, not a size.
+        rift_alloc_class_t *size_class = &alloc->classes[rift_alloc_class(nsize)];
+        alloc->allocs++;
+        alloc->allocated_bytes += nsize;
+        size_class->allocs++;
+        if (nsize <= RIFT_ALLOC_POOL_MAX && alloc->pool[nsize]) {
+            void *block = alloc->pool[nsize];
+            alloc->pool[nsize] = *(void**)block;
+            alloc->pool_depth[nsize]--;
+            alloc->pool_bytes -= nsize;
+            alloc->pool_hits++;
+            size_class->pool_hits++;
+            return block;
+        }
+        void *block = alloc->base(alloc->base_ud, NULL, osize, nsize);
+        if (!block && alloc->pool_bytes) {
+            rift_alloc_drain(alloc);
+            block = alloc->base(alloc->base_ud, NULL, osize, nsize);
+        }
+        return block;
+    }
+
+    alloc->reallocs++;
+    if (nsize > osize) alloc->allocated_bytes += nsize - osize;
+    void *block = alloc->base(alloc->base_ud, ptr, osize, nsize);
+    if (!block && alloc->pool_bytes) {
+        rift_alloc_drain(alloc);
+        block = alloc->base(alloc->base_ud, ptr, osize, nsize);
+    }
+    return block;
+}
+
+// Finalizer of a userdata that dies with every GC cycle and leaves a new one
+// behind. While the state is closing no new finalizers are registered.
+static int rift_alloc_gc_sentinel(lua_State *L) {
+    rift_alloc_box_t *box = (rift_alloc_box_t*)lua_touserdata(L, lua_upvalueindex(1));
+    if (!box->alloc) return 0;
+    box->alloc->gc_cycles++;
+    lua_newuserdatauv(L, 0, 0);
+    lua_getmetatable(L, 1);
+    lua_setmetatable(L, -2);
+    lua_pop(L, 1);
+    return 0;
+}
+
+// Runs when the state closes: hand the remaining blocks back to the original
+// allocator and put it back in place for the final sweep.
+static int rift_alloc_box_gc(lua_State *L) {
+    rift_alloc_box_t *box = (rift_alloc_box_t*)lua_touserdata(L, 1);
+    rift_alloc_t *alloc = box->alloc;
+    if (!alloc) return 0;
+    box->alloc = NULL;
+    rift_alloc_drain(alloc);
+    lua_setallocf(L, alloc->base, alloc->base_ud);
+    free(alloc);
+    return 0;
+}
+
+rift_alloc_t* rift_alloc_get(lua_State *L) {
+    lua_getfield(L, LUA_REGISTRYINDEX, RIFT_ALLOC_REGISTRY_KEY);
+    rift_alloc_box_t *box = (rift_alloc_box_t*)lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    return box ? box->alloc : NULL;
+}
+
+rift_alloc_t* rift_alloc_install(lua_State *L, bool pooled) {
+    rift_alloc_t *existing = rift_alloc_get(L);
+    if (existing) return existing;
+
+    rift_alloc_box_t *box = (rift_alloc_box_t*)lua_newuserdatauv(L, sizeof(rift_alloc_box_t), 0);
+    box->alloc = NULL;
+    lua_createtable(L, 0, 1);
+    lua_pushcfunction(L, rift_alloc_box_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_setmetatable(L, -2);
+
+    lua_newuserdatauv(L, 0, 0);
+    lua_createtable(L, 0, 1);
+    lua_pushvalue(L, -3);
+    lua_pushcclosure(L, rift_alloc_gc_sentinel, 1);
+    lua_setfield(L, -2, "__gc");
+    lua_setmetatable(L, -2);
+    lua_pop(L, 1);
+
+    rift_alloc_t *alloc = (rift_alloc_t*)calloc(1, sizeof(rift_alloc_t));
+    if (!alloc) {
+        lua_pop(L, 1);
+        return NULL;
+    }
+    alloc->base = lua_getallocf(L, &alloc->base_ud);
+    alloc->pooled = pooled;
+    box->alloc = alloc;
+    lua_setfield(L, LUA_REGISTRYINDEX, RIFT_ALLOC_REGISTRY_KEY);
+    lua_setallocf(L, rift_alloc_fn, alloc);
+    return alloc;
+}
+
+lua_State* rift_alloc_newstate(void) {
+    lua_State *L = luaL_newstate();
+    if (!L) return NULL;
+    const char *pool = getenv("RIFT_ALLOC_POOL");
+    rift_alloc_install(L, !(pool && strcmp(pool, "0") == 0));
+    return L;
+}
+
+void rift_alloc_reset(rift_alloc_t *alloc) {
+    alloc->allocs = 0;
+    alloc->frees = 0;
+    alloc->reallocs = 0;
+    alloc->pool_hits = 0;
+    alloc->allocated_bytes = 0;
+    alloc->gc_cycles = 0;
+    memset(alloc->classes, 0, sizeof(alloc->classes));
+}
+
+static void rift_alloc_set_integer(lua_State *L, const char *key, uint64_t value) {
+    lua_pushinteger(L, (lua_Integer)value);
+    lua_setfield(L, -2, key);
+}
+
+void rift_alloc_push_stats(lua_State *L, const rift_alloc_t *alloc) {
+    lua_createtable(L, 0, 10);
+    lua_pushboolean(L, alloc->pooled);
+    lua_setfield(L, -2, "pooled");
+    rift_alloc_set_integer(L, "allocs", alloc->allocs);
+    rift_alloc_set_integer(L, "frees", alloc->frees);
+    rift_alloc_set_integer(L, "reallocs", alloc->reallocs);
+    rift_alloc_set_integer(L, "pool_hits", alloc->pool_hits);
+    rift_alloc_set_integer(L, "allocated_bytes", alloc->allocated_bytes);
+    rift_alloc_set_integer(L, "pool_bytes", alloc->pool_bytes);
+    rift_alloc_set_integer(L, "gc_cycles", alloc->gc_cycles);
+
+    lua_createtable(L, RIFT_ALLOC_CLASSES, 0);
+    for (int i = 0; i < RIFT_ALLOC_CLASSES; ++i) {
+        const rift_alloc_class_t *size_class = &alloc->classes[i];
+        lua_createtable(L, 0, 4);
+        // The last class has no upper bound.
+        if (i < RIFT_ALLOC_CLASSES - 1) rift_alloc_set_integer(L, "max_bytes", (uint64_t)16 << i);
+        rift_alloc_set_integer(L, "allocs", size_class->allocs);
+        rift_alloc_set_integer(L, "frees", size_class->frees);
+        rift_alloc_set_integer(L, "pool_hits", size_class->pool_hits);
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, "classes");
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <lua.h>
+#include <lauxlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Opt-in lua_Alloc wrapper. It counts allocations by size class, counts GC
+// cycles, and can keep freed small blocks on per-size free lists, which serve
+// the next request of that exact size. Every block still comes from the
+// allocator the state had before, so it can be installed at any time.
+#define RIFT_ALLOC_REGISTRY_KEY "rift.alloc"
+#define RIFT_ALLOC_CLASSES 14
+#define RIFT_ALLOC_POOL_MAX 512
+#define RIFT_ALLOC_POOL_DEPTH 256
+#define RIFT_ALLOC_POOL_BYTES (1u << 20)
+
+typedef struct {
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t pool_hits;
+} rift_alloc_class_t;
+
+typedef struct {
+    lua_Alloc base;
+    void *base_ud;
+    bool pooled;
+    void *pool[RIFT_ALLOC_POOL_MAX + 1];
+    uint32_t pool_depth[RIFT_ALLOC_POOL_MAX + 1];
+    size_t pool_bytes;
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t reallocs;
+    uint64_t pool_hits;
+    uint64_t allocated_bytes;
+    uint64_t gc_cycles;
+    rift_alloc_class_t classes[RIFT_ALLOC_CLASSES];
+} rift_alloc_t;
+
+// Wraps the allocator of `L`; `pooled` enables the free lists. Returns the
+// existing wrapper if one is installed, or NULL when out of memory. The
+// wrapper removes itself when the state is closed.
+rift_alloc_t* rift_alloc_install(lua_State *L, bool pooled);
+
+// luaL_newstate() with the pooled wrapper installed, or counting only when
+// $RIFT_ALLOC_POOL is "0". Signature-compatible with luaL_newstate for hosts.
+lua_State* rift_alloc_newstate(void);
+
+// The wrapper installed in `L`, or NULL.
+rift_alloc_t* rift_alloc_get(lua_State *L);
+
+void rift_alloc_reset(rift_alloc_t *alloc);
+void rift_alloc_push_stats(lua_State *L, const rift_alloc_t *alloc);
@@ -57,6 +57,8 @@
 #endif
 
 #include "cJSON.h"
+#include "number.h"
+#include "scan.h"
 
 /* define our own boolean type */
 #ifdef true
@@ -304,7 +306,8 @@ typedef struct
 #define buffer_at_offset(buffer) ((buffer)->content + (buffer)->offset)
 
 /* Parse the input text to generate a number, and populate the result into item. */
-static cJSON_bool parse_number(cJSON * const item, parse_buffer * const input_buffer)
+/* strtod fallback for numbers rift_number_scan leaves alone */
+static cJSON_bool parse_number_strtod(parse_buffer * const input_buffer, double * const out, size_t * const consumed)
 {
     double number = 0;
     unsigned char *after_end = NULL;
@@ -383,6 +386,42 @@ loop_end:
         return false; /* parse_error */
     }
 
+    *out = number;
+    *consumed = (size_t)(after_end - number_c_string);
+    /* free the temporary buffer */
+    input_buffer->hooks.deallocate(number_c_string);
+    return true;
+}
+
+/* Parse the input text to generate a number, and populate the result into item. */
+static cJSON_bool parse_number(cJSON * const item, parse_buffer * const input_buffer)
+{
+    double number = 0;
+    size_t consumed = 0;
+    rift_number_t scanned;
+
+    if ((input_buffer == NULL) || (input_buffer->content == NULL))
+    {
+        return false;
+    }
+
+    item->type = cJSON_Number;
+    if (rift_number_scan(buffer_at_offset(input_buffer), input_buffer->length - input_buffer->offset, &scanned))
+    {
+        number = scanned.d;
+        consumed = scanned.len;
+        if (scanned.integer)
+        {
+            item->type |= cJSON_NumberIsInteger;
+            item->valueint64 = scanned.i;
+        }
+    }
+    else if (!parse_number_strtod(input_buffer, &number, &consumed))
+    {
+        item->type = cJSON_Invalid;
+        return false;
+    }
+
     item->valuedouble = number;
 
     /* use saturation in case of overflow */
@@ -399,17 +438,14 @@ loop_end:
         item->valueint = (int)number;
     }
 
-    item->type = cJSON_Number;
-
-    input_buffer->offset += (size_t)(after_end - number_c_string);
-    /* free the temporary buffer */
-    input_buffer->hooks.deallocate(number_c_string);
+    input_buffer->offset += consumed;
     return true;
 }
 
 /* don't ask me, but the original cJSON_SetNumberValue returns an integer or double */
 CJSON_PUBLIC(double) cJSON_SetNumberHelper(cJSON *object, double number)
 {
+    object->type &= ~cJSON_NumberIsInteger;
     if (number >= INT_MAX)
     {
         object->valueint = INT_MAX;
@@ -608,6 +644,10 @@ static cJSON_bool print_number(const cJSON * const item, printbuffer * const out
     {
         length = sprintf((char*)number_buffer, "null");
     }
+    else if (item->type & cJSON_NumberIsInteger)
+    {
+        length = sprintf((char*)number_buffer, "%lld", (long long)item->valueint64);
+    }
     else if(d == (double)item->valueint)
     {
         length = sprintf((char*)number_buffer, "%d", item->valueint);
@@ -833,20 +873,18 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
         /* calculate approximate size of the output (overestimate) */
         size_t allocation_length = 0;
         size_t skipped_bytes = 0;
-        while (((size_t)(input_end - input_buffer->content) < input_buffer->length) && (*input_end != '\"'))
+        const unsigned char *content_end = input_buffer->content + input_buffer->length;
+        /* rift: skip plain runs in blocks, stopping only at quotes and backslashes */
+        while ((input_end = rift_scan_string(input_end, content_end)) < content_end && (*input_end != '\"'))
         {
             /* is escape sequence */
-            if (input_end[0] == '\\')
+            if ((size_t)(input_end + 1 - input_buffer->content) >= input_buffer->length)
             {
-                if ((size_t)(input_end + 1 - input_buffer->content) >= input_buffer->length)
-                {
-                    /* prevent buffer overflow when last input character is a backslash */
-                    goto fail;
-                }
-                skipped_bytes++;
-                input_end++;
+                /* prevent buffer overflow when last input character is a backslash */
+                goto fail;
             }
-            input_end++;
+            skipped_bytes++;
+            input_end += 2;
         }
         if (((size_t)(input_end - input_buffer->content) >= input_buffer->length) || (*input_end != '\"'))
         {
@@ -868,7 +906,11 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
     {
         if (*input_pointer != '\\')
         {
-            *output_pointer++ = *input_pointer++;
+            /* rift: copy everything up to the next escape at once */
+            const unsigned char *run_end = rift_scan_string(input_pointer + 1, input_end);
+            memcpy(output_pointer, input_pointer, (size_t)(run_end - input_pointer));
+            output_pointer += run_end - input_pointer;
+            input_pointer = run_end;
         }
         /* escape sequence */
         else
@@ -2793,6 +2835,7 @@ cJSON * cJSON_Duplicate_rec(const cJSON *item, size_t depth, cJSON_bool recurse)
     newitem->type = item->type & (~cJSON_IsReference);
     newitem->valueint = item->valueint;
     newitem->valuedouble = item->valuedouble;
+    newitem->valueint64 = item->valueint64;
     if (item->valuestring)
     {
         newitem->valuestring = (char*)cJSON_strdup((unsigned char*)item->valuestring, &global_hooks);
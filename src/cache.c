@@ -0,0 +1,238 @@
+#include "cache.h"
+#include <stdlib.h>
+#include <string.h>
+#include "cJSON.h"
+
+// Query names are matched by substring, so "space" covers get_workspaces and
+// get_spaces alike. Window and stack changes also show up in workspace
+// queries, which is why they drop those too.
+static const char *const rift_cache_default_rules[][2] = {
+    {"workspace_changed", "space"},
+    {"windows_changed", "window"},
+    {"windows_changed", "space"},
+    {"windows_changed", "stack"},
+    {"window_title_changed", "window"},
+    {"window_title_changed", "space"},
+    {"stacks_changed", "stack"},
+    {"stacks_changed", "window"},
+    {"stacks_changed", "space"},
+};
+
+rift_cache_t* rift_cache_create(uint64_t ttl_ns, size_t max_entries, bool shared) {
+    rift_cache_t *cache = (rift_cache_t*)calloc(1, sizeof(rift_cache_t));
+    if (!cache) return NULL;
+    cache->max_entries = max_entries ? max_entries : 1;
+    cache->entries = (rift_cache_entry_t*)calloc(cache->max_entries, sizeof(rift_cache_entry_t));
+    if (!cache->entries) {
+        free(cache);
+        return NULL;
+    }
+    cache->ttl_ns = ttl_ns;
+    cache->shared = shared;
+    return cache;
+}
+
+static void rift_cache_drop(lua_State *L, rift_cache_t *cache, size_t index) {
+    rift_cache_entry_t *entry = &cache->entries[index];
+    luaL_unref(L, LUA_REGISTRYINDEX, entry->ref);
+    free(entry->key);
+    free(entry->name);
+    cache->entries[index] = cache->entries[--cache->count];
+}
+
+void rift_cache_free(lua_State *L, rift_cache_t *cache) {
+    if (!cache) return;
+    while (cache->count) rift_cache_drop(L, cache, cache->count - 1);
+    for (size_t i = 0; i < cache->rule_count; ++i) {
+        free(cache->rules[i].event);
+        free(cache->rules[i].match);
+    }
+    free(cache->rules);
+    free(cache->entries);
+    free(cache);
+}
+
+bool rift_cache_add_rule(rift_cache_t *cache, const char *event, const char *match) {
+    rift_cache_rule_t *rules = (rift_cache_rule_t*)realloc(cache->rules, (cache->rule_count + 1) * sizeof(rift_cache_rule_t));
+    if (!rules) return false;
+    cache->rules = rules;
+    rift_cache_rule_t *rule = &rules[cache->rule_count];
+    rule->event = strdup(event);
+    rule->match = strdup(match);
+    if (!rule->event || !rule->match) {
+        free(rule->event);
+        free(rule->match);
+        return false;
+    }
+    cache->rule_count++;
+    return true;
+}
+
+bool rift_cache_add_default_rules(rift_cache_t *cache) {
+    size_t count = sizeof(rift_cache_default_rules) / sizeof(rift_cache_default_rules[0]);
+    for (size_t i = 0; i < count; ++i) {
+        if (!rift_cache_add_rule(cache, rift_cache_default_rules[i][0], rift_cache_default_rules[i][1])) return false;
+    }
+    return true;
+}
+
+static int rift_cache_compare_members(const void *a, const void *b) {
+    const cJSON *x = *(const cJSON *const *)a;
+    const cJSON *y = *(const cJSON *const *)b;
+    return strcmp(x->string ? x->string : "", y->string ? y->string : "");
+}
+
+// Sorts object members by key at every level so key order doesn't split
+// otherwise identical requests.
+static bool rift_cache_normalize(cJSON *json) {
+    size_t count = 0;
+    for (cJSON *item = json->child; item; item = item->next) {
+        if (!rift_cache_normalize(item)) return false;
+        count++;
+    }
+    if (!cJSON_IsObject(json) || count < 2) return true;
+
+    cJSON **members = (cJSON**)malloc(count * sizeof(cJSON*));
+    if (!members) return false;
+    size_t i = 0;
+    for (cJSON *item = json->child; item; item = item->next) members[i++] = item;
+    qsort(members, count, sizeof(cJSON*), rift_cache_compare_members);
+    for (i = 0; i < count; ++i) {
+        members[i]->prev = i ? members[i - 1] : members[count - 1];
+        members[i]->next = i + 1 < count ? members[i + 1] : NULL;
+    }
+    json->child = members[0];
+    free(members);
+    return true;
+}
+
+char* rift_cache_key(const char *request_json, char **name) {
+    *name = NULL;
+    cJSON *request = cJSON_Parse(request_json);
+    if (!cJSON_IsObject(request) || !request->child || !request->child->string ||
+        strncmp(request->child->string, "get_", 4) != 0 || !rift_cache_normalize(request)) {
+        cJSON_Delete(request);
+        return NULL;
+    }
+
+    char *key = cJSON_PrintUnformatted(request);
+    *name = key ? strdup(request->child->string) : NULL;
+    cJSON_Delete(request);
+    if (!*name) {
+        free(key);
+        return NULL;
+    }
+    return key;
+}
+
+// FNV-1a; keys are short, and every hit is confirmed with strcmp.
+uint64_t rift_cache_hash(const char *key) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const unsigned char *p = (const unsigned char*)key; *p; ++p) {
+        hash ^= *p;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static bool rift_cache_find(const rift_cache_t *cache, const char *key, uint64_t hash, size_t *index) {
+    for (size_t i = 0; i < cache->count; ++i) {
+        const rift_cache_entry_t *entry = &cache->entries[i];
+        if (entry->hash == hash && strcmp(entry->key, key) == 0) {
+            *index = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool rift_cache_get(lua_State *L, rift_cache_t *cache, const char *key, uint64_t hash, uint64_t now_ns) {
+    size_t index = 0;
+    if (!rift_cache_find(cache, key, hash, &index)) {
+        cache->misses++;
+        return false;
+    }
+    if (cache->entries[index].expires_ns && cache->entries[index].expires_ns <= now_ns) {
+        rift_cache_drop(L, cache, index);
+        cache->expirations++;
+        cache->misses++;
+        return false;
+    }
+    cache->hits++;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, cache->entries[index].ref);
+    return true;
+}
+
+void rift_cache_put(lua_State *L, rift_cache_t *cache, char *key, char *name, uint64_t hash, uint64_t now_ns) {
+    size_t index = 0;
+    if (rift_cache_find(cache, key, hash, &index)) rift_cache_drop(L, cache, index);
+
+    // Full: evict the entry closest to expiry (the oldest, with one TTL).
+    if (cache->count == cache->max_entries) {
+        size_t oldest = 0;
+        for (size_t i = 1; i < cache->count; ++i) {
+            if (cache->entries[i].expires_ns < cache->entries[oldest].expires_ns) oldest = i;
+        }
+        rift_cache_drop(L, cache, oldest);
+        cache->evictions++;
+    }
+
+    lua_pushvalue(L, -1);
+    rift_cache_entry_t *entry = &cache->entries[cache->count++];
+    entry->hash = hash;
+    entry->key = key;
+    entry->name = name;
+    entry->expires_ns = cache->ttl_ns ? now_ns + cache->ttl_ns : 0;
+    entry->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+}
+
+static bool rift_cache_invalidates(const rift_cache_t *cache, const char *event_type, const char *name) {
+    for (size_t i = 0; i < cache->rule_count; ++i) {
+        const rift_cache_rule_t *rule = &cache->rules[i];
+        if (strcmp(rule->event, "*") != 0 && strcmp(rule->event, event_type) != 0) continue;
+        if (strstr(name, rule->match)) return true;
+    }
+    return false;
+}
+
+size_t rift_cache_invalidate(lua_State *L, rift_cache_t *cache, const char *event_type) {
+    if (!event_type) return 0;
+    size_t dropped = 0;
+    for (size_t i = cache->count; i-- > 0;) {
+        if (!rift_cache_invalidates(cache, event_type, cache->entries[i].name)) continue;
+        rift_cache_drop(L, cache, i);
+        dropped++;
+    }
+    cache->invalidations += dropped;
+    return dropped;
+}
+
+void rift_cache_clear(lua_State *L, rift_cache_t *cache) {
+    cache->invalidations += cache->count;
+    while (cache->count) rift_cache_drop(L, cache, cache->count - 1);
+}
+
+void rift_cache_reset_stats(rift_cache_t *cache) {
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->invalidations = 0;
+    cache->expirations = 0;
+    cache->evictions = 0;
+    cache->bypassed = 0;
+}
+
+static void rift_cache_set_integer(lua_State *L, const char *key, uint64_t value) {
+    lua_pushinteger(L, (lua_Integer)value);
+    lua_setfield(L, -2, key);
+}
+
+void rift_cache_push_stats(lua_State *L, const rift_cache_t *cache) {
+    lua_createtable(L, 0, 7);
+    rift_cache_set_integer(L, "hits", cache->hits);
+    rift_cache_set_integer(L, "misses", cache->misses);
+    rift_cache_set_integer(L, "invalidations", cache->invalidations);
+    rift_cache_set_integer(L, "expirations", cache->expirations);
+    rift_cache_set_integer(L, "evictions", cache->evictions);
+    rift_cache_set_integer(L, "bypassed", cache->bypassed);
+    rift_cache_set_integer(L, "entries", cache->count);
+}
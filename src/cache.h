@@ -0,0 +1,68 @@
+#pragma once
+#include <lua.h>
+#include <lauxlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Response cache behind client:set_cache(). Only get_* requests are cached,
+// keyed by their JSON with object keys sorted. Entries hold a registry ref to
+// the decoded response and expire after a TTL or when an event matching one
+// of the invalidation rules is dispatched.
+#define RIFT_CACHE_DEFAULT_TTL_MS 1000
+#define RIFT_CACHE_DEFAULT_ENTRIES 64
+
+typedef struct {
+    uint64_t hash;
+    char *key;
+    char *name;
+    uint64_t expires_ns;
+    int ref;
+} rift_cache_entry_t;
+
+// An event of type `event` ("*" for any) drops entries whose request name
+// contains `match`.
+typedef struct {
+    char *event;
+    char *match;
+} rift_cache_rule_t;
+
+typedef struct {
+    rift_cache_entry_t *entries;
+    size_t count;
+    size_t max_entries;
+    rift_cache_rule_t *rules;
+    size_t rule_count;
+    // 0 keeps entries until an event invalidates them.
+    uint64_t ttl_ns;
+    // Hits return the cached table itself instead of a copy.
+    bool shared;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t invalidations;
+    uint64_t expirations;
+    uint64_t evictions;
+    uint64_t bypassed;
+} rift_cache_t;
+
+rift_cache_t* rift_cache_create(uint64_t ttl_ns, size_t max_entries, bool shared);
+void rift_cache_free(lua_State *L, rift_cache_t *cache);
+bool rift_cache_add_rule(rift_cache_t *cache, const char *event, const char *match);
+bool rift_cache_add_default_rules(rift_cache_t *cache);
+
+// The cache key of a get_* request, with its name in `*name`; NULL for
+// requests that can't be cached. Both strings are owned by the caller.
+char* rift_cache_key(const char *request_json, char **name);
+uint64_t rift_cache_hash(const char *key);
+
+// Pushes the cached response and returns true, or returns false on a miss.
+bool rift_cache_get(lua_State *L, rift_cache_t *cache, const char *key, uint64_t hash, uint64_t now_ns);
+// Caches the table on top of the stack (left in place); takes ownership of
+// `key` and `name`.
+void rift_cache_put(lua_State *L, rift_cache_t *cache, char *key, char *name, uint64_t hash, uint64_t now_ns);
+size_t rift_cache_invalidate(lua_State *L, rift_cache_t *cache, const char *event_type);
+// Drops every entry, e.g. after reconnecting to a restarted server.
+void rift_cache_clear(lua_State *L, rift_cache_t *cache);
+
+void rift_cache_reset_stats(rift_cache_t *cache);
+void rift_cache_push_stats(lua_State *L, const rift_cache_t *cache);
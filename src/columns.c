@@ -0,0 +1,381 @@
+#include "columns.h"
+#include <string.h>
+
+// Integers that still read back exactly from a double.
+#define RIFT_COLUMNS_EXACT (1ll << 53)
+
+// What the first pass saw of one key.
+typedef struct {
+    const char *name;
+    size_t name_len;
+    uint32_t name_pos;
+    size_t present;
+    size_t last_row;
+    bool integer;
+    bool number;
+    bool boolean;
+    bool string;
+    bool other;
+    bool wide;
+} rift_columns_scan_t;
+
+static size_t rift_columns_align(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+// Rows usually list their keys in the same order, so the key after the last
+// match is tried first.
+static int rift_columns_match(const rift_columns_scan_t *scan, int count, int hint, const char *name, size_t len) {
+    if (hint < count && scan[hint].name_len == len && memcmp(scan[hint].name, name, len) == 0) return hint;
+    for (int i = 0; i < count; ++i) {
+        if (scan[i].name_len == len && memcmp(scan[i].name, name, len) == 0) return i;
+    }
+    return -1;
+}
+
+static size_t rift_columns_cell_size(rift_column_kind_t kind) {
+    switch (kind) {
+        case RIFT_COLUMN_INTEGER: return sizeof(int64_t);
+        case RIFT_COLUMN_NUMBER: return sizeof(double);
+        case RIFT_COLUMN_BOOLEAN: return sizeof(uint8_t);
+        default: return sizeof(uint32_t);
+    }
+}
+
+static rift_column_kind_t rift_columns_kind(const rift_columns_scan_t *scan) {
+    bool scalar_mix = scan->boolean || scan->string || scan->other;
+    if (scan->present == 0) return RIFT_COLUMN_VALUE;
+    if (scan->integer && !scan->number && !scalar_mix) return RIFT_COLUMN_INTEGER;
+    if (scan->number && !scalar_mix && !scan->wide) return RIFT_COLUMN_NUMBER;
+    if (scan->boolean && !scan->integer && !scan->number && !scan->string && !scan->other) return RIFT_COLUMN_BOOLEAN;
+    if (scan->string && !scan->integer && !scan->number && !scan->boolean && !scan->other) return RIFT_COLUMN_STRING;
+    return RIFT_COLUMN_VALUE;
+}
+
+static void rift_columns_metatable(lua_State *L);
+
+// Builds a view of the array at `pos` and pushes it; false, with nothing
+// pushed, when some element isn't an object or there are too many keys.
+static bool rift_columns_build(lua_State *L, const rift_tape_t *tape, size_t pos) {
+    size_t rows = rift_tape_count(tape, pos);
+    size_t end = rift_tape_skip(tape, pos);
+    rift_columns_scan_t scan[RIFT_COLUMNS_MAX];
+    int count = 0;
+
+    size_t element = rift_tape_first(tape, pos);
+    for (size_t row = 0; row < rows; ++row) {
+        if (rift_tape_tag(tape, element) != RIFT_TAPE_OBJECT) return false;
+        uint32_t members = rift_tape_count(tape, element);
+        size_t key_pos = rift_tape_first(tape, element);
+        int hint = 0;
+        for (uint32_t m = 0; m < members; ++m) {
+            size_t len = 0;
+            const char *name = rift_tape_string(tape, key_pos, &len);
+            size_t value_pos = rift_tape_skip(tape, key_pos);
+            if (!name) return false;
+            int c = rift_columns_match(scan, count, hint, name, len);
+            if (c < 0) {
+                if (count == RIFT_COLUMNS_MAX) return false;
+                c = count++;
+                memset(&scan[c], 0, sizeof(rift_columns_scan_t));
+                scan[c].name = name;
+                scan[c].name_len = len;
+                scan[c].name_pos = (uint32_t)(key_pos - pos);
+                scan[c].last_row = SIZE_MAX;
+            }
+            hint = c + 1;
+
+            rift_columns_scan_t *s = &scan[c];
+            switch (rift_tape_tag(tape, value_pos)) {
+                case RIFT_TAPE_NULL:
+                    break;
+                case RIFT_TAPE_INTEGER: {
+                    int64_t v = rift_tape_integer(tape, value_pos);
+                    s->integer = true;
+                    if (v > RIFT_COLUMNS_EXACT || v < -RIFT_COLUMNS_EXACT) s->wide = true;
+                    break;
+                }
+                case RIFT_TAPE_NUMBER:
+                    s->number = true;
+                    break;
+                case RIFT_TAPE_TRUE:
+                case RIFT_TAPE_FALSE:
+                    s->boolean = true;
+                    break;
+                case RIFT_TAPE_STRING:
+                    s->string = true;
+                    break;
+                default:
+                    s->other = true;
+                    break;
+            }
+            if (rift_tape_tag(tape, value_pos) != RIFT_TAPE_NULL && s->last_row != row) {
+                s->present++;
+                s->last_row = row;
+            }
+            key_pos = rift_tape_skip(tape, value_pos);
+        }
+        element = rift_tape_skip(tape, element);
+    }
+
+    // Header, columns, then every array 8-byte aligned, then the blob.
+    size_t bytes = rift_columns_align(sizeof(rift_columns_t)) + rift_columns_align(sizeof(rift_column_t) * (size_t)count);
+    rift_column_kind_t kinds[RIFT_COLUMNS_MAX];
+    for (int c = 0; c < count; ++c) {
+        kinds[c] = rift_columns_kind(&scan[c]);
+        bytes += rift_columns_align(rift_columns_cell_size(kinds[c]) * rows);
+        if (scan[c].present < rows) bytes += rift_columns_align(rows);
+    }
+    size_t blob_len = end - pos;
+    bytes += blob_len;
+
+    unsigned char *base = (unsigned char*)lua_newuserdatauv(L, bytes, 0);
+    rift_columns_t *view = (rift_columns_t*)base;
+    size_t offset = rift_columns_align(sizeof(rift_columns_t));
+    view->rows = rows;
+    view->column_count = (uint32_t)count;
+    view->columns = (rift_column_t*)(base + offset);
+    offset += rift_columns_align(sizeof(rift_column_t) * (size_t)count);
+    for (int c = 0; c < count; ++c) {
+        rift_column_t *column = &view->columns[c];
+        column->name_pos = scan[c].name_pos;
+        column->kind = kinds[c];
+        column->values = base + offset;
+        offset += rift_columns_align(rift_columns_cell_size(kinds[c]) * rows);
+        column->missing = NULL;
+        if (scan[c].present < rows) {
+            column->missing = base + offset;
+            memset(column->missing, 1, rows);
+            offset += rift_columns_align(rows);
+        }
+    }
+    memcpy(base + offset, tape->data + pos, blob_len);
+    view->blob = base + offset;
+    view->blob_len = blob_len;
+    view->bytes = bytes;
+
+    element = rift_tape_first(tape, pos);
+    for (size_t row = 0; row < rows; ++row) {
+        uint32_t members = rift_tape_count(tape, element);
+        size_t key_pos = rift_tape_first(tape, element);
+        int hint = 0;
+        for (uint32_t m = 0; m < members; ++m) {
+            size_t len = 0;
+            const char *name = rift_tape_string(tape, key_pos, &len);
+            size_t value_pos = rift_tape_skip(tape, key_pos);
+            int c = rift_columns_match(scan, count, hint, name, len);
+            hint = c + 1;
+            key_pos = rift_tape_skip(tape, value_pos);
+
+            rift_tape_tag_t tag = rift_tape_tag(tape, value_pos);
+            rift_column_t *column = &view->columns[c];
+            if (tag == RIFT_TAPE_NULL) continue;
+            switch (column->kind) {
+                case RIFT_COLUMN_INTEGER:
+                    ((int64_t*)column->values)[row] = rift_tape_integer(tape, value_pos);
+                    break;
+                case RIFT_COLUMN_NUMBER:
+                    ((double*)column->values)[row] = rift_tape_number(tape, value_pos);
+                    break;
+                case RIFT_COLUMN_BOOLEAN:
+                    ((uint8_t*)column->values)[row] = tag == RIFT_TAPE_TRUE;
+                    break;
+                default:
+                    ((uint32_t*)column->values)[row] = (uint32_t)(value_pos - pos);
+                    break;
+            }
+            if (column->missing) column->missing[row] = 0;
+        }
+        element = rift_tape_skip(tape, element);
+    }
+
+    rift_columns_metatable(L);
+    lua_setmetatable(L, -2);
+    return true;
+}
+
+size_t rift_columns_push_value(lua_State *L, const rift_tape_t *tape, size_t pos) {
+    luaL_checkstack(L, 3, "columns");
+    rift_tape_tag_t tag = rift_tape_tag(tape, pos);
+    if (tag == RIFT_TAPE_ARRAY) {
+        uint32_t count = rift_tape_count(tape, pos);
+        if (count && rift_columns_build(L, tape, pos)) return rift_tape_skip(tape, pos);
+        lua_createtable(L, (int)count, 0);
+        size_t element = rift_tape_first(tape, pos);
+        for (uint32_t i = 0; i < count; ++i) {
+            element = rift_columns_push_value(L, tape, element);
+            lua_rawseti(L, -2, (lua_Integer)i + 1);
+        }
+        return element;
+    }
+    if (tag == RIFT_TAPE_OBJECT) {
+        uint32_t count = rift_tape_count(tape, pos);
+        lua_createtable(L, 0, (int)count);
+        size_t key_pos = rift_tape_first(tape, pos);
+        for (uint32_t i = 0; i < count; ++i) {
+            size_t len = 0;
+            const char *key = rift_tape_string(tape, key_pos, &len);
+            lua_pushlstring(L, key ? key : "", len);
+            key_pos = rift_columns_push_value(L, tape, rift_tape_skip(tape, key_pos));
+            lua_rawset(L, -3);
+        }
+        return key_pos;
+    }
+    return rift_tape_value_to_lua(L, tape, pos);
+}
+
+bool rift_columns_push(lua_State *L, const rift_tape_t *tape) {
+    rift_tape_tag_t tag = tape->len ? rift_tape_tag(tape, 0) : RIFT_TAPE_NULL;
+    if (tag != RIFT_TAPE_OBJECT && tag != RIFT_TAPE_ARRAY) return false;
+    rift_columns_push_value(L, tape, 0);
+    return true;
+}
+
+static rift_columns_t* rift_columns_check(lua_State *L) {
+    return (rift_columns_t*)luaL_checkudata(L, 1, RIFT_COLUMNS_METATABLE);
+}
+
+static const char* rift_columns_name(const rift_columns_t *view, const rift_column_t *column, size_t *len) {
+    const rift_tape_t blob = {(unsigned char*)view->blob, view->blob_len, 0};
+    return rift_tape_string(&blob, column->name_pos, len);
+}
+
+static int rift_columns_find(const rift_columns_t *view, const char *name, size_t len) {
+    for (uint32_t c = 0; c < view->column_count; ++c) {
+        size_t column_len = 0;
+        const char *column_name = rift_columns_name(view, &view->columns[c], &column_len);
+        if (column_len == len && memcmp(column_name, name, len) == 0) return (int)c;
+    }
+    return -1;
+}
+
+static void rift_columns_push_cell(lua_State *L, const rift_columns_t *view, const rift_column_t *column, size_t row) {
+    if (column->missing && column->missing[row]) {
+        lua_pushnil(L);
+        return;
+    }
+    const rift_tape_t blob = {(unsigned char*)view->blob, view->blob_len, 0};
+    switch (column->kind) {
+        case RIFT_COLUMN_INTEGER:
+            lua_pushinteger(L, (lua_Integer)((const int64_t*)column->values)[row]);
+            break;
+        case RIFT_COLUMN_NUMBER: {
+            // Integers were widened to fit the column; give them back as such.
+            double d = ((const double*)column->values)[row];
+            if (d >= -RIFT_COLUMNS_EXACT && d <= RIFT_COLUMNS_EXACT && (double)(int64_t)d == d) lua_pushinteger(L, (lua_Integer)d);
+            else lua_pushnumber(L, d);
+            break;
+        }
+        case RIFT_COLUMN_BOOLEAN:
+            lua_pushboolean(L, ((const uint8_t*)column->values)[row]);
+            break;
+        case RIFT_COLUMN_STRING: {
+            size_t len = 0;
+            const char *s = rift_tape_string(&blob, ((const uint32_t*)column->values)[row], &len);
+            lua_pushlstring(L, s, len);
+            break;
+        }
+        case RIFT_COLUMN_VALUE:
+            rift_columns_push_value(L, &blob, ((const uint32_t*)column->values)[row]);
+            break;
+    }
+}
+
+// view:len(), also #view.
+static int rift_columns_len(lua_State *L) {
+    lua_pushinteger(L, (lua_Integer)rift_columns_check(L)->rows);
+    return 1;
+}
+
+// view:get(i, key): the field of row i, or nil.
+static int rift_columns_get(lua_State *L) {
+    const rift_columns_t *view = rift_columns_check(L);
+    lua_Integer row = luaL_checkinteger(L, 2);
+    size_t len = 0;
+    const char *name = luaL_checklstring(L, 3, &len);
+    int c = rift_columns_find(view, name, len);
+    if (c < 0 || row < 1 || (lua_Unsigned)row > view->rows) {
+        lua_pushnil(L);
+        return 1;
+    }
+    rift_columns_push_cell(L, view, &view->columns[c], (size_t)row - 1);
+    return 1;
+}
+
+// view:row(i): row i as a table, or nil.
+static int rift_columns_row(lua_State *L) {
+    const rift_columns_t *view = rift_columns_check(L);
+    lua_Integer row = luaL_checkinteger(L, 2);
+    if (row < 1 || (lua_Unsigned)row > view->rows) {
+        lua_pushnil(L);
+        return 1;
+    }
+    lua_createtable(L, 0, (int)view->column_count);
+    for (uint32_t c = 0; c < view->column_count; ++c) {
+        const rift_column_t *column = &view->columns[c];
+        if (column->missing && column->missing[row - 1]) continue;
+        size_t len = 0;
+        const char *name = rift_columns_name(view, column, &len);
+        lua_pushlstring(L, name, len);
+        rift_columns_push_cell(L, view, column, (size_t)row - 1);
+        lua_rawset(L, -3);
+    }
+    return 1;
+}
+
+static int rift_columns_next(lua_State *L) {
+    const rift_columns_t *view = rift_columns_check(L);
+    lua_Integer row = luaL_checkinteger(L, 2) + 1;
+    if (row < 1 || (lua_Unsigned)row > view->rows) return 0;
+    const rift_column_t *column = &view->columns[lua_tointeger(L, lua_upvalueindex(1))];
+    lua_pushinteger(L, row);
+    rift_columns_push_cell(L, view, column, (size_t)row - 1);
+    return 2;
+}
+
+// for i, value in view:column(key) do ... end; value is nil where the row
+// lacks the field.
+static int rift_columns_column(lua_State *L) {
+    const rift_columns_t *view = rift_columns_check(L);
+    size_t len = 0;
+    const char *name = luaL_checklstring(L, 2, &len);
+    int c = rift_columns_find(view, name, len);
+    if (c < 0) return luaL_argerror(L, 2, "no such column");
+    lua_pushinteger(L, c);
+    lua_pushcclosure(L, rift_columns_next, 1);
+    lua_pushvalue(L, 1);
+    lua_pushinteger(L, 0);
+    return 3;
+}
+
+// view:columns(): the keys, in the order they first appear.
+static int rift_columns_names(lua_State *L) {
+    const rift_columns_t *view = rift_columns_check(L);
+    lua_createtable(L, (int)view->column_count, 0);
+    for (uint32_t c = 0; c < view->column_count; ++c) {
+        size_t len = 0;
+        const char *name = rift_columns_name(view, &view->columns[c], &len);
+        lua_pushlstring(L, name, len);
+        lua_rawseti(L, -2, (lua_Integer)c + 1);
+    }
+    return 1;
+}
+
+static const luaL_Reg rift_columns_methods[] = {
+    {"len", rift_columns_len},
+    {"get", rift_columns_get},
+    {"row", rift_columns_row},
+    {"column", rift_columns_column},
+    {"columns", rift_columns_names},
+    {NULL, NULL}
+};
+
+static void rift_columns_metatable(lua_State *L) {
+    if (luaL_newmetatable(L, RIFT_COLUMNS_METATABLE)) {
+        lua_pushcfunction(L, rift_columns_len);
+        lua_setfield(L, -2, "__len");
+        lua_newtable(L);
+        luaL_setfuncs(L, rift_columns_methods, 0);
+        lua_setfield(L, -2, "__index");
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <lua.h>
+#include <lauxlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "tape.h"
+
+#define RIFT_COLUMNS_METATABLE "rift.columns"
+
+// Decoding for {as = "columns"}. A non-empty array whose elements are all
+// objects becomes a "rift.columns" view instead of a table per element. The
+// view is one userdata holding a column per key:
+//   integer   int64 per row
+//   number    double per row (integers up to 2^53 may mix in)
+//   boolean   byte per row
+//   string    offset of the string in the blob
+//   value     offset of anything else (tables, mixed types), decoded on read
+// The blob is a copy of the array's tape, so strings are read straight from
+// it. Missing and null fields read as nil, as in the table decode.
+typedef enum {
+    RIFT_COLUMN_INTEGER,
+    RIFT_COLUMN_NUMBER,
+    RIFT_COLUMN_BOOLEAN,
+    RIFT_COLUMN_STRING,
+    RIFT_COLUMN_VALUE
+} rift_column_kind_t;
+
+typedef struct {
+    // The key, as a tape string in the blob.
+    uint32_t name_pos;
+    rift_column_kind_t kind;
+    void *values;
+    // One byte per row, set where the field is absent; NULL when no row
+    // lacks it.
+    uint8_t *missing;
+} rift_column_t;
+
+// Arrays with more distinct keys than this stay tables.
+#define RIFT_COLUMNS_MAX 64
+
+typedef struct {
+    size_t rows;
+    uint32_t column_count;
+    rift_column_t *columns;
+    const unsigned char *blob;
+    size_t blob_len;
+    // Bytes in the userdata, for benchmarks.
+    size_t bytes;
+} rift_columns_t;
+
+// Pushes the value at `pos` with arrays of objects turned into views, at any
+// depth; returns the offset just past it.
+size_t rift_columns_push_value(lua_State *L, const rift_tape_t *tape, size_t pos);
+// Pushes the root object or array; false for anything else.
+bool rift_columns_push(lua_State *L, const rift_tape_t *tape);
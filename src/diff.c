@@ -0,0 +1,161 @@
+#include "diff.h"
+#include <stdlib.h>
+#include <string.h>
+#include "hash.h"
+#include "number.h"
+
+static const char *const rift_diff_lists[][2] = {
+    {"windows_changed", "windows"},
+    {"stacks_changed", "stacks"},
+};
+
+rift_diff_t* rift_diff_create(void) {
+    return (rift_diff_t*)calloc(1, sizeof(rift_diff_t));
+}
+
+void rift_diff_free(rift_diff_t *diff) {
+    if (!diff) return;
+    for (size_t i = 0; i < diff->scope_count; ++i) {
+        free(diff->scopes[i].type);
+        rift_idmap_free(&diff->scopes[i].slots);
+    }
+    free(diff->scopes);
+    free(diff->stale);
+    free(diff);
+}
+
+const char* rift_diff_list_field(const char *type) {
+    if (!type) return NULL;
+    for (size_t i = 0; i < sizeof(rift_diff_lists) / sizeof(rift_diff_lists[0]); ++i) {
+        if (strcmp(type, rift_diff_lists[i][0]) == 0) return rift_diff_lists[i][1];
+    }
+    return NULL;
+}
+
+static bool rift_diff_tape_id(const rift_tape_t *tape, size_t pos, const char *key, int64_t *out) {
+    size_t value = 0;
+    if (!rift_tape_object_get(tape, pos, key, &value)) return false;
+    switch (rift_tape_tag(tape, value)) {
+        case RIFT_TAPE_INTEGER:
+            *out = rift_tape_integer(tape, value);
+            return true;
+        case RIFT_TAPE_NUMBER:
+            return rift_number_integral(rift_tape_number(tape, value), out);
+        default:
+            return false;
+    }
+}
+
+static rift_diff_scope_t* rift_diff_get_scope(rift_diff_t *diff, const char *type, bool has_space, int64_t space_id) {
+    for (size_t i = 0; i < diff->scope_count; ++i) {
+        rift_diff_scope_t *scope = &diff->scopes[i];
+        if (scope->has_space == has_space && (!has_space || scope->space_id == space_id) &&
+            strcmp(scope->type, type) == 0) {
+            return scope;
+        }
+    }
+
+    if (diff->scope_count == diff->scope_cap) {
+        size_t cap = diff->scope_cap ? diff->scope_cap * 2 : 4;
+        rift_diff_scope_t *scopes = (rift_diff_scope_t*)realloc(diff->scopes, cap * sizeof(rift_diff_scope_t));
+        if (!scopes) return NULL;
+        diff->scopes = scopes;
+        diff->scope_cap = cap;
+    }
+    char *copy = strdup(type);
+    if (!copy) return NULL;
+    rift_diff_scope_t *scope = &diff->scopes[diff->scope_count++];
+    memset(scope, 0, sizeof(rift_diff_scope_t));
+    rift_idmap_init(&scope->slots, sizeof(rift_diff_slot_t));
+    scope->type = copy;
+    scope->has_space = has_space;
+    scope->space_id = space_id;
+    return scope;
+}
+
+static bool rift_diff_reserve_stale(rift_diff_t *diff, size_t count) {
+    if (count <= diff->stale_cap) return true;
+    int64_t *stale = (int64_t*)realloc(diff->stale, count * sizeof(int64_t));
+    if (!stale) return false;
+    diff->stale = stale;
+    diff->stale_cap = count;
+    return true;
+}
+
+bool rift_diff_push(lua_State *L, rift_diff_t *diff, const char *type, const rift_tape_t *tape) {
+    const char *field = rift_diff_list_field(type);
+    size_t list = 0;
+    if (!field || !rift_tape_object_get(tape, 0, field, &list) || rift_tape_tag(tape, list) != RIFT_TAPE_ARRAY) {
+        return false;
+    }
+
+    int64_t space_id = 0;
+    bool has_space = rift_diff_tape_id(tape, 0, "space_id", &space_id);
+    rift_diff_scope_t *scope = rift_diff_get_scope(diff, type, has_space, space_id);
+    if (!scope) return false;
+    uint64_t stamp = ++diff->stamp;
+
+    lua_createtable(L, 0, 4);
+    lua_newtable(L);
+    int added = lua_gettop(L);
+    lua_newtable(L);
+    int changed = lua_gettop(L);
+    lua_Integer added_count = 0;
+    lua_Integer changed_count = 0;
+
+    uint32_t count = rift_tape_count(tape, list);
+    size_t pos = rift_tape_first(tape, list);
+    for (uint32_t i = 0; i < count && pos < tape->len; ++i) {
+        size_t end = rift_tape_skip(tape, pos);
+        int64_t id = 0;
+        bool fresh = false;
+        rift_diff_slot_t *slot = NULL;
+        // Records without an id can't be tracked; they always count as added.
+        if (rift_diff_tape_id(tape, pos, "id", &id)) slot = (rift_diff_slot_t*)rift_idmap_put(&scope->slots, id, &fresh);
+        if (!slot) {
+            rift_tape_value_to_lua(L, tape, pos);
+            lua_rawseti(L, added, ++added_count);
+            pos = end;
+            continue;
+        }
+
+        uint64_t hash = rift_hash64(tape->data + pos, end - pos);
+        if (fresh) {
+            slot->hash = hash;
+            rift_tape_value_to_lua(L, tape, pos);
+            lua_rawseti(L, added, ++added_count);
+        } else if (slot->hash != hash && slot->stamp != stamp) {
+            slot->hash = hash;
+            rift_tape_value_to_lua(L, tape, pos);
+            lua_rawseti(L, changed, ++changed_count);
+        }
+        slot->stamp = stamp;
+        pos = end;
+    }
+    lua_setfield(L, -3, "changed");
+    lua_setfield(L, -2, "added");
+
+    // Everything the event didn't list is gone.
+    lua_newtable(L);
+    lua_Integer removed_count = 0;
+    size_t stale = 0;
+    if (scope->slots.count && rift_diff_reserve_stale(diff, scope->slots.count)) {
+        for (size_t i = 0; i < scope->slots.cap; ++i) {
+            const rift_diff_slot_t *slot = (const rift_diff_slot_t*)rift_idmap_at(&scope->slots, i);
+            if (!slot->key.used || slot->stamp == stamp) continue;
+            diff->stale[stale++] = slot->key.id;
+        }
+    }
+    for (size_t i = 0; i < stale; ++i) {
+        rift_idmap_remove(&scope->slots, rift_idmap_find(&scope->slots, diff->stale[i]));
+        lua_pushinteger(L, (lua_Integer)diff->stale[i]);
+        lua_rawseti(L, -2, ++removed_count);
+    }
+    lua_setfield(L, -2, "removed");
+
+    if (has_space) {
+        lua_pushinteger(L, (lua_Integer)space_id);
+        lua_setfield(L, -2, "space_id");
+    }
+    return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <lua.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "idmap.h"
+#include "tape.h"
+
+// Last list seen by a {diff = true} subscription, per event type and space:
+// record id -> hash of the record's tape bytes. Tapes are pointer-free, so
+// equal records have equal bytes and one hash decides "changed".
+typedef struct {
+    rift_idmap_key_t key;
+    uint64_t hash;
+    uint64_t stamp;
+} rift_diff_slot_t;
+
+typedef struct {
+    char *type;
+    bool has_space;
+    int64_t space_id;
+    // rift_diff_slot_t by record id.
+    rift_idmap_t slots;
+} rift_diff_scope_t;
+
+typedef struct {
+    rift_diff_scope_t *scopes;
+    size_t scope_count;
+    size_t scope_cap;
+    // Ids dropped by the current event, collected before they are removed.
+    int64_t *stale;
+    size_t stale_cap;
+    uint64_t stamp;
+} rift_diff_t;
+
+rift_diff_t* rift_diff_create(void);
+void rift_diff_free(rift_diff_t *diff);
+
+// The list member that events of `type` carry, or NULL when the type is not
+// delivered as a diff.
+const char* rift_diff_list_field(const char *type);
+
+// Compares the list in the event at the tape's root with the previous one of
+// the same type and space, remembers the new one and pushes
+// {added = {...}, changed = {...}, removed = {ids}} (plus space_id when the
+// event has one). Only added and changed records are built as Lua tables.
+// Returns false, pushing nothing, when the event has no such list.
+bool rift_diff_push(lua_State *L, rift_diff_t *diff, const char *type, const rift_tape_t *tape);
@@ -0,0 +1,183 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clock.h"
+
+// Event log layout: the 8-byte magic, then one record per received event:
+//   u64 monotonic timestamp (ns, little-endian)
+//   u32 payload length (little-endian)
+//   payload bytes (raw event JSON, no terminator)
+// Appending to an existing log starts a new session; replay treats a
+// timestamp that goes backwards as "no delay".
+#define RIFT_EVENTLOG_MAGIC "RIFTLOG1"
+#define RIFT_EVENTLOG_MAGIC_LEN 8
+#define RIFT_EVENTLOG_HEADER_LEN 12
+
+typedef enum {
+    RIFT_REPLAY_RECORD,
+    RIFT_REPLAY_WAIT,
+    RIFT_REPLAY_END,
+    RIFT_REPLAY_ERROR
+} rift_replay_status_t;
+
+typedef struct {
+    FILE *file;
+    bool realtime;
+    bool started;
+    bool ended;
+    uint64_t last_record_ns;
+    uint64_t due_ns;
+    char *pending;
+    size_t pending_len;
+} rift_replay_t;
+
+static inline void rift_eventlog_put_u32(unsigned char *out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) out[i] = (unsigned char)(v >> (8 * i));
+}
+
+static inline void rift_eventlog_put_u64(unsigned char *out, uint64_t v) {
+    for (int i = 0; i < 8; ++i) out[i] = (unsigned char)(v >> (8 * i));
+}
+
+static inline uint32_t rift_eventlog_get_u32(const unsigned char *in) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) v |= (uint32_t)in[i] << (8 * i);
+    return v;
+}
+
+static inline uint64_t rift_eventlog_get_u64(const unsigned char *in) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) v |= (uint64_t)in[i] << (8 * i);
+    return v;
+}
+
+static FILE* rift_recorder_open(const char *path) {
+    FILE *file = fopen(path, "ab");
+    if (!file) return NULL;
+
+    fseek(file, 0, SEEK_END);
+    if (ftell(file) == 0 && fwrite(RIFT_EVENTLOG_MAGIC, 1, RIFT_EVENTLOG_MAGIC_LEN, file) != RIFT_EVENTLOG_MAGIC_LEN) {
+        fclose(file);
+        return NULL;
+    }
+    return file;
+}
+
+static bool rift_recorder_write(FILE *file, uint64_t timestamp_ns, const char *data, size_t len) {
+    if (!file || !data || len > UINT32_MAX) return false;
+
+    unsigned char header[RIFT_EVENTLOG_HEADER_LEN];
+    rift_eventlog_put_u64(header, timestamp_ns);
+    rift_eventlog_put_u32(header + 8, (uint32_t)len);
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) return false;
+    return fwrite(data, 1, len, file) == len;
+}
+
+static void rift_replay_close(rift_replay_t *replay) {
+    if (!replay) return;
+    if (replay->file) fclose(replay->file);
+    free(replay->pending);
+    free(replay);
+}
+
+static rift_replay_t* rift_replay_open(const char *path, bool realtime, const char **err) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        *err = "Failed to open event log.";
+        return NULL;
+    }
+
+    char magic[RIFT_EVENTLOG_MAGIC_LEN];
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+        memcmp(magic, RIFT_EVENTLOG_MAGIC, RIFT_EVENTLOG_MAGIC_LEN) != 0) {
+        fclose(file);
+        *err = "Not a rift event log.";
+        return NULL;
+    }
+
+    rift_replay_t *replay = (rift_replay_t*)calloc(1, sizeof(rift_replay_t));
+    if (!replay) {
+        fclose(file);
+        *err = "Failed to allocate replay state.";
+        return NULL;
+    }
+    replay->file = file;
+    replay->realtime = realtime;
+    return replay;
+}
+
+static rift_replay_status_t rift_replay_read_pending(rift_replay_t *replay) {
+    unsigned char header[RIFT_EVENTLOG_HEADER_LEN];
+    size_t got = fread(header, 1, sizeof(header), replay->file);
+    if (got == 0 && feof(replay->file)) {
+        replay->ended = true;
+        return RIFT_REPLAY_END;
+    }
+    if (got != sizeof(header)) return RIFT_REPLAY_ERROR;
+
+    uint64_t record_ns = rift_eventlog_get_u64(header);
+    uint32_t len = rift_eventlog_get_u32(header + 8);
+
+    char *payload = (char*)malloc((size_t)len + 1);
+    if (!payload) return RIFT_REPLAY_ERROR;
+    if (fread(payload, 1, len, replay->file) != len) {
+        free(payload);
+        return RIFT_REPLAY_ERROR;
+    }
+    payload[len] = '\0';
+
+    // Records are scheduled relative to the previous one's due time rather than
+    // "now", so slow dispatch doesn't accumulate drift.
+    uint64_t now = rift_now_ns();
+    if (!replay->started) {
+        replay->due_ns = now;
+        replay->started = true;
+    } else if (record_ns > replay->last_record_ns) {
+        replay->due_ns += record_ns - replay->last_record_ns;
+    }
+    replay->last_record_ns = record_ns;
+
+    replay->pending = payload;
+    replay->pending_len = len;
+    return RIFT_REPLAY_RECORD;
+}
+
+// Monotonic time at which the next record is due; false once the log is done.
+static bool rift_replay_due_ns(rift_replay_t *replay, uint64_t *due_ns) {
+    if (replay->ended) return false;
+    if (!replay->pending && rift_replay_read_pending(replay) != RIFT_REPLAY_RECORD) return false;
+    *due_ns = replay->realtime ? replay->due_ns : 0;
+    return true;
+}
+
+// Returns the next payload in `out` (caller frees) when it is due. In realtime
+// mode this waits up to `timeout_ms` for it (forever if negative).
+static rift_replay_status_t rift_replay_next(rift_replay_t *replay, int timeout_ms, char **out, size_t *out_len) {
+    *out = NULL;
+    if (!replay->pending) {
+        rift_replay_status_t status = rift_replay_read_pending(replay);
+        if (status != RIFT_REPLAY_RECORD) return status;
+    }
+
+    if (replay->realtime) {
+        uint64_t now = rift_now_ns();
+        if (replay->due_ns > now) {
+            uint64_t wait_ns = replay->due_ns - now;
+            if (timeout_ms >= 0 && wait_ns > (uint64_t)timeout_ms * 1000000ull) {
+                if (timeout_ms > 0) rift_sleep_ns((uint64_t)timeout_ms * 1000000ull);
+                return RIFT_REPLAY_WAIT;
+            }
+            rift_sleep_ns(wait_ns);
+        }
+    }
+
+    *out = replay->pending;
+    if (out_len) *out_len = replay->pending_len;
+    replay->pending = NULL;
+    replay->pending_len = 0;
+    return RIFT_REPLAY_RECORD;
+}
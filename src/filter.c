@@ -0,0 +1,243 @@
+#include "filter.h"
+#include "number.h"
+#include <stdlib.h>
+#include <string.h>
+
+static void rift_filter_free(rift_filter_t *filter) {
+    for (int i = 0; i < filter->clause_count; ++i) {
+        rift_filter_clause_t *clause = &filter->clauses[i];
+        for (int j = 0; j < clause->segment_count; ++j) free(clause->segments[j]);
+        for (int j = 0; j < clause->value_count; ++j) free(clause->values[j].string);
+        free(clause->segments);
+        free(clause->values);
+    }
+    free(filter->clauses);
+    filter->clauses = NULL;
+    filter->clause_count = 0;
+}
+
+static int rift_filter_gc(lua_State *L) {
+    rift_filter_t *filter = (rift_filter_t*)luaL_checkudata(L, 1, RIFT_FILTER_METATABLE);
+    rift_filter_free(filter);
+    return 0;
+}
+
+static char* rift_filter_strndup(lua_State *L, const char *s, size_t len) {
+    char *out = (char*)malloc(len + 1);
+    if (!out) luaL_error(L, "where: out of memory");
+    memcpy(out, s, len);
+    out[len] = '\0';
+    return out;
+}
+
+static rift_filter_clause_t* rift_filter_add_clause(lua_State *L, rift_filter_t *filter, const char *path) {
+    rift_filter_clause_t *clauses = (rift_filter_clause_t*)realloc(
+        filter->clauses,
+        sizeof(rift_filter_clause_t) * (size_t)(filter->clause_count + 1)
+    );
+    if (!clauses) luaL_error(L, "where: out of memory");
+    filter->clauses = clauses;
+
+    rift_filter_clause_t *clause = &clauses[filter->clause_count++];
+    memset(clause, 0, sizeof(rift_filter_clause_t));
+
+    int segment_count = 1;
+    for (const char *p = path; *p; ++p) {
+        if (*p == '.') segment_count++;
+    }
+    clause->segments = (char**)calloc((size_t)segment_count, sizeof(char*));
+    if (!clause->segments) luaL_error(L, "where: out of memory");
+
+    const char *start = path;
+    while (1) {
+        const char *end = strchr(start, '.');
+        size_t len = end ? (size_t)(end - start) : strlen(start);
+        if (len == 0) luaL_error(L, "where: empty segment in field '%s'", path);
+        clause->segments[clause->segment_count++] = rift_filter_strndup(L, start, len);
+        if (!end) break;
+        start = end + 1;
+    }
+
+    return clause;
+}
+
+static void rift_filter_add_value(lua_State *L, rift_filter_clause_t *clause, int index, const char *path) {
+    rift_filter_value_t *values = (rift_filter_value_t*)realloc(
+        clause->values,
+        sizeof(rift_filter_value_t) * (size_t)(clause->value_count + 1)
+    );
+    if (!values) luaL_error(L, "where: out of memory");
+    clause->values = values;
+
+    rift_filter_value_t *value = &values[clause->value_count];
+    memset(value, 0, sizeof(rift_filter_value_t));
+
+    switch (lua_type(L, index)) {
+        case LUA_TNUMBER:
+            value->kind = RIFT_FILTER_NUMBER;
+            value->number = (double)lua_tonumber(L, index);
+            value->is_integer = lua_isinteger(L, index);
+            if (value->is_integer) value->integer = lua_tointeger(L, index);
+            break;
+        case LUA_TSTRING: {
+            size_t len = 0;
+            const char *s = lua_tolstring(L, index, &len);
+            value->kind = RIFT_FILTER_STRING;
+            value->string = rift_filter_strndup(L, s, len);
+            break;
+        }
+        case LUA_TBOOLEAN:
+            value->kind = RIFT_FILTER_BOOLEAN;
+            value->boolean = lua_toboolean(L, index);
+            break;
+        default:
+            luaL_error(L, "where: unsupported %s value for field '%s'", luaL_typename(L, index), path);
+            return;
+    }
+
+    clause->value_count++;
+}
+
+static void rift_filter_compile_table(lua_State *L, rift_filter_t *filter, int index, const char *prefix) {
+    lua_pushnil(L);
+    while (lua_next(L, index) != 0) {
+        if (lua_type(L, -2) != LUA_TSTRING) {
+            luaL_error(L, "where: field names must be strings");
+        }
+
+        const char *key = lua_tostring(L, -2);
+        if (prefix) lua_pushfstring(L, "%s.%s", prefix, key);
+        else lua_pushstring(L, key);
+        const char *path = lua_tostring(L, -1);
+
+        if (lua_istable(L, -2)) {
+            lua_Integer count = (lua_Integer)lua_rawlen(L, -2);
+            if (count > 0) {
+                // Array values are set membership: `space_id = {1, 2}`.
+                rift_filter_clause_t *clause = rift_filter_add_clause(L, filter, path);
+                for (lua_Integer i = 1; i <= count; ++i) {
+                    lua_rawgeti(L, -2, i);
+                    rift_filter_add_value(L, clause, lua_gettop(L), path);
+                    lua_pop(L, 1);
+                }
+            } else {
+                // An empty list would match nothing; reject it rather than
+                // silently dropping the predicate.
+                lua_pushnil(L);
+                if (lua_next(L, -3) == 0) luaL_error(L, "where: empty value list for '%s'", path);
+                lua_pop(L, 2);
+                // Map values nest: `workspace = {id = 3}` is `["workspace.id"] = 3`.
+                rift_filter_compile_table(L, filter, lua_gettop(L) - 1, path);
+            }
+        } else {
+            rift_filter_clause_t *clause = rift_filter_add_clause(L, filter, path);
+            rift_filter_add_value(L, clause, lua_gettop(L) - 1, path);
+        }
+
+        lua_pop(L, 2);
+    }
+}
+
+rift_filter_t* rift_filter_push(lua_State *L, int index) {
+    index = lua_absindex(L, index);
+    luaL_checktype(L, index, LUA_TTABLE);
+
+    rift_filter_t *filter = (rift_filter_t*)lua_newuserdata(L, sizeof(rift_filter_t));
+    memset(filter, 0, sizeof(rift_filter_t));
+    if (luaL_newmetatable(L, RIFT_FILTER_METATABLE)) {
+        lua_pushcfunction(L, rift_filter_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+    lua_setmetatable(L, -2);
+
+    rift_filter_compile_table(L, filter, index, NULL);
+    return filter;
+}
+
+static const cJSON* rift_filter_lookup(const cJSON *root, const rift_filter_clause_t *clause) {
+    const cJSON *node = root;
+    for (int i = 0; i < clause->segment_count; ++i) {
+        if (!cJSON_IsObject(node)) return NULL;
+        node = cJSON_GetObjectItemCaseSensitive(node, clause->segments[i]);
+        if (!node) return NULL;
+    }
+    return node;
+}
+
+static bool rift_filter_value_matches(const rift_filter_value_t *value, const cJSON *node) {
+    switch (value->kind) {
+        case RIFT_FILTER_NUMBER: {
+            if (!cJSON_IsNumber(node)) return false;
+            if (!value->is_integer) return node->valuedouble == value->number;
+            int64_t v = 0;
+            return rift_number_integer(node, &v) && v == (int64_t)value->integer;
+        }
+        case RIFT_FILTER_STRING:
+            return cJSON_IsString(node) && node->valuestring && strcmp(node->valuestring, value->string) == 0;
+        case RIFT_FILTER_BOOLEAN:
+            return cJSON_IsBool(node) && (cJSON_IsTrue(node) != 0) == value->boolean;
+    }
+    return false;
+}
+
+bool rift_filter_match(const rift_filter_t *filter, const cJSON *root) {
+    if (!filter) return true;
+
+    for (int i = 0; i < filter->clause_count; ++i) {
+        const rift_filter_clause_t *clause = &filter->clauses[i];
+        const cJSON *node = rift_filter_lookup(root, clause);
+        if (!node) return false;
+
+        bool matched = false;
+        for (int j = 0; j < clause->value_count && !matched; ++j) {
+            matched = rift_filter_value_matches(&clause->values[j], node);
+        }
+        if (!matched) return false;
+    }
+
+    return true;
+}
+
+static bool rift_filter_tape_value_matches(const rift_filter_value_t *value, const rift_tape_t *tape, size_t pos) {
+    rift_tape_tag_t tag = rift_tape_tag(tape, pos);
+    switch (value->kind) {
+        case RIFT_FILTER_NUMBER: {
+            if (tag != RIFT_TAPE_INTEGER && tag != RIFT_TAPE_NUMBER) return false;
+            if (!value->is_integer) return rift_tape_number(tape, pos) == value->number;
+            int64_t v = 0;
+            if (tag == RIFT_TAPE_INTEGER) v = rift_tape_integer(tape, pos);
+            else if (!rift_number_integral(rift_tape_number(tape, pos), &v)) return false;
+            return v == (int64_t)value->integer;
+        }
+        case RIFT_FILTER_STRING: {
+            size_t len = 0;
+            const char *s = rift_tape_string(tape, pos, &len);
+            return s && len == strlen(value->string) && memcmp(s, value->string, len) == 0;
+        }
+        case RIFT_FILTER_BOOLEAN:
+            return (tag == RIFT_TAPE_TRUE || tag == RIFT_TAPE_FALSE) && (tag == RIFT_TAPE_TRUE) == value->boolean;
+    }
+    return false;
+}
+
+bool rift_filter_match_tape(const rift_filter_t *filter, const rift_tape_t *tape) {
+    if (!filter) return true;
+
+    for (int i = 0; i < filter->clause_count; ++i) {
+        const rift_filter_clause_t *clause = &filter->clauses[i];
+        size_t pos = 0;
+        bool found = tape->len > 0;
+        for (int j = 0; j < clause->segment_count && found; ++j) {
+            found = rift_tape_object_get(tape, pos, clause->segments[j], &pos);
+        }
+        if (!found) return false;
+
+        bool matched = false;
+        for (int j = 0; j < clause->value_count && !matched; ++j) {
+            matched = rift_filter_tape_value_matches(&clause->values[j], tape, pos);
+        }
+        if (!matched) return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <lua.h>
+#include <lauxlib.h>
+#include <stdbool.h>
+#include "cJSON.h"
+#include "tape.h"
+
+#define RIFT_FILTER_METATABLE "rift.filter"
+
+typedef enum {
+    RIFT_FILTER_NUMBER,
+    RIFT_FILTER_STRING,
+    RIFT_FILTER_BOOLEAN
+} rift_filter_kind_t;
+
+typedef struct {
+    rift_filter_kind_t kind;
+    double number;
+    // Set for Lua integers, which are compared exactly: ids above 2^53 don't
+    // survive a round trip through double.
+    bool is_integer;
+    lua_Integer integer;
+    bool boolean;
+    char *string;
+} rift_filter_value_t;
+
+// One `path == value` (or `path in {values...}`) predicate. The dotted path is
+// split into segments once, at compile time.
+typedef struct {
+    char **segments;
+    int segment_count;
+    rift_filter_value_t *values;
+    int value_count;
+} rift_filter_clause_t;
+
+// All clauses must match for an event to be delivered.
+typedef struct {
+    rift_filter_clause_t *clauses;
+    int clause_count;
+} rift_filter_t;
+
+// Compiles the `where` table at `index` into a "rift.filter" userdata pushed on
+// top of the stack. Raises a Lua error on unsupported predicates.
+rift_filter_t* rift_filter_push(lua_State *L, int index);
+bool rift_filter_match(const rift_filter_t *filter, const cJSON *root);
+bool rift_filter_match_tape(const rift_filter_t *filter, const rift_tape_t *tape);
@@ -0,0 +1,123 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RIFT_IDMAP_MIN_CAPACITY 16
+
+// Open-addressing table from record ids to fixed-size entries, behind the
+// diff and mirror state. An entry is the caller's struct and starts with a
+// rift_idmap_key_t. Probing is linear and the table stays at most half full;
+// removal shifts the rest of the probe run back, so lookups never meet
+// tombstones.
+typedef struct {
+    int64_t id;
+    bool used;
+} rift_idmap_key_t;
+
+typedef struct {
+    unsigned char *entries;
+    size_t entry_size;
+    size_t cap;
+    size_t count;
+} rift_idmap_t;
+
+static inline void rift_idmap_init(rift_idmap_t *map, size_t entry_size) {
+    memset(map, 0, sizeof(rift_idmap_t));
+    map->entry_size = entry_size;
+}
+
+static inline void rift_idmap_free(rift_idmap_t *map) {
+    free(map->entries);
+    map->entries = NULL;
+    map->cap = 0;
+    map->count = 0;
+}
+
+// Empties the table and keeps its capacity.
+static inline void rift_idmap_clear(rift_idmap_t *map) {
+    if (map->cap) memset(map->entries, 0, map->cap * map->entry_size);
+    map->count = 0;
+}
+
+// The entry in `slot`, used or not; slots run from 0 to cap - 1.
+static inline void* rift_idmap_at(const rift_idmap_t *map, size_t slot) {
+    return map->entries + slot * map->entry_size;
+}
+
+static inline rift_idmap_key_t* rift_idmap_key(const rift_idmap_t *map, size_t slot) {
+    return (rift_idmap_key_t*)rift_idmap_at(map, slot);
+}
+
+static inline size_t rift_idmap_home(int64_t id, size_t cap) {
+    uint64_t hash = (uint64_t)id * 0x9E3779B97F4A7C15ull;
+    return (size_t)(hash >> 32) & (cap - 1);
+}
+
+// The slot holding `id`, or the empty one where it would go. Needs cap > 0.
+static inline size_t rift_idmap_slot(const rift_idmap_t *map, int64_t id) {
+    size_t mask = map->cap - 1;
+    size_t slot = rift_idmap_home(id, map->cap);
+    while (rift_idmap_key(map, slot)->used && rift_idmap_key(map, slot)->id != id) slot = (slot + 1) & mask;
+    return slot;
+}
+
+static inline void* rift_idmap_find(const rift_idmap_t *map, int64_t id) {
+    if (!map->cap) return NULL;
+    size_t slot = rift_idmap_slot(map, id);
+    return rift_idmap_key(map, slot)->used ? rift_idmap_at(map, slot) : NULL;
+}
+
+// Makes room for one more entry; false when out of memory.
+static inline bool rift_idmap_reserve(rift_idmap_t *map) {
+    if ((map->count + 1) * 2 <= map->cap) return true;
+
+    size_t cap = map->cap ? map->cap * 2 : RIFT_IDMAP_MIN_CAPACITY;
+    unsigned char *entries = (unsigned char*)calloc(cap, map->entry_size);
+    if (!entries) return false;
+
+    rift_idmap_t old = *map;
+    map->entries = entries;
+    map->cap = cap;
+    for (size_t i = 0; i < old.cap; ++i) {
+        if (!rift_idmap_key(&old, i)->used) continue;
+        memcpy(rift_idmap_at(map, rift_idmap_slot(map, rift_idmap_key(&old, i)->id)), rift_idmap_at(&old, i), map->entry_size);
+    }
+    free(old.entries);
+    return true;
+}
+
+// The entry for `id`. A new one is zeroed apart from its key, and `*added`
+// tells which it was. NULL when out of memory.
+static inline void* rift_idmap_put(rift_idmap_t *map, int64_t id, bool *added) {
+    *added = false;
+    if (!rift_idmap_reserve(map)) return NULL;
+    size_t slot = rift_idmap_slot(map, id);
+    rift_idmap_key_t *key = rift_idmap_key(map, slot);
+    if (!key->used) {
+        key->id = id;
+        key->used = true;
+        map->count++;
+        *added = true;
+    }
+    return key;
+}
+
+// Removes `entry`, a pointer returned by find or put. Entries after it in
+// its probe run may move.
+static inline void rift_idmap_remove(rift_idmap_t *map, void *entry) {
+    size_t mask = map->cap - 1;
+    size_t hole = (size_t)((unsigned char*)entry - map->entries) / map->entry_size;
+    memset(entry, 0, map->entry_size);
+    map->count--;
+
+    for (size_t slot = (hole + 1) & mask; rift_idmap_key(map, slot)->used; slot = (slot + 1) & mask) {
+        size_t home = rift_idmap_home(rift_idmap_key(map, slot)->id, map->cap);
+        if (((slot - home) & mask) < ((slot - hole) & mask)) continue;
+        memcpy(rift_idmap_at(map, hole), rift_idmap_at(map, slot), map->entry_size);
+        memset(rift_idmap_at(map, slot), 0, map->entry_size);
+        hole = slot;
+    }
+}
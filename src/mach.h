@@ -1,5 +1,9 @@
 #include <mach/mach.h>
+#include <mach/notify.h>
 #include <bootstrap.h>
+#include <sys/event.h>
+#include <unistd.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
@@ -9,11 +13,6 @@
 #define MAX_MSG_SIZE (64 * 1024)
 #define RIFT_EVENT_PORT_QLIMIT MACH_PORT_QLIMIT_LARGE
 
-typedef struct {
-    mach_port_t server_port;
-    mach_port_t event_port;
-} rift_t;
-
 static bool rift_set_port_queue_limit_internal(mach_port_t port, mach_port_msgcount_t qlimit) {
     if (port == MACH_PORT_NULL) {
         return false;
@@ -37,6 +36,24 @@ static bool rift_set_port_queue_limit_internal(mach_port_t port, mach_port_msgco
     return true;
 }
 
+// Messages queued on `port` and its queue limit.
+static bool rift_port_backlog_internal(mach_port_t port, size_t *count, size_t *qlimit) {
+    if (port == MACH_PORT_NULL) return false;
+    mach_port_status_t status;
+    mach_msg_type_number_t status_count = MACH_PORT_RECEIVE_STATUS_COUNT;
+    kern_return_t kr = mach_port_get_attributes(
+        mach_task_self(),
+        port,
+        MACH_PORT_RECEIVE_STATUS,
+        (mach_port_info_t)&status,
+        &status_count
+    );
+    if (kr != KERN_SUCCESS) return false;
+    *count = status.mps_msgcount;
+    *qlimit = status.mps_qlimit;
+    return true;
+}
+
 static mach_port_t rift_connect_internal() {
     mach_port_t bootstrap_port;
     kern_return_t kr;
@@ -242,13 +259,39 @@ static char* rift_send_request_with_reply_port_internal(
     return result;
 }
 
+// Asks the kernel to send a MACH_NOTIFY_DEAD_NAME to `notify_port` when the
+// server's receive right goes away, i.e. when Rift exits.
+static bool rift_request_dead_name_internal(mach_port_t server_port, mach_port_t notify_port) {
+    if (server_port == MACH_PORT_NULL || notify_port == MACH_PORT_NULL) return false;
+    mach_port_t previous = MACH_PORT_NULL;
+    kern_return_t kr = mach_port_request_notification(
+        mach_task_self(),
+        server_port,
+        MACH_NOTIFY_DEAD_NAME,
+        0,
+        notify_port,
+        MACH_MSG_TYPE_MAKE_SEND_ONCE,
+        &previous
+    );
+    if (kr != KERN_SUCCESS) {
+        fprintf(stderr, "mach_port_request_notification failed: %s\n", mach_error_string(kr));
+        return false;
+    }
+    if (previous != MACH_PORT_NULL) mach_port_deallocate(mach_task_self(), previous);
+    return true;
+}
+
+// `server_dead` is set, and NULL returned, when the message is the dead-name
+// notification for the server port instead of an event.
 static char* rift_receive_event_internal_with_options(
     mach_port_t reply_port,
     mach_msg_timeout_t timeout_ms,
     bool use_timeout,
-    bool* timed_out
+    bool* timed_out,
+    bool* server_dead
 ) {
     if (timed_out) *timed_out = false;
+    if (server_dead) *server_dead = false;
 
     if (reply_port == MACH_PORT_NULL) {
         return NULL;
@@ -281,6 +324,14 @@ static char* rift_receive_event_internal_with_options(
         return NULL;
     }
 
+    if (event_msg->msgh_id == MACH_NOTIFY_DEAD_NAME) {
+        // The notification carries a reference to the dead name; drop it.
+        mach_dead_name_notification_t* notification = (mach_dead_name_notification_t*)event_msg;
+        mach_port_deallocate(mach_task_self(), notification->not_port);
+        if (server_dead) *server_dead = true;
+        return NULL;
+    }
+
     char* event_json_ptr = (char*)event_msg + sizeof(mach_msg_header_t);
     size_t event_len = event_msg->msgh_size - sizeof(mach_msg_header_t);
     char* result = (char*)malloc(event_len + 1);
@@ -292,12 +343,49 @@ static char* rift_receive_event_internal_with_options(
     return result;
 }
 
-static char* rift_receive_event_internal(mach_port_t reply_port, mach_msg_timeout_t timeout_ms, bool* timed_out) {
-    return rift_receive_event_internal_with_options(reply_port, timeout_ms, timeout_ms > 0, timed_out);
+// Mach ports aren't file descriptors, so event readiness is exposed as a
+// kqueue watching a port set that contains the event port. The kqueue fd is
+// itself pollable and can be nested in another kqueue.
+static int rift_event_kqueue_internal(mach_port_t event_port, mach_port_t *port_set) {
+    *port_set = MACH_PORT_NULL;
+    kern_return_t kr = mach_port_allocate(mach_task_self(), MACH_PORT_RIGHT_PORT_SET, port_set);
+    if (kr != KERN_SUCCESS) {
+        fprintf(stderr, "mach_port_allocate port set failed: %s\n", mach_error_string(kr));
+        return -1;
+    }
+
+    kr = mach_port_insert_member(mach_task_self(), event_port, *port_set);
+    if (kr != KERN_SUCCESS) {
+        fprintf(stderr, "mach_port_insert_member failed: %s\n", mach_error_string(kr));
+        mach_port_mod_refs(mach_task_self(), *port_set, MACH_PORT_RIGHT_PORT_SET, -1);
+        *port_set = MACH_PORT_NULL;
+        return -1;
+    }
+
+    int kq = kqueue();
+    if (kq < 0) {
+        mach_port_mod_refs(mach_task_self(), *port_set, MACH_PORT_RIGHT_PORT_SET, -1);
+        *port_set = MACH_PORT_NULL;
+        return -1;
+    }
+
+    struct kevent change;
+    EV_SET(&change, *port_set, EVFILT_MACHPORT, EV_ADD | EV_ENABLE, 0, 0, NULL);
+    if (kevent(kq, &change, 1, NULL, 0, NULL) != 0) {
+        close(kq);
+        mach_port_mod_refs(mach_task_self(), *port_set, MACH_PORT_RIGHT_PORT_SET, -1);
+        *port_set = MACH_PORT_NULL;
+        return -1;
+    }
+
+    return kq;
 }
 
-static char* rift_try_receive_event_internal(mach_port_t reply_port, mach_msg_timeout_t timeout_ms, bool* timed_out) {
-    return rift_receive_event_internal_with_options(reply_port, timeout_ms, true, timed_out);
+static void rift_close_event_kqueue_internal(int kq, mach_port_t port_set) {
+    if (kq >= 0) close(kq);
+    if (port_set != MACH_PORT_NULL) {
+        mach_port_mod_refs(mach_task_self(), port_set, MACH_PORT_RIGHT_PORT_SET, -1);
+    }
 }
 
 static void rift_disconnect_internal(mach_port_t server_port) {
@@ -0,0 +1,275 @@
+#include "mirror.h"
+#include "number.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool rift_mirror_number(const cJSON *object, const char *key, int64_t *out) {
+    const cJSON *item = cJSON_GetObjectItemCaseSensitive(object, key);
+    return cJSON_IsNumber(item) && rift_number_integer(item, out);
+}
+
+static rift_mirror_window_t* rift_mirror_find(const rift_mirror_t *mirror, int64_t id) {
+    return (rift_mirror_window_t*)rift_idmap_find(&mirror->windows, id);
+}
+
+static rift_mirror_space_t* rift_mirror_get_space(rift_mirror_t *mirror, int64_t id, bool create) {
+    for (size_t i = 0; i < mirror->space_count; ++i) {
+        if (mirror->spaces[i].id == id) return &mirror->spaces[i];
+    }
+    if (!create) return NULL;
+
+    if (mirror->space_count == mirror->space_cap) {
+        size_t cap = mirror->space_cap ? mirror->space_cap * 2 : 8;
+        rift_mirror_space_t *spaces = (rift_mirror_space_t*)realloc(mirror->spaces, cap * sizeof(rift_mirror_space_t));
+        if (!spaces) return NULL;
+        mirror->spaces = spaces;
+        mirror->space_cap = cap;
+    }
+    rift_mirror_space_t *space = &mirror->spaces[mirror->space_count++];
+    memset(space, 0, sizeof(rift_mirror_space_t));
+    space->id = id;
+    return space;
+}
+
+static void rift_mirror_space_remove(rift_mirror_space_t *space, int64_t id) {
+    for (size_t i = 0; i < space->window_count; ++i) {
+        if (space->window_ids[i] != id) continue;
+        memmove(&space->window_ids[i], &space->window_ids[i + 1], (space->window_count - i - 1) * sizeof(int64_t));
+        space->window_count--;
+        return;
+    }
+}
+
+static void rift_mirror_space_add(rift_mirror_space_t *space, int64_t id) {
+    for (size_t i = 0; i < space->window_count; ++i) {
+        if (space->window_ids[i] == id) return;
+    }
+    if (space->window_count == space->window_cap) {
+        size_t cap = space->window_cap ? space->window_cap * 2 : 16;
+        int64_t *ids = (int64_t*)realloc(space->window_ids, cap * sizeof(int64_t));
+        if (!ids) return;
+        space->window_ids = ids;
+        space->window_cap = cap;
+    }
+    space->window_ids[space->window_count++] = id;
+}
+
+static void rift_mirror_unlink(rift_mirror_t *mirror, const rift_mirror_window_t *window) {
+    if (!window->has_space) return;
+    rift_mirror_space_t *space = rift_mirror_get_space(mirror, window->space_id, false);
+    if (space) rift_mirror_space_remove(space, window->key.id);
+}
+
+static void rift_mirror_delete(rift_mirror_t *mirror, int64_t id) {
+    rift_mirror_window_t *window = rift_mirror_find(mirror, id);
+    if (!window) return;
+    rift_mirror_unlink(mirror, window);
+    cJSON_Delete(window->json);
+    rift_idmap_remove(&mirror->windows, window);
+}
+
+static rift_mirror_window_t* rift_mirror_put(rift_mirror_t *mirror, const cJSON *json, bool has_space, int64_t space_id) {
+    int64_t id = 0;
+    if (!rift_mirror_number(json, "id", &id)) return NULL;
+    cJSON *copy = cJSON_Duplicate(json, true);
+    bool added = false;
+    rift_mirror_window_t *window = copy ? (rift_mirror_window_t*)rift_idmap_put(&mirror->windows, id, &added) : NULL;
+    if (!window) {
+        cJSON_Delete(copy);
+        return NULL;
+    }
+
+    bool moved = true;
+    if (!added) {
+        moved = window->has_space != has_space || window->space_id != space_id;
+        if (moved) rift_mirror_unlink(mirror, window);
+        cJSON_Delete(window->json);
+    }
+    window->has_space = has_space;
+    window->space_id = space_id;
+    window->stamp = mirror->stamp;
+    window->json = copy;
+
+    if (moved && has_space) {
+        rift_mirror_space_t *space = rift_mirror_get_space(mirror, space_id, true);
+        if (space) rift_mirror_space_add(space, id);
+    }
+    return window;
+}
+
+static void rift_mirror_put_with_space(rift_mirror_t *mirror, const cJSON *json, bool has_space, int64_t space_id) {
+    int64_t own_space = 0;
+    if (rift_mirror_number(json, "space_id", &own_space)) {
+        has_space = true;
+        space_id = own_space;
+    }
+    rift_mirror_put(mirror, json, has_space, space_id);
+}
+
+rift_mirror_t* rift_mirror_create(void) {
+    rift_mirror_t *mirror = (rift_mirror_t*)calloc(1, sizeof(rift_mirror_t));
+    if (mirror) rift_idmap_init(&mirror->windows, sizeof(rift_mirror_window_t));
+    return mirror;
+}
+
+static void rift_mirror_clear_windows(rift_mirror_t *mirror) {
+    for (size_t i = 0; i < mirror->windows.cap; ++i) {
+        rift_mirror_window_t *window = (rift_mirror_window_t*)rift_idmap_at(&mirror->windows, i);
+        if (window->key.used) cJSON_Delete(window->json);
+    }
+    rift_idmap_clear(&mirror->windows);
+    for (size_t i = 0; i < mirror->space_count; ++i) mirror->spaces[i].window_count = 0;
+}
+
+void rift_mirror_free(rift_mirror_t *mirror) {
+    if (!mirror) return;
+    rift_mirror_clear_windows(mirror);
+    for (size_t i = 0; i < mirror->space_count; ++i) {
+        free(mirror->spaces[i].window_ids);
+        cJSON_Delete(mirror->spaces[i].workspace);
+        cJSON_Delete(mirror->spaces[i].stacks);
+    }
+    free(mirror->spaces);
+    rift_idmap_free(&mirror->windows);
+    free(mirror);
+}
+
+const cJSON* rift_mirror_snapshot_windows(const cJSON *response) {
+    if (cJSON_IsArray(response)) return response;
+    const cJSON *windows = cJSON_GetObjectItemCaseSensitive(response, "windows");
+    if (cJSON_IsArray(windows)) return windows;
+    windows = cJSON_GetObjectItemCaseSensitive(response, "data");
+    return cJSON_IsArray(windows) ? windows : NULL;
+}
+
+bool rift_mirror_load(rift_mirror_t *mirror, const cJSON *windows) {
+    if (!cJSON_IsArray(windows)) return false;
+    rift_mirror_clear_windows(mirror);
+    mirror->stamp++;
+    const cJSON *window;
+    cJSON_ArrayForEach(window, windows) rift_mirror_put_with_space(mirror, window, false, 0);
+    return true;
+}
+
+// A windows_changed event lists every window of its space: windows missing
+// from the list are gone, and the list order becomes the space order.
+static void rift_mirror_apply_windows(rift_mirror_t *mirror, const cJSON *event) {
+    const cJSON *windows = cJSON_GetObjectItemCaseSensitive(event, "windows");
+    if (!cJSON_IsArray(windows)) return;
+    int64_t space_id = 0;
+    if (!rift_mirror_number(event, "space_id", &space_id)) {
+        rift_mirror_load(mirror, windows);
+        return;
+    }
+
+    rift_mirror_space_t *space = rift_mirror_get_space(mirror, space_id, true);
+    if (!space) return;
+    int64_t *previous = space->window_ids;
+    size_t previous_count = space->window_count;
+    space->window_ids = NULL;
+    space->window_count = 0;
+    space->window_cap = 0;
+
+    mirror->stamp++;
+    const cJSON *window;
+    cJSON_ArrayForEach(window, windows) rift_mirror_put_with_space(mirror, window, true, space_id);
+
+    for (size_t i = 0; i < previous_count; ++i) {
+        rift_mirror_window_t *old = rift_mirror_find(mirror, previous[i]);
+        if (old && old->stamp != mirror->stamp && old->has_space && old->space_id == space_id) {
+            rift_mirror_delete(mirror, previous[i]);
+        }
+    }
+    free(previous);
+
+    space = rift_mirror_get_space(mirror, space_id, true);
+    if (!space) return;
+    space->window_count = 0;
+    cJSON_ArrayForEach(window, windows) {
+        int64_t id = 0;
+        if (!rift_mirror_number(window, "id", &id)) continue;
+        rift_mirror_window_t *current = rift_mirror_find(mirror, id);
+        if (current && current->has_space && current->space_id == space_id) rift_mirror_space_add(space, id);
+    }
+}
+
+static void rift_mirror_apply_title(rift_mirror_t *mirror, const cJSON *event) {
+    int64_t id = 0;
+    if (!rift_mirror_number(event, "window_id", &id) && !rift_mirror_number(event, "id", &id)) return;
+    const cJSON *title = cJSON_GetObjectItemCaseSensitive(event, "title");
+    rift_mirror_window_t *window = rift_mirror_find(mirror, id);
+    if (!window || !cJSON_IsString(title)) return;
+
+    cJSON *value = cJSON_CreateString(title->valuestring);
+    if (!value) return;
+    if (cJSON_HasObjectItem(window->json, "title")) cJSON_ReplaceItemInObjectCaseSensitive(window->json, "title", value);
+    else cJSON_AddItemToObject(window->json, "title", value);
+}
+
+static void rift_mirror_store(cJSON **slot, const cJSON *json) {
+    cJSON *copy = cJSON_Duplicate(json, true);
+    if (!copy) return;
+    cJSON_Delete(*slot);
+    *slot = copy;
+}
+
+void rift_mirror_apply(rift_mirror_t *mirror, const char *type, const cJSON *event) {
+    if (!type || !cJSON_IsObject(event)) return;
+    mirror->events++;
+
+    int64_t space_id = 0;
+    bool has_space = rift_mirror_number(event, "space_id", &space_id);
+    if (strcmp(type, "windows_changed") == 0) {
+        rift_mirror_apply_windows(mirror, event);
+    } else if (strcmp(type, "window_title_changed") == 0) {
+        rift_mirror_apply_title(mirror, event);
+    } else if (strcmp(type, "stacks_changed") == 0) {
+        const cJSON *stacks = cJSON_GetObjectItemCaseSensitive(event, "stacks");
+        rift_mirror_space_t *space = has_space ? rift_mirror_get_space(mirror, space_id, true) : NULL;
+        if (space && stacks) rift_mirror_store(&space->stacks, stacks);
+    } else if (strcmp(type, "workspace_changed") == 0) {
+        const cJSON *workspace = cJSON_GetObjectItemCaseSensitive(event, "workspace");
+        if (!cJSON_IsObject(workspace)) return;
+        if (rift_mirror_number(workspace, "id", &space_id)) has_space = true;
+        rift_mirror_space_t *space = has_space ? rift_mirror_get_space(mirror, space_id, true) : NULL;
+        if (space) rift_mirror_store(&space->workspace, workspace);
+    }
+}
+
+const rift_mirror_window_t* rift_mirror_window(const rift_mirror_t *mirror, int64_t id) {
+    return rift_mirror_find(mirror, id);
+}
+
+const rift_mirror_space_t* rift_mirror_space(const rift_mirror_t *mirror, int64_t id) {
+    return rift_mirror_get_space((rift_mirror_t*)mirror, id, false);
+}
+
+bool rift_mirror_matches(const rift_mirror_t *mirror, const cJSON *windows, char *out, size_t out_len) {
+    if (!cJSON_IsArray(windows)) {
+        snprintf(out, out_len, "the snapshot has no window list");
+        return false;
+    }
+
+    size_t count = 0;
+    const cJSON *window;
+    cJSON_ArrayForEach(window, windows) {
+        int64_t id = 0;
+        if (!rift_mirror_number(window, "id", &id)) continue;
+        count++;
+        const rift_mirror_window_t *mirrored = rift_mirror_find(mirror, id);
+        if (!mirrored) {
+            snprintf(out, out_len, "window %lld is missing from the mirror", (long long)id);
+            return false;
+        }
+        if (!cJSON_Compare(mirrored->json, window, true)) {
+            snprintf(out, out_len, "window %lld differs from the snapshot", (long long)id);
+            return false;
+        }
+    }
+    if (count != mirror->windows.count) {
+        snprintf(out, out_len, "the mirror has %zu windows, the snapshot %zu", mirror->windows.count, count);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cJSON.h"
+#include "idmap.h"
+
+// Window and workspace state behind client:mirror(), kept current by
+// applying events as they are dispatched. Windows are indexed by id in an
+// open-addressing table; each space keeps its window ids in event order.
+typedef struct {
+    rift_idmap_key_t key;
+    int64_t space_id;
+    bool has_space;
+    uint64_t stamp;
+    // Owned copy of the window object.
+    cJSON *json;
+} rift_mirror_window_t;
+
+typedef struct {
+    int64_t id;
+    int64_t *window_ids;
+    size_t window_count;
+    size_t window_cap;
+    cJSON *workspace;
+    cJSON *stacks;
+} rift_mirror_space_t;
+
+typedef struct {
+    // rift_mirror_window_t by window id.
+    rift_idmap_t windows;
+    rift_mirror_space_t *spaces;
+    size_t space_count;
+    size_t space_cap;
+    uint64_t stamp;
+    uint64_t events;
+} rift_mirror_t;
+
+rift_mirror_t* rift_mirror_create(void);
+void rift_mirror_free(rift_mirror_t *mirror);
+
+// The window list in a get_windows response: the response itself when it is
+// an array, otherwise its `windows` or `data` member. NULL if there is none.
+const cJSON* rift_mirror_snapshot_windows(const cJSON *response);
+
+// Replaces every window with the ones in `windows`; workspaces and stacks
+// are kept.
+bool rift_mirror_load(rift_mirror_t *mirror, const cJSON *windows);
+void rift_mirror_apply(rift_mirror_t *mirror, const char *type, const cJSON *event);
+
+const rift_mirror_window_t* rift_mirror_window(const rift_mirror_t *mirror, int64_t id);
+const rift_mirror_space_t* rift_mirror_space(const rift_mirror_t *mirror, int64_t id);
+
+// Compares the mirrored windows with a fresh window list. Returns true when
+// they match; otherwise describes the first difference in `out`.
+bool rift_mirror_matches(const rift_mirror_t *mirror, const cJSON *windows, char *out, size_t out_len);
@@ -0,0 +1,120 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cJSON.h"
+
+// JSON number scanner used by cJSON's parse_number. Numbers written as
+// integers that fit int64 are read exactly; the rest are decimals. A decimal
+// whose significant digits fit in 53 bits and whose power of ten is within
+// 10^±22 is one exact multiply or divide of two exact doubles, which rounds
+// correctly (Clinger's fast path). That covers the coordinates, sizes and
+// ratios Rift sends. Anything else is left to strtod. No locale is involved
+// on the fast paths.
+typedef struct {
+    bool integer;
+    int64_t i;
+    double d;
+    size_t len;
+} rift_number_t;
+
+#define RIFT_NUMBER_MAX_DIGITS 19
+#define RIFT_NUMBER_MAX_EXACT (1ull << 53)
+
+static const double rift_number_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static inline bool rift_number_digit(const unsigned char *p, size_t len, size_t i) {
+    return i < len && p[i] >= '0' && p[i] <= '9';
+}
+
+// Scans the number at `p` (`len` readable bytes). Returns false, with
+// nothing consumed, when the text needs strtod: more than 19 significant
+// digits, an exponent out of the fast range, or a form strtod reads
+// differently (like "1." or "1e").
+static inline bool rift_number_scan(const unsigned char *p, size_t len, rift_number_t *out) {
+    size_t i = 0;
+    bool negative = false;
+    if (i < len && p[i] == '-') {
+        negative = true;
+        i++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    size_t start = i;
+    for (; rift_number_digit(p, len, i); ++i) {
+        if (digits == RIFT_NUMBER_MAX_DIGITS) return false;
+        mantissa = mantissa * 10 + (uint64_t)(p[i] - '0');
+        if (mantissa) digits++;
+    }
+    if (i == start) return false;
+
+    bool integer = true;
+    if (i < len && p[i] == '.') {
+        start = ++i;
+        for (; rift_number_digit(p, len, i); ++i) {
+            if (digits == RIFT_NUMBER_MAX_DIGITS) return false;
+            mantissa = mantissa * 10 + (uint64_t)(p[i] - '0');
+            if (mantissa) digits++;
+            exponent--;
+        }
+        if (i == start) return false;
+        integer = false;
+    }
+
+    if (i < len && (p[i] == 'e' || p[i] == 'E')) {
+        size_t j = i + 1;
+        bool exponent_negative = false;
+        if (j < len && (p[j] == '+' || p[j] == '-')) exponent_negative = p[j++] == '-';
+        if (!rift_number_digit(p, len, j)) return false;
+        int value = 0;
+        for (; rift_number_digit(p, len, j); ++j) {
+            if (value < 10000) value = value * 10 + (p[j] - '0');
+        }
+        exponent += exponent_negative ? -value : value;
+        i = j;
+        integer = false;
+    }
+
+    if (integer) {
+        if (mantissa > (negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX)) return false;
+        out->integer = true;
+        out->i = negative ? (int64_t)(0 - mantissa) : (int64_t)mantissa;
+        out->d = (double)out->i;
+        out->len = i;
+        return true;
+    }
+
+    if (mantissa > RIFT_NUMBER_MAX_EXACT || exponent < -22 || exponent > 22) return false;
+    double d = (double)mantissa;
+    d = exponent < 0 ? d / rift_number_pow10[-exponent] : d * rift_number_pow10[exponent];
+    out->integer = false;
+    out->i = 0;
+    out->d = negative ? -d : d;
+    out->len = i;
+    return true;
+}
+
+// Integral decimals in int64 range (100.0 for a whole-pixel frame).
+static inline bool rift_number_integral(double d, int64_t *out) {
+    if (!(d >= -9223372036854775808.0 && d < 9223372036854775808.0)) return false;
+    int64_t v = (int64_t)d;
+    if ((double)v != d) return false;
+    *out = v;
+    return true;
+}
+
+// The integer a parsed number stands for: exact when it was written as one,
+// and also for integral decimals. False for everything else, so fractions
+// stay floats.
+static inline bool rift_number_integer(const cJSON *item, int64_t *out) {
+    if (item->type & cJSON_NumberIsInteger) {
+        *out = item->valueint64;
+        return true;
+    }
+    return rift_number_integral(item->valuedouble, out);
+}
@@ -1,19 +1,24 @@
 #include "parsing.h"
-#include <math.h>
+#include "number.h"
 
 void json_object_to_lua_table(lua_State* state, cJSON* json);
 
+static void json_push_number(lua_State* state, const cJSON* item) {
+  int64_t integer = 0;
+  if (rift_number_integer(item, &integer))
+    lua_pushinteger(state, (lua_Integer)integer);
+  else
+    lua_pushnumber(state, item->valuedouble);
+}
+
 void json_array_to_lua_table(lua_State* state, cJSON* json) {
   int i = 1;
   cJSON* item;
   lua_newtable(state);
   cJSON_ArrayForEach(item, json) {
-    switch (item->type) {
+    switch (item->type & 0xFF) {
       case cJSON_Number:
-        if (fabs(item->valuedouble - (double)item->valueint) < 1e-5)
-          lua_pushinteger(state, item->valueint);
-        else
-          lua_pushnumber(state, item->valuedouble);
+        json_push_number(state, item);
         break;
       case cJSON_String:
         lua_pushstring(state, item->valuestring);
@@ -45,12 +50,9 @@ void json_object_to_lua_table(lua_State* state, cJSON* json) {
   cJSON* item;
   cJSON_ArrayForEach(item, json) {
     lua_pushstring(state, item->string);
-    switch (item->type) {
+    switch (item->type & 0xFF) {
       case cJSON_Number:
-        if (fabs(item->valuedouble - (double)item->valueint) < 1e-5)
-          lua_pushinteger(state, item->valueint);
-        else
-          lua_pushnumber(state, item->valuedouble);
+        json_push_number(state, item);
         break;
       case cJSON_String:
         lua_pushstring(state, item->valuestring);
@@ -75,14 +77,8 @@ void json_object_to_lua_table(lua_State* state, cJSON* json) {
   }
 }
 
-bool json_to_lua_table(lua_State* state, const char* json_str) {
-  cJSON* json = cJSON_Parse(json_str);
-  if (!json) {
-    return false;
-  }
-
-  if (cJSON_IsInvalid(json)) {
-    cJSON_Delete(json);
+bool cjson_to_lua_table(lua_State* state, cJSON* json) {
+  if (!json || cJSON_IsInvalid(json)) {
     return false;
   }
 
@@ -94,14 +90,130 @@ bool json_to_lua_table(lua_State* state, const char* json_str) {
       json_object_to_lua_table(state, json);
       break;
     default:
-      cJSON_Delete(json);
       return false;
+  }
+  return true;
+}
+
+static void json_push_scalar(lua_State* state, cJSON* item) {
+  switch (item->type & 0xFF) {
+    case cJSON_Number:
+      json_push_number(state, item);
+      break;
+    case cJSON_String:
+      lua_pushstring(state, item->valuestring);
+      break;
+    case cJSON_True:
+      lua_pushboolean(state, true);
+      break;
+    case cJSON_False:
+      lua_pushboolean(state, false);
+      break;
+    default:
+      lua_pushnil(state);
       break;
   }
-  cJSON_Delete(json);
+}
+
+void cjson_push_value(lua_State* state, cJSON* item) {
+  switch (item->type & 0xFF) {
+    case cJSON_Array:
+      json_array_to_lua_table(state, item);
+      break;
+    case cJSON_Object:
+      json_object_to_lua_table(state, item);
+      break;
+    default:
+      json_push_scalar(state, item);
+      break;
+  }
+}
+
+static void json_fill_table(lua_State* state, cJSON* json, int index);
+
+// Sets the key on top of the stack to `item`, refilling a table that is
+// already stored under that key instead of building a new one.
+static void json_set_value(lua_State* state, int index, cJSON* item) {
+  if (cJSON_IsArray(item) || cJSON_IsObject(item)) {
+    lua_pushvalue(state, -1);
+    if (lua_rawget(state, index) == LUA_TTABLE) {
+      json_fill_table(state, item, lua_gettop(state));
+    } else {
+      lua_pop(state, 1);
+      cjson_to_lua_table(state, item);
+    }
+  } else {
+    json_push_scalar(state, item);
+  }
+  lua_rawset(state, index);
+}
+
+static bool json_has_key(lua_State* state, cJSON* json, int count) {
+  if (cJSON_IsArray(json)) {
+    if (!lua_isinteger(state, -1)) return false;
+    lua_Integer i = lua_tointeger(state, -1);
+    return i >= 1 && i <= count;
+  }
+  if (lua_type(state, -1) != LUA_TSTRING) return false;
+  cJSON* item = cJSON_GetObjectItemCaseSensitive(json, lua_tostring(state, -1));
+  return item && !cJSON_IsNull(item);
+}
+
+static void json_fill_table(lua_State* state, cJSON* json, int index) {
+  cJSON* item;
+  int count = 0;
+  int kept = 0;
+  cJSON_ArrayForEach(item, json) {
+    count++;
+    if (cJSON_IsArray(json))
+      lua_pushinteger(state, count);
+    else
+      lua_pushstring(state, item->string);
+    json_set_value(state, index, item);
+    if (!cJSON_IsNull(item)) kept++;
+  }
+
+  // Every key in the table now holds a value from `json`, unless the table
+  // had more keys than that before; only then look for the stale ones.
+  int present = 0;
+  lua_pushnil(state);
+  while (lua_next(state, index)) {
+    present++;
+    lua_pop(state, 1);
+  }
+  if (present == kept) return;
+
+  lua_pushnil(state);
+  while (lua_next(state, index)) {
+    lua_pop(state, 1);
+    if (!json_has_key(state, json, count)) {
+      lua_pushvalue(state, -1);
+      lua_pushnil(state);
+      lua_rawset(state, index);
+    }
+  }
+}
+
+bool cjson_fill_lua_table(lua_State* state, cJSON* json, int index) {
+  if (!json || !(cJSON_IsArray(json) || cJSON_IsObject(json))) {
+    return false;
+  }
+
+  json_fill_table(state, json, lua_absindex(state, index));
   return true;
 }
 
+bool json_to_lua_table(lua_State* state, const char* json_str) {
+  cJSON* json = cJSON_Parse(json_str);
+  if (!json) {
+    return false;
+  }
+
+  bool res = cjson_to_lua_table(state, json);
+  cJSON_Delete(json);
+  return res;
+}
+
 void parse_kv_table(lua_State* state, char* prefix, struct stack* stack) {
   lua_pushnil(state);
   const char* key,* value;
@@ -11,4 +11,9 @@
 
 void parse_kv_table(lua_State* state, char* prefix, struct stack* stack);
 void parse_table_values_to_stack(lua_State* state, int index, struct stack* stack);
+bool cjson_to_lua_table(lua_State* state, cJSON* json);
+// Pushes any value: a table for containers, nil for null.
+void cjson_push_value(lua_State* state, cJSON* item);
+// Makes the table at `index` equal to `json`, reusing its nested tables.
+bool cjson_fill_lua_table(lua_State* state, cJSON* json, int index);
 bool json_to_lua_table(lua_State* state, const char* json_str);
@@ -0,0 +1,63 @@
+#pragma once
+#include <errno.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#else
+#include <sys/event.h>
+#include <time.h>
+#endif
+
+// Thin readiness multiplexer for rift.run(): epoll on Linux, kqueue elsewhere.
+// Registrations carry an opaque pointer that comes back from rift_poller_wait.
+#define RIFT_POLLER_MAX_EVENTS 64
+
+static int rift_poller_create(void) {
+#if defined(__linux__)
+    return epoll_create1(EPOLL_CLOEXEC);
+#else
+    return kqueue();
+#endif
+}
+
+static bool rift_poller_add(int poller, int fd, void *ptr) {
+#if defined(__linux__)
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = ptr;
+    return epoll_ctl(poller, EPOLL_CTL_ADD, fd, &ev) == 0;
+#else
+    struct kevent change;
+    EV_SET(&change, fd, EVFILT_READ, EV_ADD | EV_ENABLE, 0, 0, ptr);
+    return kevent(poller, &change, 1, NULL, 0, NULL) == 0;
+#endif
+}
+
+// Blocks up to `timeout_ms` (forever if negative). Returns the number of ready
+// registrations written to `ready`, or -1 on error.
+static int rift_poller_wait(int poller, int timeout_ms, void **ready, int max) {
+    if (max > RIFT_POLLER_MAX_EVENTS) max = RIFT_POLLER_MAX_EVENTS;
+
+#if defined(__linux__)
+    struct epoll_event events[RIFT_POLLER_MAX_EVENTS];
+    int n = epoll_wait(poller, events, max, timeout_ms);
+    if (n < 0) return errno == EINTR ? 0 : -1;
+    for (int i = 0; i < n; ++i) ready[i] = events[i].data.ptr;
+    return n;
+#else
+    struct kevent events[RIFT_POLLER_MAX_EVENTS];
+    struct timespec ts;
+    struct timespec *tsp = NULL;
+    if (timeout_ms >= 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+        tsp = &ts;
+    }
+    int n = kevent(poller, NULL, 0, events, max, tsp);
+    if (n < 0) return errno == EINTR ? 0 : -1;
+    for (int i = 0; i < n; ++i) ready[i] = events[i].udata;
+    return n;
+#endif
+}
@@ -1,173 +1,889 @@
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef __APPLE__
 #include <CoreFoundation/CoreFoundation.h>
+#endif
 #include <lauxlib.h>
 #include <lualib.h>
 
-#include "mach.h"
+#include "transport.h"
+#include "worker.h"
+#include "poller.h"
 #include "parsing.h"
+#include "filter.h"
+#include "stats.h"
+#include "trace.h"
+#include "alloc.h"
+#include "mirror.h"
+#include "cache.h"
+#include "hash.h"
+#include "diff.h"
+#include "number.h"
+#include "template.h"
+#include "select.h"
+#include "columns.h"
 
-#define RIFT_CB_STORE_KEY "rift.client.callback_store"
-#define RIFT_TIMER_STORE_KEY "rift.client.timer_store"
-#define RIFT_CLIENT_KEEPALIVE_KEY "rift.client.keepalive"
 #define RIFT_AUTO_PUMP_INTERVAL_SECONDS 0.01
 
-static int rift_send_event_subscription_request(lua_State *L, rift_t *client, const char *key, const char *event);
-static char* rift_extract_event_type(const char *event_json);
+// Callback entries are integer-keyed so dispatch never hashes field names.
+#define RIFT_CB_CALLBACK 1
+#define RIFT_CB_EVENTS 2
+#define RIFT_CB_MASK 3
+#define RIFT_CB_FILTER 4
+// Event type -> env table reused by this callback when recycling is on.
+#define RIFT_CB_RECYCLED 5
+// Event type -> hash of the last body delivered, for {dedupe = true}.
+#define RIFT_CB_DEDUPE 6
+// rift.diff userdata holding the last lists seen, for {diff = true}.
+#define RIFT_CB_DIFF 7
+// rift.select userdata projecting DATA, for {select = {...}}.
+#define RIFT_CB_SELECT 8
+// True for {as = "columns"}: DATA holds rift.columns views.
+#define RIFT_CB_COLUMNS 9
+
+// Event types whose last body hash the client remembers.
+#define RIFT_DEDUPE_TYPES 16
+
+#define RIFT_RECONNECT_DEFAULT_MIN_MS 50
+#define RIFT_RECONNECT_DEFAULT_MAX_MS 5000
+
+#define RIFT_BACKLOG_SAMPLE_EVENTS 16
+#define RIFT_CATCHUP_DEFAULT_ENTER 64
+#define RIFT_CATCHUP_DEFAULT_EXIT 8
+#define RIFT_CATCHUP_DEFAULT_BATCH 64
+#define RIFT_CATCHUP_MAX_BATCH 1024
+#define RIFT_CATCHUP_MAX_RCVBUF (8u * 1024u * 1024u)
+// Bodies at least this long become INFO without a copy on Lua 5.5. Shorter
+// ones are copied by Lua anyway (short strings are interned).
+#define RIFT_INFO_EXTERNAL_MIN 64
+
+#define RIFT_ENV_METATABLE "rift.env"
+#define RIFT_MIRROR_METATABLE "rift.mirror"
+#define RIFT_DIFF_METATABLE "rift.diff"
+#define RIFT_TEMPLATE_METATABLE "rift.template"
+#define RIFT_MIRROR_DEFAULT_REQUEST "{\"get_windows\":{\"space_id\":null}}"
+
+#define RIFT_EVENT_MASK_ALL 1
+
+static const char *const rift_known_events[] = {
+    "workspace_changed",
+    "windows_changed",
+    "window_title_changed",
+    "stacks_changed",
+};
+
+typedef struct rift_timer_ctx rift_timer_ctx_t;
+
+typedef struct {
+    char *type;
+    uint64_t hash;
+} rift_dedupe_type_t;
+
+// One received event, either parsed here (`root`) or handed over by the worker
+// already flattened into a tape (`item`).
+// `unparsed` marks a repeated body whose parse was put off until something
+// needs the tree; rift_event_ensure_parsed() does it then. `tape` is encoded
+// from `root` on first use by a diff subscription. `json_external` is set once
+// the buffer has been handed to Lua as INFO; Lua frees it then.
+typedef struct {
+    char *json;
+    size_t len;
+    bool json_external;
+    const char *type;
+    cJSON *root;
+    rift_worker_item_t *item;
+    bool hashed;
+    bool unparsed;
+    uint64_t hash;
+    rift_tape_t tape;
+} rift_event_t;
+
+// Kernel backlog of the event stream, sampled every RIFT_BACKLOG_SAMPLE_EVENTS
+// events. Depth is in messages; the socket transport only reports bytes, so
+// there it is estimated from the average event size. With catch-up enabled by
+// client:set_catchup(), a depth of `enter` or more switches to receiving
+// batches of up to `batch` events and dropping list events that a later one
+// in the same batch replaces, until the depth is down to `exit`.
+typedef struct {
+    uint32_t countdown;
+    size_t depth;
+    size_t bytes;
+    size_t limit;
+    size_t high_water;
+    double avg_event_bytes;
+    uint64_t samples;
+    bool catchup_enabled;
+    bool catchup;
+    size_t enter;
+    size_t exit;
+    size_t batch;
+    uint64_t catchup_entries;
+    uint64_t coalesced;
+    uint64_t queue_grows;
+    // Received ahead while catching up and dispatched in order; a close or
+    // error met while filling the batch is reported once they are gone.
+    rift_event_t *queue;
+    size_t queue_head;
+    size_t queue_count;
+    rift_recv_status_t deferred_status;
+    bool deferred;
+} rift_backlog_t;
+
+// Automatic recovery enabled by client:set_reconnect(). While the server is
+// gone `lost_ns` is when that was noticed and `next_ns` the next attempt;
+// both are 0 while connected. Missed events are estimated from the event
+// rate of the connection that was lost.
+typedef struct {
+    bool enabled;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t backoff_ns;
+    uint64_t lost_ns;
+    uint64_t next_ns;
+    uint64_t connected_ns;
+    uint64_t connected_events;
+    double lost_rate;
+    uint64_t disconnects;
+    uint64_t reconnects;
+    uint64_t attempts;
+    uint64_t failures;
+    uint64_t last_recovery_ns;
+    uint64_t max_recovery_ns;
+    uint64_t downtime_ns;
+    uint64_t missed_estimate;
+} rift_reconnect_t;
 
 typedef struct {
+    rift_transport_t transport;
+    // Event log opened by client:record(path); every received event is
+    // appended to it before dispatch.
+    FILE *recorder;
+    // Registry refs (luaL_ref) for the callback list and the self-reference
+    // that keeps a subscribed client alive; LUA_NOREF when unset.
+    int callbacks_ref;
+    int keepalive_ref;
+    rift_timer_ctx_t *timer_ctx;
+    // Descriptor and stream generation registered with the rift.run() poller.
+    int loop_fd;
+    uint32_t loop_generation;
+    // Set by client:set_worker(true); the worker runs while the event stream
+    // is open and owns its receive side.
+    bool worker_enabled;
+    rift_worker_t worker;
+    // Set by client:set_recycle(true); callbacks get the same env and DATA
+    // tables back, refilled in place, for every event of a type.
+    bool recycle;
+    // State kept current by events once client:mirror() was called, and the
+    // request that fetches its snapshots.
+    rift_mirror_t *mirror;
+    char *mirror_request;
+    // get_* response cache enabled by client:set_cache(); NULL when off.
+    rift_cache_t *cache;
+    // Requests queued by client:request() until the next flush, as a registry
+    // ref to their table (LUA_NOREF when empty). Identical get_* requests
+    // share one entry and one round trip.
+    int pending_ref;
+    uint64_t flight_requests;
+    uint64_t flights;
+    // Set once a subscription asks for {dedupe = true}. Every event body is
+    // then hashed, and one identical to the last body of its type takes the
+    // type from here instead of being parsed.
+    bool dedupe;
+    rift_dedupe_type_t dedupe_types[RIFT_DEDUPE_TYPES];
+    size_t dedupe_type_count;
+    uint64_t dedupe_checked;
+    uint64_t dedupe_suppressed;
+    uint64_t dedupe_parses_skipped;
+    // INFO strings built, how many took the receive buffer as is, and the
+    // bytes copied for the rest.
+    uint64_t info_pushed;
+    uint64_t info_external;
+    uint64_t info_copied_bytes;
+    // Responses and events decoded through {select = ...}.
+    rift_select_stats_t select;
+    rift_reconnect_t reconnect;
+    rift_backlog_t backlog;
+    rift_stats_t stats;
+    // Span ring armed by client:trace(); NULL until first armed.
+    rift_trace_t *trace;
+} rift_t;
+
+typedef struct {
+    rift_diff_t *diff;
+} rift_diff_box_t;
+
+typedef struct {
+    rift_template_t *tpl;
+} rift_template_box_t;
+
+// How a response is decoded when not in full: projected by `select`, or
+// with rift.columns views for {as = "columns"}.
+typedef struct {
+    const rift_select_t *select;
+    bool columns;
+} rift_decode_t;
+
+static int rift_send_event_subscription_request(lua_State *L, rift_t *client, const char *key, const char *event);
+static bool rift_client_try_reconnect(lua_State *L, rift_t *client, int timeout_ms);
+static const char* rift_event_type(const cJSON *event_root);
+
+struct rift_timer_ctx {
     lua_State *L;
     rift_t *client;
+#ifdef __APPLE__
     CFRunLoopTimerRef timer;
-} rift_timer_ctx_t;
+#endif
+};
 
-static void rift_push_callback_store(lua_State *L, bool create) {
-    lua_pushstring(L, RIFT_CB_STORE_KEY);
-    lua_gettable(L, LUA_REGISTRYINDEX);
-    if (!lua_istable(L, -1)) {
-        lua_pop(L, 1);
-        if (!create) {
-            lua_pushnil(L);
-            return;
-        }
+// Bit for a known event type, RIFT_EVENT_MASK_ALL for "*", or 0 for types that
+// have to be looked up in the entry's events table.
+static lua_Integer rift_event_mask(const char *event) {
+    if (!event) return 0;
+    if (event[0] == '*' && event[1] == '\0') return RIFT_EVENT_MASK_ALL;
 
-        lua_newtable(L);
-        lua_pushstring(L, RIFT_CB_STORE_KEY);
-        lua_pushvalue(L, -2);
-        lua_settable(L, LUA_REGISTRYINDEX);
+    size_t count = sizeof(rift_known_events) / sizeof(rift_known_events[0]);
+    for (size_t i = 0; i < count; ++i) {
+        if (strcmp(event, rift_known_events[i]) == 0) return (lua_Integer)1 << (i + 1);
     }
+    return 0;
 }
 
 static bool rift_push_client_callback_list(lua_State *L, rift_t *client, bool create) {
-    rift_push_callback_store(L, create);
-    if (!lua_istable(L, -1)) {
+    if (client->callbacks_ref != LUA_NOREF) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, client->callbacks_ref);
+        return true;
+    }
+
+    if (!create) {
+        lua_pushnil(L);
         return false;
     }
 
-    lua_pushlightuserdata(L, (void*)client);
-    lua_gettable(L, -2);
-    if (!lua_istable(L, -1)) {
-        lua_pop(L, 1);
-        if (!create) {
-            lua_pop(L, 1);
-            lua_pushnil(L);
-            return false;
-        }
+    lua_newtable(L);
+    lua_pushvalue(L, -1);
+    client->callbacks_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    return true;
+}
 
-        lua_newtable(L);
-        lua_pushlightuserdata(L, (void*)client);
-        lua_pushvalue(L, -2);
-        lua_settable(L, -4);
+static void rift_retain_client(lua_State *L, rift_t *client, int client_index) {
+    if (client->keepalive_ref != LUA_NOREF) return;
+    lua_pushvalue(L, client_index);
+    client->keepalive_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+}
+
+static void rift_release_client(lua_State *L, rift_t *client) {
+    if (client->keepalive_ref == LUA_NOREF) return;
+    luaL_unref(L, LUA_REGISTRYINDEX, client->keepalive_ref);
+    client->keepalive_ref = LUA_NOREF;
+}
+
+static void rift_clear_client_callback_list(lua_State *L, rift_t *client) {
+    if (client->callbacks_ref == LUA_NOREF) return;
+    luaL_unref(L, LUA_REGISTRYINDEX, client->callbacks_ref);
+    client->callbacks_ref = LUA_NOREF;
+}
+
+static void rift_record_event(rift_t *client, uint64_t received_ns, const char *json, size_t len) {
+    if (!client->recorder) return;
+    if (!rift_recorder_write(client->recorder, received_ns, json, len)) {
+        fprintf(stderr, "rift record: failed to write event log, recording stopped.\n");
+        fclose(client->recorder);
+        client->recorder = NULL;
+    }
+}
+
+static bool rift_client_has_event_stream(const rift_t *client) {
+    if (client->backlog.queue_count || client->backlog.deferred) return true;
+    return client->worker.running || rift_transport_has_event_stream(&client->transport);
+}
+
+// Worker start/stop bump the stream generation so rift.run() re-registers the
+// client's descriptor (the ready pipe replaces the stream and vice versa).
+static void rift_client_start_worker(rift_t *client) {
+    if (!client->worker_enabled || client->worker.running) return;
+    if (!rift_transport_has_event_stream(&client->transport)) return;
+    if (!rift_worker_start(&client->worker, &client->transport, client->trace)) {
+        fprintf(stderr, "rift worker: failed to start, decoding on the Lua thread.\n");
+        return;
+    }
+    client->transport.stream_generation++;
+}
+
+static void rift_client_stop_worker(rift_t *client) {
+    if (!client->worker.running) return;
+    rift_worker_stop(&client->worker);
+    client->transport.stream_generation++;
+}
+
+static int rift_client_fileno(rift_t *client) {
+    if (client->worker.running) return client->worker.ready_pipe[0];
+    return rift_transport_fileno(&client->transport);
+}
+
+// 1 when an event is waiting, 0 on timeout, -1 on error or without a stream.
+static int rift_client_wait(rift_t *client, int timeout_ms) {
+    if (!rift_client_has_event_stream(client)) return -1;
+    if (client->backlog.queue_count || client->backlog.deferred) return 1;
+    if (client->worker.running) {
+        rift_socket_status_t ready = rift_socket_wait_readable(client->worker.ready_pipe[0], timeout_ms);
+        return ready == RIFT_SOCKET_FRAME ? 1 : (ready == RIFT_SOCKET_TIMEOUT ? 0 : -1);
     }
+    return rift_transport_wait(&client->transport, timeout_ms);
+}
 
-    lua_remove(L, -2);
+// Called when the event stream closes or breaks: EOF/HUP on the socket, or a
+// dead-name notification for the Mach server port. With reconnection enabled
+// the client starts retrying and true is returned.
+static bool rift_client_lost(rift_t *client) {
+    rift_reconnect_t *reconnect = &client->reconnect;
+    if (!reconnect->enabled || !rift_transport_has_server(&client->transport)) return false;
+    if (reconnect->lost_ns) return true;
+
+    uint64_t now = rift_now_ns();
+    double connected_s = (double)(now - reconnect->connected_ns) / 1e9;
+    reconnect->lost_rate = connected_s > 0 ? (double)reconnect->connected_events / connected_s : 0.0;
+    reconnect->lost_ns = now;
+    reconnect->next_ns = now;
+    reconnect->backoff_ns = reconnect->min_ns;
+    reconnect->disconnects++;
+    rift_client_stop_worker(client);
+    rift_transport_close_event_stream(&client->transport);
     return true;
 }
 
-static void rift_push_keepalive_store(lua_State *L, bool create) {
-    lua_pushstring(L, RIFT_CLIENT_KEEPALIVE_KEY);
-    lua_gettable(L, LUA_REGISTRYINDEX);
-    if (!lua_istable(L, -1)) {
-        lua_pop(L, 1);
-        if (!create) {
-            lua_pushnil(L);
-            return;
+static void rift_client_recovered(rift_t *client) {
+    rift_reconnect_t *reconnect = &client->reconnect;
+    uint64_t now = rift_now_ns();
+    if (reconnect->lost_ns) {
+        uint64_t recovery_ns = now - reconnect->lost_ns;
+        reconnect->reconnects++;
+        reconnect->last_recovery_ns = recovery_ns;
+        if (recovery_ns > reconnect->max_recovery_ns) reconnect->max_recovery_ns = recovery_ns;
+        reconnect->downtime_ns += recovery_ns;
+        reconnect->missed_estimate += (uint64_t)(reconnect->lost_rate * (double)recovery_ns / 1e9 + 0.5);
+    }
+    reconnect->lost_ns = 0;
+    reconnect->next_ns = 0;
+    reconnect->connected_ns = now;
+    reconnect->connected_events = 0;
+}
+
+static bool rift_client_deadline_ns(rift_t *client, uint64_t *due_ns) {
+    // Events queued while catching up are due right away.
+    if (client->backlog.queue_count || client->backlog.deferred) {
+        *due_ns = 0;
+        return true;
+    }
+    // A lost server is retried from rift.run() like a due replay event.
+    if (client->reconnect.lost_ns) {
+        *due_ns = client->reconnect.next_ns;
+        return true;
+    }
+    if (client->worker.running) return false;
+    return rift_transport_deadline_ns(&client->transport, due_ns);
+}
+
+// Lua heap size in bytes, sampled around table building and callbacks.
+static int64_t rift_lua_heap_bytes(lua_State *L) {
+    return (int64_t)lua_gc(L, LUA_GCCOUNT, 0) * 1024 + lua_gc(L, LUA_GCCOUNTB, 0);
+}
+
+// The Lua heap before a stage. The allocation counts come from the
+// rift.alloc wrapper and stay 0 without one.
+typedef struct {
+    int64_t heap_bytes;
+    uint64_t allocs;
+    uint64_t allocated_bytes;
+} rift_heap_mark_t;
+
+static rift_heap_mark_t rift_heap_mark(lua_State *L) {
+    rift_heap_mark_t mark = {rift_lua_heap_bytes(L), 0, 0};
+    const rift_alloc_t *alloc = rift_alloc_get(L);
+    if (alloc) {
+        mark.allocs = alloc->allocs;
+        mark.allocated_bytes = alloc->allocated_bytes;
+    }
+    return mark;
+}
+
+// Charges `op` with what the stage since `mark` allocated. Counts reset by
+// rift.alloc_stats(true) meanwhile are left out.
+static void rift_stats_heap_since(lua_State *L, rift_stats_t *stats, rift_stat_op_t op, rift_heap_mark_t mark) {
+    rift_heap_mark_t now = rift_heap_mark(L);
+    bool counted = now.allocs >= mark.allocs && now.allocated_bytes >= mark.allocated_bytes;
+    rift_stats_alloc(stats, op, now.heap_bytes - mark.heap_bytes,
+                     counted ? now.allocs - mark.allocs : 0,
+                     counted ? now.allocated_bytes - mark.allocated_bytes : 0);
+}
+
+static const char* rift_dedupe_known_type(const rift_t *client, uint64_t hash) {
+    for (size_t i = 0; i < client->dedupe_type_count; ++i) {
+        if (client->dedupe_types[i].hash == hash) return client->dedupe_types[i].type;
+    }
+    return NULL;
+}
+
+static void rift_dedupe_remember(rift_t *client, const char *type, uint64_t hash) {
+    if (!type) return;
+    for (size_t i = 0; i < client->dedupe_type_count; ++i) {
+        if (strcmp(client->dedupe_types[i].type, type) != 0) continue;
+        client->dedupe_types[i].hash = hash;
+        return;
+    }
+    if (client->dedupe_type_count == RIFT_DEDUPE_TYPES) return;
+    char *copy = strdup(type);
+    if (!copy) return;
+    client->dedupe_types[client->dedupe_type_count].type = copy;
+    client->dedupe_types[client->dedupe_type_count++].hash = hash;
+}
+
+static void rift_dedupe_free(rift_t *client) {
+    for (size_t i = 0; i < client->dedupe_type_count; ++i) free(client->dedupe_types[i].type);
+    client->dedupe_type_count = 0;
+}
+
+static void rift_event_parse(rift_t *client, rift_event_t *event) {
+    uint64_t start = rift_now_ns();
+    event->root = cJSON_Parse(event->json);
+    uint64_t parsed = rift_now_ns();
+    if (!event->type) event->type = rift_event_type(event->root);
+    uint64_t sniffed = rift_now_ns();
+    rift_stats_record(&client->stats, RIFT_STAT_PARSE, sniffed - start, event->len);
+    rift_trace_span(client->trace, "parse", RIFT_TRACE_TID_LUA, start, parsed, (int64_t)event->len);
+    rift_trace_span(client->trace, "sniff_type", RIFT_TRACE_TID_LUA, parsed, sniffed, 0);
+    if (!event->root) rift_stats_error(&client->stats, RIFT_STAT_PARSE);
+}
+
+static void rift_event_ensure_parsed(rift_t *client, rift_event_t *event) {
+    if (!event->unparsed) return;
+    event->unparsed = false;
+    rift_event_parse(client, event);
+}
+
+// With `lazy`, a body identical to the last one of some type is left
+// unparsed; the caller must use rift_event_ensure_parsed() before reading it.
+static bool rift_client_receive_event(rift_t *client, int timeout_ms, rift_event_t *event, rift_recv_status_t *status, bool lazy) {
+    memset(event, 0, sizeof(rift_event_t));
+
+    if (client->worker.running) {
+        rift_worker_item_t *item = rift_worker_pop(&client->worker, timeout_ms, status);
+        if (!item) {
+            if (*status == RIFT_RECV_ERROR) rift_stats_error(&client->stats, RIFT_STAT_RECEIVE);
+            // The worker has exited; join it so the transport is ours again.
+            if (*status == RIFT_RECV_CLOSED || *status == RIFT_RECV_ERROR) rift_client_stop_worker(client);
+            if (*status == RIFT_RECV_CLOSED) rift_transport_reap_event_stream(&client->transport);
+            return false;
+        }
+        rift_stats_record(&client->stats, RIFT_STAT_RECEIVE, item->receive_ns, item->json_len);
+        rift_stats_record(&client->stats, RIFT_STAT_PARSE, item->parse_ns, item->json_len);
+        if (item->tape.len == 0) rift_stats_error(&client->stats, RIFT_STAT_PARSE);
+        rift_record_event(client, item->received_ns, item->json, item->json_len);
+        event->json = item->json;
+        event->len = item->json_len;
+        event->type = item->type;
+        event->item = item;
+        if (client->dedupe) {
+            event->hash = rift_hash64(event->json, event->len);
+            event->hashed = true;
+        }
+        client->reconnect.connected_events++;
+        return true;
+    }
+
+    uint64_t start = rift_now_ns();
+    char *json = rift_transport_receive(&client->transport, timeout_ms, status);
+    if (!json) {
+        if (*status == RIFT_RECV_ERROR) rift_stats_error(&client->stats, RIFT_STAT_RECEIVE);
+        if (*status == RIFT_RECV_CLOSED) rift_transport_reap_event_stream(&client->transport);
+        return false;
+    }
+    uint64_t received = rift_now_ns();
+    size_t len = strlen(json);
+    rift_stats_record(&client->stats, RIFT_STAT_RECEIVE, received - start, len);
+    rift_trace_span(client->trace, "receive", RIFT_TRACE_TID_LUA, start, received, (int64_t)len);
+    rift_record_event(client, received, json, len);
+    client->reconnect.connected_events++;
+
+    event->json = json;
+    event->len = len;
+    if (client->dedupe) {
+        event->hash = rift_hash64(json, len);
+        event->hashed = true;
+        // Identical bytes have the same type, so a repeat needs no parse to
+        // be routed.
+        const char *known = lazy ? rift_dedupe_known_type(client, event->hash) : NULL;
+        if (known) {
+            event->type = known;
+            event->unparsed = true;
+            return true;
         }
-        lua_newtable(L);
-        lua_pushstring(L, RIFT_CLIENT_KEEPALIVE_KEY);
-        lua_pushvalue(L, -2);
-        lua_settable(L, LUA_REGISTRYINDEX);
     }
+    rift_event_parse(client, event);
+    if (event->hashed) rift_dedupe_remember(client, event->type, event->hash);
+    return true;
 }
 
-static void rift_retain_client(lua_State *L, rift_t *client, int client_index) {
-    rift_push_keepalive_store(L, true);
-    lua_pushlightuserdata(L, (void*)client);
-    lua_pushvalue(L, client_index);
-    lua_settable(L, -3);
-    lua_pop(L, 1);
+static bool rift_event_parsed(const rift_event_t *event) {
+    if (event->item) return event->item->tape.len > 0;
+    return event->root != NULL;
 }
 
-static void rift_release_client(lua_State *L, rift_t *client) {
-    rift_push_keepalive_store(L, false);
-    if (!lua_istable(L, -1)) {
-        lua_pop(L, 1);
+static bool rift_event_match(const rift_event_t *event, const rift_filter_t *filter) {
+    if (event->item) return rift_filter_match_tape(filter, &event->item->tape);
+    return rift_filter_match(filter, event->root);
+}
+
+// Pushes DATA; with `reuse_index` it refills and pushes that table instead.
+static bool rift_event_push_data(lua_State *L, const rift_event_t *event, int reuse_index) {
+    if (reuse_index) {
+        bool ok = event->item ? rift_tape_fill_lua_table(L, &event->item->tape, reuse_index)
+                              : cjson_fill_lua_table(L, event->root, reuse_index);
+        if (ok) lua_pushvalue(L, reuse_index);
+        return ok;
+    }
+    if (event->item) return rift_tape_to_lua_table(L, &event->item->tape);
+    return cjson_to_lua_table(L, event->root);
+}
+
+// Builds DATA for one callback, accounting the time and Lua heap growth to
+// the materialize stage.
+static bool rift_client_push_event_data(lua_State *L, rift_t *client, const rift_event_t *event, int reuse_index) {
+    rift_heap_mark_t heap = rift_heap_mark(L);
+    uint64_t start = rift_now_ns();
+    bool ok = rift_event_push_data(L, event, reuse_index);
+    uint64_t end = rift_now_ns();
+    size_t bytes = event->item ? event->item->tape.len : event->len;
+    rift_stats_record(&client->stats, RIFT_STAT_MATERIALIZE, end - start, bytes);
+    rift_trace_span(client->trace, "materialize", RIFT_TRACE_TID_LUA, start, end, (int64_t)bytes);
+    rift_stats_heap_since(L, &client->stats, RIFT_STAT_MATERIALIZE, heap);
+    if (!ok) rift_stats_error(&client->stats, RIFT_STAT_MATERIALIZE);
+    return ok;
+}
+
+// DATA for a {select = ...} subscription, projected from the tape or the
+// parsed tree, with the same accounting as the full build.
+static bool rift_client_push_event_select(lua_State *L, rift_t *client, const rift_event_t *event, const rift_select_t *sel) {
+    rift_heap_mark_t heap = rift_heap_mark(L);
+    uint64_t start = rift_now_ns();
+    bool ok = event->item ? rift_select_push_tape(L, sel, &event->item->tape, &client->select)
+                          : event->root && rift_select_push_cjson(L, sel, event->root, &client->select);
+    uint64_t end = rift_now_ns();
+    size_t bytes = event->item ? event->item->tape.len : event->len;
+    rift_stats_record(&client->stats, RIFT_STAT_MATERIALIZE, end - start, bytes);
+    rift_trace_span(client->trace, "materialize", RIFT_TRACE_TID_LUA, start, end, (int64_t)bytes);
+    rift_stats_heap_since(L, &client->stats, RIFT_STAT_MATERIALIZE, heap);
+    if (!ok) rift_stats_error(&client->stats, RIFT_STAT_MATERIALIZE);
+    return ok;
+}
+
+// Updates the mirror and drops cached responses the event makes stale; runs
+// before callbacks, so they already see the new state.
+static void rift_client_observe_event(lua_State *L, rift_t *client, const rift_event_t *event) {
+    if (client->cache) rift_cache_invalidate(L, client->cache, event->type);
+    if (!client->mirror || !rift_event_parsed(event)) return;
+    if (event->item) {
+        cJSON *root = rift_tape_to_cjson(&event->item->tape, 0);
+        rift_mirror_apply(client->mirror, event->type, root);
+        cJSON_Delete(root);
+    } else {
+        rift_mirror_apply(client->mirror, event->type, event->root);
+    }
+}
+
+static void rift_event_free(rift_event_t *event) {
+    if (event->item) {
+        rift_worker_item_free(event->item);
+    } else {
+        if (!event->json_external) free(event->json);
+        cJSON_Delete(event->root);
+    }
+    rift_tape_free(&event->tape);
+    memset(event, 0, sizeof(rift_event_t));
+}
+
+#if LUA_VERSION_NUM >= 505
+// lua_Alloc-shaped deallocator Lua calls when an external INFO string dies.
+static void* rift_info_free(void *ud, void *ptr, size_t osize, size_t nsize) {
+    (void)ud;
+    (void)osize;
+    (void)nsize;
+    free(ptr);
+    return NULL;
+}
+#endif
+
+// Pushes the event body for env.INFO. On Lua 5.5 a long body is handed over
+// as an external string, so the receive buffer becomes the Lua string and is
+// freed by the collector; it stays valid while the string is on the stack.
+// Otherwise the body is copied once, with its known length.
+static void rift_push_event_info(lua_State *L, rift_t *client, rift_event_t *event) {
+    client->info_pushed++;
+#if LUA_VERSION_NUM >= 505
+    if (event->len >= RIFT_INFO_EXTERNAL_MIN && !event->json_external) {
+        // The worker item no longer owns its buffer either.
+        if (event->item) event->item->json = NULL;
+        event->json_external = true;
+        lua_pushexternalstring(L, event->json, event->len, rift_info_free, NULL);
+        client->info_external++;
         return;
     }
-    lua_pushlightuserdata(L, (void*)client);
-    lua_pushnil(L);
-    lua_settable(L, -3);
-    lua_pop(L, 1);
+#endif
+    lua_pushlstring(L, event->json, event->len);
+    client->info_copied_bytes += event->len;
 }
 
-static void rift_push_timer_store(lua_State *L, bool create) {
-    lua_pushstring(L, RIFT_TIMER_STORE_KEY);
-    lua_gettable(L, LUA_REGISTRYINDEX);
-    if (!lua_istable(L, -1)) {
-        lua_pop(L, 1);
-        if (!create) {
-            lua_pushnil(L);
-            return;
+// Samples the kernel backlog (plus the worker's queue) and switches catch-up
+// mode on or off. The event stream is only closed on the Lua thread, so the
+// kernel can be asked while the worker reads from it.
+static void rift_client_sample_backlog(rift_t *client) {
+    rift_backlog_t *backlog = &client->backlog;
+    backlog->countdown = RIFT_BACKLOG_SAMPLE_EVENTS;
+    size_t messages = 0;
+    size_t bytes = 0;
+    size_t limit = 0;
+    bool exact = false;
+    if (!rift_transport_backlog(&client->transport, &messages, &bytes, &limit, &exact) && !client->worker.running) return;
+    if (!exact && bytes) {
+        double avg = backlog->avg_event_bytes > 0 ? backlog->avg_event_bytes : 1024.0;
+        messages = (size_t)((double)bytes / avg + 0.5);
+        if (messages == 0) messages = 1;
+    }
+    if (client->worker.running) messages += rift_worker_depth(&client->worker);
+
+    backlog->depth = messages;
+    backlog->bytes = bytes;
+    backlog->limit = limit;
+    backlog->samples++;
+    if (messages > backlog->high_water) backlog->high_water = messages;
+
+    if (!backlog->catchup_enabled) return;
+    if (!backlog->catchup && messages >= backlog->enter) {
+        backlog->catchup = true;
+        backlog->catchup_entries++;
+        if (rift_transport_grow_queue(&client->transport, RIFT_CATCHUP_MAX_RCVBUF)) backlog->queue_grows++;
+    } else if (backlog->catchup && messages <= backlog->exit) {
+        backlog->catchup = false;
+    }
+}
+
+static bool rift_event_space_id(const rift_event_t *event, int64_t *space_id) {
+    if (event->item) {
+        size_t pos = 0;
+        if (!rift_tape_object_get(&event->item->tape, 0, "space_id", &pos)) return false;
+        switch (rift_tape_tag(&event->item->tape, pos)) {
+            case RIFT_TAPE_INTEGER:
+                *space_id = rift_tape_integer(&event->item->tape, pos);
+                return true;
+            case RIFT_TAPE_NUMBER:
+                *space_id = (int64_t)rift_tape_number(&event->item->tape, pos);
+                return true;
+            default:
+                return false;
         }
+    }
+    const cJSON *space = event->root ? cJSON_GetObjectItemCaseSensitive(event->root, "space_id") : NULL;
+    return cJSON_IsNumber(space) && rift_number_integer(space, space_id);
+}
 
-        lua_newtable(L);
-        lua_pushstring(L, RIFT_TIMER_STORE_KEY);
-        lua_pushvalue(L, -2);
-        lua_settable(L, LUA_REGISTRYINDEX);
+// Whether a later `next` makes `event` redundant: both carry the complete
+// list of the same kind, and `next` covers the same space or all of them.
+static bool rift_event_replaced_by(const rift_event_t *event, const rift_event_t *next) {
+    if (!event->type || !next->type || strcmp(event->type, next->type) != 0) return false;
+    if (strcmp(event->type, "windows_changed") != 0 && strcmp(event->type, "stacks_changed") != 0 &&
+        strcmp(event->type, "workspace_changed") != 0) {
+        return false;
     }
+    int64_t next_space = 0;
+    if (!rift_event_space_id(next, &next_space)) return true;
+    int64_t space = 0;
+    return rift_event_space_id(event, &space) && space == next_space;
 }
 
-static rift_timer_ctx_t* rift_get_timer_ctx(lua_State *L, rift_t *client) {
-    rift_push_timer_store(L, false);
-    if (!lua_istable(L, -1)) {
-        lua_pop(L, 1);
-        return NULL;
+// Receives what is already waiting, up to a batch, and drops the events a
+// later one in the batch replaces. The first receive may wait `timeout_ms`.
+static bool rift_client_fill_catchup(rift_t *client, int timeout_ms, rift_recv_status_t *status) {
+    rift_backlog_t *backlog = &client->backlog;
+    if (!backlog->queue) {
+        backlog->queue = (rift_event_t*)calloc(RIFT_CATCHUP_MAX_BATCH, sizeof(rift_event_t));
+        if (!backlog->queue) return false;
+    }
+    backlog->queue_head = 0;
+    size_t count = 0;
+    while (count < backlog->batch) {
+        rift_recv_status_t batch_status;
+        if (!rift_client_receive_event(client, count ? 0 : timeout_ms, &backlog->queue[count], &batch_status, false)) {
+            if (count == 0) {
+                *status = batch_status;
+                return false;
+            }
+            if (batch_status != RIFT_RECV_TIMEOUT) {
+                backlog->deferred = true;
+                backlog->deferred_status = batch_status;
+            }
+            break;
+        }
+        count++;
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < count; ++i) {
+        bool replaced = false;
+        for (size_t j = i + 1; j < count && !replaced; ++j) {
+            replaced = rift_event_replaced_by(&backlog->queue[i], &backlog->queue[j]);
+        }
+        if (replaced) {
+            rift_event_free(&backlog->queue[i]);
+            backlog->coalesced++;
+            continue;
+        }
+        if (kept != i) {
+            backlog->queue[kept] = backlog->queue[i];
+            memset(&backlog->queue[i], 0, sizeof(rift_event_t));
+        }
+        kept++;
     }
+    backlog->queue_count = kept;
+    return true;
+}
 
-    lua_pushlightuserdata(L, (void*)client);
-    lua_gettable(L, -2);
-    rift_timer_ctx_t *ctx = NULL;
-    if (lua_islightuserdata(L, -1)) {
-        ctx = (rift_timer_ctx_t*)lua_touserdata(L, -1);
+// The next event to dispatch: queued catch-up events first, then a new
+// batch while catching up, otherwise a single receive.
+static bool rift_next_event(rift_t *client, int timeout_ms, rift_event_t *event, rift_recv_status_t *status, bool lazy) {
+    rift_backlog_t *backlog = &client->backlog;
+    if (!backlog->queue_count) {
+        if (backlog->deferred) {
+            backlog->deferred = false;
+            *status = backlog->deferred_status;
+            memset(event, 0, sizeof(rift_event_t));
+            return false;
+        }
+        if (backlog->countdown == 0 || backlog->catchup) rift_client_sample_backlog(client);
+        backlog->countdown--;
+        if (!backlog->catchup) {
+            bool ok = rift_client_receive_event(client, timeout_ms, event, status, lazy);
+            if (ok) backlog->avg_event_bytes += ((double)event->len - backlog->avg_event_bytes) / 16.0;
+            return ok;
+        }
+        if (!rift_client_fill_catchup(client, timeout_ms, status)) {
+            memset(event, 0, sizeof(rift_event_t));
+            return false;
+        }
     }
-    lua_pop(L, 2);
-    return ctx;
+
+    *event = backlog->queue[backlog->queue_head];
+    memset(&backlog->queue[backlog->queue_head], 0, sizeof(rift_event_t));
+    backlog->queue_head++;
+    backlog->queue_count--;
+    backlog->avg_event_bytes += ((double)event->len - backlog->avg_event_bytes) / 16.0;
+    *status = RIFT_RECV_OK;
+    return true;
 }
 
-static void rift_set_timer_ctx(lua_State *L, rift_t *client, rift_timer_ctx_t *ctx) {
-    rift_push_timer_store(L, true);
-    lua_pushlightuserdata(L, (void*)client);
-    if (ctx) lua_pushlightuserdata(L, (void*)ctx);
-    else lua_pushnil(L);
-    lua_settable(L, -3);
-    lua_pop(L, 1);
+static void rift_backlog_free(rift_backlog_t *backlog) {
+    if (backlog->queue) {
+        for (size_t i = 0; i < backlog->queue_count; ++i) rift_event_free(&backlog->queue[backlog->queue_head + i]);
+    }
+    free(backlog->queue);
+    backlog->queue = NULL;
+    backlog->queue_head = 0;
+    backlog->queue_count = 0;
+    backlog->deferred = false;
 }
 
-static void rift_clear_client_callback_list(lua_State *L, rift_t *client) {
-    rift_push_callback_store(L, false);
-    if (!lua_istable(L, -1)) {
+static const rift_tape_t* rift_event_tape(rift_event_t *event) {
+    if (event->item) return &event->item->tape;
+    if (event->tape.len == 0 && !(event->root && rift_tape_encode(&event->tape, event->root))) return NULL;
+    return &event->tape;
+}
+
+// Pushes DATA as a diff against the previous list; false (nothing pushed)
+// when the event has no list to diff, so the caller builds the full table.
+static bool rift_client_push_event_diff(lua_State *L, rift_t *client, rift_event_t *event, rift_diff_t *diff) {
+    if (!rift_diff_list_field(event->type)) return false;
+    rift_heap_mark_t heap = rift_heap_mark(L);
+    uint64_t start = rift_now_ns();
+    const rift_tape_t *tape = rift_event_tape(event);
+    bool ok = tape && rift_diff_push(L, diff, event->type, tape);
+    if (!ok) return false;
+    uint64_t end = rift_now_ns();
+    rift_stats_record(&client->stats, RIFT_STAT_MATERIALIZE, end - start, tape->len);
+    rift_trace_span(client->trace, "materialize", RIFT_TRACE_TID_LUA, start, end, (int64_t)tape->len);
+    rift_stats_heap_since(L, &client->stats, RIFT_STAT_MATERIALIZE, heap);
+    return true;
+}
+
+// DATA for an {as = "columns"} subscription, built from the event's tape.
+static bool rift_client_push_event_columns(lua_State *L, rift_t *client, rift_event_t *event) {
+    rift_heap_mark_t heap = rift_heap_mark(L);
+    uint64_t start = rift_now_ns();
+    const rift_tape_t *tape = rift_event_tape(event);
+    bool ok = tape && rift_columns_push(L, tape);
+    uint64_t end = rift_now_ns();
+    size_t bytes = tape ? tape->len : event->len;
+    rift_stats_record(&client->stats, RIFT_STAT_MATERIALIZE, end - start, bytes);
+    rift_trace_span(client->trace, "materialize", RIFT_TRACE_TID_LUA, start, end, (int64_t)bytes);
+    rift_stats_heap_since(L, &client->stats, RIFT_STAT_MATERIALIZE, heap);
+    if (!ok) rift_stats_error(&client->stats, RIFT_STAT_MATERIALIZE);
+    return ok;
+}
+
+// Pushes the env table that the callback entry at `entry_index` reuses for
+// the event type at `type_index`, creating it on first use. Only recycled envs
+// get the "rift.env" metatable, since only they need retain().
+static void rift_push_recycled_env(lua_State *L, int entry_index, int type_index) {
+    if (lua_rawgeti(L, entry_index, RIFT_CB_RECYCLED) != LUA_TTABLE) {
         lua_pop(L, 1);
-        return;
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_rawseti(L, entry_index, RIFT_CB_RECYCLED);
     }
+    int recycled_index = lua_gettop(L);
 
-    lua_pushlightuserdata(L, (void*)client);
-    lua_pushnil(L);
-    lua_settable(L, -3);
-    lua_pop(L, 1);
+    if (lua_isnil(L, type_index)) lua_pushboolean(L, 0);
+    else lua_pushvalue(L, type_index);
+    lua_pushvalue(L, -1);
+    if (lua_rawget(L, recycled_index) != LUA_TTABLE) {
+        lua_pop(L, 1);
+        lua_createtable(L, 0, 3);
+        luaL_setmetatable(L, RIFT_ENV_METATABLE);
+        lua_pushvalue(L, -2);
+        lua_pushvalue(L, -2);
+        lua_rawset(L, recycled_index);
+    }
+    lua_replace(L, recycled_index);
+    lua_settop(L, recycled_index);
 }
 
-static int rift_pump_once_internal(lua_State *L, rift_t *client, mach_msg_timeout_t timeout_ms, bool push_lua_error) {
-    if (client->event_port == MACH_PORT_NULL) {
-        return 0;
+// Reads and dispatches at most one event. Returns 1 when an event was
+// consumed, even if `where` or dedupe kept it from every callback, 0 when
+// none was ready and -1 on error. `dispatched_out`, if given, receives the
+// number of callbacks run.
+static int rift_pump_once_internal(lua_State *L, rift_t *client, int timeout_ms, bool push_lua_error, int *dispatched_out) {
+    if (dispatched_out) *dispatched_out = 0;
+    if (!rift_client_has_event_stream(client)) {
+        if (!rift_client_try_reconnect(L, client, timeout_ms)) return 0;
+        // The attempt may have used up the timeout.
+        timeout_ms = 0;
     }
 
-    bool timed_out = false;
-    char *event_json = rift_try_receive_event_internal(client->event_port, timeout_ms, &timed_out);
-    if (!event_json) {
-        if (timed_out) {
+    rift_recv_status_t status;
+    rift_event_t event;
+    // The mirror applies every event, so it always needs the parse.
+    if (!rift_next_event(client, timeout_ms, &event, &status, client->dedupe && !client->mirror)) {
+        if (status == RIFT_RECV_TIMEOUT) {
+            return 0;
+        }
+        if (rift_client_lost(client)) {
             return 0;
         }
+        if (status == RIFT_RECV_CLOSED) {
+            if (!push_lua_error) return 0;
+            lua_pushnil(L);
+            lua_pushstring(L, "Event stream closed.");
+            return -1;
+        }
         if (push_lua_error) {
             lua_pushnil(L);
             lua_pushstring(L, "Failed to receive event.");
@@ -177,94 +893,192 @@ static int rift_pump_once_internal(lua_State *L, rift_t *client, mach_msg_timeou
         return -1;
     }
 
-    char *event_type = rift_extract_event_type(event_json);
+    rift_client_observe_event(L, client, &event);
+
+    const char *event_type = event.type;
+    lua_Integer event_mask = rift_event_mask(event_type);
 
     if (!rift_push_client_callback_list(L, client, false)) {
-        free(event_json);
-        if (event_type) free(event_type);
-        return 0;
+        lua_pop(L, 1);
+        rift_event_free(&event);
+        return 1;
     }
 
+    // INFO and EVENT are shared by every callback for this event; the slots
+    // are filled on first dispatch so filtered-out events never copy them.
+    // The last slot is the key of dedupe tables (false for untyped events),
+    // filled by the first dedupe subscription.
+    int list_index = lua_gettop(L);
+    int info_index = list_index + 1;
+    int type_index = list_index + 2;
+    int dedupe_key_index = list_index + 3;
+    bool strings_pushed = false;
+    lua_pushnil(L);
+    lua_pushnil(L);
+    lua_pushnil(L);
+
     int dispatched = 0;
-    lua_Integer cb_count = (lua_Integer)lua_rawlen(L, -1);
+    lua_Integer cb_count = (lua_Integer)lua_rawlen(L, list_index);
     for (lua_Integer i = 1; i <= cb_count; ++i) {
-        lua_rawgeti(L, -1, i);
-        if (!lua_istable(L, -1)) {
+        if (lua_rawgeti(L, list_index, i) != LUA_TTABLE) {
             lua_pop(L, 1);
             continue;
         }
 
-        bool should_dispatch = false;
-        lua_getfield(L, -1, "events");
-        if (lua_istable(L, -1)) {
-            lua_pushstring(L, "*");
-            lua_gettable(L, -2);
-            should_dispatch = lua_toboolean(L, -1);
-            lua_pop(L, 1);
+        lua_rawgeti(L, -1, RIFT_CB_MASK);
+        lua_Integer mask = lua_tointeger(L, -1);
+        lua_pop(L, 1);
 
-            if (!should_dispatch && event_type) {
+        bool should_dispatch = (mask & RIFT_EVENT_MASK_ALL) || (mask & event_mask);
+        if (!should_dispatch && event_type && event_mask == 0) {
+            if (lua_rawgeti(L, -1, RIFT_CB_EVENTS) == LUA_TTABLE) {
                 lua_pushstring(L, event_type);
-                lua_gettable(L, -2);
+                lua_rawget(L, -2);
                 should_dispatch = lua_toboolean(L, -1);
                 lua_pop(L, 1);
             }
+            lua_pop(L, 1);
         }
-        lua_pop(L, 1);
 
         if (!should_dispatch) {
             lua_pop(L, 1);
             continue;
         }
 
-        lua_getfield(L, -1, "callback");
-        if (!lua_isfunction(L, -1)) {
+        // Skipped before the filter runs: a repeat of the last delivered
+        // body would pass or fail it the same way.
+        bool dedupe = false;
+        if (event.hashed) {
+            if (lua_rawgeti(L, -1, RIFT_CB_DEDUPE) == LUA_TTABLE) {
+                dedupe = true;
+                client->dedupe_checked++;
+                if (lua_isnil(L, dedupe_key_index)) {
+                    if (event_type) lua_pushstring(L, event_type);
+                    else lua_pushboolean(L, 0);
+                    lua_replace(L, dedupe_key_index);
+                }
+                lua_pushvalue(L, dedupe_key_index);
+                bool repeated = lua_rawget(L, -2) == LUA_TNUMBER && (uint64_t)lua_tointeger(L, -1) == event.hash;
+                lua_pop(L, 1);
+                if (repeated) {
+                    client->dedupe_suppressed++;
+                    lua_pop(L, 2);
+                    continue;
+                }
+            }
+            lua_pop(L, 1);
+        }
+
+        lua_rawgeti(L, -1, RIFT_CB_FILTER);
+        const rift_filter_t *filter = (const rift_filter_t*)lua_touserdata(L, -1);
+        lua_pop(L, 1);
+        if (filter) rift_event_ensure_parsed(client, &event);
+        if (filter && (!rift_event_parsed(&event) || !rift_event_match(&event, filter))) {
+            lua_pop(L, 1);
+            continue;
+        }
+
+        if (lua_rawgeti(L, -1, RIFT_CB_CALLBACK) != LUA_TFUNCTION) {
             lua_pop(L, 2);
             continue;
         }
 
-        lua_newtable(L);
-        lua_pushstring(L, event_json);
-        lua_setfield(L, -2, "INFO");
-        if (event_type) {
-            lua_pushstring(L, event_type);
-            lua_setfield(L, -2, "EVENT");
-        } else {
-            lua_pushnil(L);
-            lua_setfield(L, -2, "EVENT");
+        if (dedupe) {
+            lua_rawgeti(L, -2, RIFT_CB_DEDUPE);
+            lua_pushvalue(L, dedupe_key_index);
+            lua_pushinteger(L, (lua_Integer)event.hash);
+            lua_rawset(L, -3);
+            lua_pop(L, 1);
+        }
+        rift_event_ensure_parsed(client, &event);
+
+        // The entry keeps the box alive for the rest of this dispatch.
+        lua_rawgeti(L, -2, RIFT_CB_DIFF);
+        rift_diff_box_t *diff_box = (rift_diff_box_t*)lua_touserdata(L, -1);
+        lua_rawgeti(L, -3, RIFT_CB_SELECT);
+        const rift_select_t *sel = (const rift_select_t*)lua_touserdata(L, -1);
+        lua_rawgeti(L, -4, RIFT_CB_COLUMNS);
+        bool columns = lua_toboolean(L, -1);
+        lua_pop(L, 3);
+
+        if (!strings_pushed) {
+            rift_push_event_info(L, client, &event);
+            lua_replace(L, info_index);
+            if (event_type) {
+                lua_pushstring(L, event_type);
+                lua_replace(L, type_index);
+            }
+            strings_pushed = true;
         }
 
-        if (json_to_lua_table(L, event_json)) {
-            lua_setfield(L, -2, "DATA");
+        int data_index = 0;
+        if (client->recycle) {
+            rift_push_recycled_env(L, lua_gettop(L) - 1, type_index);
+            if (lua_getfield(L, -1, "DATA") == LUA_TTABLE) data_index = lua_gettop(L);
+            else lua_pop(L, 1);
         } else {
+            lua_createtable(L, 0, 3);
+        }
+        int env_index = data_index ? data_index - 1 : lua_gettop(L);
+        lua_pushvalue(L, info_index);
+        lua_setfield(L, env_index, "INFO");
+        lua_pushvalue(L, type_index);
+        lua_setfield(L, env_index, "EVENT");
+
+        // Projections and views are always built fresh; the recycled DATA is
+        // replaced.
+        if (sel) {
+            if (!rift_client_push_event_select(L, client, &event, sel)) lua_pushnil(L);
+        } else if (columns) {
+            if (!rift_client_push_event_columns(L, client, &event)) lua_pushnil(L);
+        } else if (!(diff_box && rift_client_push_event_diff(L, client, &event, diff_box->diff)) &&
+                   !rift_client_push_event_data(L, client, &event, data_index)) {
             lua_pushnil(L);
-            lua_setfield(L, -2, "DATA");
         }
-
-        if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
+        lua_setfield(L, env_index, "DATA");
+        lua_settop(L, env_index);
+
+        rift_heap_mark_t heap = rift_heap_mark(L);
+        uint64_t start = rift_now_ns();
+        int call_rc = lua_pcall(L, 1, 0, 0);
+        uint64_t end = rift_now_ns();
+        rift_stats_record(&client->stats, RIFT_STAT_CALLBACK, end - start, 0);
+        rift_trace_span(client->trace, "callback", RIFT_TRACE_TID_LUA, start, end, 0);
+        rift_stats_heap_since(L, &client->stats, RIFT_STAT_CALLBACK, heap);
+        if (call_rc != LUA_OK) {
+            rift_stats_error(&client->stats, RIFT_STAT_CALLBACK);
             const char *cb_err = lua_tostring(L, -1);
-            lua_pop(L, 2);
-            free(event_json);
-            if (event_type) free(event_type);
             if (push_lua_error) {
                 lua_pushnil(L);
                 lua_pushfstring(L, "Pump callback failed: %s", cb_err ? cb_err : "unknown error");
+                lua_replace(L, list_index + 1);
+                lua_replace(L, list_index);
+                lua_settop(L, list_index + 1);
             } else {
                 fprintf(stderr, "rift auto-pump callback error: %s\n", cb_err ? cb_err : "unknown error");
+                lua_settop(L, list_index - 1);
             }
+            rift_event_free(&event);
             return -1;
         }
 
         dispatched++;
         lua_pop(L, 1);
     }
-    lua_pop(L, 1);
+    lua_settop(L, list_index - 1);
 
-    free(event_json);
-    if (event_type) free(event_type);
+    if (event.unparsed) client->dedupe_parses_skipped++;
+    rift_event_free(&event);
+    // Heap size after each dispatch; drops between samples show GC steps.
+    if (rift_trace_armed(client->trace)) {
+        rift_trace_counter(client->trace, "lua_heap_bytes", rift_now_ns(), rift_lua_heap_bytes(L));
+    }
 
-    return dispatched;
+    if (dispatched_out) *dispatched_out = dispatched;
+    return 1;
 }
 
+#ifdef __APPLE__
 static void rift_timer_callback(CFRunLoopTimerRef timer, void *info) {
     (void)timer;
     rift_timer_ctx_t *ctx = (rift_timer_ctx_t*)info;
@@ -273,14 +1087,14 @@ static void rift_timer_callback(CFRunLoopTimerRef timer, void *info) {
     lua_State *L = ctx->L;
     int top = lua_gettop(L);
     while (1) {
-        int rc = rift_pump_once_internal(L, ctx->client, 0, false);
+        int rc = rift_pump_once_internal(L, ctx->client, 0, false, NULL);
         if (rc <= 0) break;
     }
     lua_settop(L, top);
 }
 
-static bool rift_start_auto_pump(lua_State *L, rift_t *client) {
-    rift_timer_ctx_t *existing = rift_get_timer_ctx(L, client);
+static bool rift_start_run_loop_timer(lua_State *L, rift_t *client) {
+    rift_timer_ctx_t *existing = client->timer_ctx;
     if (existing && existing->timer) return true;
 
     rift_timer_ctx_t *ctx = (rift_timer_ctx_t*)calloc(1, sizeof(rift_timer_ctx_t));
@@ -312,12 +1126,12 @@ static bool rift_start_auto_pump(lua_State *L, rift_t *client) {
     }
 
     CFRunLoopAddTimer(CFRunLoopGetMain(), ctx->timer, kCFRunLoopCommonModes);
-    rift_set_timer_ctx(L, client, ctx);
+    client->timer_ctx = ctx;
     return true;
 }
 
-static void rift_stop_auto_pump(lua_State *L, rift_t *client) {
-    rift_timer_ctx_t *ctx = rift_get_timer_ctx(L, client);
+static void rift_stop_run_loop_timer(rift_t *client) {
+    rift_timer_ctx_t *ctx = client->timer_ctx;
     if (!ctx) return;
 
     if (ctx->timer) {
@@ -325,149 +1139,758 @@ static void rift_stop_auto_pump(lua_State *L, rift_t *client) {
         CFRelease(ctx->timer);
         ctx->timer = NULL;
     }
-    rift_set_timer_ctx(L, client, NULL);
+    client->timer_ctx = NULL;
     free(ctx);
 }
+#endif
 
-static int rift_subscribe_events(lua_State *L, rift_t *client, int table_index) {
-    uint32_t event_count = (uint32_t)lua_rawlen(L, table_index);
-    if (event_count == 0) {
-        lua_pushnil(L);
-        lua_pushstring(L, "Events table cannot be empty.");
-        return 2;
+#define RIFT_LOOP_METATABLE "rift.loop"
+#define RIFT_LOOP_MIN_INTERVAL_NS 1000000ull
+
+typedef struct {
+    lua_Integer id;
+    uint64_t due_ns;
+    uint64_t interval_ns;
+    int callback_ref;
+} rift_loop_timer_t;
+
+// State behind rift.run(): the clients whose events it dispatches, timers from
+// rift.after/rift.every and the rift.defer queue. One per lua_State, kept in
+// the registry under a lightuserdata key.
+typedef struct {
+    int poller;
+    bool dirty;
+    rift_t **clients;
+    size_t client_count;
+    size_t client_capacity;
+    rift_loop_timer_t *timers;
+    size_t timer_count;
+    size_t timer_capacity;
+    lua_Integer next_timer_id;
+    int deferred_ref;
+    bool running;
+    bool stopping;
+} rift_loop_t;
+
+static const char rift_loop_key = 0;
+
+static int rift_loop_gc(lua_State *L) {
+    rift_loop_t *loop = (rift_loop_t*)luaL_checkudata(L, 1, RIFT_LOOP_METATABLE);
+    if (loop->poller >= 0) close(loop->poller);
+    loop->poller = -1;
+    free(loop->clients);
+    loop->clients = NULL;
+    loop->client_count = 0;
+    loop->client_capacity = 0;
+    free(loop->timers);
+    loop->timers = NULL;
+    loop->timer_count = 0;
+    loop->timer_capacity = 0;
+    return 0;
+}
+
+static rift_loop_t* rift_get_loop(lua_State *L, bool create) {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &rift_loop_key);
+    rift_loop_t *loop = (rift_loop_t*)lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    if (loop || !create) return loop;
+
+    loop = (rift_loop_t*)lua_newuserdata(L, sizeof(rift_loop_t));
+    memset(loop, 0, sizeof(rift_loop_t));
+    loop->poller = -1;
+    loop->next_timer_id = 1;
+    loop->deferred_ref = LUA_NOREF;
+    if (luaL_newmetatable(L, RIFT_LOOP_METATABLE)) {
+        lua_pushcfunction(L, rift_loop_gc);
+        lua_setfield(L, -2, "__gc");
     }
+    lua_setmetatable(L, -2);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &rift_loop_key);
+    return loop;
+}
 
-    for (uint32_t i = 0; i < event_count; ++i) {
-        lua_rawgeti(L, table_index, (lua_Integer)(i + 1));
-        const char *event = luaL_checkstring(L, -1);
-        int rc = rift_send_event_subscription_request(L, client, "subscribe", event);
-        lua_pop(L, 1);
-        if (rc != 1) {
-            return rc;
-        }
-        lua_pop(L, 1);
+static bool rift_loop_has_client(const rift_loop_t *loop, const rift_t *client) {
+    for (size_t i = 0; i < loop->client_count; ++i) {
+        if (loop->clients[i] == client) return true;
     }
+    return false;
+}
 
-    return 1;
+static bool rift_loop_add_client(lua_State *L, rift_t *client) {
+    rift_loop_t *loop = rift_get_loop(L, true);
+    if (rift_loop_has_client(loop, client)) return true;
+
+    if (loop->client_count == loop->client_capacity) {
+        size_t capacity = loop->client_capacity ? loop->client_capacity * 2 : 4;
+        rift_t **clients = (rift_t**)realloc(loop->clients, sizeof(rift_t*) * capacity);
+        if (!clients) return false;
+        loop->clients = clients;
+        loop->client_capacity = capacity;
+    }
+
+    loop->clients[loop->client_count++] = client;
+    client->loop_fd = -1;
+    loop->dirty = true;
+    return true;
 }
 
-static int rift_resubscribe_callback_events(lua_State *L, rift_t *client) {
-    if (!rift_push_client_callback_list(L, client, false)) {
-        return 1;
+static void rift_loop_remove_client(lua_State *L, rift_t *client) {
+    rift_loop_t *loop = rift_get_loop(L, false);
+    if (!loop) return;
+
+    for (size_t i = 0; i < loop->client_count; ++i) {
+        if (loop->clients[i] != client) continue;
+        memmove(&loop->clients[i], &loop->clients[i + 1], sizeof(rift_t*) * (loop->client_count - i - 1));
+        loop->client_count--;
+        // The client's descriptor may already be closed and its number reused,
+        // so the poller is rebuilt instead of deregistering it.
+        loop->dirty = true;
+        break;
     }
+    client->loop_fd = -1;
+}
 
-    lua_Integer cb_count = (lua_Integer)lua_rawlen(L, -1);
-    for (lua_Integer i = 1; i <= cb_count; ++i) {
+// Registers every client's descriptor with the poller, rebuilding it when a
+// client joined, left or reopened its event stream. Returns how many clients
+// can be waited on.
+static size_t rift_loop_sync(rift_loop_t *loop) {
+    bool dirty = loop->dirty || loop->poller < 0;
+    for (size_t i = 0; i < loop->client_count && !dirty; ++i) {
+        rift_t *client = loop->clients[i];
+        int fd = rift_client_fileno(client);
+        if (fd != client->loop_fd || (fd >= 0 && client->transport.stream_generation != client->loop_generation)) {
+            dirty = true;
+        }
+    }
+
+    size_t waitable = 0;
+    if (!dirty) {
+        for (size_t i = 0; i < loop->client_count; ++i) {
+            if (loop->clients[i]->loop_fd >= 0) waitable++;
+        }
+        return waitable;
+    }
+
+    if (loop->poller >= 0) close(loop->poller);
+    loop->poller = rift_poller_create();
+    loop->dirty = false;
+
+    for (size_t i = 0; i < loop->client_count; ++i) {
+        rift_t *client = loop->clients[i];
+        int fd = rift_client_fileno(client);
+        client->loop_fd = -1;
+        if (fd < 0 || loop->poller < 0) continue;
+        if (rift_poller_add(loop->poller, fd, client)) {
+            client->loop_fd = fd;
+            client->loop_generation = client->transport.stream_generation;
+            waitable++;
+        }
+    }
+    return waitable;
+}
+
+static void rift_loop_report_error(lua_State *L, const char *what) {
+    const char *err = lua_tostring(L, -1);
+    fprintf(stderr, "rift %s error: %s\n", what, err ? err : "unknown error");
+    lua_pop(L, 1);
+}
+
+static void rift_loop_run_deferred(lua_State *L, rift_loop_t *loop) {
+    if (loop->deferred_ref == LUA_NOREF) return;
+
+    // Detach the queue first so callbacks deferring more work land in the
+    // next iteration instead of extending this one forever.
+    lua_rawgeti(L, LUA_REGISTRYINDEX, loop->deferred_ref);
+    luaL_unref(L, LUA_REGISTRYINDEX, loop->deferred_ref);
+    loop->deferred_ref = LUA_NOREF;
+
+    lua_Integer count = (lua_Integer)lua_rawlen(L, -1);
+    for (lua_Integer i = 1; i <= count; ++i) {
         lua_rawgeti(L, -1, i);
-        if (!lua_istable(L, -1)) {
-            lua_pop(L, 1);
-            continue;
+        if (lua_pcall(L, 0, 0, 0) != LUA_OK) rift_loop_report_error(L, "deferred callback");
+    }
+    lua_pop(L, 1);
+}
+
+static bool rift_loop_next_deadline(rift_loop_t *loop, uint64_t *deadline) {
+    bool found = false;
+    for (size_t i = 0; i < loop->timer_count; ++i) {
+        if (!found || loop->timers[i].due_ns < *deadline) *deadline = loop->timers[i].due_ns;
+        found = true;
+    }
+
+    for (size_t i = 0; i < loop->client_count; ++i) {
+        uint64_t due_ns = 0;
+        if (!rift_client_deadline_ns(loop->clients[i], &due_ns)) continue;
+        if (!found || due_ns < *deadline) *deadline = due_ns;
+        found = true;
+    }
+    return found;
+}
+
+static void rift_loop_drain(lua_State *L, rift_t *client) {
+    int top = lua_gettop(L);
+    while (rift_pump_once_internal(L, client, 0, false, NULL) > 0) {}
+    lua_settop(L, top);
+}
+
+static void rift_loop_pump_due(lua_State *L, rift_loop_t *loop) {
+    uint64_t now = rift_now_ns();
+    for (size_t i = 0; i < loop->client_count; ++i) {
+        rift_t *client = loop->clients[i];
+        uint64_t due_ns = 0;
+        if (!rift_client_deadline_ns(client, &due_ns) || due_ns > now) continue;
+
+        int top = lua_gettop(L);
+        rift_pump_once_internal(L, client, 0, false, NULL);
+        lua_settop(L, top);
+    }
+}
+
+static void rift_loop_remove_timer_at(rift_loop_t *loop, size_t index) {
+    memmove(&loop->timers[index], &loop->timers[index + 1], sizeof(rift_loop_timer_t) * (loop->timer_count - index - 1));
+    loop->timer_count--;
+}
+
+static void rift_loop_fire_timers(lua_State *L, rift_loop_t *loop) {
+    uint64_t now = rift_now_ns();
+    while (!loop->stopping) {
+        size_t index = loop->timer_count;
+        for (size_t i = 0; i < loop->timer_count; ++i) {
+            if (loop->timers[i].due_ns > now) continue;
+            if (index == loop->timer_count || loop->timers[i].due_ns < loop->timers[index].due_ns) index = i;
         }
+        if (index == loop->timer_count) break;
 
-        lua_getfield(L, -1, "events");
-        if (!lua_istable(L, -1)) {
-            lua_pop(L, 2);
-            continue;
+        rift_loop_timer_t timer = loop->timers[index];
+        if (timer.interval_ns) {
+            uint64_t next = timer.due_ns + timer.interval_ns;
+            loop->timers[index].due_ns = next > now ? next : now + timer.interval_ns;
+            lua_rawgeti(L, LUA_REGISTRYINDEX, timer.callback_ref);
+        } else {
+            rift_loop_remove_timer_at(loop, index);
+            lua_rawgeti(L, LUA_REGISTRYINDEX, timer.callback_ref);
+            luaL_unref(L, LUA_REGISTRYINDEX, timer.callback_ref);
+        }
+
+        if (lua_pcall(L, 0, 0, 0) != LUA_OK) rift_loop_report_error(L, "timer callback");
+    }
+}
+
+static int rift_loop_add_timer(lua_State *L, bool repeat) {
+    lua_Integer ms = luaL_checkinteger(L, 1);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    if (ms < 0) ms = 0;
+
+    rift_loop_t *loop = rift_get_loop(L, true);
+    if (loop->timer_count == loop->timer_capacity) {
+        size_t capacity = loop->timer_capacity ? loop->timer_capacity * 2 : 8;
+        rift_loop_timer_t *timers = (rift_loop_timer_t*)realloc(loop->timers, sizeof(rift_loop_timer_t) * capacity);
+        if (!timers) {
+            lua_pushnil(L);
+            lua_pushstring(L, "Failed to allocate timer.");
+            return 2;
         }
+        loop->timers = timers;
+        loop->timer_capacity = capacity;
+    }
+
+    uint64_t interval_ns = (uint64_t)ms * 1000000ull;
+    rift_loop_timer_t *timer = &loop->timers[loop->timer_count++];
+    timer->id = loop->next_timer_id++;
+    timer->due_ns = rift_now_ns() + interval_ns;
+    timer->interval_ns = repeat ? (interval_ns < RIFT_LOOP_MIN_INTERVAL_NS ? RIFT_LOOP_MIN_INTERVAL_NS : interval_ns) : 0;
+    lua_pushvalue(L, 2);
+    timer->callback_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    lua_pushinteger(L, timer->id);
+    return 1;
+}
+
+static int l_rift_after(lua_State *L) {
+    return rift_loop_add_timer(L, false);
+}
+
+static int l_rift_every(lua_State *L) {
+    return rift_loop_add_timer(L, true);
+}
+
+static int l_rift_cancel(lua_State *L) {
+    lua_Integer id = luaL_checkinteger(L, 1);
+    rift_loop_t *loop = rift_get_loop(L, false);
+    if (loop) {
+        for (size_t i = 0; i < loop->timer_count; ++i) {
+            if (loop->timers[i].id != id) continue;
+            luaL_unref(L, LUA_REGISTRYINDEX, loop->timers[i].callback_ref);
+            rift_loop_remove_timer_at(loop, i);
+            lua_pushboolean(L, 1);
+            return 1;
+        }
+    }
+    lua_pushboolean(L, 0);
+    return 1;
+}
 
+// Queues the function on top of the stack (popped) for the next loop turn.
+static void rift_loop_defer(lua_State *L) {
+    rift_loop_t *loop = rift_get_loop(L, true);
+    if (loop->deferred_ref == LUA_NOREF) {
+        lua_newtable(L);
+        loop->deferred_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, loop->deferred_ref);
+    lua_insert(L, -2);
+    lua_rawseti(L, -2, (lua_Integer)lua_rawlen(L, -2) + 1);
+    lua_pop(L, 1);
+}
+
+static int l_rift_defer(lua_State *L) {
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    lua_pushvalue(L, 1);
+    rift_loop_defer(L);
+    return 0;
+}
+
+static int l_rift_stop(lua_State *L) {
+    rift_loop_t *loop = rift_get_loop(L, false);
+    if (loop) loop->stopping = true;
+    return 0;
+}
+
+// Dispatches events for every subscribed client plus timers and deferred
+// callbacks until rift.stop() is called or there is nothing left to wait for.
+// Blocks in epoll/kqueue with no timeout while idle.
+static int l_rift_run(lua_State *L) {
+    rift_loop_t *loop = rift_get_loop(L, true);
+    if (loop->running) return luaL_error(L, "rift.run is already running.");
+
+    loop->running = true;
+    loop->stopping = false;
+    int top = lua_gettop(L);
+
+    while (!loop->stopping) {
+        rift_loop_run_deferred(L, loop);
+        if (loop->stopping) break;
+
+        size_t waitable = rift_loop_sync(loop);
+        uint64_t deadline = 0;
+        bool has_deadline = rift_loop_next_deadline(loop, &deadline);
+        bool has_deferred = loop->deferred_ref != LUA_NOREF;
+        if (!waitable && !has_deadline && !has_deferred) break;
+
+        int timeout_ms = -1;
+        if (has_deferred) {
+            timeout_ms = 0;
+        } else if (has_deadline) {
+            uint64_t now = rift_now_ns();
+            uint64_t wait_ns = deadline > now ? deadline - now : 0;
+            uint64_t wait_ms = (wait_ns + 999999ull) / 1000000ull;
+            timeout_ms = wait_ms > INT_MAX ? INT_MAX : (int)wait_ms;
+        }
+
+        void *ready[RIFT_POLLER_MAX_EVENTS];
+        int ready_count = 0;
+        if (waitable) {
+            ready_count = rift_poller_wait(loop->poller, timeout_ms, ready, RIFT_POLLER_MAX_EVENTS);
+            if (ready_count < 0) {
+                loop->running = false;
+                lua_pushnil(L);
+                lua_pushstring(L, "Event loop wait failed.");
+                return 2;
+            }
+        } else if (timeout_ms > 0) {
+            rift_sleep_ns((uint64_t)timeout_ms * 1000000ull);
+        }
+
+        for (int i = 0; i < ready_count && !loop->stopping; ++i) {
+            rift_t *client = (rift_t*)ready[i];
+            if (rift_loop_has_client(loop, client)) rift_loop_drain(L, client);
+        }
+        if (!loop->stopping) rift_loop_pump_due(L, loop);
+        rift_loop_fire_timers(L, loop);
+        lua_settop(L, top);
+    }
+
+    loop->running = false;
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// Subscribed clients are always dispatched by rift.run(); on macOS they are
+// also pumped from a CoreFoundation run-loop timer for Cocoa hosts.
+static bool rift_start_auto_pump(lua_State *L, rift_t *client) {
+    if (!rift_loop_add_client(L, client)) return false;
+#ifdef __APPLE__
+    return rift_start_run_loop_timer(L, client);
+#else
+    return true;
+#endif
+}
+
+static void rift_stop_auto_pump(lua_State *L, rift_t *client) {
+    rift_loop_remove_client(L, client);
+#ifdef __APPLE__
+    rift_stop_run_loop_timer(client);
+#endif
+}
+
+static int rift_subscribe_events(lua_State *L, rift_t *client, int table_index) {
+    uint32_t event_count = (uint32_t)lua_rawlen(L, table_index);
+    if (event_count == 0) {
         lua_pushnil(L);
-        while (lua_next(L, -2) != 0) {
-            const char *event = lua_tostring(L, -2);
-            if (event) {
-                int rc = rift_send_event_subscription_request(L, client, "subscribe", event);
-                lua_pop(L, 1);
-                if (rc != 1) {
-                    lua_pop(L, 2);
-                    lua_pop(L, 1);
-                    return rc;
-                }
-                lua_pop(L, 1);
-            } else {
+        lua_pushstring(L, "Events table cannot be empty.");
+        return 2;
+    }
+
+    for (uint32_t i = 0; i < event_count; ++i) {
+        lua_rawgeti(L, table_index, (lua_Integer)(i + 1));
+        const char *event = luaL_checkstring(L, -1);
+        int rc = rift_send_event_subscription_request(L, client, "subscribe", event);
+        lua_pop(L, 1);
+        if (rc != 1) {
+            return rc;
+        }
+        lua_pop(L, 1);
+    }
+
+    return 1;
+}
+
+// Subscribes again to every event the callbacks, the mirror and the cache
+// need, each name once, as one batch of control requests.
+static int rift_resubscribe_callback_events(lua_State *L, rift_t *client) {
+    lua_newtable(L);
+    int names_index = lua_gettop(L);
+    if (client->mirror) {
+        for (size_t i = 0; i < sizeof(rift_known_events) / sizeof(rift_known_events[0]); ++i) {
+            lua_pushboolean(L, 1);
+            lua_setfield(L, names_index, rift_known_events[i]);
+        }
+    }
+    if (client->cache) {
+        for (size_t i = 0; i < client->cache->rule_count; ++i) {
+            lua_pushboolean(L, 1);
+            lua_setfield(L, names_index, client->cache->rules[i].event);
+        }
+    }
+    if (rift_push_client_callback_list(L, client, false)) {
+        lua_Integer cb_count = (lua_Integer)lua_rawlen(L, -1);
+        for (lua_Integer i = 1; i <= cb_count; ++i) {
+            if (lua_rawgeti(L, -1, i) != LUA_TTABLE || lua_rawgeti(L, -1, RIFT_CB_EVENTS) != LUA_TTABLE) {
+                lua_settop(L, names_index + 1);
+                continue;
+            }
+            lua_pushnil(L);
+            while (lua_next(L, -2) != 0) {
                 lua_pop(L, 1);
+                if (lua_type(L, -1) != LUA_TSTRING) continue;
+                lua_pushvalue(L, -1);
+                lua_pushboolean(L, 1);
+                lua_rawset(L, names_index);
             }
+            lua_settop(L, names_index + 1);
         }
+    }
+    lua_settop(L, names_index);
 
-        lua_pop(L, 2);
+    size_t count = 0;
+    lua_pushnil(L);
+    while (lua_next(L, names_index) != 0) {
+        lua_pop(L, 1);
+        count++;
+    }
+    if (count == 0) {
+        lua_pop(L, 1);
+        return 1;
     }
 
+    char **requests = (char**)calloc(count, sizeof(char*));
+    char **replies = (char**)calloc(count, sizeof(char*));
+    bool ok = requests && replies;
+    size_t built = 0;
+    size_t bytes = 0;
+    lua_pushnil(L);
+    while (lua_next(L, names_index) != 0) {
+        lua_pop(L, 1);
+        if (!ok) continue;
+        cJSON *root = cJSON_CreateObject();
+        cJSON *sub = root ? cJSON_AddObjectToObject(root, "subscribe") : NULL;
+        if (sub && cJSON_AddStringToObject(sub, "event", lua_tostring(L, -1))) {
+            requests[built] = cJSON_PrintUnformatted(root);
+        }
+        cJSON_Delete(root);
+        if (!requests[built]) {
+            ok = false;
+            continue;
+        }
+        bytes += strlen(requests[built++]);
+    }
     lua_pop(L, 1);
+
+    if (ok) {
+        uint64_t start = rift_now_ns();
+        ok = rift_transport_control_batch(&client->transport, (const char *const *)requests, count, replies);
+        uint64_t end = rift_now_ns();
+        rift_stats_record(&client->stats, RIFT_STAT_SEND, end - start, bytes);
+        rift_trace_span(client->trace, "control_batch", RIFT_TRACE_TID_LUA, start, end, (int64_t)count);
+        if (!ok) rift_stats_error(&client->stats, RIFT_STAT_SEND);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (requests) cJSON_free(requests[i]);
+        if (replies) free(replies[i]);
+    }
+    free(requests);
+    free(replies);
+
+    if (!ok) {
+        lua_pushnil(L);
+        lua_pushstring(L, "Failed to resubscribe to events.");
+        return 2;
+    }
     return 1;
 }
 
-static char* rift_extract_event_type(const char *event_json) {
-    if (!event_json) return NULL;
-    cJSON *root = cJSON_Parse(event_json);
-    if (!root) return NULL;
+static const char* rift_event_type(const cJSON *event_root) {
+    if (!event_root) return NULL;
 
-    cJSON *type = cJSON_GetObjectItemCaseSensitive(root, "type");
-    char *out = NULL;
+    const cJSON *type = cJSON_GetObjectItemCaseSensitive(event_root, "type");
     if (cJSON_IsString(type) && type->valuestring) {
-        size_t len = strlen(type->valuestring);
-        out = (char*)malloc(len + 1);
-        if (out) memcpy(out, type->valuestring, len + 1);
+        return type->valuestring;
     }
-
-    cJSON_Delete(root);
-    return out;
+    return NULL;
 }
 
 static bool rift_ensure_event_port(lua_State *L, rift_t *client) {
-    if (client->server_port == MACH_PORT_NULL) {
+    if (!rift_transport_is_connected(&client->transport)) {
         lua_pushnil(L);
         lua_pushstring(L, "Client is disconnected.");
         return false;
     }
 
-    if (client->event_port == MACH_PORT_NULL) {
-        client->event_port = rift_allocate_reply_port_internal();
-        if (client->event_port == MACH_PORT_NULL) {
-            lua_pushnil(L);
-            lua_pushstring(L, "Failed to allocate event stream port.");
-            return false;
-        }
+    // A worker may have read a replay to its end with the events still
+    // queued; the stream is open as far as callers are concerned.
+    if (!rift_client_has_event_stream(client) && !rift_transport_open_event_stream(&client->transport)) {
+        lua_pushnil(L);
+        lua_pushstring(L, "Failed to allocate event stream port.");
+        return false;
     }
 
     return true;
 }
 
-static int l_rift_reconnect(lua_State *L) {
-    rift_t *client = (rift_t*)luaL_checkudata(L, 1, "rift.client");
+// One request/response exchange, accounted to the send stage. `frame`, when
+// not NULL, holds `request_json` behind room for the socket frame header.
+static char* rift_client_request_frame(rift_t *client, char *frame, const char *request_json, size_t len, bool await_response) {
+    uint64_t start = rift_now_ns();
+    char* response_json = frame ?
+        rift_transport_request_prefixed(&client->transport, frame, len, await_response) :
+        rift_transport_request(&client->transport, request_json, await_response);
+    uint64_t end = rift_now_ns();
+    rift_stats_record(&client->stats, RIFT_STAT_SEND, end - start, len);
+    rift_trace_span(client->trace, "send_request", RIFT_TRACE_TID_LUA, start, end, (int64_t)len);
+    if (response_json == NULL) rift_stats_error(&client->stats, RIFT_STAT_SEND);
+    return response_json;
+}
+
+static char* rift_client_request(rift_t *client, const char *request_json, bool await_response) {
+    return rift_client_request_frame(client, NULL, request_json, strlen(request_json), await_response);
+}
 
-    if (client->event_port != MACH_PORT_NULL) {
-        rift_deallocate_reply_port_internal(client->event_port);
-        client->event_port = MACH_PORT_NULL;
+// Fetches a snapshot and parses it; the window list points into `*root`.
+static const cJSON* rift_client_fetch_windows(lua_State *L, rift_t *client, cJSON **root) {
+    *root = NULL;
+    char *response = rift_client_request(client, client->mirror_request, true);
+    if (!response) {
+        lua_pushnil(L);
+        lua_pushstring(L, "Snapshot request failed.");
+        return NULL;
     }
-    if (client->server_port != MACH_PORT_NULL) {
-        rift_disconnect_internal(client->server_port);
-        client->server_port = MACH_PORT_NULL;
+    *root = cJSON_Parse(response);
+    free(response);
+    const cJSON *windows = rift_mirror_snapshot_windows(*root);
+    if (!windows) {
+        cJSON_Delete(*root);
+        *root = NULL;
+        lua_pushnil(L);
+        lua_pushstring(L, "Snapshot response has no window list.");
     }
+    return windows;
+}
 
-    client->server_port = rift_connect_internal();
-    if (client->server_port == MACH_PORT_NULL) {
+static int rift_client_load_mirror(lua_State *L, rift_t *client) {
+    // Replay clients have no server; their mirror is built from events only.
+    if (!rift_transport_has_server(&client->transport)) return 1;
+    cJSON *root = NULL;
+    const cJSON *windows = rift_client_fetch_windows(L, client, &root);
+    if (!windows) return 2;
+    rift_mirror_load(client->mirror, windows);
+    cJSON_Delete(root);
+    return 1;
+}
+
+// Subscribes to every event the mirror follows, then loads a snapshot, so
+// no change between the two is missed.
+static int rift_client_sync_mirror(lua_State *L, rift_t *client) {
+    size_t count = sizeof(rift_known_events) / sizeof(rift_known_events[0]);
+    for (size_t i = 0; i < count; ++i) {
+        int rc = rift_send_event_subscription_request(L, client, "subscribe", rift_known_events[i]);
+        if (rc != 1) return rc;
+        lua_pop(L, 1);
+    }
+    return rift_client_load_mirror(L, client);
+}
+
+// Reconnects to the same endpoint and brings back the event stream, every
+// subscription, the mirror's snapshot and the worker. Cached responses came
+// from the old server and are dropped. Returns 1 with nothing pushed, or 2
+// with nil and a message.
+static int rift_client_restore(lua_State *L, rift_t *client) {
+    rift_client_stop_worker(client);
+
+    const char *err = NULL;
+    if (!rift_transport_reconnect(&client->transport, &err)) {
         lua_pushnil(L);
         lua_pushstring(L, "Failed to reconnect to Rift server.");
         return 2;
     }
 
-    client->event_port = rift_allocate_reply_port_internal();
-    if (client->event_port == MACH_PORT_NULL) {
-        rift_disconnect_internal(client->server_port);
-        client->server_port = MACH_PORT_NULL;
+    if (!rift_transport_open_event_stream(&client->transport)) {
+        rift_transport_close(&client->transport);
         lua_pushnil(L);
         lua_pushstring(L, "Failed to allocate event stream port on reconnect.");
         return 2;
     }
 
+    // The mirror's events are in the batch, so only its snapshot is left.
     int rc = rift_resubscribe_callback_events(L, client);
     if (rc != 1) {
         return rc;
     }
+    if (client->mirror) {
+        rc = rift_client_load_mirror(L, client);
+        if (rc != 1) return rc;
+    }
+    if (client->cache) rift_cache_clear(L, client->cache);
+    rift_client_recovered(client);
+    rift_client_start_worker(client);
+    return 1;
+}
+
+// One attempt once the backoff has passed, waiting for it up to
+// `timeout_ms` (< 0 waits as long as needed). True once recovered.
+static bool rift_client_try_reconnect(lua_State *L, rift_t *client, int timeout_ms) {
+    rift_reconnect_t *reconnect = &client->reconnect;
+    if (!reconnect->lost_ns) return false;
+
+    uint64_t now = rift_now_ns();
+    if (reconnect->next_ns > now) {
+        uint64_t wait_ns = reconnect->next_ns - now;
+        if (timeout_ms >= 0 && wait_ns > (uint64_t)timeout_ms * 1000000ull) {
+            if (timeout_ms > 0) rift_sleep_ns((uint64_t)timeout_ms * 1000000ull);
+            return false;
+        }
+        rift_sleep_ns(wait_ns);
+    }
 
+    reconnect->attempts++;
+    int top = lua_gettop(L);
+    int rc = rift_client_restore(L, client);
+    lua_settop(L, top);
+    if (rc == 1) return true;
+
+    // Whatever was reopened goes again, so the next attempt starts clean.
+    rift_client_stop_worker(client);
+    rift_transport_close(&client->transport);
+    reconnect->failures++;
+    reconnect->next_ns = rift_now_ns() + reconnect->backoff_ns;
+    reconnect->backoff_ns *= 2;
+    if (reconnect->backoff_ns > reconnect->max_ns) reconnect->backoff_ns = reconnect->max_ns;
+    return false;
+}
+
+// client:set_catchup(true | false | {enter, exit, batch}): thresholds are
+// backlog depths in events; see rift_backlog_t.
+static int l_rift_set_catchup(lua_State *L) {
+    rift_t *client = (rift_t*)luaL_checkudata(L, 1, "rift.client");
+    rift_backlog_t *backlog = &client->backlog;
+    lua_Integer enter_at = RIFT_CATCHUP_DEFAULT_ENTER;
+    lua_Integer exit_at = RIFT_CATCHUP_DEFAULT_EXIT;
+    lua_Integer batch = RIFT_CATCHUP_DEFAULT_BATCH;
+    if (lua_istable(L, 2)) {
+        lua_getfield(L, 2, "enter");
+        if (!lua_isnil(L, -1)) enter_at = luaL_checkinteger(L, -1);
+        lua_getfield(L, 2, "exit");
+        if (!lua_isnil(L, -1)) exit_at = luaL_checkinteger(L, -1);
+        lua_getfield(L, 2, "batch");
+        if (!lua_isnil(L, -1)) batch = luaL_checkinteger(L, -1);
+        lua_pop(L, 3);
+    }
+    if (enter_at < 1) return luaL_argerror(L, 2, "enter must be positive");
+    if (exit_at < 0 || exit_at >= enter_at) return luaL_argerror(L, 2, "exit must be below enter");
+    if (batch < 2 || batch > RIFT_CATCHUP_MAX_BATCH) return luaL_argerror(L, 2, "batch must be between 2 and 1024");
+
+    backlog->catchup_enabled = lua_toboolean(L, 2);
+    backlog->enter = (size_t)enter_at;
+    backlog->exit = (size_t)exit_at;
+    backlog->batch = (size_t)batch;
+    if (!backlog->catchup_enabled) backlog->catchup = false;
+    lua_pushboolean(L, backlog->catchup_enabled);
+    return 1;
+}
+
+static int l_rift_reconnect(lua_State *L) {
+    rift_t *client = (rift_t*)luaL_checkudata(L, 1, "rift.client");
+
+    if (!rift_transport_has_server(&client->transport)) {
+        lua_pushnil(L);
+        lua_pushstring(L, "Replay clients cannot reconnect.");
+        return 2;
+    }
+
+    int rc = rift_client_restore(L, client);
+    if (rc != 1) return rc;
     lua_settop(L, 1);
     return 1;
 }
 
+// client:set_reconnect(true | false | {min_ms, max_ms}): with it on, a closed
+// or broken event stream is reconnected by pump() and rift.run(), retrying
+// after min_ms and doubling up to max_ms between attempts.
+static int l_rift_set_reconnect(lua_State *L) {
+    rift_t *client = (rift_t*)luaL_checkudata(L, 1, "rift.client");
+    rift_reconnect_t *reconnect = &client->reconnect;
+    lua_Integer min_ms = RIFT_RECONNECT_DEFAULT_MIN_MS;
+    lua_Integer max_ms = RIFT_RECONNECT_DEFAULT_MAX_MS;
+    if (lua_istable(L, 2)) {
+        lua_getfield(L, 2, "min_ms");
+        if (!lua_isnil(L, -1)) min_ms = luaL_checkinteger(L, -1);
+        lua_getfield(L, 2, "max_ms");
+        if (!lua_isnil(L, -1)) max_ms = luaL_checkinteger(L, -1);
+        lua_pop(L, 2);
+    }
+    if (min_ms < 1) return luaL_argerror(L, 2, "min_ms must be positive");
+    if (max_ms < min_ms) max_ms = min_ms;
+
+    reconnect->enabled = lua_toboolean(L, 2) && rift_transport_has_server(&client->transport);
+    reconnect->min_ns = (uint64_t)min_ms * 1000000ull;
+    reconnect->max_ns = (uint64_t)max_ms * 1000000ull;
+    if (!reconnect->enabled) {
+        reconnect->lost_ns = 0;
+        reconnect->next_ns = 0;
+    }
+    lua_pushboolean(L, reconnect->enabled);
+    return 1;
+}
+
 static int rift_send_event_subscription_request(lua_State *L, rift_t *client, const char *key, const char *event) {
+    // A replay log already contains whatever the recording client subscribed
+    // to; callbacks only filter it locally.
+    if (!rift_transport_has_server(&client->transport)) {
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
     cJSON *root = cJSON_CreateObject();
     cJSON *sub = cJSON_CreateObject();
     if (!root || !sub) {
@@ -489,15 +1912,19 @@ static int rift_send_event_subscription_request(lua_State *L, rift_t *client, co
         return 2;
     }
 
-    char *response_json = rift_send_request_with_reply_port_internal(
-        client->server_port,
-        client->event_port,
-        request_json,
-        true
-    );
+    // The reply may arrive on the event stream, so the worker must not be
+    // reading it meanwhile.
+    rift_worker_pause(&client->worker);
+    uint64_t start = rift_now_ns();
+    char *response_json = rift_transport_control_request(&client->transport, request_json);
+    uint64_t end = rift_now_ns();
+    rift_stats_record(&client->stats, RIFT_STAT_SEND, end - start, strlen(request_json));
+    rift_trace_span(client->trace, "control_request", RIFT_TRACE_TID_LUA, start, end, (int64_t)strlen(request_json));
+    rift_worker_resume(&client->worker);
     cJSON_free(request_json);
 
     if (!response_json) {
+        rift_stats_error(&client->stats, RIFT_STAT_SEND);
         lua_pushnil(L);
         lua_pushstring(L, "Subscription request failed in C module.");
         return 2;
@@ -514,62 +1941,412 @@ static int rift_send_event_subscription_request(lua_State *L, rift_t *client, co
     return 1;
 }
 
+static rift_t* rift_push_client(lua_State *L, const rift_transport_t *transport) {
+    rift_t *client = (rift_t*)lua_newuserdata(L, sizeof(rift_t));
+    client->transport = *transport;
+    client->recorder = NULL;
+    client->callbacks_ref = LUA_NOREF;
+    client->keepalive_ref = LUA_NOREF;
+    client->timer_ctx = NULL;
+    client->loop_fd = -1;
+    client->loop_generation = 0;
+    client->worker_enabled = false;
+    rift_worker_init(&client->worker);
+    client->recycle = false;
+    client->mirror = NULL;
+    client->mirror_request = NULL;
+    client->cache = NULL;
+    client->pending_ref = LUA_NOREF;
+    client->flight_requests = 0;
+    client->flights = 0;
+    client->dedupe = false;
+    client->dedupe_type_count = 0;
+    client->dedupe_checked = 0;
+    client->dedupe_suppressed = 0;
+    client->dedupe_parses_skipped = 0;
+    client->info_pushed = 0;
+    client->info_external = 0;
+    client->info_copied_bytes = 0;
+    memset(&client->select, 0, sizeof(rift_select_stats_t));
+    memset(&client->reconnect, 0, sizeof(rift_reconnect_t));
+    client->reconnect.connected_ns = rift_now_ns();
+    memset(&client->backlog, 0, sizeof(rift_backlog_t));
+    rift_stats_reset(&client->stats, rift_now_ns());
+    client->trace = NULL;
+
+    luaL_newmetatable(L, "rift.client");
+    lua_setmetatable(L, -2);
+
+    return client;
+}
+
 static int l_rift_connect(lua_State *L) {
-    mach_port_t port = rift_connect_internal();
-    if (port == MACH_PORT_NULL) {
+    const char *socket_path = NULL;
+    if (lua_istable(L, 1)) {
+        lua_getfield(L, 1, "socket");
+        socket_path = lua_tostring(L, -1);
+        lua_pop(L, 1);
+    }
+
+    rift_transport_t transport;
+    const char *err = NULL;
+    if (!rift_transport_connect(&transport, socket_path, &err)) {
         lua_pushnil(L);
-        lua_pushstring(L, "Failed to connect to Rift server.");
+        lua_pushstring(L, err);
         return 2;
     }
 
-    rift_t *client = (rift_t*)lua_newuserdata(L, sizeof(rift_t));
-    client->server_port = port;
-    client->event_port = MACH_PORT_NULL;
+    rift_push_client(L, &transport);
+    return 1;
+}
 
-    luaL_newmetatable(L, "rift.client");
-    lua_setmetatable(L, -2);
+static int l_rift_replay(lua_State *L) {
+    const char *path = luaL_checkstring(L, 1);
+    bool realtime = false;
+    if (lua_gettop(L) >= 2 && !lua_isnil(L, 2)) {
+        luaL_checktype(L, 2, LUA_TTABLE);
+        lua_getfield(L, 2, "realtime");
+        realtime = lua_toboolean(L, -1);
+        lua_pop(L, 1);
+    }
+
+    rift_transport_t transport;
+    const char *err = NULL;
+    if (!rift_transport_open_replay(&transport, path, realtime, &err)) {
+        lua_pushnil(L);
+        lua_pushstring(L, err);
+        return 2;
+    }
 
+    rift_push_client(L, &transport);
     return 1;
 }
 
-static int l_rift_send_request(lua_State *L) {
+static int l_rift_record(lua_State *L) {
     rift_t *client = (rift_t*)luaL_checkudata(L, 1, "rift.client");
-    const char *request_json = luaL_checkstring(L, 2);
-    bool await_response = true;
-    if (lua_gettop(L) >= 3) {
-        await_response = lua_toboolean(L, 3);
+
+    if (client->recorder) {
+        fclose(client->recorder);
+        client->recorder = NULL;
     }
 
-    char* response_json = rift_send_request_internal(client->server_port, request_json, await_response);
+    if (lua_isnoneornil(L, 2) || (lua_isboolean(L, 2) && !lua_toboolean(L, 2))) {
+        lua_pushboolean(L, 1);
+        return 1;
+    }
 
+    const char *path = luaL_checkstring(L, 2);
+    client->recorder = rift_recorder_open(path);
+    if (!client->recorder) {
+        lua_pushnil(L);
+        lua_pushfstring(L, "Failed to open event log '%s'.", path);
+        return 2;
+    }
+
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+static void rift_copy_table(lua_State *L, int index) {
+    index = lua_absindex(L, index);
+    luaL_checkstack(L, 4, "table copy");
+    lua_createtable(L, (int)lua_rawlen(L, index), 0);
+    lua_pushnil(L);
+    while (lua_next(L, index)) {
+        if (lua_type(L, -1) == LUA_TTABLE) {
+            rift_copy_table(L, -1);
+            lua_replace(L, -2);
+        }
+        lua_pushvalue(L, -2);
+        lua_insert(L, -2);
+        lua_rawset(L, -4);
+    }
+}
+
+// Views are built from the tape, so the response takes that form first.
+static bool rift_push_columns_json(lua_State *L, const char *json) {
+    cJSON *root = cJSON_Parse(json);
+    rift_tape_t tape = {0};
+    bool ok = root && rift_tape_encode(&tape, root);
+    cJSON_Delete(root);
+    ok = ok && rift_columns_push(L, &tape);
+    rift_tape_free(&tape);
+    return ok;
+}
+
+// Pushes the decoded response (true without await_response), or nil and a
+// message; returns the number of values pushed. Serves get_* requests from
+// the response cache. A hit is only used while no event is waiting to be
+// dispatched, since that event may invalidate it. With `decode` the cache is
+// left out, since it holds full tables.
+static int rift_client_send_request_frame(lua_State *L, rift_t *client, char *frame, const char *request_json, size_t len, bool await_response, const rift_decode_t *decode) {
+    if (!rift_transport_has_server(&client->transport)) {
+        lua_pushnil(L);
+        lua_pushstring(L, "Replay clients cannot send requests.");
+        return 2;
+    }
+
+    rift_cache_t *cache = await_response && !decode ? client->cache : NULL;
+    char *cache_name = NULL;
+    char *cache_key = cache ? rift_cache_key(request_json, &cache_name) : NULL;
+    uint64_t cache_hash = cache_key ? rift_cache_hash(cache_key) : 0;
+    if (cache_key) {
+        if (rift_client_wait(client, 0) > 0) {
+            cache->bypassed++;
+        } else if (rift_cache_get(L, cache, cache_key, cache_hash, rift_now_ns())) {
+            free(cache_key);
+            free(cache_name);
+            if (!cache->shared) {
+                rift_copy_table(L, -1);
+                lua_remove(L, -2);
+            }
+            return 1;
+        }
+    }
+
+    char* response_json = rift_client_request_frame(client, frame, request_json, len, await_response);
     if (response_json == NULL) {
+        free(cache_key);
+        free(cache_name);
         lua_pushnil(L);
         lua_pushstring(L, "Request failed in C module.");
         return 2;
     }
 
     if (await_response) {
-        bool res = json_to_lua_table(L, response_json);
+        bool res = false;
+        if (!decode) res = json_to_lua_table(L, response_json);
+        else if (decode->select) res = rift_select_decode(L, decode->select, response_json, strlen(response_json), &client->select);
+        else res = rift_push_columns_json(L, response_json);
         free(response_json);
         if (!res) {
+            free(cache_key);
+            free(cache_name);
             lua_pushnil(L);
             lua_pushstring(L, "Failed to parse JSON response.");
             return 2;
         }
-    } else lua_pushboolean(L, 1);
+        if (cache_key) {
+            // The caller may modify its table; unless shared, cache a copy.
+            if (!cache->shared) rift_copy_table(L, -1);
+            rift_cache_put(L, cache, cache_key, cache_name, cache_hash, rift_now_ns());
+            if (!cache->shared) lua_pop(L, 1);
+        }
+    } else lua_pushboolean(L, 1);
+
+    return 1;
+}
+
+static int rift_client_send_request(lua_State *L, rift_t *client, const char *request_json, bool await_response) {
+    return rift_client_send_request_frame(L, client, NULL, request_json, strlen(request_json), await_response, NULL);
+}
+
+// Reads `as` from the options table at `index`; only "columns" is known.
+static bool rift_check_as(lua_State *L, int index) {
+    lua_getfield(L, index, "as");
+    const char *as = lua_tostring(L, -1);
+    bool columns = as && strcmp(as, "columns") == 0;
+    if (!columns && !lua_isnil(L, -1)) luaL_argerror(L, index, "as must be \"columns\"");
+    lua_pop(L, 1);
+    return columns;
+}
+
+// The compiled selector for the `select` option at `index`: a rift.select
+// from rift.select(), or a list of paths compiled here and left in its place.
+static const rift_select_t* rift_check_select(lua_State *L, int index) {
+    index = lua_absindex(L, index);
+    const rift_select_t *sel = (const rift_select_t*)luaL_testudata(L, index, RIFT_SELECT_METATABLE);
+    if (sel) return sel;
+    sel = rift_select_push(L, index);
+    lua_replace(L, index);
+    return sel;
+}
+
+static int l_rift_send_request(lua_State *L) {
+    rift_t *client = (rift_t*)luaL_checkudata(L, 1, "rift.client");
+    size_t len = 0;
+    const char *request_json = luaL_checklstring(L, 2, &len);
+    bool await_response = true;
+    rift_decode_t decode = {NULL, false};
+    if (lua_type(L, 3) == LUA_TTABLE) {
+        // An options table always waits for the response.
+        decode.columns = rift_check_as(L, 3);
+        lua_getfield(L, 3, "select");
+        if (!lua_isnil(L, -1)) {
+            if (decode.columns) return luaL_argerror(L, 3, "select can't be combined with as");
+            decode.select = rift_check_select(L, -1);
+        }
+    } else if (lua_gettop(L) >= 3) {
+        await_response = lua_toboolean(L, 3);
+    }
+    bool decoded = decode.select || decode.columns;
+    return rift_client_send_request_frame(L, client, NULL, request_json, len, await_response, decoded ? &decode : NULL);
+}
+
+// rift.select(paths): a selector compiled once, for any `select` option.
+static int l_rift_select(lua_State *L) {
+    rift_select_push(L, 1);
+    return 1;
+}
+
+// rift.template(format [, await_response]): a request compiled once and sent
+// with client:send_template(t, ...).
+static int l_rift_template(lua_State *L) {
+    size_t len = 0;
+    const char *format = luaL_checklstring(L, 1, &len);
+    bool await_response = lua_isnoneornil(L, 2) || lua_toboolean(L, 2);
+    rift_template_box_t *box = (rift_template_box_t*)lua_newuserdatauv(L, sizeof(rift_template_box_t), 0);
+    box->tpl = NULL;
+    luaL_setmetatable(L, RIFT_TEMPLATE_METATABLE);
+    const char *err = NULL;
+    box->tpl = rift_template_compile(format, len, await_response, &err);
+    if (!box->tpl) return luaL_argerror(L, 1, err);
+    return 1;
+}
+
+static int l_rift_template_gc(lua_State *L) {
+    rift_template_box_t *box = (rift_template_box_t*)luaL_checkudata(L, 1, RIFT_TEMPLATE_METATABLE);
+    rift_template_free(box->tpl);
+    box->tpl = NULL;
+    return 0;
+}
+
+// Renders the template into its own buffer, behind room for the socket frame
+// header, and sends it from there.
+static int l_rift_send_template(lua_State *L) {
+    rift_t *client = (rift_t*)luaL_checkudata(L, 1, "rift.client");
+    rift_template_box_t *box = (rift_template_box_t*)luaL_checkudata(L, 2, RIFT_TEMPLATE_METATABLE);
+    if (lua_gettop(L) - 2 != (int)box->tpl->slot_count) {
+        return luaL_error(L, "send_template: the template takes %d arguments", (int)box->tpl->slot_count);
+    }
+    size_t len = 0;
+    char *frame = rift_template_render(L, box->tpl, 3, RIFT_SOCKET_FRAME_HEADER_LEN, &len);
+    return rift_client_send_request_frame(L, client, frame, frame + RIFT_SOCKET_FRAME_HEADER_LEN, len, box->tpl->await_response, NULL);
+}
+
+// Sends every queued request and runs its callbacks in the order they were
+// queued. Each entry is {request = json, fn1, shared1, fn2, shared2, ...}.
+// Shared callers get the decoded table itself; the others get copies, except
+// that the last of them gets the table when no caller shares it.
+static size_t rift_client_flush(lua_State *L, rift_t *client) {
+    if (client->pending_ref == LUA_NOREF) return 0;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, client->pending_ref);
+    luaL_unref(L, LUA_REGISTRYINDEX, client->pending_ref);
+    client->pending_ref = LUA_NOREF;
+    int pending = lua_gettop(L);
+
+    lua_Integer count = (lua_Integer)lua_rawlen(L, pending);
+    for (lua_Integer i = 1; i <= count; ++i) {
+        lua_rawgeti(L, pending, i);
+        int entry = lua_gettop(L);
+        lua_getfield(L, entry, "request");
+        int results = rift_client_send_request(L, client, lua_tostring(L, -1), true);
+        int response = lua_gettop(L) - results + 1;
+        client->flights++;
+
+        lua_Integer callers = (lua_Integer)lua_rawlen(L, entry) / 2;
+        lua_Integer last_copy = 0;
+        for (lua_Integer j = 1; j <= callers; ++j) {
+            lua_rawgeti(L, entry, 2 * j);
+            if (lua_toboolean(L, -1)) last_copy = -1;
+            else if (last_copy >= 0) last_copy = j;
+            lua_pop(L, 1);
+        }
+
+        for (lua_Integer j = 1; j <= callers; ++j) {
+            lua_rawgeti(L, entry, 2 * j - 1);
+            lua_rawgeti(L, entry, 2 * j);
+            bool shared = lua_toboolean(L, -1);
+            lua_pop(L, 1);
+            if (lua_istable(L, response) && !shared && j != last_copy) rift_copy_table(L, response);
+            else lua_pushvalue(L, response);
+            if (results == 2) lua_pushvalue(L, response + 1);
+            else lua_pushnil(L);
+            if (lua_pcall(L, 2, 0, 0) != LUA_OK) rift_loop_report_error(L, "request callback");
+        }
+        lua_settop(L, entry - 1);
+    }
+    lua_pop(L, 1);
+    return (size_t)count;
+}
+
+static int rift_client_flush_deferred(lua_State *L) {
+    rift_t *client = (rift_t*)lua_touserdata(L, lua_upvalueindex(1));
+    rift_client_flush(L, client);
+    return 0;
+}
+
+// client:request(json, fn [, shared]) queues a request and calls fn(response,
+// err) when it is sent: on the next rift.run() turn or client:flush().
+// Identical get_* requests queued in the meantime ride on the same round trip.
+static int l_rift_request(lua_State *L) {
+    rift_t *client = (rift_t*)luaL_checkudata(L, 1, "rift.client");
+    const char *request_json = luaL_checkstring(L, 2);
+    luaL_checktype(L, 3, LUA_TFUNCTION);
+    bool shared = lua_toboolean(L, 4);
+
+    if (!rift_transport_has_server(&client->transport)) {
+        lua_pushnil(L);
+        lua_pushstring(L, "Replay clients cannot send requests.");
+        return 2;
+    }
+
+    if (client->pending_ref == LUA_NOREF) {
+        lua_newtable(L);
+        client->pending_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+        lua_pushvalue(L, 1);
+        lua_pushcclosure(L, rift_client_flush_deferred, 1);
+        rift_loop_defer(L);
+    }
+    lua_rawgeti(L, LUA_REGISTRYINDEX, client->pending_ref);
+    int pending = lua_gettop(L);
+
+    // Only get_* requests are collapsed; anything else may have side effects.
+    char *name = NULL;
+    char *key = rift_cache_key(request_json, &name);
+    free(name);
+    if (key) lua_getfield(L, pending, key);
+    else lua_pushnil(L);
+
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        lua_createtable(L, 2, 1);
+        lua_pushvalue(L, 2);
+        lua_setfield(L, -2, "request");
+        lua_pushvalue(L, -1);
+        lua_rawseti(L, pending, (lua_Integer)lua_rawlen(L, pending) + 1);
+        if (key) {
+            lua_pushvalue(L, -1);
+            lua_setfield(L, pending, key);
+        }
+    }
+    free(key);
+
+    lua_Integer n = (lua_Integer)lua_rawlen(L, -1);
+    lua_pushvalue(L, 3);
+    lua_rawseti(L, -2, n + 1);
+    lua_pushboolean(L, shared);
+    lua_rawseti(L, -2, n + 2);
+    client->flight_requests++;
+
+    lua_pushboolean(L, 1);
+    return 1;
+}
 
+static int l_rift_flush(lua_State *L) {
+    rift_t *client = (rift_t*)luaL_checkudata(L, 1, "rift.client");
+    lua_pushinteger(L, (lua_Integer)rift_client_flush(L, client));
     return 1;
 }
 
 static int l_rift_disconnect(lua_State *L) {
     rift_t *client = (rift_t*)luaL_checkudata(L, 1, "rift.client");
     rift_release_client(L, client);
-    if (client->event_port != MACH_PORT_NULL) {
-        rift_deallocate_reply_port_internal(client->event_port);
-        client->event_port = MACH_PORT_NULL;
-    }
-    rift_disconnect_internal(client->server_port);
-    client->server_port = MACH_PORT_NULL;
+    rift_client_stop_worker(client);
+    rift_transport_close(&client->transport);
+    client->reconnect.lost_ns = 0;
+    client->reconnect.next_ns = 0;
+    rift_backlog_free(&client->backlog);
     return 0;
 }
 
@@ -578,11 +2355,24 @@ static int l_rift_gc(lua_State *L) {
     rift_release_client(L, client);
     rift_stop_auto_pump(L, client);
     rift_clear_client_callback_list(L, client);
-    if (client->event_port != MACH_PORT_NULL) {
-        rift_deallocate_reply_port_internal(client->event_port);
-        client->event_port = MACH_PORT_NULL;
+    rift_client_stop_worker(client);
+    rift_transport_free(&client->transport);
+    rift_trace_free(client->trace);
+    client->trace = NULL;
+    rift_mirror_free(client->mirror);
+    client->mirror = NULL;
+    free(client->mirror_request);
+    client->mirror_request = NULL;
+    rift_cache_free(L, client->cache);
+    client->cache = NULL;
+    luaL_unref(L, LUA_REGISTRYINDEX, client->pending_ref);
+    client->pending_ref = LUA_NOREF;
+    rift_dedupe_free(client);
+    rift_backlog_free(&client->backlog);
+    if (client->recorder) {
+        fclose(client->recorder);
+        client->recorder = NULL;
     }
-    if (client->server_port != MACH_PORT_NULL) rift_disconnect_internal(client->server_port);
     return 0;
 }
 
@@ -594,14 +2384,53 @@ static int l_rift_subscribe(lua_State *L) {
 
     if (lua_type(L, 2) == LUA_TSTRING) {
         const char *event = lua_tostring(L, 2);
-        return rift_send_event_subscription_request(L, client, "subscribe", event);
+        int rc = rift_send_event_subscription_request(L, client, "subscribe", event);
+        if (rc == 1) rift_client_start_worker(client);
+        return rc;
     }
 
     luaL_checktype(L, 2, LUA_TTABLE);
     bool has_callback = (lua_gettop(L) >= 3 && lua_type(L, 3) == LUA_TFUNCTION);
 
+    // Compile `where` before touching the server so a bad predicate raises
+    // without leaving a half-registered subscription behind.
+    int filter_index = 0;
+    int select_index = 0;
+    bool dedupe = false;
+    bool diff = false;
+    bool columns = false;
+    if (has_callback && lua_gettop(L) >= 4 && !lua_isnil(L, 4)) {
+        luaL_checktype(L, 4, LUA_TTABLE);
+        lua_getfield(L, 4, "dedupe");
+        dedupe = lua_toboolean(L, -1);
+        lua_getfield(L, 4, "diff");
+        diff = lua_toboolean(L, -1);
+        lua_pop(L, 2);
+        lua_getfield(L, 4, "where");
+        if (!lua_isnil(L, -1)) {
+            rift_filter_push(L, -1);
+            lua_remove(L, -2);
+            filter_index = lua_gettop(L);
+        } else {
+            lua_pop(L, 1);
+        }
+        lua_getfield(L, 4, "select");
+        if (!lua_isnil(L, -1)) {
+            // Diff entries are whole records; a projection would drop fields
+            // the diff hashes.
+            if (diff) return luaL_argerror(L, 4, "select can't be combined with diff");
+            rift_check_select(L, -1);
+            select_index = lua_gettop(L);
+        } else {
+            lua_pop(L, 1);
+        }
+        columns = rift_check_as(L, 4);
+        if (columns && (diff || select_index)) return luaL_argerror(L, 4, "as can't be combined with diff or select");
+    }
+
     int rc = rift_subscribe_events(L, client, 2);
     if (rc != 1) return rc;
+    rift_client_start_worker(client);
 
     if (!has_callback) {
         lua_pushboolean(L, 1);
@@ -614,21 +2443,58 @@ static int l_rift_subscribe(lua_State *L) {
         return 2;
     }
 
+    lua_createtable(L, RIFT_CB_COLUMNS, 0);
     lua_newtable(L);
-    lua_newtable(L);
+    lua_Integer mask = 0;
     uint32_t event_count = (uint32_t)lua_rawlen(L, 2);
     for (uint32_t i = 0; i < event_count; ++i) {
         lua_rawgeti(L, 2, (lua_Integer)(i + 1));
         const char *event = luaL_checkstring(L, -1);
-        lua_pop(L, 1);
-        lua_pushstring(L, event);
+        mask |= rift_event_mask(event);
         lua_pushboolean(L, 1);
-        lua_settable(L, -3);
+        lua_rawset(L, -3);
     }
-    lua_setfield(L, -2, "events");
+    lua_rawseti(L, -2, RIFT_CB_EVENTS);
+
+    lua_pushinteger(L, mask);
+    lua_rawseti(L, -2, RIFT_CB_MASK);
 
     lua_pushvalue(L, 3);
-    lua_setfield(L, -2, "callback");
+    lua_rawseti(L, -2, RIFT_CB_CALLBACK);
+
+    if (filter_index) {
+        lua_pushvalue(L, filter_index);
+        lua_rawseti(L, -2, RIFT_CB_FILTER);
+    }
+
+    if (dedupe) {
+        lua_newtable(L);
+        lua_rawseti(L, -2, RIFT_CB_DEDUPE);
+        client->dedupe = true;
+    }
+
+    if (diff) {
+        rift_diff_box_t *box = (rift_diff_box_t*)lua_newuserdatauv(L, sizeof(rift_diff_box_t), 0);
+        box->diff = rift_diff_create();
+        luaL_setmetatable(L, RIFT_DIFF_METATABLE);
+        if (!box->diff) {
+            lua_pop(L, 3);
+            lua_pushnil(L);
+            lua_pushstring(L, "Failed to allocate diff state.");
+            return 2;
+        }
+        lua_rawseti(L, -2, RIFT_CB_DIFF);
+    }
+
+    if (select_index) {
+        lua_pushvalue(L, select_index);
+        lua_rawseti(L, -2, RIFT_CB_SELECT);
+    }
+
+    if (columns) {
+        lua_pushboolean(L, 1);
+        lua_rawseti(L, -2, RIFT_CB_COLUMNS);
+    }
 
     lua_Integer cb_count = (lua_Integer)lua_rawlen(L, -2);
     lua_rawseti(L, -2, cb_count + 1);
@@ -648,13 +2514,13 @@ static int l_rift_unsubscribe(lua_State *L) {
     rift_t *client = (rift_t*)luaL_checkudata(L, 1, "rift.client");
     const char *event = luaL_checkstring(L, 2);
 
-    if (client->server_port == MACH_PORT_NULL) {
+    if (!rift_transport_is_connected(&client->transport)) {
         lua_pushnil(L);
         lua_pushstring(L, "Client is disconnected.");
         return 2;
     }
 
-    if (client->event_port == MACH_PORT_NULL) {
+    if (!rift_transport_has_event_stream(&client->transport)) {
         lua_pushnil(L);
         lua_pushstring(L, "No active event stream port.");
         return 2;
@@ -666,34 +2532,40 @@ static int l_rift_unsubscribe(lua_State *L) {
 static int l_rift_receive_event(lua_State *L) {
     rift_t *client = (rift_t*)luaL_checkudata(L, 1, "rift.client");
 
-    if (client->event_port == MACH_PORT_NULL) {
+    if (!rift_client_has_event_stream(client)) {
         lua_pushnil(L);
         lua_pushstring(L, "No active event stream. Call subscribe first.");
         return 2;
     }
 
-    mach_msg_timeout_t timeout_ms = MACH_MSG_TIMEOUT_NONE;
+    // A timeout of 0 (or none) blocks until an event arrives.
+    int timeout_ms = -1;
     if (lua_gettop(L) >= 2 && !lua_isnil(L, 2)) {
         lua_Integer v = luaL_checkinteger(L, 2);
-        if (v < 0) v = 0;
-        timeout_ms = (mach_msg_timeout_t)v;
+        if (v > 0) timeout_ms = v > INT_MAX ? INT_MAX : (int)v;
     }
 
-    bool timed_out = false;
-    char *event_json = rift_receive_event_internal(client->event_port, timeout_ms, &timed_out);
-    if (!event_json) {
-        if (timed_out) {
+    rift_recv_status_t status;
+    rift_event_t event;
+    if (!rift_next_event(client, timeout_ms, &event, &status, false)) {
+        if (status == RIFT_RECV_TIMEOUT) {
             lua_pushnil(L);
             return 1;
         }
+        if (status == RIFT_RECV_CLOSED) {
+            lua_pushnil(L);
+            lua_pushstring(L, "Event stream closed.");
+            return 2;
+        }
 
         lua_pushnil(L);
         lua_pushstring(L, "Failed to receive event.");
         return 2;
     }
 
-    bool res = json_to_lua_table(L, event_json);
-    free(event_json);
+    rift_client_observe_event(L, client, &event);
+    bool res = rift_event_parsed(&event) && rift_client_push_event_data(L, client, &event, 0);
+    rift_event_free(&event);
     if (!res) {
         lua_pushnil(L);
         lua_pushstring(L, "Failed to parse event JSON.");
@@ -705,48 +2577,661 @@ static int l_rift_receive_event(lua_State *L) {
 
 static int l_rift_pump(lua_State *L) {
     rift_t *client = (rift_t*)luaL_checkudata(L, 1, "rift.client");
-    if (client->event_port == MACH_PORT_NULL) {
+    if (!rift_client_has_event_stream(client) && !client->reconnect.lost_ns) {
         lua_pushinteger(L, 0);
         return 1;
     }
 
-    mach_msg_timeout_t timeout_ms = 0;
+    int timeout_ms = 0;
     if (lua_gettop(L) >= 2 && !lua_isnil(L, 2)) {
         lua_Integer v = luaL_checkinteger(L, 2);
         if (v < 0) v = 0;
-        timeout_ms = (mach_msg_timeout_t)v;
+        timeout_ms = v > INT_MAX ? INT_MAX : (int)v;
     }
 
-    int rc = rift_pump_once_internal(L, client, timeout_ms, true);
+    int dispatched = 0;
+    int rc = rift_pump_once_internal(L, client, timeout_ms, true, &dispatched);
     if (rc < 0) return 2;
-    lua_pushinteger(L, rc);
+    lua_pushinteger(L, dispatched);
+    return 1;
+}
+
+static int l_rift_fileno(lua_State *L) {
+    rift_t *client = (rift_t*)luaL_checkudata(L, 1, "rift.client");
+    int fd = rift_client_fileno(client);
+    if (fd < 0) {
+        lua_pushnil(L);
+        lua_pushstring(L, "No pollable event stream.");
+        return 2;
+    }
+    lua_pushinteger(L, fd);
+    return 1;
+}
+
+static int l_rift_wait(lua_State *L) {
+    rift_t *client = (rift_t*)luaL_checkudata(L, 1, "rift.client");
+    int timeout_ms = -1;
+    if (lua_gettop(L) >= 2 && !lua_isnil(L, 2)) {
+        lua_Integer v = luaL_checkinteger(L, 2);
+        if (v < 0) v = 0;
+        timeout_ms = v > INT_MAX ? INT_MAX : (int)v;
+    }
+
+    // While reconnecting, wait for the next attempt; pump() makes it.
+    if (client->reconnect.lost_ns) {
+        uint64_t now = rift_now_ns();
+        uint64_t wait_ns = client->reconnect.next_ns > now ? client->reconnect.next_ns - now : 0;
+        if (timeout_ms >= 0 && wait_ns > (uint64_t)timeout_ms * 1000000ull) {
+            rift_sleep_ns((uint64_t)timeout_ms * 1000000ull);
+            lua_pushboolean(L, 0);
+            return 1;
+        }
+        rift_sleep_ns(wait_ns);
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    if (!rift_client_has_event_stream(client)) {
+        lua_pushnil(L);
+        lua_pushstring(L, "No active event stream.");
+        return 2;
+    }
+
+    int rc = rift_client_wait(client, timeout_ms);
+    if (rc < 0) {
+        lua_pushnil(L);
+        lua_pushstring(L, "Failed to wait for events.");
+        return 2;
+    }
+    lua_pushboolean(L, rc > 0);
+    return 1;
+}
+
+// Returns counters and latency percentiles per stage; `client:stats(true)`
+// also starts a new measurement window.
+static int l_rift_stats(lua_State *L) {
+    rift_t *client = (rift_t*)luaL_checkudata(L, 1, "rift.client");
+    bool reset = lua_toboolean(L, 2);
+    uint64_t now = rift_now_ns();
+    rift_stats_push(L, &client->stats, now);
+    if (client->cache) {
+        rift_cache_push_stats(L, client->cache);
+        lua_setfield(L, -2, "cache");
+    }
+    // collapse_ratio is requests per round trip; 1 means nothing was shared.
+    lua_createtable(L, 0, 4);
+    lua_pushinteger(L, (lua_Integer)client->flight_requests);
+    lua_setfield(L, -2, "requests");
+    lua_pushinteger(L, (lua_Integer)client->flights);
+    lua_setfield(L, -2, "flights");
+    uint64_t collapsed = client->flight_requests > client->flights ? client->flight_requests - client->flights : 0;
+    lua_pushinteger(L, (lua_Integer)collapsed);
+    lua_setfield(L, -2, "collapsed");
+    lua_pushnumber(L, client->flights ? (double)client->flight_requests / (double)client->flights : 1.0);
+    lua_setfield(L, -2, "collapse_ratio");
+    lua_setfield(L, -2, "singleflight");
+    if (client->dedupe) {
+        lua_createtable(L, 0, 4);
+        lua_pushinteger(L, (lua_Integer)client->dedupe_checked);
+        lua_setfield(L, -2, "checked");
+        lua_pushinteger(L, (lua_Integer)client->dedupe_suppressed);
+        lua_setfield(L, -2, "suppressed");
+        lua_pushinteger(L, (lua_Integer)client->dedupe_parses_skipped);
+        lua_setfield(L, -2, "parses_skipped");
+        lua_pushnumber(L, client->dedupe_checked ? (double)client->dedupe_suppressed / (double)client->dedupe_checked : 0.0);
+        lua_setfield(L, -2, "suppressed_fraction");
+        lua_setfield(L, -2, "dedupe");
+    }
+    const rift_backlog_t *backlog = &client->backlog;
+    if (backlog->samples) {
+        lua_createtable(L, 0, 9);
+        lua_pushinteger(L, (lua_Integer)backlog->depth);
+        lua_setfield(L, -2, "depth");
+        lua_pushinteger(L, (lua_Integer)backlog->high_water);
+        lua_setfield(L, -2, "high_water");
+        if (backlog->bytes || backlog->limit) {
+            lua_pushinteger(L, (lua_Integer)backlog->bytes);
+            lua_setfield(L, -2, "bytes");
+            lua_pushinteger(L, (lua_Integer)backlog->limit);
+            lua_setfield(L, -2, "limit");
+        }
+        lua_pushinteger(L, (lua_Integer)backlog->samples);
+        lua_setfield(L, -2, "samples");
+        lua_pushboolean(L, backlog->catchup);
+        lua_setfield(L, -2, "catchup");
+        lua_pushinteger(L, (lua_Integer)backlog->catchup_entries);
+        lua_setfield(L, -2, "catchup_entries");
+        lua_pushinteger(L, (lua_Integer)backlog->coalesced);
+        lua_setfield(L, -2, "coalesced");
+        lua_pushinteger(L, (lua_Integer)backlog->queue_grows);
+        lua_setfield(L, -2, "queue_grows");
+        lua_setfield(L, -2, "backlog");
+    }
+    const rift_reconnect_t *reconnect = &client->reconnect;
+    if (reconnect->enabled || reconnect->disconnects) {
+        lua_createtable(L, 0, 9);
+        lua_pushboolean(L, reconnect->lost_ns != 0);
+        lua_setfield(L, -2, "reconnecting");
+        lua_pushinteger(L, (lua_Integer)reconnect->disconnects);
+        lua_setfield(L, -2, "disconnects");
+        lua_pushinteger(L, (lua_Integer)reconnect->reconnects);
+        lua_setfield(L, -2, "reconnects");
+        lua_pushinteger(L, (lua_Integer)reconnect->attempts);
+        lua_setfield(L, -2, "attempts");
+        lua_pushinteger(L, (lua_Integer)reconnect->failures);
+        lua_setfield(L, -2, "failures");
+        lua_pushnumber(L, (double)reconnect->last_recovery_ns / 1e6);
+        lua_setfield(L, -2, "last_recovery_ms");
+        lua_pushnumber(L, (double)reconnect->max_recovery_ns / 1e6);
+        lua_setfield(L, -2, "max_recovery_ms");
+        lua_pushnumber(L, (double)reconnect->downtime_ns / 1e6);
+        lua_setfield(L, -2, "downtime_ms");
+        lua_pushinteger(L, (lua_Integer)reconnect->missed_estimate);
+        lua_setfield(L, -2, "missed_estimate");
+        lua_setfield(L, -2, "reconnect");
+    }
+    if (client->info_pushed) {
+        lua_createtable(L, 0, 3);
+        lua_pushinteger(L, (lua_Integer)client->info_pushed);
+        lua_setfield(L, -2, "pushed");
+        lua_pushinteger(L, (lua_Integer)client->info_external);
+        lua_setfield(L, -2, "external");
+        lua_pushinteger(L, (lua_Integer)client->info_copied_bytes);
+        lua_setfield(L, -2, "copied_bytes");
+        lua_setfield(L, -2, "info");
+    }
+    if (client->select.decodes) {
+        lua_createtable(L, 0, 3);
+        lua_pushinteger(L, (lua_Integer)client->select.decodes);
+        lua_setfield(L, -2, "decodes");
+        lua_pushinteger(L, (lua_Integer)client->select.skipped_values);
+        lua_setfield(L, -2, "skipped_values");
+        lua_pushinteger(L, (lua_Integer)client->select.skipped_bytes);
+        lua_setfield(L, -2, "skipped_bytes");
+        lua_setfield(L, -2, "select");
+    }
+    // Events that arrived while a subscribe/unsubscribe waited for its reply.
+    if (client->transport.stash.total) {
+        lua_pushinteger(L, (lua_Integer)client->transport.stash.total);
+        lua_setfield(L, -2, "interleaved");
+    }
+    if (reset) {
+        rift_stats_reset(&client->stats, now);
+        if (client->cache) rift_cache_reset_stats(client->cache);
+        client->flight_requests = 0;
+        client->flights = 0;
+        client->dedupe_checked = 0;
+        client->dedupe_suppressed = 0;
+        client->dedupe_parses_skipped = 0;
+        client->info_pushed = 0;
+        client->info_external = 0;
+        client->info_copied_bytes = 0;
+        memset(&client->select, 0, sizeof(rift_select_stats_t));
+        client->reconnect.disconnects = 0;
+        client->reconnect.reconnects = 0;
+        client->reconnect.attempts = 0;
+        client->reconnect.failures = 0;
+        client->reconnect.last_recovery_ns = 0;
+        client->reconnect.max_recovery_ns = 0;
+        client->reconnect.downtime_ns = 0;
+        client->reconnect.missed_estimate = 0;
+        client->backlog.high_water = client->backlog.depth;
+        client->backlog.samples = 0;
+        client->backlog.catchup_entries = 0;
+        client->backlog.coalesced = 0;
+        client->backlog.queue_grows = 0;
+        client->transport.stash.total = 0;
+    }
+    return 1;
+}
+
+// `client:trace(true | capacity)` arms span recording into a ring of
+// `capacity` events (replacing the ring if the size changes);
+// `client:trace(false)` disarms it and keeps what was recorded.
+static int l_rift_trace(lua_State *L) {
+    rift_t *client = (rift_t*)luaL_checkudata(L, 1, "rift.client");
+    if (lua_isboolean(L, 2) && !lua_toboolean(L, 2)) {
+        if (client->trace) rift_trace_set_armed(client->trace, false);
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    uint32_t capacity = RIFT_TRACE_DEFAULT_CAPACITY;
+    if (lua_type(L, 2) == LUA_TNUMBER) {
+        lua_Integer v = luaL_checkinteger(L, 2);
+        if (v < 1) return luaL_argerror(L, 2, "capacity must be positive");
+        capacity = v > (1 << 24) ? (1u << 24) : (uint32_t)v;
+    }
+
+    if (!client->trace || (lua_type(L, 2) == LUA_TNUMBER && client->trace->mask + 1 < capacity)) {
+        rift_trace_t *trace = rift_trace_create(capacity, rift_now_ns());
+        if (!trace) {
+            lua_pushnil(L);
+            lua_pushstring(L, "Failed to allocate trace buffer.");
+            return 2;
+        }
+        // The worker records into the ring too; swap it while the worker is parked.
+        rift_worker_pause(&client->worker);
+        rift_trace_t *old = client->trace;
+        client->trace = trace;
+        client->worker.trace = trace;
+        rift_worker_resume(&client->worker);
+        rift_trace_free(old);
+    }
+
+    rift_trace_set_armed(client->trace, true);
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+static int l_rift_trace_dump(lua_State *L) {
+    rift_t *client = (rift_t*)luaL_checkudata(L, 1, "rift.client");
+    const char *path = luaL_checkstring(L, 2);
+    if (!client->trace) {
+        lua_pushnil(L);
+        lua_pushstring(L, "Tracing was never enabled on this client.");
+        return 2;
+    }
+
+    long written = rift_trace_dump(client->trace, path);
+    if (written < 0) {
+        lua_pushnil(L);
+        lua_pushfstring(L, "Failed to write trace '%s'.", path);
+        return 2;
+    }
+    lua_pushinteger(L, (lua_Integer)written);
+    return 1;
+}
+
+// Moves receiving and JSON parsing for this client's events to a background
+// thread; the Lua thread only builds tables from the parsed result.
+static int l_rift_set_worker(lua_State *L) {
+    rift_t *client = (rift_t*)luaL_checkudata(L, 1, "rift.client");
+    client->worker_enabled = lua_toboolean(L, 2);
+    if (client->worker_enabled) rift_client_start_worker(client);
+    else rift_client_stop_worker(client);
+    lua_pushboolean(L, client->worker.running);
+    return 1;
+}
+
+typedef struct {
+    rift_t *client;
+} rift_mirror_handle_t;
+
+static rift_t* rift_check_mirror(lua_State *L, int index) {
+    rift_mirror_handle_t *handle = (rift_mirror_handle_t*)luaL_checkudata(L, index, RIFT_MIRROR_METATABLE);
+    if (!handle->client->mirror) luaL_error(L, "mirror: the client has been closed");
+    return handle->client;
+}
+
+static void rift_push_mirror_json(lua_State *L, const cJSON *json) {
+    if (!json || !cjson_to_lua_table(L, (cJSON*)json)) lua_pushnil(L);
+}
+
+// client:mirror([opts]): subscribes to every window and workspace event,
+// loads a snapshot and keeps it current from then on. `opts.request`
+// replaces the get_windows request used for snapshots.
+static int l_rift_mirror(lua_State *L) {
+    rift_t *client = (rift_t*)luaL_checkudata(L, 1, "rift.client");
+    if (!client->mirror) {
+        const char *request = RIFT_MIRROR_DEFAULT_REQUEST;
+        if (lua_istable(L, 2)) {
+            lua_getfield(L, 2, "request");
+            if (!lua_isnil(L, -1)) request = luaL_checkstring(L, -1);
+            lua_pop(L, 1);
+        }
+
+        rift_retain_client(L, client, 1);
+        if (!rift_ensure_event_port(L, client)) return 2;
+        client->mirror = rift_mirror_create();
+        client->mirror_request = strdup(request);
+        if (!client->mirror || !client->mirror_request) {
+            rift_mirror_free(client->mirror);
+            free(client->mirror_request);
+            client->mirror = NULL;
+            client->mirror_request = NULL;
+            return luaL_error(L, "mirror: out of memory");
+        }
+
+        int rc = rift_client_sync_mirror(L, client);
+        if (rc != 1) {
+            rift_mirror_free(client->mirror);
+            free(client->mirror_request);
+            client->mirror = NULL;
+            client->mirror_request = NULL;
+            return rc;
+        }
+        rift_client_start_worker(client);
+        if (!rift_start_auto_pump(L, client)) {
+            lua_pushnil(L);
+            lua_pushstring(L, "Failed to start auto-pump timer.");
+            return 2;
+        }
+    }
+
+    rift_mirror_handle_t *handle = (rift_mirror_handle_t*)lua_newuserdatauv(L, sizeof(rift_mirror_handle_t), 1);
+    handle->client = client;
+    lua_pushvalue(L, 1);
+    lua_setiuservalue(L, -2, 1);
+    luaL_setmetatable(L, RIFT_MIRROR_METATABLE);
+    return 1;
+}
+
+static int l_rift_mirror_window(lua_State *L) {
+    rift_t *client = rift_check_mirror(L, 1);
+    const rift_mirror_window_t *window = rift_mirror_window(client->mirror, (int64_t)luaL_checkinteger(L, 2));
+    rift_push_mirror_json(L, window ? window->json : NULL);
+    return 1;
+}
+
+static int rift_compare_ids(const void *a, const void *b) {
+    int64_t x = *(const int64_t*)a;
+    int64_t y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// mirror:windows(space_id) in the space's order, or every window by id.
+static int l_rift_mirror_windows(lua_State *L) {
+    rift_t *client = rift_check_mirror(L, 1);
+    const rift_mirror_t *mirror = client->mirror;
+
+    if (!lua_isnoneornil(L, 2)) {
+        const rift_mirror_space_t *space = rift_mirror_space(mirror, (int64_t)luaL_checkinteger(L, 2));
+        size_t count = space ? space->window_count : 0;
+        lua_createtable(L, (int)count, 0);
+        for (size_t i = 0; i < count; ++i) {
+            const rift_mirror_window_t *window = rift_mirror_window(mirror, space->window_ids[i]);
+            rift_push_mirror_json(L, window ? window->json : NULL);
+            lua_rawseti(L, -2, (lua_Integer)i + 1);
+        }
+        return 1;
+    }
+
+    int64_t *ids = (int64_t*)malloc((mirror->windows.count + 1) * sizeof(int64_t));
+    if (!ids) return luaL_error(L, "mirror: out of memory");
+    size_t count = 0;
+    for (size_t i = 0; i < mirror->windows.cap; ++i) {
+        const rift_idmap_key_t *key = rift_idmap_key(&mirror->windows, i);
+        if (key->used) ids[count++] = key->id;
+    }
+    qsort(ids, count, sizeof(int64_t), rift_compare_ids);
+
+    lua_createtable(L, (int)count, 0);
+    for (size_t i = 0; i < count; ++i) {
+        rift_push_mirror_json(L, rift_mirror_window(mirror, ids[i])->json);
+        lua_rawseti(L, -2, (lua_Integer)i + 1);
+    }
+    free(ids);
+    return 1;
+}
+
+static int l_rift_mirror_workspace(lua_State *L) {
+    rift_t *client = rift_check_mirror(L, 1);
+    const rift_mirror_space_t *space = rift_mirror_space(client->mirror, (int64_t)luaL_checkinteger(L, 2));
+    rift_push_mirror_json(L, space ? space->workspace : NULL);
+    return 1;
+}
+
+static int l_rift_mirror_stacks(lua_State *L) {
+    rift_t *client = rift_check_mirror(L, 1);
+    const rift_mirror_space_t *space = rift_mirror_space(client->mirror, (int64_t)luaL_checkinteger(L, 2));
+    rift_push_mirror_json(L, space ? space->stacks : NULL);
+    return 1;
+}
+
+static int l_rift_mirror_refresh(lua_State *L) {
+    rift_t *client = rift_check_mirror(L, 1);
+    int rc = rift_client_load_mirror(L, client);
+    if (rc != 1) return rc;
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// Compares the mirror with a fresh snapshot: true, or false and the first
+// difference. Pump pending events first, or they show up as differences.
+static int l_rift_mirror_verify(lua_State *L) {
+    rift_t *client = rift_check_mirror(L, 1);
+    if (!rift_transport_has_server(&client->transport)) {
+        lua_pushnil(L);
+        lua_pushstring(L, "Replay clients cannot fetch snapshots.");
+        return 2;
+    }
+
+    cJSON *root = NULL;
+    const cJSON *windows = rift_client_fetch_windows(L, client, &root);
+    if (!windows) return 2;
+    char diff[128];
+    bool same = rift_mirror_matches(client->mirror, windows, diff, sizeof(diff));
+    cJSON_Delete(root);
+    lua_pushboolean(L, same);
+    if (same) return 1;
+    lua_pushstring(L, diff);
+    return 2;
+}
+
+// Subscribes to every event type the cache's rules name, so the events that
+// make its entries stale are delivered even without a callback for them.
+static int rift_client_subscribe_cache_events(lua_State *L, rift_t *client, const rift_cache_t *cache) {
+    for (size_t i = 0; i < cache->rule_count; ++i) {
+        const char *event = cache->rules[i].event;
+        bool seen = false;
+        for (size_t j = 0; j < i && !seen; ++j) seen = strcmp(cache->rules[j].event, event) == 0;
+        if (seen) continue;
+        int rc = rift_send_event_subscription_request(L, client, "subscribe", event);
+        if (rc != 1) return rc;
+        lua_pop(L, 1);
+    }
+    return 1;
+}
+
+// client:set_cache(true | false | opts). opts: ttl_ms (0 = until an event
+// invalidates), max_entries, shared (hits return the cached table itself),
+// invalidate = { event_type = { name_substring, ... } } replacing the defaults.
+// Subscribes to the rules' event types, like client:mirror() does.
+static int l_rift_set_cache(lua_State *L) {
+    rift_t *client = (rift_t*)luaL_checkudata(L, 1, "rift.client");
+    rift_cache_free(L, client->cache);
+    client->cache = NULL;
+    if (!lua_toboolean(L, 2)) {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+
+    lua_Integer ttl_ms = RIFT_CACHE_DEFAULT_TTL_MS;
+    lua_Integer max_entries = RIFT_CACHE_DEFAULT_ENTRIES;
+    bool shared = false;
+    bool custom_rules = false;
+    if (lua_istable(L, 2)) {
+        lua_getfield(L, 2, "ttl_ms");
+        if (!lua_isnil(L, -1)) ttl_ms = luaL_checkinteger(L, -1);
+        lua_getfield(L, 2, "max_entries");
+        if (!lua_isnil(L, -1)) max_entries = luaL_checkinteger(L, -1);
+        lua_getfield(L, 2, "shared");
+        shared = lua_toboolean(L, -1);
+        lua_getfield(L, 2, "invalidate");
+        custom_rules = !lua_isnil(L, -1);
+        if (custom_rules) luaL_checktype(L, -1, LUA_TTABLE);
+        lua_pop(L, 4);
+    }
+    if (ttl_ms < 0) ttl_ms = 0;
+    if (max_entries < 1) return luaL_argerror(L, 2, "max_entries must be positive");
+
+    rift_cache_t *cache = rift_cache_create((uint64_t)ttl_ms * 1000000ull, (size_t)max_entries, shared);
+    bool ok = cache != NULL;
+    if (ok && !custom_rules) ok = rift_cache_add_default_rules(cache);
+    if (ok && custom_rules) {
+        lua_getfield(L, 2, "invalidate");
+        lua_pushnil(L);
+        while (ok && lua_next(L, -2)) {
+            // lua_tostring would convert a number key in place and upset lua_next.
+            const char *event = lua_type(L, -2) == LUA_TSTRING ? lua_tostring(L, -2) : NULL;
+            if (!event || !lua_istable(L, -1)) {
+                rift_cache_free(L, cache);
+                return luaL_error(L, "set_cache: invalidate maps event names to lists of request names");
+            }
+            lua_Integer count = (lua_Integer)lua_rawlen(L, -1);
+            for (lua_Integer i = 1; ok && i <= count; ++i) {
+                lua_rawgeti(L, -1, i);
+                const char *match = lua_tostring(L, -1);
+                if (match) ok = rift_cache_add_rule(cache, event, match);
+                lua_pop(L, 1);
+            }
+            lua_pop(L, 1);
+        }
+        lua_pop(L, 1);
+    }
+    if (!ok) {
+        rift_cache_free(L, cache);
+        return luaL_error(L, "set_cache: out of memory");
+    }
+
+    rift_retain_client(L, client, 1);
+    int rc = rift_ensure_event_port(L, client) ? rift_client_subscribe_cache_events(L, client, cache) : 2;
+    if (rc != 1) {
+        rift_cache_free(L, cache);
+        return rc;
+    }
+    client->cache = cache;
+    rift_client_start_worker(client);
+    if (!rift_start_auto_pump(L, client)) {
+        lua_pushnil(L);
+        lua_pushstring(L, "Failed to start auto-pump timer.");
+        return 2;
+    }
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// Hands every callback the same env and DATA tables for each event type,
+// cleared and refilled in place; callbacks call env:retain() to keep one.
+static int l_rift_set_recycle(lua_State *L) {
+    rift_t *client = (rift_t*)luaL_checkudata(L, 1, "rift.client");
+    client->recycle = lua_toboolean(L, 2);
+    if (!client->recycle && rift_push_client_callback_list(L, client, false)) {
+        lua_Integer cb_count = (lua_Integer)lua_rawlen(L, -1);
+        for (lua_Integer i = 1; i <= cb_count; ++i) {
+            if (lua_rawgeti(L, -1, i) == LUA_TTABLE) {
+                lua_pushnil(L);
+                lua_rawseti(L, -2, RIFT_CB_RECYCLED);
+            }
+            lua_pop(L, 1);
+        }
+    }
+    lua_pop(L, 1);
+    lua_pushboolean(L, client->recycle);
+    return 1;
+}
+
+static int l_rift_diff_gc(lua_State *L) {
+    rift_diff_box_t *box = (rift_diff_box_t*)luaL_checkudata(L, 1, RIFT_DIFF_METATABLE);
+    rift_diff_free(box->diff);
+    box->diff = NULL;
+    return 0;
+}
+
+// env:retain(): a deep copy of the env that later events leave alone.
+static int l_rift_env_retain(lua_State *L) {
+    luaL_checktype(L, 1, LUA_TTABLE);
+    rift_copy_table(L, 1);
+    if (lua_getmetatable(L, 1)) lua_setmetatable(L, -2);
     return 1;
 }
 
+// Monotonic clock shared with event logs and the load generator's `sent_ns`.
+static int l_rift_now_ns(lua_State *L) {
+    lua_pushinteger(L, (lua_Integer)rift_now_ns());
+    return 1;
+}
+
+// Counters of the allocator installed by rift_alloc_install(); the host has to
+// install it, so plain interpreters get nil.
+static int l_rift_alloc_stats(lua_State *L) {
+    bool reset = lua_toboolean(L, 1);
+    rift_alloc_t *alloc = rift_alloc_get(L);
+    if (!alloc) {
+        lua_pushnil(L);
+        lua_pushstring(L, "The rift allocator is not installed in this state.");
+        return 2;
+    }
+    rift_alloc_push_stats(L, alloc);
+    if (reset) rift_alloc_reset(alloc);
+    return 1;
+}
 
 static const struct luaL_Reg rift_lib[] = {
     {"connect", l_rift_connect},
+    {"replay", l_rift_replay},
+    {"run", l_rift_run},
+    {"stop", l_rift_stop},
+    {"after", l_rift_after},
+    {"every", l_rift_every},
+    {"cancel", l_rift_cancel},
+    {"defer", l_rift_defer},
+    {"now_ns", l_rift_now_ns},
+    {"alloc_stats", l_rift_alloc_stats},
     {"reconnect", l_rift_reconnect},
+    {"set_reconnect", l_rift_set_reconnect},
+    {"set_catchup", l_rift_set_catchup},
     {"send_request", l_rift_send_request},
+    {"template", l_rift_template},
+    {"select", l_rift_select},
+    {"send_template", l_rift_send_template},
+    {"request", l_rift_request},
+    {"flush", l_rift_flush},
     {"subscribe", l_rift_subscribe},
     {"unsubscribe", l_rift_unsubscribe},
     {"receive_event", l_rift_receive_event},
     {"pump", l_rift_pump},
+    {"wait", l_rift_wait},
+    {"fileno", l_rift_fileno},
+    {"record", l_rift_record},
+    {"set_worker", l_rift_set_worker},
+    {"set_recycle", l_rift_set_recycle},
+    {"set_cache", l_rift_set_cache},
+    {"mirror", l_rift_mirror},
+    {"stats", l_rift_stats},
+    {"trace", l_rift_trace},
+    {"trace_dump", l_rift_trace_dump},
     {"disconnect", l_rift_disconnect},
     {NULL, NULL}
 };
 
 static const struct luaL_Reg rift_client_methods[] = {
     {"reconnect", l_rift_reconnect},
+    {"set_reconnect", l_rift_set_reconnect},
+    {"set_catchup", l_rift_set_catchup},
     {"send_request", l_rift_send_request},
+    {"send_template", l_rift_send_template},
+    {"request", l_rift_request},
+    {"flush", l_rift_flush},
     {"subscribe", l_rift_subscribe},
     {"unsubscribe", l_rift_unsubscribe},
     {"receive_event", l_rift_receive_event},
     {"pump", l_rift_pump},
+    {"wait", l_rift_wait},
+    {"fileno", l_rift_fileno},
+    {"record", l_rift_record},
+    {"set_worker", l_rift_set_worker},
+    {"set_recycle", l_rift_set_recycle},
+    {"set_cache", l_rift_set_cache},
+    {"mirror", l_rift_mirror},
+    {"stats", l_rift_stats},
+    {"trace", l_rift_trace},
+    {"trace_dump", l_rift_trace_dump},
     {"disconnect", l_rift_disconnect},
     {NULL, NULL}
 };
 
+static const struct luaL_Reg rift_mirror_methods[] = {
+    {"window", l_rift_mirror_window},
+    {"windows", l_rift_mirror_windows},
+    {"workspace", l_rift_mirror_workspace},
+    {"stacks", l_rift_mirror_stacks},
+    {"refresh", l_rift_mirror_refresh},
+    {"verify", l_rift_mirror_verify},
+    {NULL, NULL}
+};
+
 int luaopen_rift(lua_State *L) {
     luaL_newlib(L, rift_lib);
 
@@ -760,5 +3245,32 @@ int luaopen_rift(lua_State *L) {
     }
     lua_pop(L, 1);
 
+    if (luaL_newmetatable(L, RIFT_MIRROR_METATABLE)) {
+        lua_newtable(L);
+        luaL_setfuncs(L, rift_mirror_methods, 0);
+        lua_setfield(L, -2, "__index");
+    }
+    lua_pop(L, 1);
+
+    if (luaL_newmetatable(L, RIFT_DIFF_METATABLE)) {
+        lua_pushcfunction(L, l_rift_diff_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+    lua_pop(L, 1);
+
+    if (luaL_newmetatable(L, RIFT_TEMPLATE_METATABLE)) {
+        lua_pushcfunction(L, l_rift_template_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+    lua_pop(L, 1);
+
+    if (luaL_newmetatable(L, RIFT_ENV_METATABLE)) {
+        lua_createtable(L, 0, 1);
+        lua_pushcfunction(L, l_rift_env_retain);
+        lua_setfield(L, -2, "retain");
+        lua_setfield(L, -2, "__index");
+    }
+    lua_pop(L, 1);
+
     return 1;
 }
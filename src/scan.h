@@ -0,0 +1,56 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RIFT_SCAN_SSE2 1
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define RIFT_SCAN_NEON 1
+#endif
+
+// Finds where a JSON string body stops being plain bytes: the first '"' or
+// '\\' in [p, end), or `end`. cJSON's parse_string uses it to measure a
+// string and to copy the runs between escapes with memcpy. SSE2 and NEON are
+// part of the x86-64 and arm64 baselines, so each slice of a universal build
+// picks its own at compile time; anything else scans 8 bytes at a time.
+#define RIFT_SCAN_ONES 0x0101010101010101ull
+#define RIFT_SCAN_HIGHS 0x8080808080808080ull
+
+static inline uint64_t rift_scan_zero_bytes(uint64_t v) {
+    return (v - RIFT_SCAN_ONES) & ~v & RIFT_SCAN_HIGHS;
+}
+
+static inline const unsigned char* rift_scan_string(const unsigned char *p, const unsigned char *end) {
+#if defined(RIFT_SCAN_SSE2)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    for (; end - p >= 16; p += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)p);
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, backslash)));
+        if (mask) return p + __builtin_ctz((unsigned)mask);
+    }
+#elif defined(RIFT_SCAN_NEON)
+    const uint8x16_t quote = vdupq_n_u8('"');
+    const uint8x16_t backslash = vdupq_n_u8('\\');
+    for (; end - p >= 16; p += 16) {
+        uint8x16_t block = vld1q_u8(p);
+        uint8x16_t hits = vorrq_u8(vceqq_u8(block, quote), vceqq_u8(block, backslash));
+        // Narrowing by 4 leaves one nibble per byte in a 64-bit mask.
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hits), 4)), 0);
+        if (mask) return p + (__builtin_ctzll(mask) >> 2);
+    }
+#else
+    for (; end - p >= 8; p += 8) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        uint64_t hits = rift_scan_zero_bytes(v ^ ('"' * RIFT_SCAN_ONES)) |
+                        rift_scan_zero_bytes(v ^ ('\\' * RIFT_SCAN_ONES));
+        // The lowest flagged byte is always a real match (little-endian).
+        if (hits) return p + (__builtin_ctzll(hits) >> 3);
+    }
+#endif
+    while (p < end && *p != '"' && *p != '\\') p++;
+    return p;
+}
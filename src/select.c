@@ -0,0 +1,404 @@
+#include "select.h"
+#include <stdlib.h>
+#include <string.h>
+#include "number.h"
+#include "parsing.h"
+#include "scan.h"
+
+// Bounds the recursion through nested arrays, which never advance the trie.
+#define RIFT_SELECT_MAX_DEPTH 1000
+
+static void rift_select_free(rift_select_t *sel) {
+    for (uint32_t i = 0; i < sel->node_count; ++i) free(sel->nodes[i].key);
+    free(sel->nodes);
+    sel->nodes = NULL;
+    sel->node_count = 0;
+    sel->node_cap = 0;
+}
+
+static int rift_select_gc(lua_State *L) {
+    rift_select_t *sel = (rift_select_t*)luaL_checkudata(L, 1, RIFT_SELECT_METATABLE);
+    rift_select_free(sel);
+    return 0;
+}
+
+static uint32_t rift_select_add_node(lua_State *L, rift_select_t *sel, const char *key, size_t len) {
+    if (sel->node_count == sel->node_cap) {
+        uint32_t cap = sel->node_cap ? sel->node_cap * 2 : 8;
+        rift_select_node_t *nodes = (rift_select_node_t*)realloc(sel->nodes, sizeof(rift_select_node_t) * cap);
+        if (!nodes) luaL_error(L, "select: out of memory");
+        sel->nodes = nodes;
+        sel->node_cap = cap;
+    }
+    rift_select_node_t *node = &sel->nodes[sel->node_count];
+    memset(node, 0, sizeof(rift_select_node_t));
+    if (key) {
+        node->key = (char*)malloc(len + 1);
+        if (!node->key) luaL_error(L, "select: out of memory");
+        memcpy(node->key, key, len);
+        node->key[len] = '\0';
+        node->len = len;
+    }
+    return sel->node_count++;
+}
+
+static uint32_t rift_select_find(const rift_select_t *sel, uint32_t parent, const char *key, size_t len) {
+    for (uint32_t i = sel->nodes[parent].child; i; i = sel->nodes[i].next) {
+        if (sel->nodes[i].len == len && memcmp(sel->nodes[i].key, key, len) == 0) return i;
+    }
+    return 0;
+}
+
+static void rift_select_add_path(lua_State *L, rift_select_t *sel, const char *path) {
+    uint32_t node = 0;
+    const char *start = path;
+    while (1) {
+        const char *end = strchr(start, '.');
+        size_t len = end ? (size_t)(end - start) : strlen(start);
+        if (len == 0) luaL_error(L, "select: empty segment in path '%s'", path);
+        uint32_t child = rift_select_find(sel, node, start, len);
+        if (!child) {
+            child = rift_select_add_node(L, sel, start, len);
+            sel->nodes[child].next = sel->nodes[node].child;
+            sel->nodes[node].child = child;
+        }
+        node = child;
+        if (!end) break;
+        start = end + 1;
+    }
+    sel->nodes[node].whole = true;
+}
+
+rift_select_t* rift_select_push(lua_State *L, int index) {
+    index = lua_absindex(L, index);
+    luaL_checktype(L, index, LUA_TTABLE);
+
+    rift_select_t *sel = (rift_select_t*)lua_newuserdata(L, sizeof(rift_select_t));
+    memset(sel, 0, sizeof(rift_select_t));
+    if (luaL_newmetatable(L, RIFT_SELECT_METATABLE)) {
+        lua_pushcfunction(L, rift_select_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+    lua_setmetatable(L, -2);
+
+    lua_Integer count = (lua_Integer)lua_rawlen(L, index);
+    if (count == 0) luaL_error(L, "select: expected a list of paths");
+    rift_select_add_node(L, sel, NULL, 0);
+    for (lua_Integer i = 1; i <= count; ++i) {
+        if (lua_rawgeti(L, index, i) != LUA_TSTRING) luaL_error(L, "select: paths must be strings");
+        rift_select_add_path(L, sel, lua_tostring(L, -1));
+        lua_pop(L, 1);
+    }
+    return sel;
+}
+
+// Text decoder. Positions always stay within [p, end); every helper returns
+// false on malformed input.
+typedef struct {
+    lua_State *L;
+    const rift_select_t *sel;
+    const unsigned char *p;
+    const unsigned char *end;
+    rift_select_stats_t *stats;
+} rift_select_reader_t;
+
+static void rift_select_space(rift_select_reader_t *r) {
+    while (r->p < r->end && (*r->p == ' ' || *r->p == '\n' || *r->p == '\r' || *r->p == '\t')) r->p++;
+}
+
+static bool rift_select_skip_string(rift_select_reader_t *r) {
+    const unsigned char *p = r->p + 1;
+    while (1) {
+        p = rift_scan_string(p, r->end);
+        if (p == r->end) return false;
+        if (*p == '"') break;
+        // Backslash: the escaped byte can't end the string.
+        p += 2;
+        if (p > r->end) return false;
+    }
+    r->p = p + 1;
+    return true;
+}
+
+static bool rift_select_skip_value(rift_select_reader_t *r) {
+    const unsigned char *start = r->p;
+    unsigned char c = *r->p;
+    if (c == '"') {
+        if (!rift_select_skip_string(r)) return false;
+    } else if (c == '{' || c == '[') {
+        int depth = 0;
+        while (1) {
+            if (r->p == r->end) return false;
+            c = *r->p;
+            if (c == '"') {
+                if (!rift_select_skip_string(r)) return false;
+                continue;
+            }
+            r->p++;
+            if (c == '{' || c == '[') depth++;
+            else if ((c == '}' || c == ']') && --depth == 0) break;
+        }
+    } else {
+        while (r->p < r->end && *r->p != ',' && *r->p != '}' && *r->p != ']' &&
+               *r->p != ' ' && *r->p != '\n' && *r->p != '\r' && *r->p != '\t') {
+            r->p++;
+        }
+        if (r->p == start) return false;
+    }
+    r->stats->skipped_values++;
+    r->stats->skipped_bytes += (uint64_t)(r->p - start);
+    return true;
+}
+
+// Anything the shortcuts below don't cover goes through cJSON.
+static bool rift_select_push_parsed(rift_select_reader_t *r) {
+    const char *stop = NULL;
+    cJSON *item = cJSON_ParseWithLengthOpts((const char*)r->p, (size_t)(r->end - r->p), &stop, false);
+    if (!item) return false;
+    cjson_push_value(r->L, item);
+    cJSON_Delete(item);
+    r->p = (const unsigned char*)stop;
+    return true;
+}
+
+static bool rift_select_literal(rift_select_reader_t *r, const char *word, size_t len) {
+    if ((size_t)(r->end - r->p) < len || memcmp(r->p, word, len) != 0) return false;
+    r->p += len;
+    return true;
+}
+
+static bool rift_select_push_whole(rift_select_reader_t *r) {
+    unsigned char c = *r->p;
+    if (c == '"') {
+        const unsigned char *q = rift_scan_string(r->p + 1, r->end);
+        if (q < r->end && *q == '"') {
+            lua_pushlstring(r->L, (const char*)r->p + 1, (size_t)(q - r->p - 1));
+            r->p = q + 1;
+            return true;
+        }
+        return rift_select_push_parsed(r);
+    }
+    if (c == '-' || (c >= '0' && c <= '9')) {
+        rift_number_t number;
+        if (!rift_number_scan(r->p, (size_t)(r->end - r->p), &number)) return rift_select_push_parsed(r);
+        // Same integer rule as the full decoder.
+        int64_t integer = number.i;
+        if (number.integer || rift_number_integral(number.d, &integer)) lua_pushinteger(r->L, (lua_Integer)integer);
+        else lua_pushnumber(r->L, number.d);
+        r->p += number.len;
+        return true;
+    }
+    if (rift_select_literal(r, "true", 4)) {
+        lua_pushboolean(r->L, 1);
+        return true;
+    }
+    if (rift_select_literal(r, "false", 5)) {
+        lua_pushboolean(r->L, 0);
+        return true;
+    }
+    if (rift_select_literal(r, "null", 4)) {
+        lua_pushnil(r->L);
+        return true;
+    }
+    return rift_select_push_parsed(r);
+}
+
+// The trie child for the key string at [start, stop); keys with escapes are
+// decoded first.
+static uint32_t rift_select_key_child(rift_select_reader_t *r, uint32_t node, const unsigned char *start, const unsigned char *stop) {
+    size_t len = (size_t)(stop - start - 2);
+    if (!memchr(start + 1, '\\', len)) return rift_select_find(r->sel, node, (const char*)start + 1, len);
+    cJSON *key = cJSON_ParseWithLength((const char*)start, (size_t)(stop - start));
+    uint32_t child = 0;
+    if (cJSON_IsString(key)) child = rift_select_find(r->sel, node, key->valuestring, strlen(key->valuestring));
+    cJSON_Delete(key);
+    return child;
+}
+
+// Decodes the value at r->p against `node`. Returns 1 with the value pushed,
+// 0 when it was dropped, -1 on malformed input.
+static int rift_select_read(rift_select_reader_t *r, uint32_t node, int depth) {
+    if (depth > RIFT_SELECT_MAX_DEPTH || !lua_checkstack(r->L, 3)) return -1;
+    unsigned char c = *r->p;
+    if (c == '{') {
+        lua_newtable(r->L);
+        r->p++;
+        rift_select_space(r);
+        if (r->p < r->end && *r->p == '}') {
+            r->p++;
+            return 1;
+        }
+        while (1) {
+            if (r->p == r->end || *r->p != '"') return -1;
+            const unsigned char *key = r->p;
+            if (!rift_select_skip_string(r)) return -1;
+            uint32_t child = rift_select_key_child(r, node, key, r->p);
+            rift_select_space(r);
+            if (r->p == r->end || *r->p != ':') return -1;
+            r->p++;
+            rift_select_space(r);
+            if (r->p == r->end) return -1;
+
+            if (!child) {
+                if (!rift_select_skip_value(r)) return -1;
+            } else {
+                const rift_select_node_t *target = &r->sel->nodes[child];
+                lua_pushlstring(r->L, target->key, target->len);
+                int rc = target->whole ? (rift_select_push_whole(r) ? 1 : -1) : rift_select_read(r, child, depth + 1);
+                if (rc < 0) return -1;
+                if (rc) lua_rawset(r->L, -3);
+                else lua_pop(r->L, 1);
+            }
+
+            rift_select_space(r);
+            if (r->p == r->end) return -1;
+            if (*r->p == '}') {
+                r->p++;
+                return 1;
+            }
+            if (*r->p != ',') return -1;
+            r->p++;
+            rift_select_space(r);
+        }
+    }
+    if (c == '[') {
+        lua_newtable(r->L);
+        r->p++;
+        rift_select_space(r);
+        if (r->p < r->end && *r->p == ']') {
+            r->p++;
+            return 1;
+        }
+        lua_Integer n = 0;
+        while (1) {
+            if (r->p == r->end) return -1;
+            int rc = rift_select_read(r, node, depth + 1);
+            if (rc < 0) return -1;
+            if (rc) lua_rawseti(r->L, -2, ++n);
+
+            rift_select_space(r);
+            if (r->p == r->end) return -1;
+            if (*r->p == ']') {
+                r->p++;
+                return 1;
+            }
+            if (*r->p != ',') return -1;
+            r->p++;
+            rift_select_space(r);
+        }
+    }
+    return rift_select_skip_value(r) ? 0 : -1;
+}
+
+bool rift_select_decode(lua_State *L, const rift_select_t *sel, const char *json, size_t len, rift_select_stats_t *stats) {
+    rift_select_reader_t r = {L, sel, (const unsigned char*)json, (const unsigned char*)json + len, stats};
+    int top = lua_gettop(L);
+    rift_select_space(&r);
+    if (r.p == r.end || (*r.p != '{' && *r.p != '[')) return false;
+    if (rift_select_read(&r, 0, 0) != 1) {
+        lua_settop(L, top);
+        return false;
+    }
+    rift_select_space(&r);
+    if (r.p != r.end) {
+        lua_settop(L, top);
+        return false;
+    }
+    stats->decodes++;
+    return true;
+}
+
+// Parsed trees: skipping is free, so this only saves building the tables.
+static bool rift_select_cjson_value(lua_State *L, const rift_select_t *sel, uint32_t node, const cJSON *item, rift_select_stats_t *stats) {
+    luaL_checkstack(L, 3, "select");
+    if (cJSON_IsObject(item)) {
+        lua_newtable(L);
+        for (const cJSON *member = item->child; member; member = member->next) {
+            uint32_t child = rift_select_find(sel, node, member->string, strlen(member->string));
+            if (!child) {
+                stats->skipped_values++;
+                continue;
+            }
+            const rift_select_node_t *target = &sel->nodes[child];
+            lua_pushlstring(L, target->key, target->len);
+            if (target->whole) cjson_push_value(L, (cJSON*)member);
+            else if (!rift_select_cjson_value(L, sel, child, member, stats)) {
+                lua_pop(L, 1);
+                continue;
+            }
+            lua_rawset(L, -3);
+        }
+        return true;
+    }
+    if (cJSON_IsArray(item)) {
+        lua_newtable(L);
+        lua_Integer n = 0;
+        for (const cJSON *element = item->child; element; element = element->next) {
+            if (rift_select_cjson_value(L, sel, node, element, stats)) lua_rawseti(L, -2, ++n);
+        }
+        return true;
+    }
+    stats->skipped_values++;
+    return false;
+}
+
+bool rift_select_push_cjson(lua_State *L, const rift_select_t *sel, const cJSON *root, rift_select_stats_t *stats) {
+    if (!cJSON_IsObject(root) && !cJSON_IsArray(root)) return false;
+    rift_select_cjson_value(L, sel, 0, root, stats);
+    stats->decodes++;
+    return true;
+}
+
+static bool rift_select_tape_value(lua_State *L, const rift_select_t *sel, uint32_t node, const rift_tape_t *tape, size_t pos, rift_select_stats_t *stats) {
+    luaL_checkstack(L, 3, "select");
+    rift_tape_tag_t tag = rift_tape_tag(tape, pos);
+    if (tag == RIFT_TAPE_OBJECT) {
+        uint32_t count = rift_tape_count(tape, pos);
+        size_t key_pos = rift_tape_first(tape, pos);
+        lua_newtable(L);
+        for (uint32_t i = 0; i < count; ++i) {
+            size_t key_len = 0;
+            const char *key = rift_tape_string(tape, key_pos, &key_len);
+            size_t value_pos = rift_tape_skip(tape, key_pos);
+            size_t next = rift_tape_skip(tape, value_pos);
+            uint32_t child = key ? rift_select_find(sel, node, key, key_len) : 0;
+            key_pos = next;
+            if (!child) {
+                stats->skipped_values++;
+                stats->skipped_bytes += next - value_pos;
+                continue;
+            }
+            const rift_select_node_t *target = &sel->nodes[child];
+            lua_pushlstring(L, target->key, target->len);
+            if (target->whole) rift_tape_value_to_lua(L, tape, value_pos);
+            else if (!rift_select_tape_value(L, sel, child, tape, value_pos, stats)) {
+                lua_pop(L, 1);
+                continue;
+            }
+            lua_rawset(L, -3);
+        }
+        return true;
+    }
+    if (tag == RIFT_TAPE_ARRAY) {
+        uint32_t count = rift_tape_count(tape, pos);
+        size_t element = rift_tape_first(tape, pos);
+        lua_newtable(L);
+        lua_Integer n = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+            if (rift_select_tape_value(L, sel, node, tape, element, stats)) lua_rawseti(L, -2, ++n);
+            element = rift_tape_skip(tape, element);
+        }
+        return true;
+    }
+    stats->skipped_values++;
+    stats->skipped_bytes += rift_tape_skip(tape, pos) - pos;
+    return false;
+}
+
+bool rift_select_push_tape(lua_State *L, const rift_select_t *sel, const rift_tape_t *tape, rift_select_stats_t *stats) {
+    rift_tape_tag_t tag = tape->len ? rift_tape_tag(tape, 0) : RIFT_TAPE_NULL;
+    if (tag != RIFT_TAPE_OBJECT && tag != RIFT_TAPE_ARRAY) return false;
+    rift_select_tape_value(L, sel, 0, tape, 0, stats);
+    stats->decodes++;
+    return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <lua.h>
+#include <lauxlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cJSON.h"
+#include "tape.h"
+
+#define RIFT_SELECT_METATABLE "rift.select"
+
+// Field projection for {select = {...}}. A path is a dotted list of object
+// keys from the root, like "windows.title". Arrays on the way are passed
+// through, so the rest of the path applies to every element. The paths are
+// merged into a key trie, and decoding walks the document against it: a
+// member no path names is skipped without being decoded, a member a path
+// ends on is decoded whole, and an object in between is rebuilt with only
+// the selected members. A scalar where a path expects an object is dropped.
+typedef struct {
+    char *key;
+    size_t len;
+    // First child and next sibling as node indexes; 0 for none, since the
+    // root is node 0 and nobody's child.
+    uint32_t child;
+    uint32_t next;
+    // A path ends here, so the value is kept whole.
+    bool whole;
+} rift_select_node_t;
+
+typedef struct {
+    rift_select_node_t *nodes;
+    uint32_t node_count;
+    uint32_t node_cap;
+} rift_select_t;
+
+// What projection left undecoded. Bytes are counted in the input: JSON text
+// for responses, tape bytes for worker events, none for parsed trees.
+typedef struct {
+    uint64_t decodes;
+    uint64_t skipped_values;
+    uint64_t skipped_bytes;
+} rift_select_stats_t;
+
+// Compiles the list of paths at `index` into a "rift.select" userdata pushed
+// on top of the stack. Raises a Lua error on an empty list or a bad path.
+rift_select_t* rift_select_push(lua_State *L, int index);
+
+// Each pushes the projected root object or array, or returns false with
+// nothing pushed when the root is neither. The text decoder checks the
+// structure of what it skips (brackets and strings) but not its contents.
+bool rift_select_decode(lua_State *L, const rift_select_t *sel, const char *json, size_t len, rift_select_stats_t *stats);
+bool rift_select_push_cjson(lua_State *L, const rift_select_t *sel, const cJSON *root, rift_select_stats_t *stats);
+bool rift_select_push_tape(lua_State *L, const rift_select_t *sel, const rift_tape_t *tape, rift_select_stats_t *stats);
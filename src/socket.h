@@ -0,0 +1,284 @@
+#pragma once
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "stash.h"
+
+// Unix-domain socket framing used by the socket transport. Every message is
+//   u32 payload length (little-endian)
+//   u32 id (little-endian)
+//   payload bytes (JSON, no terminator)
+// A request with a non-zero id gets exactly one reply carrying the same id;
+// id 0 means no reply is wanted. The server pushes events with id 0 on the
+// connection that subscribed. Requests and the event stream use separate
+// connections, mirroring the Mach server port and event port.
+#define RIFT_SOCKET_ENV "RIFT_SOCKET"
+#define RIFT_SOCKET_FRAME_HEADER_LEN 8
+#define RIFT_SOCKET_MAX_FRAME (64u * 1024u * 1024u)
+
+typedef enum {
+    RIFT_SOCKET_FRAME,
+    RIFT_SOCKET_TIMEOUT,
+    RIFT_SOCKET_CLOSED,
+    RIFT_SOCKET_ERROR
+} rift_socket_status_t;
+
+static int rift_socket_connect_internal(const char *path) {
+    struct sockaddr_un addr;
+    if (!path || strlen(path) >= sizeof(addr.sun_path)) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        fprintf(stderr, "socket failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "Failed to connect to Rift socket %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static bool rift_socket_write_all(int fd, const void *data, size_t len) {
+    const char *p = (const char*)data;
+    int flags = 0;
+#ifdef MSG_NOSIGNAL
+    flags = MSG_NOSIGNAL;
+#endif
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, flags);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static bool rift_socket_read_all(int fd, void *data, size_t len, bool *closed) {
+    char *p = (char*)data;
+    *closed = false;
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n == 0) {
+            *closed = true;
+            return false;
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static void rift_socket_put_header(unsigned char *header, uint32_t id, size_t len) {
+    for (int i = 0; i < 4; ++i) {
+        header[i] = (unsigned char)((uint32_t)len >> (8 * i));
+        header[4 + i] = (unsigned char)(id >> (8 * i));
+    }
+}
+
+static bool rift_socket_send_frame(int fd, uint32_t id, const char *payload, size_t len) {
+    if (fd < 0 || len > RIFT_SOCKET_MAX_FRAME) return false;
+
+    unsigned char header[RIFT_SOCKET_FRAME_HEADER_LEN];
+    rift_socket_put_header(header, id, len);
+    if (!rift_socket_write_all(fd, header, sizeof(header))) {
+        fprintf(stderr, "socket send failed: %s\n", strerror(errno));
+        return false;
+    }
+    if (!rift_socket_write_all(fd, payload, len)) {
+        fprintf(stderr, "socket send failed: %s\n", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+// Sends `len` payload bytes that follow RIFT_SOCKET_FRAME_HEADER_LEN free
+// bytes at the start of `frame`, header included, in a single write.
+static bool rift_socket_send_prefixed(int fd, uint32_t id, char *frame, size_t len) {
+    if (fd < 0 || len > RIFT_SOCKET_MAX_FRAME) return false;
+
+    rift_socket_put_header((unsigned char*)frame, id, len);
+    if (!rift_socket_write_all(fd, frame, RIFT_SOCKET_FRAME_HEADER_LEN + len)) {
+        fprintf(stderr, "socket send failed: %s\n", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+// Waits up to `timeout_ms` (forever if negative) for the fd to become readable.
+static rift_socket_status_t rift_socket_wait_readable(int fd, int timeout_ms) {
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    while (1) {
+        int rc = poll(&pfd, 1, timeout_ms);
+        if (rc > 0) return RIFT_SOCKET_FRAME;
+        if (rc == 0) return RIFT_SOCKET_TIMEOUT;
+        if (errno != EINTR) return RIFT_SOCKET_ERROR;
+    }
+}
+
+// Bytes received on `fd` and not read yet, and the receive buffer size.
+static bool rift_socket_backlog(int fd, size_t *bytes, size_t *rcvbuf) {
+    if (fd < 0) return false;
+    int pending = 0;
+    int size = 0;
+    socklen_t len = sizeof(size);
+    if (ioctl(fd, FIONREAD, &pending) != 0 || getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, &len) != 0) return false;
+    *bytes = pending > 0 ? (size_t)pending : 0;
+    *rcvbuf = size > 0 ? (size_t)size : 0;
+    return true;
+}
+
+// Doubles the receive buffer up to `max_bytes`; false if it didn't grow.
+static bool rift_socket_grow_rcvbuf(int fd, size_t max_bytes) {
+    size_t pending = 0;
+    size_t current = 0;
+    if (!rift_socket_backlog(fd, &pending, &current) || current >= max_bytes) return false;
+    int size = (int)(current * 2 < max_bytes ? current * 2 : max_bytes);
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) != 0) return false;
+    size_t grown = 0;
+    return rift_socket_backlog(fd, &pending, &grown) && grown > current;
+}
+
+// Reads one frame into a malloc'd NUL-terminated buffer.
+static char* rift_socket_recv_frame(int fd, int timeout_ms, uint32_t *id, size_t *out_len, rift_socket_status_t *status) {
+    *status = RIFT_SOCKET_ERROR;
+    if (fd < 0) return NULL;
+
+    rift_socket_status_t ready = rift_socket_wait_readable(fd, timeout_ms);
+    if (ready != RIFT_SOCKET_FRAME) {
+        *status = ready;
+        return NULL;
+    }
+
+    unsigned char header[RIFT_SOCKET_FRAME_HEADER_LEN];
+    bool closed = false;
+    if (!rift_socket_read_all(fd, header, sizeof(header), &closed)) {
+        *status = closed ? RIFT_SOCKET_CLOSED : RIFT_SOCKET_ERROR;
+        return NULL;
+    }
+
+    uint32_t len = 0;
+    uint32_t frame_id = 0;
+    for (int i = 0; i < 4; ++i) {
+        len |= (uint32_t)header[i] << (8 * i);
+        frame_id |= (uint32_t)header[4 + i] << (8 * i);
+    }
+    if (len > RIFT_SOCKET_MAX_FRAME) {
+        fprintf(stderr, "socket frame too large: %u bytes\n", len);
+        return NULL;
+    }
+
+    char *payload = (char*)malloc((size_t)len + 1);
+    if (!payload) return NULL;
+    if (!rift_socket_read_all(fd, payload, len, &closed)) {
+        free(payload);
+        *status = closed ? RIFT_SOCKET_CLOSED : RIFT_SOCKET_ERROR;
+        return NULL;
+    }
+    payload[len] = '\0';
+
+    if (id) *id = frame_id;
+    if (out_len) *out_len = len;
+    *status = RIFT_SOCKET_FRAME;
+    return payload;
+}
+
+// Keeps an event frame that turned up while waiting for a reply, or drops it
+// when there is nowhere to keep it (or it is a stray reply).
+static void rift_socket_stash_frame(rift_stash_t *stash, uint32_t id, char *frame) {
+    if (stash && id == 0) rift_stash_push(stash, frame);
+    else free(frame);
+}
+
+// Waits for the frame carrying `id`. Events (id 0) that arrive first go to
+// `stash` when one is given; other frames are discarded.
+static char* rift_socket_await_reply(int fd, uint32_t id, rift_stash_t *stash) {
+    while (1) {
+        uint32_t reply_id = 0;
+        rift_socket_status_t status;
+        char *reply = rift_socket_recv_frame(fd, -1, &reply_id, NULL, &status);
+        if (!reply) {
+            fprintf(stderr, "socket receive failed\n");
+            return NULL;
+        }
+        if (reply_id == id) return reply;
+        rift_socket_stash_frame(stash, reply_id, reply);
+    }
+}
+
+// Sends a request and, when `id` is non-zero, waits for its reply.
+static char* rift_socket_request_internal(int fd, uint32_t id, const char *request_json, rift_stash_t *stash) {
+    if (!rift_socket_send_frame(fd, id, request_json, strlen(request_json))) return NULL;
+    if (id == 0) return (char*)1;
+    return rift_socket_await_reply(fd, id, stash);
+}
+
+// rift_socket_request_internal for a payload already behind header room, as
+// rift_socket_send_prefixed takes it.
+static char* rift_socket_request_prefixed(int fd, uint32_t id, char *frame, size_t len, rift_stash_t *stash) {
+    if (!rift_socket_send_prefixed(fd, id, frame, len)) return NULL;
+    if (id == 0) return (char*)1;
+    return rift_socket_await_reply(fd, id, stash);
+}
+
+// Sends every request before reading any reply, then collects the replies
+// by id into `replies` (malloc'd, NULL where none came). One round trip for
+// the whole batch instead of one per request. Other frames are stashed or
+// discarded as in rift_socket_await_reply.
+static bool rift_socket_request_batch_internal(int fd, const uint32_t *ids, const char *const *requests, size_t count, char **replies, rift_stash_t *stash) {
+    for (size_t i = 0; i < count; ++i) replies[i] = NULL;
+    for (size_t i = 0; i < count; ++i) {
+        if (!rift_socket_send_frame(fd, ids[i], requests[i], strlen(requests[i]))) return false;
+    }
+
+    size_t pending = count;
+    while (pending) {
+        uint32_t reply_id = 0;
+        rift_socket_status_t status;
+        char *reply = rift_socket_recv_frame(fd, -1, &reply_id, NULL, &status);
+        if (!reply) {
+            fprintf(stderr, "socket receive failed\n");
+            return false;
+        }
+        size_t i = 0;
+        while (i < count && (ids[i] != reply_id || replies[i])) i++;
+        if (i == count) {
+            rift_socket_stash_frame(stash, reply_id, reply);
+            continue;
+        }
+        replies[i] = reply;
+        pending--;
+    }
+    return true;
+}
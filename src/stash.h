@@ -0,0 +1,53 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Events that arrived on the event stream while a subscribe/unsubscribe was
+// waiting there for its reply. They are kept in arrival order and handed out
+// by the next receives before anything new is read.
+typedef struct rift_stash_item {
+    char *json;
+    struct rift_stash_item *next;
+} rift_stash_item_t;
+
+typedef struct {
+    rift_stash_item_t *head;
+    rift_stash_item_t *tail;
+    size_t count;
+    // Events stashed since the transport was created.
+    uint64_t total;
+} rift_stash_t;
+
+// Takes ownership of `json`; frees it and returns false when out of memory.
+static bool rift_stash_push(rift_stash_t *stash, char *json) {
+    rift_stash_item_t *item = (rift_stash_item_t*)malloc(sizeof(rift_stash_item_t));
+    if (!item) {
+        free(json);
+        return false;
+    }
+    item->json = json;
+    item->next = NULL;
+    if (stash->tail) stash->tail->next = item;
+    else stash->head = item;
+    stash->tail = item;
+    stash->count++;
+    stash->total++;
+    return true;
+}
+
+static char* rift_stash_pop(rift_stash_t *stash) {
+    rift_stash_item_t *item = stash->head;
+    if (!item) return NULL;
+    stash->head = item->next;
+    if (!stash->head) stash->tail = NULL;
+    stash->count--;
+    char *json = item->json;
+    free(item);
+    return json;
+}
+
+static void rift_stash_clear(rift_stash_t *stash) {
+    while (stash->head) free(rift_stash_pop(stash));
+}
@@ -0,0 +1,150 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <lua.h>
+
+// Per-client counters and latency histograms behind client:stats(). Cheap
+// enough to stay on: recording is two clock reads and a few increments.
+typedef enum {
+    RIFT_STAT_SEND,
+    RIFT_STAT_RECEIVE,
+    RIFT_STAT_PARSE,
+    RIFT_STAT_MATERIALIZE,
+    RIFT_STAT_CALLBACK,
+    RIFT_STAT_COUNT
+} rift_stat_op_t;
+
+static const char *const rift_stat_names[RIFT_STAT_COUNT] = {
+    "send",
+    "receive",
+    "parse",
+    "materialize",
+    "callback",
+};
+
+// Log-linear (HDR-style) buckets: values below 16ns are exact, above that each
+// power of two is split into 16 sub-buckets (~6% precision). Anything past
+// 2^40ns (~18 minutes) lands in the last bucket.
+#define RIFT_HIST_SUB_BITS 4
+#define RIFT_HIST_SUB_COUNT (1 << RIFT_HIST_SUB_BITS)
+#define RIFT_HIST_MAX_EXP 40
+#define RIFT_HIST_BUCKETS ((RIFT_HIST_MAX_EXP - RIFT_HIST_SUB_BITS + 2) * RIFT_HIST_SUB_COUNT)
+
+typedef struct {
+    uint64_t count;
+    uint64_t errors;
+    uint64_t bytes;
+    // Net Lua heap growth, clamped at 0 per sample, so it misses whatever
+    // the stage freed again.
+    uint64_t heap_growth_bytes;
+    // From the rift.alloc wrapper when installed, 0 otherwise.
+    uint64_t allocs;
+    uint64_t allocated_bytes;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t buckets[RIFT_HIST_BUCKETS];
+} rift_stat_t;
+
+typedef struct {
+    uint64_t since_ns;
+    rift_stat_t ops[RIFT_STAT_COUNT];
+} rift_stats_t;
+
+static inline int rift_hist_index(uint64_t ns) {
+    if (ns < RIFT_HIST_SUB_COUNT) return (int)ns;
+
+    int exp = 63 - __builtin_clzll(ns);
+    if (exp > RIFT_HIST_MAX_EXP) return RIFT_HIST_BUCKETS - 1;
+    int sub = (int)(ns >> (exp - RIFT_HIST_SUB_BITS)) - RIFT_HIST_SUB_COUNT;
+    return (exp - RIFT_HIST_SUB_BITS + 1) * RIFT_HIST_SUB_COUNT + sub;
+}
+
+// Highest value that maps to bucket `index`.
+static inline uint64_t rift_hist_value(int index) {
+    if (index < RIFT_HIST_SUB_COUNT) return (uint64_t)index;
+
+    int exp = index / RIFT_HIST_SUB_COUNT + RIFT_HIST_SUB_BITS - 1;
+    uint64_t sub = (uint64_t)(index % RIFT_HIST_SUB_COUNT + RIFT_HIST_SUB_COUNT);
+    int shift = exp - RIFT_HIST_SUB_BITS;
+    return ((sub + 1) << shift) - 1;
+}
+
+static inline void rift_stats_reset(rift_stats_t *stats, uint64_t now_ns) {
+    memset(stats, 0, sizeof(rift_stats_t));
+    stats->since_ns = now_ns;
+}
+
+static inline void rift_stats_record(rift_stats_t *stats, rift_stat_op_t op, uint64_t ns, size_t bytes) {
+    rift_stat_t *stat = &stats->ops[op];
+    stat->count++;
+    stat->bytes += bytes;
+    stat->total_ns += ns;
+    if (ns > stat->max_ns) stat->max_ns = ns;
+    stat->buckets[rift_hist_index(ns)]++;
+}
+
+static inline void rift_stats_error(rift_stats_t *stats, rift_stat_op_t op) {
+    stats->ops[op].errors++;
+}
+
+static inline void rift_stats_alloc(rift_stats_t *stats, rift_stat_op_t op, int64_t heap_growth, uint64_t allocs, uint64_t allocated_bytes) {
+    rift_stat_t *stat = &stats->ops[op];
+    if (heap_growth > 0) stat->heap_growth_bytes += (uint64_t)heap_growth;
+    stat->allocs += allocs;
+    stat->allocated_bytes += allocated_bytes;
+}
+
+static inline uint64_t rift_stat_percentile(const rift_stat_t *stat, double quantile) {
+    if (stat->count == 0) return 0;
+
+    uint64_t rank = (uint64_t)(quantile * (double)stat->count + 0.5);
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < RIFT_HIST_BUCKETS; ++i) {
+        seen += stat->buckets[i];
+        if (seen >= rank) {
+            uint64_t value = rift_hist_value(i);
+            return value < stat->max_ns ? value : stat->max_ns;
+        }
+    }
+    return stat->max_ns;
+}
+
+// Pushes `{ [op] = { count, errors, bytes, heap_growth_bytes, allocs,
+// allocated_bytes, total_ns, mean_ns, max_ns, p50_ns, p99_ns, p999_ns },
+// elapsed_ns = ... }`.
+static void rift_stats_push(lua_State *L, const rift_stats_t *stats, uint64_t now_ns) {
+    lua_createtable(L, 0, RIFT_STAT_COUNT + 1);
+    lua_pushinteger(L, (lua_Integer)(now_ns - stats->since_ns));
+    lua_setfield(L, -2, "elapsed_ns");
+
+    for (int op = 0; op < RIFT_STAT_COUNT; ++op) {
+        const rift_stat_t *stat = &stats->ops[op];
+        lua_createtable(L, 0, 12);
+        lua_pushinteger(L, (lua_Integer)stat->count);
+        lua_setfield(L, -2, "count");
+        lua_pushinteger(L, (lua_Integer)stat->errors);
+        lua_setfield(L, -2, "errors");
+        lua_pushinteger(L, (lua_Integer)stat->bytes);
+        lua_setfield(L, -2, "bytes");
+        lua_pushinteger(L, (lua_Integer)stat->heap_growth_bytes);
+        lua_setfield(L, -2, "heap_growth_bytes");
+        lua_pushinteger(L, (lua_Integer)stat->allocs);
+        lua_setfield(L, -2, "allocs");
+        lua_pushinteger(L, (lua_Integer)stat->allocated_bytes);
+        lua_setfield(L, -2, "allocated_bytes");
+        lua_pushinteger(L, (lua_Integer)stat->total_ns);
+        lua_setfield(L, -2, "total_ns");
+        lua_pushinteger(L, (lua_Integer)(stat->count ? stat->total_ns / stat->count : 0));
+        lua_setfield(L, -2, "mean_ns");
+        lua_pushinteger(L, (lua_Integer)stat->max_ns);
+        lua_setfield(L, -2, "max_ns");
+        lua_pushinteger(L, (lua_Integer)rift_stat_percentile(stat, 0.50));
+        lua_setfield(L, -2, "p50_ns");
+        lua_pushinteger(L, (lua_Integer)rift_stat_percentile(stat, 0.99));
+        lua_setfield(L, -2, "p99_ns");
+        lua_pushinteger(L, (lua_Integer)rift_stat_percentile(stat, 0.999));
+        lua_setfield(L, -2, "p999_ns");
+        lua_setfield(L, -2, rift_stat_names[op]);
+    }
+}
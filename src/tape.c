@@ -0,0 +1,397 @@
+#include "tape.h"
+#include "number.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define RIFT_TAPE_CONTAINER_HEADER 9
+
+static bool rift_tape_reserve(rift_tape_t *tape, size_t extra) {
+    if (tape->len + extra <= tape->cap) return true;
+
+    size_t cap = tape->cap ? tape->cap : 256;
+    while (cap < tape->len + extra) cap *= 2;
+    unsigned char *data = (unsigned char*)realloc(tape->data, cap);
+    if (!data) return false;
+    tape->data = data;
+    tape->cap = cap;
+    return true;
+}
+
+static void rift_tape_put_u32(unsigned char *out, uint32_t v) {
+    memcpy(out, &v, sizeof(v));
+}
+
+static uint32_t rift_tape_get_u32(const unsigned char *in) {
+    uint32_t v;
+    memcpy(&v, in, sizeof(v));
+    return v;
+}
+
+static bool rift_tape_put_string(rift_tape_t *tape, const char *s) {
+    size_t len = s ? strlen(s) : 0;
+    if (len > UINT32_MAX || !rift_tape_reserve(tape, 5 + len)) return false;
+    tape->data[tape->len] = RIFT_TAPE_STRING;
+    rift_tape_put_u32(tape->data + tape->len + 1, (uint32_t)len);
+    if (len) memcpy(tape->data + tape->len + 5, s, len);
+    tape->len += 5 + len;
+    return true;
+}
+
+static bool rift_tape_put_value(rift_tape_t *tape, const cJSON *item);
+
+static bool rift_tape_put_container(rift_tape_t *tape, const cJSON *json, bool object) {
+    if (!rift_tape_reserve(tape, RIFT_TAPE_CONTAINER_HEADER)) return false;
+    size_t header = tape->len;
+    tape->data[header] = object ? RIFT_TAPE_OBJECT : RIFT_TAPE_ARRAY;
+    tape->len += RIFT_TAPE_CONTAINER_HEADER;
+
+    uint32_t count = 0;
+    const cJSON *item;
+    cJSON_ArrayForEach(item, json) {
+        if (object && !rift_tape_put_string(tape, item->string)) return false;
+        if (!rift_tape_put_value(tape, item)) return false;
+        count++;
+    }
+
+    size_t payload = tape->len - header - RIFT_TAPE_CONTAINER_HEADER;
+    if (payload > UINT32_MAX) return false;
+    rift_tape_put_u32(tape->data + header + 1, count);
+    rift_tape_put_u32(tape->data + header + 5, (uint32_t)payload);
+    return true;
+}
+
+static bool rift_tape_put_value(rift_tape_t *tape, const cJSON *item) {
+    switch (item->type & 0xFF) {
+        case cJSON_Number: {
+            if (!rift_tape_reserve(tape, 9)) return false;
+            // Same integer test json_to_lua_table uses, so both paths agree.
+            int64_t v = 0;
+            if (rift_number_integer(item, &v)) {
+                tape->data[tape->len] = RIFT_TAPE_INTEGER;
+                memcpy(tape->data + tape->len + 1, &v, sizeof(v));
+            } else {
+                double v = item->valuedouble;
+                tape->data[tape->len] = RIFT_TAPE_NUMBER;
+                memcpy(tape->data + tape->len + 1, &v, sizeof(v));
+            }
+            tape->len += 9;
+            return true;
+        }
+        case cJSON_String:
+            return rift_tape_put_string(tape, item->valuestring);
+        case cJSON_Array:
+            return rift_tape_put_container(tape, item, false);
+        case cJSON_Object:
+            return rift_tape_put_container(tape, item, true);
+        default: {
+            if (!rift_tape_reserve(tape, 1)) return false;
+            rift_tape_tag_t tag = RIFT_TAPE_NULL;
+            if (cJSON_IsTrue(item)) tag = RIFT_TAPE_TRUE;
+            else if (cJSON_IsFalse(item)) tag = RIFT_TAPE_FALSE;
+            tape->data[tape->len++] = (unsigned char)tag;
+            return true;
+        }
+    }
+}
+
+bool rift_tape_encode(rift_tape_t *tape, const cJSON *json) {
+    tape->len = 0;
+    if (!json) return false;
+    if (!rift_tape_put_value(tape, json)) {
+        tape->len = 0;
+        return false;
+    }
+    return true;
+}
+
+void rift_tape_free(rift_tape_t *tape) {
+    free(tape->data);
+    tape->data = NULL;
+    tape->len = 0;
+    tape->cap = 0;
+}
+
+rift_tape_tag_t rift_tape_tag(const rift_tape_t *tape, size_t pos) {
+    if (pos >= tape->len) return RIFT_TAPE_NULL;
+    return (rift_tape_tag_t)tape->data[pos];
+}
+
+size_t rift_tape_skip(const rift_tape_t *tape, size_t pos) {
+    if (pos >= tape->len) return tape->len;
+    switch ((rift_tape_tag_t)tape->data[pos]) {
+        case RIFT_TAPE_INTEGER:
+        case RIFT_TAPE_NUMBER:
+            return pos + 9;
+        case RIFT_TAPE_STRING:
+            return pos + 5 + rift_tape_get_u32(tape->data + pos + 1);
+        case RIFT_TAPE_ARRAY:
+        case RIFT_TAPE_OBJECT:
+            return pos + RIFT_TAPE_CONTAINER_HEADER + rift_tape_get_u32(tape->data + pos + 5);
+        default:
+            return pos + 1;
+    }
+}
+
+bool rift_tape_object_get(const rift_tape_t *tape, size_t pos, const char *key, size_t *value_pos) {
+    if (rift_tape_tag(tape, pos) != RIFT_TAPE_OBJECT) return false;
+
+    size_t key_len = strlen(key);
+    uint32_t count = rift_tape_get_u32(tape->data + pos + 1);
+    size_t cursor = pos + RIFT_TAPE_CONTAINER_HEADER;
+    for (uint32_t i = 0; i < count && cursor < tape->len; ++i) {
+        size_t len = 0;
+        const char *name = rift_tape_string(tape, cursor, &len);
+        cursor = rift_tape_skip(tape, cursor);
+        if (name && len == key_len && memcmp(name, key, len) == 0) {
+            *value_pos = cursor;
+            return true;
+        }
+        cursor = rift_tape_skip(tape, cursor);
+    }
+    return false;
+}
+
+uint32_t rift_tape_count(const rift_tape_t *tape, size_t pos) {
+    rift_tape_tag_t tag = rift_tape_tag(tape, pos);
+    if (tag != RIFT_TAPE_ARRAY && tag != RIFT_TAPE_OBJECT) return 0;
+    return rift_tape_get_u32(tape->data + pos + 1);
+}
+
+size_t rift_tape_first(const rift_tape_t *tape, size_t pos) {
+    (void)tape;
+    return pos + RIFT_TAPE_CONTAINER_HEADER;
+}
+
+int64_t rift_tape_integer(const rift_tape_t *tape, size_t pos) {
+    int64_t v = 0;
+    if (pos + 9 <= tape->len) memcpy(&v, tape->data + pos + 1, sizeof(v));
+    return v;
+}
+
+double rift_tape_number(const rift_tape_t *tape, size_t pos) {
+    if (rift_tape_tag(tape, pos) == RIFT_TAPE_INTEGER) return (double)rift_tape_integer(tape, pos);
+    double v = 0;
+    if (pos + 9 <= tape->len) memcpy(&v, tape->data + pos + 1, sizeof(v));
+    return v;
+}
+
+const char* rift_tape_string(const rift_tape_t *tape, size_t pos, size_t *len) {
+    if (rift_tape_tag(tape, pos) != RIFT_TAPE_STRING) return NULL;
+    *len = rift_tape_get_u32(tape->data + pos + 1);
+    return (const char*)tape->data + pos + 5;
+}
+
+static char* rift_tape_strdup(const rift_tape_t *tape, size_t pos) {
+    size_t len = 0;
+    const char *s = rift_tape_string(tape, pos, &len);
+    char *out = (char*)malloc(len + 1);
+    if (!out) return NULL;
+    if (len) memcpy(out, s, len);
+    out[len] = '\0';
+    return out;
+}
+
+cJSON* rift_tape_to_cjson(const rift_tape_t *tape, size_t pos) {
+    switch (rift_tape_tag(tape, pos)) {
+        case RIFT_TAPE_FALSE:
+            return cJSON_CreateFalse();
+        case RIFT_TAPE_TRUE:
+            return cJSON_CreateTrue();
+        case RIFT_TAPE_INTEGER: {
+            // Keep the exact value, as cJSON's own parser does.
+            cJSON *item = cJSON_CreateNumber(rift_tape_number(tape, pos));
+            if (item) {
+                item->type |= cJSON_NumberIsInteger;
+                item->valueint64 = rift_tape_integer(tape, pos);
+            }
+            return item;
+        }
+        case RIFT_TAPE_NUMBER:
+            return cJSON_CreateNumber(rift_tape_number(tape, pos));
+        case RIFT_TAPE_STRING: {
+            char *s = rift_tape_strdup(tape, pos);
+            cJSON *item = s ? cJSON_CreateString(s) : NULL;
+            free(s);
+            return item;
+        }
+        case RIFT_TAPE_ARRAY:
+        case RIFT_TAPE_OBJECT:
+            break;
+        default:
+            return cJSON_CreateNull();
+    }
+
+    bool object = rift_tape_tag(tape, pos) == RIFT_TAPE_OBJECT;
+    cJSON *json = object ? cJSON_CreateObject() : cJSON_CreateArray();
+    uint32_t count = rift_tape_get_u32(tape->data + pos + 1);
+    size_t cursor = pos + RIFT_TAPE_CONTAINER_HEADER;
+    for (uint32_t i = 0; json && i < count; ++i) {
+        char *key = NULL;
+        if (object) {
+            key = rift_tape_strdup(tape, cursor);
+            cursor = rift_tape_skip(tape, cursor);
+        }
+        cJSON *item = rift_tape_to_cjson(tape, cursor);
+        cursor = rift_tape_skip(tape, cursor);
+        bool ok = item && (!object || key) &&
+                  (object ? cJSON_AddItemToObject(json, key, item) : cJSON_AddItemToArray(json, item));
+        free(key);
+        if (!ok) {
+            cJSON_Delete(item);
+            cJSON_Delete(json);
+            json = NULL;
+        }
+    }
+    return json;
+}
+
+static size_t rift_tape_push_value(lua_State *L, const rift_tape_t *tape, size_t pos);
+
+static size_t rift_tape_push_container(lua_State *L, const rift_tape_t *tape, size_t pos, bool object) {
+    uint32_t count = rift_tape_get_u32(tape->data + pos + 1);
+    size_t cursor = pos + RIFT_TAPE_CONTAINER_HEADER;
+
+    if (object) {
+        lua_createtable(L, 0, (int)count);
+        for (uint32_t i = 0; i < count; ++i) {
+            size_t len = 0;
+            const char *key = rift_tape_string(tape, cursor, &len);
+            lua_pushlstring(L, key ? key : "", len);
+            cursor = rift_tape_push_value(L, tape, rift_tape_skip(tape, cursor));
+            lua_settable(L, -3);
+        }
+    } else {
+        lua_createtable(L, (int)count, 0);
+        for (uint32_t i = 0; i < count; ++i) {
+            cursor = rift_tape_push_value(L, tape, cursor);
+            lua_rawseti(L, -2, (lua_Integer)i + 1);
+        }
+    }
+    return cursor;
+}
+
+static size_t rift_tape_push_value(lua_State *L, const rift_tape_t *tape, size_t pos) {
+    switch (rift_tape_tag(tape, pos)) {
+        case RIFT_TAPE_FALSE:
+            lua_pushboolean(L, 0);
+            break;
+        case RIFT_TAPE_TRUE:
+            lua_pushboolean(L, 1);
+            break;
+        case RIFT_TAPE_INTEGER:
+            lua_pushinteger(L, (lua_Integer)rift_tape_integer(tape, pos));
+            break;
+        case RIFT_TAPE_NUMBER:
+            lua_pushnumber(L, (lua_Number)rift_tape_number(tape, pos));
+            break;
+        case RIFT_TAPE_STRING: {
+            size_t len = 0;
+            const char *s = rift_tape_string(tape, pos, &len);
+            lua_pushlstring(L, s, len);
+            break;
+        }
+        case RIFT_TAPE_ARRAY:
+            rift_tape_push_container(L, tape, pos, false);
+            break;
+        case RIFT_TAPE_OBJECT:
+            rift_tape_push_container(L, tape, pos, true);
+            break;
+        default:
+            lua_pushnil(L);
+            break;
+    }
+    return rift_tape_skip(tape, pos);
+}
+
+static size_t rift_tape_fill_container(lua_State *L, const rift_tape_t *tape, size_t pos, int index);
+
+// Sets the key on top of the stack to the value at `pos`, refilling a table
+// that is already stored under that key instead of building a new one.
+static size_t rift_tape_set_value(lua_State *L, const rift_tape_t *tape, size_t pos, int index) {
+    rift_tape_tag_t tag = rift_tape_tag(tape, pos);
+    size_t next;
+    if (tag == RIFT_TAPE_ARRAY || tag == RIFT_TAPE_OBJECT) {
+        lua_pushvalue(L, -1);
+        if (lua_rawget(L, index) == LUA_TTABLE) {
+            next = rift_tape_fill_container(L, tape, pos, lua_gettop(L));
+        } else {
+            lua_pop(L, 1);
+            next = rift_tape_push_value(L, tape, pos);
+        }
+    } else {
+        next = rift_tape_push_value(L, tape, pos);
+    }
+    lua_rawset(L, index);
+    return next;
+}
+
+static bool rift_tape_has_key(lua_State *L, const rift_tape_t *tape, size_t pos, uint32_t count) {
+    if (rift_tape_tag(tape, pos) == RIFT_TAPE_ARRAY) {
+        if (!lua_isinteger(L, -1)) return false;
+        lua_Integer i = lua_tointeger(L, -1);
+        return i >= 1 && i <= (lua_Integer)count;
+    }
+    if (lua_type(L, -1) != LUA_TSTRING) return false;
+    size_t value = 0;
+    return rift_tape_object_get(tape, pos, lua_tostring(L, -1), &value) &&
+           rift_tape_tag(tape, value) != RIFT_TAPE_NULL;
+}
+
+static size_t rift_tape_fill_container(lua_State *L, const rift_tape_t *tape, size_t pos, int index) {
+    bool object = rift_tape_tag(tape, pos) == RIFT_TAPE_OBJECT;
+    uint32_t count = rift_tape_get_u32(tape->data + pos + 1);
+    size_t cursor = pos + RIFT_TAPE_CONTAINER_HEADER;
+    int kept = 0;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        if (object) {
+            size_t len = 0;
+            const char *key = rift_tape_string(tape, cursor, &len);
+            lua_pushlstring(L, key ? key : "", len);
+            cursor = rift_tape_skip(tape, cursor);
+        } else {
+            lua_pushinteger(L, (lua_Integer)i + 1);
+        }
+        if (rift_tape_tag(tape, cursor) != RIFT_TAPE_NULL) kept++;
+        cursor = rift_tape_set_value(L, tape, cursor, index);
+    }
+
+    // Every key in the table now holds a value from the tape, unless the
+    // table had more keys than that before; only then look for stale ones.
+    int present = 0;
+    lua_pushnil(L);
+    while (lua_next(L, index)) {
+        present++;
+        lua_pop(L, 1);
+    }
+    if (present != kept) {
+        lua_pushnil(L);
+        while (lua_next(L, index)) {
+            lua_pop(L, 1);
+            if (!rift_tape_has_key(L, tape, pos, count)) {
+                lua_pushvalue(L, -1);
+                lua_pushnil(L);
+                lua_rawset(L, index);
+            }
+        }
+    }
+    return cursor;
+}
+
+bool rift_tape_fill_lua_table(lua_State *L, const rift_tape_t *tape, int index) {
+    rift_tape_tag_t tag = rift_tape_tag(tape, 0);
+    if (tape->len == 0 || (tag != RIFT_TAPE_ARRAY && tag != RIFT_TAPE_OBJECT)) return false;
+    rift_tape_fill_container(L, tape, 0, lua_absindex(L, index));
+    return true;
+}
+
+bool rift_tape_to_lua_table(lua_State *L, const rift_tape_t *tape) {
+    rift_tape_tag_t tag = rift_tape_tag(tape, 0);
+    if (tape->len == 0 || (tag != RIFT_TAPE_ARRAY && tag != RIFT_TAPE_OBJECT)) return false;
+    rift_tape_push_value(L, tape, 0);
+    return true;
+}
+
+size_t rift_tape_value_to_lua(lua_State *L, const rift_tape_t *tape, size_t pos) {
+    return rift_tape_push_value(L, tape, pos);
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <lua.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cJSON.h"
+
+// A decoded JSON document flattened into one pointer-free byte buffer, so it
+// can be built on a worker thread and handed to the Lua thread as-is.
+//
+// Every value starts with a one-byte tag:
+//   null/false/true   tag only
+//   integer           tag, i64
+//   number            tag, double
+//   string            tag, u32 length, bytes (no terminator)
+//   array             tag, u32 element count, u32 payload bytes, elements
+//   object            tag, u32 member count, u32 payload bytes, key/value pairs
+// Object keys are encoded as strings. Payload sizes let readers skip a
+// container without walking it.
+typedef enum {
+    RIFT_TAPE_NULL,
+    RIFT_TAPE_FALSE,
+    RIFT_TAPE_TRUE,
+    RIFT_TAPE_INTEGER,
+    RIFT_TAPE_NUMBER,
+    RIFT_TAPE_STRING,
+    RIFT_TAPE_ARRAY,
+    RIFT_TAPE_OBJECT
+} rift_tape_tag_t;
+
+typedef struct {
+    unsigned char *data;
+    size_t len;
+    size_t cap;
+} rift_tape_t;
+
+bool rift_tape_encode(rift_tape_t *tape, const cJSON *json);
+void rift_tape_free(rift_tape_t *tape);
+
+// Readers take the byte offset of a value and never read past `tape->len`.
+rift_tape_tag_t rift_tape_tag(const rift_tape_t *tape, size_t pos);
+size_t rift_tape_skip(const rift_tape_t *tape, size_t pos);
+bool rift_tape_object_get(const rift_tape_t *tape, size_t pos, const char *key, size_t *value_pos);
+int64_t rift_tape_integer(const rift_tape_t *tape, size_t pos);
+double rift_tape_number(const rift_tape_t *tape, size_t pos);
+const char* rift_tape_string(const rift_tape_t *tape, size_t pos, size_t *len);
+// Element or member count of the container at `pos`; 0 for anything else.
+uint32_t rift_tape_count(const rift_tape_t *tape, size_t pos);
+// Offset of the first element (or first key) of the container at `pos`.
+size_t rift_tape_first(const rift_tape_t *tape, size_t pos);
+// Rebuilds the value at `pos` as a cJSON tree owned by the caller.
+cJSON* rift_tape_to_cjson(const rift_tape_t *tape, size_t pos);
+
+// Pushes the root object or array as a Lua table; false for anything else.
+bool rift_tape_to_lua_table(lua_State *L, const rift_tape_t *tape);
+// Pushes the value at `pos`; returns the offset just past it.
+size_t rift_tape_value_to_lua(lua_State *L, const rift_tape_t *tape, size_t pos);
+// Makes the table at `index` equal to the root, reusing its nested tables.
+bool rift_tape_fill_lua_table(lua_State *L, const rift_tape_t *tape, int index);
@@ -0,0 +1,200 @@
+#include "template.h"
+#include <locale.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RIFT_TEMPLATE_MIN_BUFFER 256
+
+rift_template_t* rift_template_compile(const char *format, size_t len, bool await_response, const char **err) {
+    rift_template_t *tpl = (rift_template_t*)calloc(1, sizeof(rift_template_t));
+    // A format with n slots has at most n + 1 fragments, and n <= len / 2.
+    size_t max_parts = len / 2 + 1;
+    if (tpl) {
+        tpl->text = (char*)malloc(len + 1);
+        tpl->parts = (rift_template_part_t*)malloc(max_parts * sizeof(rift_template_part_t));
+    }
+    if (!tpl || !tpl->text || !tpl->parts) {
+        *err = "out of memory";
+        rift_template_free(tpl);
+        return NULL;
+    }
+    tpl->await_response = await_response;
+
+    size_t text_len = 0;
+    rift_template_part_t *part = &tpl->parts[0];
+    part->offset = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if (format[i] != '%') {
+            tpl->text[text_len++] = format[i];
+            continue;
+        }
+        char spec = i + 1 < len ? format[++i] : '\0';
+        if (spec == '%') {
+            tpl->text[text_len++] = '%';
+            continue;
+        }
+        if (spec != 'd' && spec != 'g' && spec != 's' && spec != 'b') {
+            *err = "slots are %d, %g, %s and %b (%% for a literal '%')";
+            rift_template_free(tpl);
+            return NULL;
+        }
+        part->len = text_len - part->offset;
+        part->slot = spec;
+        tpl->slot_count++;
+        part = &tpl->parts[++tpl->part_count];
+        part->offset = text_len;
+    }
+    part->len = text_len - part->offset;
+    part->slot = 0;
+    tpl->part_count++;
+    tpl->text[text_len] = '\0';
+    return tpl;
+}
+
+void rift_template_free(rift_template_t *tpl) {
+    if (!tpl) return;
+    free(tpl->text);
+    free(tpl->parts);
+    free(tpl->buf);
+    free(tpl);
+}
+
+static void rift_template_reserve(lua_State *L, rift_template_t *tpl, size_t len, size_t extra) {
+    if (len + extra <= tpl->buf_cap) return;
+    size_t cap = tpl->buf_cap ? tpl->buf_cap : RIFT_TEMPLATE_MIN_BUFFER;
+    while (cap < len + extra) cap *= 2;
+    char *buf = (char*)realloc(tpl->buf, cap);
+    if (!buf) luaL_error(L, "send_template: out of memory");
+    tpl->buf = buf;
+    tpl->buf_cap = cap;
+}
+
+static size_t rift_template_put_integer(char *out, lua_Integer value) {
+    char digits[24];
+    size_t n = 0;
+    // Negated as unsigned so the minimum integer works too.
+    lua_Unsigned v = value < 0 ? (lua_Unsigned)0 - (lua_Unsigned)value : (lua_Unsigned)value;
+    do {
+        digits[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    size_t len = 0;
+    if (value < 0) out[len++] = '-';
+    while (n) out[len++] = digits[--n];
+    return len;
+}
+
+// Same shortest-of-15-or-17-digits rule cJSON prints numbers with.
+// snprintf and strtod both follow the C locale, so the round trip is checked
+// in its spelling and the decimal point is swapped for '.' afterwards, as
+// cJSON's print_number does.
+static size_t rift_template_put_number(char *out, double value) {
+    int n = snprintf(out, 26, "%1.15g", value);
+    if (strtod(out, NULL) != value) n = snprintf(out, 26, "%1.17g", value);
+    if (n <= 0) return 0;
+    char point = localeconv()->decimal_point[0];
+    if (point != '.') {
+        char *p = memchr(out, point, (size_t)n);
+        if (p) *p = '.';
+    }
+    return (size_t)n;
+}
+
+static size_t rift_template_escaped_len(const unsigned char *s, size_t len) {
+    size_t out = len + 2;
+    for (size_t i = 0; i < len; ++i) {
+        if (s[i] == '"' || s[i] == '\\') out++;
+        else if (s[i] < 0x20) out += 5;
+    }
+    return out;
+}
+
+static size_t rift_template_put_string(char *out, const unsigned char *s, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    size_t n = 0;
+    out[n++] = '"';
+    size_t run = 0;
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = s[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        memcpy(out + n, s + run, i - run);
+        n += i - run;
+        run = i + 1;
+        out[n++] = '\\';
+        switch (c) {
+            case '"': out[n++] = '"'; break;
+            case '\\': out[n++] = '\\'; break;
+            case '\n': out[n++] = 'n'; break;
+            case '\r': out[n++] = 'r'; break;
+            case '\t': out[n++] = 't'; break;
+            default:
+                out[n++] = 'u';
+                out[n++] = '0';
+                out[n++] = '0';
+                out[n++] = hex[c >> 4];
+                out[n++] = hex[c & 15];
+                break;
+        }
+    }
+    memcpy(out + n, s + run, len - run);
+    n += len - run;
+    out[n++] = '"';
+    return n;
+}
+
+char* rift_template_render(lua_State *L, rift_template_t *tpl, int first_arg, size_t headroom, size_t *out_len) {
+    size_t len = headroom;
+    int arg = first_arg;
+    for (size_t i = 0; i < tpl->part_count; ++i) {
+        const rift_template_part_t *part = &tpl->parts[i];
+        rift_template_reserve(L, tpl, len, part->len + 1);
+        memcpy(tpl->buf + len, tpl->text + part->offset, part->len);
+        len += part->len;
+
+        switch (part->slot) {
+            case 'd': {
+                lua_Integer value = luaL_checkinteger(L, arg);
+                rift_template_reserve(L, tpl, len, 24);
+                len += rift_template_put_integer(tpl->buf + len, value);
+                break;
+            }
+            case 'g': {
+                if (lua_isinteger(L, arg)) {
+                    rift_template_reserve(L, tpl, len, 24);
+                    len += rift_template_put_integer(tpl->buf + len, lua_tointeger(L, arg));
+                    break;
+                }
+                double value = (double)luaL_checknumber(L, arg);
+                // JSON has no spelling for these.
+                if (!isfinite(value)) luaL_argerror(L, arg, "number must be finite");
+                rift_template_reserve(L, tpl, len, 26);
+                len += rift_template_put_number(tpl->buf + len, value);
+                break;
+            }
+            case 's': {
+                size_t n = 0;
+                const char *s = luaL_checklstring(L, arg, &n);
+                rift_template_reserve(L, tpl, len, rift_template_escaped_len((const unsigned char*)s, n));
+                len += rift_template_put_string(tpl->buf + len, (const unsigned char*)s, n);
+                break;
+            }
+            case 'b': {
+                luaL_checkany(L, arg);
+                const char *value = lua_toboolean(L, arg) ? "true" : "false";
+                rift_template_reserve(L, tpl, len, 5);
+                memcpy(tpl->buf + len, value, strlen(value));
+                len += strlen(value);
+                break;
+            }
+            default:
+                break;
+        }
+        if (part->slot) arg++;
+    }
+    rift_template_reserve(L, tpl, len, 1);
+    tpl->buf[len] = '\0';
+    *out_len = len - headroom;
+    return tpl->buf;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <lua.h>
+#include <lauxlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Request templates behind rift.template(). The format is split once into
+// fixed fragments and typed slots:
+//   %d  integer
+//   %g  number (integers print as integers)
+//   %s  string, written as a quoted and escaped JSON string
+//   %b  boolean
+//   %%  a literal '%'
+// Rendering appends the fragments and the Lua arguments to the template's
+// own buffer, so sending creates no Lua strings.
+typedef struct {
+    size_t offset;
+    size_t len;
+    // The slot after this fragment; 0 for the last fragment.
+    char slot;
+} rift_template_part_t;
+
+typedef struct {
+    // The fixed fragments back to back, indexed by the parts.
+    char *text;
+    rift_template_part_t *parts;
+    size_t part_count;
+    size_t slot_count;
+    // Set from rift.template(format, false): sends don't wait for a reply.
+    bool await_response;
+    // Render buffer, reused by every send.
+    char *buf;
+    size_t buf_cap;
+} rift_template_t;
+
+// NULL with `*err` set for a malformed format.
+rift_template_t* rift_template_compile(const char *format, size_t len, bool await_response, const char **err);
+void rift_template_free(rift_template_t *tpl);
+
+// Renders the template with the arguments from `first_arg` on, after
+// `headroom` free bytes at the start of the buffer, and returns the buffer
+// (the JSON is NUL-terminated). A wrong argument raises a Lua error.
+char* rift_template_render(lua_State *L, rift_template_t *tpl, int first_arg, size_t headroom, size_t *out_len);
@@ -0,0 +1,133 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Span recorder behind client:trace()/trace_dump(). Writers on any thread
+// claim a slot with one atomic increment and publish it with a sequence
+// number, so recording never takes a lock; once the ring is full the oldest
+// spans are overwritten. Names must be string literals.
+#define RIFT_TRACE_DEFAULT_CAPACITY (1u << 15)
+#define RIFT_TRACE_TID_LUA 1
+#define RIFT_TRACE_TID_WORKER 2
+
+typedef struct {
+    uint64_t seq;
+    const char *name;
+    uint64_t start_ns;
+    uint64_t dur_ns;
+    int64_t arg;
+    uint32_t tid;
+    char phase;
+} rift_trace_event_t;
+
+typedef struct {
+    rift_trace_event_t *events;
+    uint64_t mask;
+    uint64_t head;
+    uint64_t origin_ns;
+    bool armed;
+} rift_trace_t;
+
+static rift_trace_t* rift_trace_create(uint32_t capacity, uint64_t now_ns) {
+    uint32_t size = 1;
+    while (size < capacity && size < (1u << 24)) size <<= 1;
+
+    rift_trace_t *trace = (rift_trace_t*)calloc(1, sizeof(rift_trace_t));
+    if (!trace) return NULL;
+    trace->events = (rift_trace_event_t*)calloc(size, sizeof(rift_trace_event_t));
+    if (!trace->events) {
+        free(trace);
+        return NULL;
+    }
+    trace->mask = size - 1;
+    trace->origin_ns = now_ns;
+    return trace;
+}
+
+static void rift_trace_free(rift_trace_t *trace) {
+    if (!trace) return;
+    free(trace->events);
+    free(trace);
+}
+
+static inline bool rift_trace_armed(const rift_trace_t *trace) {
+    return trace && __atomic_load_n(&trace->armed, __ATOMIC_RELAXED);
+}
+
+static inline void rift_trace_set_armed(rift_trace_t *trace, bool armed) {
+    __atomic_store_n(&trace->armed, armed, __ATOMIC_RELAXED);
+}
+
+static inline void rift_trace_put(rift_trace_t *trace, char phase, const char *name, uint32_t tid,
+                                  uint64_t start_ns, uint64_t dur_ns, int64_t arg) {
+    if (!rift_trace_armed(trace)) return;
+
+    uint64_t index = __atomic_fetch_add(&trace->head, 1, __ATOMIC_RELAXED);
+    rift_trace_event_t *event = &trace->events[index & trace->mask];
+    __atomic_store_n(&event->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    event->name = name;
+    event->start_ns = start_ns;
+    event->dur_ns = dur_ns;
+    event->arg = arg;
+    event->tid = tid;
+    event->phase = phase;
+    __atomic_store_n(&event->seq, index + 1, __ATOMIC_RELEASE);
+}
+
+static inline void rift_trace_span(rift_trace_t *trace, const char *name, uint32_t tid,
+                                   uint64_t start_ns, uint64_t end_ns, int64_t bytes) {
+    rift_trace_put(trace, 'X', name, tid, start_ns, end_ns - start_ns, bytes);
+}
+
+static inline void rift_trace_counter(rift_trace_t *trace, const char *name, uint64_t ts_ns, int64_t value) {
+    rift_trace_put(trace, 'C', name, RIFT_TRACE_TID_LUA, ts_ns, 0, value);
+}
+
+static void rift_trace_write_ts(FILE *file, const char *key, uint64_t ns) {
+    fprintf(file, "\"%s\":%llu.%03llu", key, (unsigned long long)(ns / 1000), (unsigned long long)(ns % 1000));
+}
+
+// Writes the spans still in the ring as Chrome trace-event JSON (loadable in
+// Perfetto or chrome://tracing). Returns the number of events written, or -1.
+static long rift_trace_dump(rift_trace_t *trace, const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) return -1;
+
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", file);
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"lua\"}},\n", RIFT_TRACE_TID_LUA);
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"rift worker\"}}", RIFT_TRACE_TID_WORKER);
+
+    uint64_t head = __atomic_load_n(&trace->head, __ATOMIC_ACQUIRE);
+    uint64_t capacity = trace->mask + 1;
+    uint64_t first = head > capacity ? head - capacity : 0;
+    long written = 0;
+    for (uint64_t index = first; index < head; ++index) {
+        rift_trace_event_t *slot = &trace->events[index & trace->mask];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != index + 1) continue;
+        rift_trace_event_t event = *slot;
+        // Skip slots a writer reclaimed while we were copying them.
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != index + 1) continue;
+
+        uint64_t ts = event.start_ns > trace->origin_ns ? event.start_ns - trace->origin_ns : 0;
+        fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"rift\",\"ph\":\"%c\",\"pid\":1,\"tid\":%u,",
+                event.name, event.phase, (unsigned)event.tid);
+        rift_trace_write_ts(file, "ts", ts);
+        if (event.phase == 'X') {
+            fputc(',', file);
+            rift_trace_write_ts(file, "dur", event.dur_ns);
+            fprintf(file, ",\"args\":{\"bytes\":%lld}}", (long long)event.arg);
+        } else {
+            fprintf(file, ",\"args\":{\"value\":%lld}}", (long long)event.arg);
+        }
+        written++;
+    }
+
+    fputs("\n]}\n", file);
+    if (fclose(file) != 0) return -1;
+    return written;
+}
@@ -0,0 +1,521 @@
+#pragma once
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __APPLE__
+#include "mach.h"
+#include "cJSON.h"
+#endif
+#include "socket.h"
+#include "eventlog.h"
+#include "stash.h"
+
+typedef enum {
+    RIFT_TRANSPORT_MACH,
+    RIFT_TRANSPORT_SOCKET,
+    RIFT_TRANSPORT_REPLAY
+} rift_transport_kind_t;
+
+typedef enum {
+    RIFT_RECV_OK,
+    RIFT_RECV_TIMEOUT,
+    RIFT_RECV_ERROR,
+    RIFT_RECV_CLOSED
+} rift_recv_status_t;
+
+// The server side a client talks to. Mach is the live Rift service, socket is
+// the same JSON protocol over a Unix-domain socket, and replay feeds a recorded
+// event log through the same receive path and has no server.
+typedef struct {
+    rift_transport_kind_t kind;
+#ifdef __APPLE__
+    mach_port_t server_port;
+    mach_port_t event_port;
+    mach_port_t event_port_set;
+    int event_kq;
+#endif
+    char *socket_path;
+    int server_fd;
+    int event_fd;
+    uint32_t next_request_id;
+    rift_replay_t *replay;
+    // Bumped whenever the event stream is (re)opened so pollers can tell a
+    // recycled descriptor number from the one they registered.
+    uint32_t stream_generation;
+    // Events that came in while a control request waited for its reply, and
+    // whether the stream ended: the Mach server died or the socket peer hung
+    // up. Both are drained by the next receives; only the thread that owns
+    // the event stream touches them.
+    rift_stash_t stash;
+    bool stream_closed;
+} rift_transport_t;
+
+static void rift_transport_init(rift_transport_t *t, rift_transport_kind_t kind) {
+    memset(t, 0, sizeof(rift_transport_t));
+    t->kind = kind;
+#ifdef __APPLE__
+    t->server_port = MACH_PORT_NULL;
+    t->event_port = MACH_PORT_NULL;
+    t->event_port_set = MACH_PORT_NULL;
+    t->event_kq = -1;
+#endif
+    t->server_fd = -1;
+    t->event_fd = -1;
+    t->next_request_id = 1;
+}
+
+static bool rift_transport_connect_socket(rift_transport_t *t, const char *path, const char **err) {
+    rift_transport_init(t, RIFT_TRANSPORT_SOCKET);
+    t->socket_path = strdup(path);
+    if (!t->socket_path) {
+        *err = "Failed to allocate socket path.";
+        return false;
+    }
+
+    t->server_fd = rift_socket_connect_internal(path);
+    if (t->server_fd < 0) {
+        free(t->socket_path);
+        t->socket_path = NULL;
+        *err = "Failed to connect to Rift socket.";
+        return false;
+    }
+    return true;
+}
+
+// Connects to `socket_path` when given, otherwise to the Mach service, falling
+// back to $RIFT_SOCKET where Mach isn't available.
+static bool rift_transport_connect(rift_transport_t *t, const char *socket_path, const char **err) {
+    if (socket_path) return rift_transport_connect_socket(t, socket_path, err);
+
+#ifdef __APPLE__
+    rift_transport_init(t, RIFT_TRANSPORT_MACH);
+    t->server_port = rift_connect_internal();
+    if (t->server_port == MACH_PORT_NULL) {
+        *err = "Failed to connect to Rift server.";
+        return false;
+    }
+    return true;
+#else
+    const char *env_path = getenv(RIFT_SOCKET_ENV);
+    if (env_path && env_path[0]) return rift_transport_connect_socket(t, env_path, err);
+
+    rift_transport_init(t, RIFT_TRANSPORT_MACH);
+    *err = "Mach transport is not available on this platform; set " RIFT_SOCKET_ENV " or pass {socket = path}.";
+    return false;
+#endif
+}
+
+static bool rift_transport_open_replay(rift_transport_t *t, const char *path, bool realtime, const char **err) {
+    rift_transport_init(t, RIFT_TRANSPORT_REPLAY);
+    t->replay = rift_replay_open(path, realtime, err);
+    return t->replay != NULL;
+}
+
+static bool rift_transport_has_server(const rift_transport_t *t) {
+    return t->kind != RIFT_TRANSPORT_REPLAY;
+}
+
+static bool rift_transport_is_connected(const rift_transport_t *t) {
+    switch (t->kind) {
+#ifdef __APPLE__
+        case RIFT_TRANSPORT_MACH:
+            return t->server_port != MACH_PORT_NULL;
+#endif
+        case RIFT_TRANSPORT_SOCKET:
+            return t->server_fd >= 0;
+        case RIFT_TRANSPORT_REPLAY:
+            return t->replay != NULL;
+        default:
+            return false;
+    }
+}
+
+static bool rift_transport_has_event_stream(const rift_transport_t *t) {
+    switch (t->kind) {
+#ifdef __APPLE__
+        case RIFT_TRANSPORT_MACH:
+            return t->event_port != MACH_PORT_NULL;
+#endif
+        case RIFT_TRANSPORT_SOCKET:
+            return t->event_fd >= 0;
+        case RIFT_TRANSPORT_REPLAY:
+            return t->replay != NULL && !t->replay->ended;
+        default:
+            return false;
+    }
+}
+
+static bool rift_transport_open_event_stream(rift_transport_t *t) {
+    if (rift_transport_has_event_stream(t)) return true;
+    switch (t->kind) {
+#ifdef __APPLE__
+        case RIFT_TRANSPORT_MACH:
+            t->event_port = rift_allocate_reply_port_internal();
+            if (t->event_port == MACH_PORT_NULL) return false;
+            // Rift exiting then shows up on the event stream as a close,
+            // like EOF on the socket transport.
+            rift_request_dead_name_internal(t->server_port, t->event_port);
+            break;
+#endif
+        case RIFT_TRANSPORT_SOCKET:
+            t->event_fd = rift_socket_connect_internal(t->socket_path);
+            if (t->event_fd < 0) return false;
+            break;
+        default:
+            return false;
+    }
+    t->stream_generation++;
+    return true;
+}
+
+static void rift_transport_close_event_stream(rift_transport_t *t) {
+    rift_stash_clear(&t->stash);
+    t->stream_closed = false;
+#ifdef __APPLE__
+    if (t->kind == RIFT_TRANSPORT_MACH) {
+        rift_close_event_kqueue_internal(t->event_kq, t->event_port_set);
+        t->event_kq = -1;
+        t->event_port_set = MACH_PORT_NULL;
+        if (t->event_port != MACH_PORT_NULL) {
+            rift_deallocate_reply_port_internal(t->event_port);
+            t->event_port = MACH_PORT_NULL;
+        }
+    }
+#endif
+    if (t->event_fd >= 0) {
+        close(t->event_fd);
+        t->event_fd = -1;
+    }
+}
+
+// Closes a socket stream whose peer hung up once its stashed events are
+// read, so the client stops waiting on it. Only for the Lua thread, with no
+// worker running.
+static void rift_transport_reap_event_stream(rift_transport_t *t) {
+    if (t->kind == RIFT_TRANSPORT_SOCKET && t->stream_closed && !t->stash.count) rift_transport_close_event_stream(t);
+}
+
+static void rift_transport_close(rift_transport_t *t) {
+    rift_transport_close_event_stream(t);
+#ifdef __APPLE__
+    if (t->kind == RIFT_TRANSPORT_MACH && t->server_port != MACH_PORT_NULL) {
+        rift_disconnect_internal(t->server_port);
+        t->server_port = MACH_PORT_NULL;
+    }
+#endif
+    if (t->server_fd >= 0) {
+        close(t->server_fd);
+        t->server_fd = -1;
+    }
+    if (t->replay) {
+        rift_replay_close(t->replay);
+        t->replay = NULL;
+    }
+}
+
+// Closes everything and reconnects to the same endpoint. A failed attempt
+// keeps the endpoint, so it can be retried.
+static bool rift_transport_reconnect(rift_transport_t *t, const char **err) {
+    char *socket_path = t->socket_path;
+    uint32_t generation = t->stream_generation;
+    t->socket_path = NULL;
+    rift_transport_close(t);
+
+    bool ok = rift_transport_connect(t, socket_path, err);
+    t->stream_generation = generation;
+    if (ok) {
+        free(socket_path);
+    } else {
+        t->socket_path = socket_path;
+    }
+    return ok;
+}
+
+static void rift_transport_free(rift_transport_t *t) {
+    rift_transport_close(t);
+    free(t->socket_path);
+    t->socket_path = NULL;
+}
+
+static uint32_t rift_transport_next_id(rift_transport_t *t) {
+    uint32_t id = t->next_request_id++;
+    if (t->next_request_id == 0) t->next_request_id = 1;
+    return id;
+}
+
+// Returns a malloc'd response, (char*)1 when not awaiting one, or NULL.
+static char* rift_transport_request(rift_transport_t *t, const char *request_json, bool await_response) {
+    switch (t->kind) {
+#ifdef __APPLE__
+        case RIFT_TRANSPORT_MACH:
+            return rift_send_request_internal(t->server_port, request_json, await_response);
+#endif
+        case RIFT_TRANSPORT_SOCKET:
+            return rift_socket_request_internal(
+                t->server_fd,
+                await_response ? rift_transport_next_id(t) : 0,
+                request_json,
+                NULL
+            );
+        default:
+            return NULL;
+    }
+}
+
+// rift_transport_request for a NUL-terminated payload of `len` bytes behind
+// RIFT_SOCKET_FRAME_HEADER_LEN free bytes, which the socket transport fills
+// with the frame header so the request goes out in one write.
+static char* rift_transport_request_prefixed(rift_transport_t *t, char *frame, size_t len, bool await_response) {
+    switch (t->kind) {
+#ifdef __APPLE__
+        case RIFT_TRANSPORT_MACH:
+            return rift_send_request_internal(t->server_port, frame + RIFT_SOCKET_FRAME_HEADER_LEN, await_response);
+#endif
+        case RIFT_TRANSPORT_SOCKET:
+            return rift_socket_request_prefixed(
+                t->server_fd,
+                await_response ? rift_transport_next_id(t) : 0,
+                frame,
+                len,
+                NULL
+            );
+        default:
+            return NULL;
+    }
+}
+
+#ifdef __APPLE__
+// Events carry a top-level "type"; subscription replies don't.
+static bool rift_transport_is_event_message(const char *json) {
+    cJSON *root = cJSON_Parse(json);
+    bool event = cJSON_IsString(cJSON_GetObjectItemCaseSensitive(root, "type"));
+    cJSON_Delete(root);
+    return event;
+}
+
+// The reply comes back on the event port, queued behind any events already
+// there. Those are stashed in order and the first other message is the reply.
+static char* rift_transport_mach_control(rift_transport_t *t, const char *request_json) {
+    if (!rift_send_request_with_reply_port_internal(t->server_port, t->event_port, request_json, false)) return NULL;
+    while (1) {
+        bool server_dead = false;
+        char *message = rift_receive_event_internal_with_options(t->event_port, 0, false, NULL, &server_dead);
+        if (!message) {
+            if (server_dead) t->stream_closed = true;
+            return NULL;
+        }
+        if (!rift_transport_is_event_message(message)) return message;
+        rift_stash_push(&t->stash, message);
+    }
+}
+#endif
+
+// Subscribe/unsubscribe go out with the event stream as their reply port.
+// Events received ahead of the reply are stashed, not lost.
+static char* rift_transport_control_request(rift_transport_t *t, const char *request_json) {
+    switch (t->kind) {
+#ifdef __APPLE__
+        case RIFT_TRANSPORT_MACH:
+            return rift_transport_mach_control(t, request_json);
+#endif
+        case RIFT_TRANSPORT_SOCKET:
+            return rift_socket_request_internal(t->event_fd, rift_transport_next_id(t), request_json, &t->stash);
+        default:
+            return NULL;
+    }
+}
+
+// Control requests sent as one batch; see rift_socket_request_batch_internal.
+// Mach replies share the event port with events, so they go one at a time.
+static bool rift_transport_control_batch(rift_transport_t *t, const char *const *requests, size_t count, char **replies) {
+    switch (t->kind) {
+#ifdef __APPLE__
+        case RIFT_TRANSPORT_MACH:
+            for (size_t i = 0; i < count; ++i) replies[i] = NULL;
+            for (size_t i = 0; i < count; ++i) {
+                replies[i] = rift_transport_control_request(t, requests[i]);
+                if (!replies[i]) return false;
+            }
+            return true;
+#endif
+        case RIFT_TRANSPORT_SOCKET: {
+            uint32_t *ids = (uint32_t*)malloc((count ? count : 1) * sizeof(uint32_t));
+            if (!ids) return false;
+            for (size_t i = 0; i < count; ++i) ids[i] = rift_transport_next_id(t);
+            bool ok = rift_socket_request_batch_internal(t->event_fd, ids, requests, count, replies, &t->stash);
+            free(ids);
+            return ok;
+        }
+        default:
+            return false;
+    }
+}
+
+// Receives one event as a malloc'd NUL-terminated string. `timeout_ms` < 0
+// blocks until an event arrives; 0 polls.
+static char* rift_transport_receive(rift_transport_t *t, int timeout_ms, rift_recv_status_t *status) {
+    *status = RIFT_RECV_ERROR;
+
+    char *stashed = rift_stash_pop(&t->stash);
+    if (stashed) {
+        *status = RIFT_RECV_OK;
+        return stashed;
+    }
+    if (t->stream_closed) {
+        *status = RIFT_RECV_CLOSED;
+        return NULL;
+    }
+
+    switch (t->kind) {
+#ifdef __APPLE__
+        case RIFT_TRANSPORT_MACH: {
+            bool timed_out = false;
+            bool server_dead = false;
+            char *event_json = rift_receive_event_internal_with_options(
+                t->event_port,
+                timeout_ms < 0 ? MACH_MSG_TIMEOUT_NONE : (mach_msg_timeout_t)timeout_ms,
+                timeout_ms >= 0,
+                &timed_out,
+                &server_dead
+            );
+            if (event_json) *status = RIFT_RECV_OK;
+            else if (timed_out) *status = RIFT_RECV_TIMEOUT;
+            else if (server_dead) *status = RIFT_RECV_CLOSED;
+            return event_json;
+        }
+#endif
+        case RIFT_TRANSPORT_SOCKET: {
+            rift_socket_status_t socket_status;
+            char *event_json = rift_socket_recv_frame(t->event_fd, timeout_ms, NULL, NULL, &socket_status);
+            switch (socket_status) {
+                case RIFT_SOCKET_FRAME: *status = RIFT_RECV_OK; break;
+                case RIFT_SOCKET_TIMEOUT: *status = RIFT_RECV_TIMEOUT; break;
+                case RIFT_SOCKET_CLOSED:
+                    // Closed later by rift_transport_reap_event_stream; this
+                    // may run on the worker while the Lua thread reads the fd.
+                    t->stream_closed = true;
+                    *status = RIFT_RECV_CLOSED;
+                    break;
+                case RIFT_SOCKET_ERROR: *status = RIFT_RECV_ERROR; break;
+            }
+            return event_json;
+        }
+        case RIFT_TRANSPORT_REPLAY: {
+            if (!t->replay) return NULL;
+            char *event_json = NULL;
+            switch (rift_replay_next(t->replay, timeout_ms, &event_json, NULL)) {
+                case RIFT_REPLAY_RECORD: *status = RIFT_RECV_OK; break;
+                case RIFT_REPLAY_WAIT: *status = RIFT_RECV_TIMEOUT; break;
+                case RIFT_REPLAY_END: *status = RIFT_RECV_CLOSED; break;
+                case RIFT_REPLAY_ERROR: *status = RIFT_RECV_ERROR; break;
+            }
+            return event_json;
+        }
+        default:
+            return NULL;
+    }
+}
+
+// A descriptor that becomes readable when an event is waiting, or -1 when the
+// transport has none (replay, or no event stream yet).
+static int rift_transport_fileno(rift_transport_t *t) {
+    switch (t->kind) {
+#ifdef __APPLE__
+        case RIFT_TRANSPORT_MACH:
+            if (t->event_port == MACH_PORT_NULL) return -1;
+            if (t->event_kq < 0) {
+                t->event_kq = rift_event_kqueue_internal(t->event_port, &t->event_port_set);
+            }
+            return t->event_kq;
+#endif
+        case RIFT_TRANSPORT_SOCKET:
+            return t->event_fd;
+        default:
+            return -1;
+    }
+}
+
+// Events waiting in the kernel: messages on the Mach event port, with the
+// port's queue limit, or unread bytes on the event socket, with its receive
+// buffer size. `*exact` is false when only bytes are known.
+static bool rift_transport_backlog(rift_transport_t *t, size_t *messages, size_t *bytes, size_t *limit, bool *exact) {
+    *messages = 0;
+    *bytes = 0;
+    *limit = 0;
+    *exact = false;
+    switch (t->kind) {
+#ifdef __APPLE__
+        case RIFT_TRANSPORT_MACH:
+            *exact = true;
+            return rift_port_backlog_internal(t->event_port, messages, limit);
+#endif
+        case RIFT_TRANSPORT_SOCKET:
+            return rift_socket_backlog(t->event_fd, bytes, limit);
+        default:
+            return false;
+    }
+}
+
+// Makes room for a longer backlog: the Mach queue limit goes to its maximum,
+// the socket receive buffer doubles up to `max_bytes`. False if nothing grew.
+static bool rift_transport_grow_queue(rift_transport_t *t, size_t max_bytes) {
+    switch (t->kind) {
+#ifdef __APPLE__
+        case RIFT_TRANSPORT_MACH: {
+            size_t count = 0;
+            size_t qlimit = 0;
+            if (!rift_port_backlog_internal(t->event_port, &count, &qlimit) || qlimit >= MACH_PORT_QLIMIT_MAX) return false;
+            return rift_set_port_queue_limit_internal(t->event_port, MACH_PORT_QLIMIT_MAX);
+        }
+#endif
+        case RIFT_TRANSPORT_SOCKET:
+            return rift_socket_grow_rcvbuf(t->event_fd, max_bytes);
+        default:
+            return false;
+    }
+}
+
+// Something to receive that the descriptor doesn't show: stashed events, or
+// the close of the stream.
+static bool rift_transport_has_stashed(const rift_transport_t *t) {
+    return t->stash.count || t->stream_closed;
+}
+
+// For transports without a descriptor, and for stashed events: when the next
+// event is due (0 means now). False if there is nothing left to wait for.
+static bool rift_transport_deadline_ns(rift_transport_t *t, uint64_t *due_ns) {
+    if (rift_transport_has_stashed(t)) {
+        *due_ns = 0;
+        return true;
+    }
+    if (t->kind != RIFT_TRANSPORT_REPLAY || !t->replay) return false;
+    return rift_replay_due_ns(t->replay, due_ns);
+}
+
+// 1 when an event can be received without blocking, 0 on timeout, -1 when the
+// stream is closed or can't be waited on.
+static int rift_transport_wait(rift_transport_t *t, int timeout_ms) {
+    uint64_t due_ns = 0;
+    if (rift_transport_deadline_ns(t, &due_ns)) {
+        uint64_t now = rift_now_ns();
+        if (due_ns <= now) return 1;
+        uint64_t wait_ns = due_ns - now;
+        if (timeout_ms >= 0 && wait_ns > (uint64_t)timeout_ms * 1000000ull) {
+            rift_sleep_ns((uint64_t)timeout_ms * 1000000ull);
+            return 0;
+        }
+        rift_sleep_ns(wait_ns);
+        return 1;
+    }
+
+    int fd = rift_transport_fileno(t);
+    if (fd < 0) return -1;
+
+    switch (rift_socket_wait_readable(fd, timeout_ms)) {
+        case RIFT_SOCKET_FRAME: return 1;
+        case RIFT_SOCKET_TIMEOUT: return 0;
+        default: return -1;
+    }
+}
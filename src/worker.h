@@ -0,0 +1,333 @@
+#pragma once
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "transport.h"
+#include "tape.h"
+#include "clock.h"
+#include "trace.h"
+
+// Background receive-and-parse stage for one client's event stream. The worker
+// owns the stream's receive side while running: it waits for events, parses
+// them and flattens the result into a tape, and the Lua thread only turns
+// tapes into tables. Items are handed over through a bounded queue; one byte
+// per queued item is written to `ready_pipe` so the Lua side can poll it.
+#define RIFT_WORKER_QUEUE_LIMIT 1024
+#define RIFT_WORKER_REPLAY_SLICE_MS 100
+
+typedef struct rift_worker_item {
+    struct rift_worker_item *next;
+    char *json;
+    size_t json_len;
+    char *type;
+    rift_tape_t tape;
+    uint64_t received_ns;
+    uint64_t receive_ns;
+    uint64_t parse_ns;
+} rift_worker_item_t;
+
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    rift_transport_t *transport;
+    rift_trace_t *trace;
+    int stream_fd;
+    int wake_pipe[2];
+    int ready_pipe[2];
+    rift_worker_item_t *head;
+    rift_worker_item_t *tail;
+    size_t depth;
+    bool running;
+    bool stop;
+    bool pause;
+    bool paused;
+    bool finished;
+    rift_recv_status_t final_status;
+} rift_worker_t;
+
+static void rift_worker_item_free(rift_worker_item_t *item) {
+    if (!item) return;
+    free(item->json);
+    free(item->type);
+    rift_tape_free(&item->tape);
+    free(item);
+}
+
+static void rift_worker_close_pipe(int fds[2]) {
+    if (fds[0] >= 0) close(fds[0]);
+    if (fds[1] >= 0) close(fds[1]);
+    fds[0] = -1;
+    fds[1] = -1;
+}
+
+static bool rift_worker_open_pipe(int fds[2]) {
+    if (pipe(fds) != 0) {
+        fds[0] = -1;
+        fds[1] = -1;
+        return false;
+    }
+    for (int i = 0; i < 2; ++i) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    return true;
+}
+
+static void rift_worker_signal(int fd) {
+    char byte = 1;
+    while (write(fd, &byte, 1) < 0 && errno == EINTR) {}
+}
+
+static rift_worker_item_t* rift_worker_parse(rift_worker_t *worker, char *json, uint64_t received_ns) {
+    rift_worker_item_t *item = (rift_worker_item_t*)calloc(1, sizeof(rift_worker_item_t));
+    if (!item) {
+        free(json);
+        return NULL;
+    }
+    item->json = json;
+    item->json_len = strlen(json);
+    item->received_ns = received_ns;
+
+    cJSON *root = cJSON_Parse(json);
+    if (root) {
+        const cJSON *type = cJSON_GetObjectItemCaseSensitive(root, "type");
+        if (cJSON_IsString(type) && type->valuestring) item->type = strdup(type->valuestring);
+        if (!rift_tape_encode(&item->tape, root)) rift_tape_free(&item->tape);
+        cJSON_Delete(root);
+    }
+    uint64_t parsed_ns = rift_now_ns();
+    item->parse_ns = parsed_ns - received_ns;
+    rift_trace_span(worker->trace, "parse", RIFT_TRACE_TID_WORKER, received_ns, parsed_ns, (int64_t)item->json_len);
+    return item;
+}
+
+// Waits until the stream has data or the Lua thread pokes `wake_pipe`. Returns
+// false when the worker should re-check its flags instead of receiving.
+static bool rift_worker_wait_stream(rift_worker_t *worker) {
+    if (worker->stream_fd < 0 || rift_transport_has_stashed(worker->transport)) return true;
+
+    struct pollfd fds[2];
+    fds[0].fd = worker->stream_fd;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    fds[1].fd = worker->wake_pipe[0];
+    fds[1].events = POLLIN;
+    fds[1].revents = 0;
+
+    if (poll(fds, 2, -1) < 0) return false;
+    if (fds[1].revents) {
+        char drain[64];
+        while (read(worker->wake_pipe[0], drain, sizeof(drain)) > 0) {}
+        return false;
+    }
+    return fds[0].revents != 0;
+}
+
+static void* rift_worker_main(void *arg) {
+    rift_worker_t *worker = (rift_worker_t*)arg;
+
+    while (1) {
+        pthread_mutex_lock(&worker->mutex);
+        while (!worker->stop && (worker->pause || worker->depth >= RIFT_WORKER_QUEUE_LIMIT)) {
+            if (worker->pause && !worker->paused) {
+                worker->paused = true;
+                pthread_cond_broadcast(&worker->cond);
+            }
+            pthread_cond_wait(&worker->cond, &worker->mutex);
+        }
+        worker->paused = false;
+        bool stop = worker->stop;
+        pthread_mutex_unlock(&worker->mutex);
+        if (stop) break;
+
+        if (!rift_worker_wait_stream(worker)) continue;
+
+        // Descriptor-less transports (replay) are sliced so pause/stop requests
+        // are noticed; everything else only receives once data is ready.
+        int timeout_ms = worker->stream_fd < 0 ? RIFT_WORKER_REPLAY_SLICE_MS : 0;
+        rift_recv_status_t status;
+        uint64_t receive_start = rift_now_ns();
+        char *json = rift_transport_receive(worker->transport, timeout_ms, &status);
+        if (!json) {
+            if (status == RIFT_RECV_TIMEOUT) continue;
+            pthread_mutex_lock(&worker->mutex);
+            worker->finished = true;
+            worker->final_status = status;
+            pthread_mutex_unlock(&worker->mutex);
+            rift_worker_signal(worker->ready_pipe[1]);
+            break;
+        }
+
+        uint64_t received_ns = rift_now_ns();
+        rift_trace_span(worker->trace, "receive", RIFT_TRACE_TID_WORKER, receive_start, received_ns, 0);
+        rift_worker_item_t *item = rift_worker_parse(worker, json, received_ns);
+        if (!item) continue;
+        item->receive_ns = received_ns - receive_start;
+
+        pthread_mutex_lock(&worker->mutex);
+        if (worker->tail) worker->tail->next = item;
+        else worker->head = item;
+        worker->tail = item;
+        worker->depth++;
+        pthread_mutex_unlock(&worker->mutex);
+        rift_worker_signal(worker->ready_pipe[1]);
+    }
+
+    pthread_mutex_lock(&worker->mutex);
+    worker->paused = true;
+    pthread_cond_broadcast(&worker->cond);
+    pthread_mutex_unlock(&worker->mutex);
+    return NULL;
+}
+
+static void rift_worker_init(rift_worker_t *worker) {
+    memset(worker, 0, sizeof(rift_worker_t));
+    worker->stream_fd = -1;
+    worker->wake_pipe[0] = worker->wake_pipe[1] = -1;
+    worker->ready_pipe[0] = worker->ready_pipe[1] = -1;
+}
+
+static bool rift_worker_start(rift_worker_t *worker, rift_transport_t *transport, rift_trace_t *trace) {
+    if (worker->running) return true;
+
+    rift_worker_init(worker);
+    worker->transport = transport;
+    worker->trace = trace;
+    worker->stream_fd = rift_transport_fileno(transport);
+    if (!rift_worker_open_pipe(worker->wake_pipe)) return false;
+    if (!rift_worker_open_pipe(worker->ready_pipe)) {
+        rift_worker_close_pipe(worker->wake_pipe);
+        return false;
+    }
+
+    pthread_mutex_init(&worker->mutex, NULL);
+    pthread_cond_init(&worker->cond, NULL);
+    if (pthread_create(&worker->thread, NULL, rift_worker_main, worker) != 0) {
+        pthread_mutex_destroy(&worker->mutex);
+        pthread_cond_destroy(&worker->cond);
+        rift_worker_close_pipe(worker->wake_pipe);
+        rift_worker_close_pipe(worker->ready_pipe);
+        return false;
+    }
+
+    worker->running = true;
+    return true;
+}
+
+static void rift_worker_stop(rift_worker_t *worker) {
+    if (!worker->running) return;
+
+    pthread_mutex_lock(&worker->mutex);
+    worker->stop = true;
+    pthread_cond_broadcast(&worker->cond);
+    pthread_mutex_unlock(&worker->mutex);
+    rift_worker_signal(worker->wake_pipe[1]);
+    pthread_join(worker->thread, NULL);
+
+    while (worker->head) {
+        rift_worker_item_t *next = worker->head->next;
+        rift_worker_item_free(worker->head);
+        worker->head = next;
+    }
+    worker->tail = NULL;
+    worker->depth = 0;
+
+    pthread_mutex_destroy(&worker->mutex);
+    pthread_cond_destroy(&worker->cond);
+    rift_worker_close_pipe(worker->wake_pipe);
+    rift_worker_close_pipe(worker->ready_pipe);
+    worker->running = false;
+}
+
+// Parks the worker between receives so the Lua thread can use the event
+// stream directly (subscription acks arrive on it).
+static void rift_worker_pause(rift_worker_t *worker) {
+    if (!worker->running) return;
+
+    pthread_mutex_lock(&worker->mutex);
+    worker->pause = true;
+    pthread_cond_broadcast(&worker->cond);
+    pthread_mutex_unlock(&worker->mutex);
+    rift_worker_signal(worker->wake_pipe[1]);
+
+    pthread_mutex_lock(&worker->mutex);
+    while (!worker->paused && !worker->finished) pthread_cond_wait(&worker->cond, &worker->mutex);
+    pthread_mutex_unlock(&worker->mutex);
+}
+
+static void rift_worker_resume(rift_worker_t *worker) {
+    if (!worker->running) return;
+
+    pthread_mutex_lock(&worker->mutex);
+    worker->pause = false;
+    pthread_cond_broadcast(&worker->cond);
+    pthread_mutex_unlock(&worker->mutex);
+}
+
+// Parsed events waiting for the Lua side.
+static size_t rift_worker_depth(rift_worker_t *worker) {
+    if (!worker->running) return 0;
+    pthread_mutex_lock(&worker->mutex);
+    size_t depth = worker->depth;
+    pthread_mutex_unlock(&worker->mutex);
+    return depth;
+}
+
+// Takes the oldest parsed event, waiting up to `timeout_ms` (forever if
+// negative). Reports RIFT_RECV_CLOSED/ERROR once the worker has stopped and
+// the queue is empty. Wakeups that find nothing, e.g. a stale ready byte,
+// only wait out what is left of the timeout.
+static rift_worker_item_t* rift_worker_pop(rift_worker_t *worker, int timeout_ms, rift_recv_status_t *status) {
+    *status = RIFT_RECV_TIMEOUT;
+    uint64_t deadline_ns = timeout_ms > 0 ? rift_now_ns() + (uint64_t)timeout_ms * 1000000ull : 0;
+
+    while (1) {
+        pthread_mutex_lock(&worker->mutex);
+        rift_worker_item_t *item = worker->head;
+        if (item) {
+            worker->head = item->next;
+            if (!worker->head) worker->tail = NULL;
+            if (worker->depth-- == RIFT_WORKER_QUEUE_LIMIT) pthread_cond_broadcast(&worker->cond);
+        }
+        bool finished = worker->finished;
+        rift_recv_status_t final_status = worker->final_status;
+        pthread_mutex_unlock(&worker->mutex);
+
+        if (item) {
+            char byte;
+            while (read(worker->ready_pipe[0], &byte, 1) < 0 && errno == EINTR) {}
+            item->next = NULL;
+            *status = RIFT_RECV_OK;
+            return item;
+        }
+        if (finished) {
+            *status = final_status;
+            return NULL;
+        }
+        if (timeout_ms == 0) return NULL;
+
+        int wait_ms = timeout_ms;
+        if (timeout_ms > 0) {
+            uint64_t now = rift_now_ns();
+            if (now >= deadline_ns) return NULL;
+            // Rounded up, so the last wait doesn't end just short of the deadline.
+            wait_ms = (int)((deadline_ns - now + 999999) / 1000000);
+        }
+        switch (rift_socket_wait_readable(worker->ready_pipe[0], wait_ms)) {
+            case RIFT_SOCKET_FRAME:
+                break;
+            case RIFT_SOCKET_TIMEOUT:
+                return NULL;
+            default:
+                *status = RIFT_RECV_ERROR;
+                return NULL;
+        }
+    }
+}
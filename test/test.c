@@ -0,0 +1,524 @@
+// Tests for `make test`. Embeds the vendored Lua and the rift sources, built
+// with ASan and UBSan. Most cases are Lua scripts run against the stand-in
+// server from bench/server.h, once decoding on the Lua thread and once with
+// the background worker; the rest check the JSON string scanner from C:
+//
+//   bin/test [name]
+//
+// With a name, only that case runs. The exit status is the number of failed
+// runs.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+
+#include "../bench/server.h"
+#include "cJSON.h"
+#include "scan.h"
+
+int luaopen_rift(lua_State *L);
+
+// Shared by every script. emit() has the server push an event and settle()
+// pumps until all emitted events were dispatched; respond() sets what get_*
+// requests return.
+#define TEST_PRELUDE \
+    "local rift, path, worker = ...\n" \
+    "local client = assert(rift.connect({ socket = path }))\n" \
+    "local emitted, seen = 0, 0\n" \
+    "assert(client:subscribe({ '*' }, function(env) seen = seen + 1 end))\n" \
+    "client:set_worker(worker)\n" \
+    "local function send(name, body)\n" \
+    "    assert(client:send_request('{\"' .. name .. '\":' .. body .. '}', false))\n" \
+    "end\n" \
+    "local function emit(event)\n" \
+    "    send('bench_emit', event)\n" \
+    "    emitted = emitted + 1\n" \
+    "end\n" \
+    "local function respond(json) send('bench_respond', json) end\n" \
+    "local function settle()\n" \
+    "    local deadline = rift.now_ns() + 5e9\n" \
+    "    while seen < emitted do\n" \
+    "        assert(client:pump(100))\n" \
+    "        assert(rift.now_ns() < deadline, 'timed out waiting for events')\n" \
+    "    end\n" \
+    "end\n"
+
+// Opens, closes, moves and retitles windows and switches workspaces, checking
+// the mirror against a fresh snapshot of the server's state after each step.
+static const char test_mirror_script[] =
+    TEST_PRELUDE
+    "local windows, order = {}, { {}, {} }\n"
+    "local function window_json(w)\n"
+    "    return string.format('{\"id\":%d,\"title\":\"%s\",\"space_id\":%d}', w.id, w.title, w.space_id)\n"
+    "end\n"
+    "local function list(spaces)\n"
+    "    local out = {}\n"
+    "    for _, space in ipairs(spaces) do\n"
+    "        for _, id in ipairs(order[space]) do out[#out + 1] = window_json(windows[id]) end\n"
+    "    end\n"
+    "    return '[' .. table.concat(out, ',') .. ']'\n"
+    "end\n"
+    "local function space_event(space)\n"
+    "    return string.format('{\"type\":\"windows_changed\",\"space_id\":%d,\"windows\":%s}', space, list({ space }))\n"
+    "end\n"
+    "local function open(id, space, title)\n"
+    "    windows[id] = { id = id, space_id = space, title = title }\n"
+    "    table.insert(order[space], id)\n"
+    "end\n"
+    "local function close(id)\n"
+    "    local space = order[windows[id].space_id]\n"
+    "    windows[id] = nil\n"
+    "    for i, other in ipairs(space) do\n"
+    "        if other == id then table.remove(space, i) break end\n"
+    "    end\n"
+    "end\n"
+    "local mirror\n"
+    "local function check(step)\n"
+    "    respond('{\"windows\":' .. list({ 1, 2 }) .. '}')\n"
+    "    if not mirror then mirror = assert(client:mirror()) end\n"
+    "    settle()\n"
+    "    local same, diff = mirror:verify()\n"
+    "    assert(same, step .. ': ' .. tostring(diff))\n"
+    "    for space = 1, 2 do\n"
+    "        local ids = {}\n"
+    "        for _, w in ipairs(mirror:windows(space)) do ids[#ids + 1] = w.id end\n"
+    "        assert(table.concat(ids, ',') == table.concat(order[space], ','), step .. ': order of space ' .. space)\n"
+    "    end\n"
+    "end\n"
+    "open(1, 1, 'Terminal')\n"
+    "open(2, 1, 'Editor')\n"
+    "open(3, 2, 'Browser')\n"
+    "check('snapshot')\n"
+    "open(4, 1, 'Notes')\n"
+    "emit(space_event(1))\n"
+    "check('open')\n"
+    "close(2)\n"
+    "emit(space_event(1))\n"
+    "check('close')\n"
+    "close(4)\n"
+    "open(4, 2, 'Notes')\n"
+    "emit(space_event(1))\n"
+    "emit(space_event(2))\n"
+    "check('move')\n"
+    "windows[1].title = 'Terminal - make'\n"
+    "emit('{\"type\":\"window_title_changed\",\"window_id\":1,\"title\":\"Terminal - make\"}')\n"
+    "check('retitle')\n"
+    "assert(mirror:window(1).title == 'Terminal - make', 'retitle: mirror:window')\n"
+    "emit('{\"type\":\"workspace_changed\",\"workspace\":{\"id\":2,\"name\":\"web\"}}')\n"
+    "check('workspace switch')\n"
+    "assert(mirror:workspace(2) and mirror:workspace(2).name == 'web', 'workspace switch: mirror:workspace')\n"
+    "open(5, 2, 'Mail')\n"
+    "emit('{\"type\":\"windows_changed\",\"windows\":' .. list({ 1, 2 }) .. '}')\n"
+    "check('full list')\n"
+    "assert(mirror:window(2) == nil, 'closed window still mirrored')\n"
+    "client:disconnect()\n";
+
+// Ids just above 2^53, where neighbours share a double: the mirror, where
+// filters and decoded events must all keep them apart.
+static const char test_integer_ids_script[] =
+    TEST_PRELUDE
+    "local big = 9007199254740993\n"
+    "local filtered = {}\n"
+    "assert(client:subscribe({ 'window_title_changed' }, function(env)\n"
+    "    filtered[#filtered + 1] = env.DATA.window_id\n"
+    "end, { where = { window_id = big } }))\n"
+    "respond('{\"windows\":[]}')\n"
+    "local mirror = assert(client:mirror())\n"
+    "emit('{\"type\":\"windows_changed\",\"space_id\":1,\"windows\":['\n"
+    "    .. '{\"id\":9007199254740993,\"title\":\"a\",\"space_id\":1},'\n"
+    "    .. '{\"id\":9007199254740992,\"title\":\"b\",\"space_id\":1}]}')\n"
+    "emit('{\"type\":\"window_title_changed\",\"window_id\":9007199254740992,\"title\":\"c\"}')\n"
+    "emit('{\"type\":\"window_title_changed\",\"window_id\":9007199254740993,\"title\":\"d\"}')\n"
+    "respond('{\"windows\":['\n"
+    "    .. '{\"id\":9007199254740993,\"title\":\"d\",\"space_id\":1},'\n"
+    "    .. '{\"id\":9007199254740992,\"title\":\"c\",\"space_id\":1}]}')\n"
+    "settle()\n"
+    "local same, diff = mirror:verify()\n"
+    "assert(same, diff)\n"
+    "local window = mirror:window(big)\n"
+    "assert(window and window.id == big and window.title == 'd', 'mirror:window lost the id')\n"
+    "assert(math.type(window.id) == 'integer', 'id decoded as a float')\n"
+    "assert(#filtered == 1 and filtered[1] == big, 'where matched a neighbouring id')\n"
+    "client:disconnect()\n";
+
+// Random opens, closes and retitles on two spaces, with some lists sent
+// twice. One subscription rebuilds the state from full lists, and another
+// rebuilds it from {diff = true}; the two must agree after every event.
+// Recycling is switched on halfway through.
+static const char test_diff_script[] =
+    TEST_PRELUDE
+    "local full, diffed, checked = {}, {}, 0\n"
+    "assert(client:subscribe({ 'windows_changed' }, function(env)\n"
+    "    local current = {}\n"
+    "    for _, w in ipairs(env.DATA.windows) do current[w.id] = w.title end\n"
+    "    full[env.DATA.space_id] = current\n"
+    "end))\n"
+    "assert(client:subscribe({ 'windows_changed' }, function(env)\n"
+    "    local d = env.DATA\n"
+    "    local known = diffed[d.space_id] or {}\n"
+    "    diffed[d.space_id] = known\n"
+    "    for _, w in ipairs(d.added) do\n"
+    "        assert(known[w.id] == nil, 'added twice: ' .. w.id)\n"
+    "        known[w.id] = w.title\n"
+    "    end\n"
+    "    for _, w in ipairs(d.changed) do\n"
+    "        assert(known[w.id] ~= nil and known[w.id] ~= w.title, 'changed without a change: ' .. w.id)\n"
+    "        known[w.id] = w.title\n"
+    "    end\n"
+    "    for _, id in ipairs(d.removed) do\n"
+    "        assert(known[id] ~= nil, 'removed twice: ' .. id)\n"
+    "        known[id] = nil\n"
+    "    end\n"
+    "    local expected = full[d.space_id]\n"
+    "    for id, title in pairs(expected) do assert(known[id] == title, 'diverged at ' .. id) end\n"
+    "    for id in pairs(known) do assert(expected[id] ~= nil, 'kept removed ' .. id) end\n"
+    "    checked = checked + 1\n"
+    "end, { diff = true }))\n"
+    "local seed, next_id = 7, 1\n"
+    "local function random(n)\n"
+    "    seed = (seed * 1103515245 + 12345) % 2147483648\n"
+    "    return seed % n + 1\n"
+    "end\n"
+    "local spaces = { {}, {} }\n"
+    "for space = 1, 2 do\n"
+    "    for _ = 1, 20 do\n"
+    "        spaces[space][#spaces[space] + 1] = { id = next_id, title = 'w' .. next_id }\n"
+    "        next_id = next_id + 1\n"
+    "    end\n"
+    "end\n"
+    "for i = 1, 80 do\n"
+    "    local space = i % 2 + 1\n"
+    "    local list = spaces[space]\n"
+    "    if i % 10 ~= 0 then\n"
+    "        local w = list[random(#list)]\n"
+    "        w.title = w.title .. '+'\n"
+    "        if random(5) == 1 then table.remove(list, random(#list)) end\n"
+    "        if random(5) == 1 then\n"
+    "            list[#list + 1] = { id = next_id, title = 'w' .. next_id }\n"
+    "            next_id = next_id + 1\n"
+    "        end\n"
+    "    end\n"
+    "    local windows = {}\n"
+    "    for _, w in ipairs(list) do\n"
+    "        windows[#windows + 1] = string.format('{\"id\":%d,\"title\":\"%s\",\"frame\":{\"x\":%d.5}}', w.id, w.title, w.id)\n"
+    "    end\n"
+    "    emit(string.format('{\"type\":\"windows_changed\",\"space_id\":%d,\"windows\":[%s]}', space, table.concat(windows, ',')))\n"
+    "    if i == 40 then\n"
+    "        settle()\n"
+    "        client:set_recycle(true)\n"
+    "    end\n"
+    "end\n"
+    "settle()\n"
+    "assert(checked == 80, 'diff callbacks: ' .. checked)\n"
+    "client:disconnect()\n";
+
+// Repeated bodies among long and short events of two types. A {dedupe =
+// true} subscription must see exactly the bodies that differ from the last
+// one of their type, and a plain one every body, byte for byte in env.INFO.
+static const char test_dedupe_script[] =
+    TEST_PRELUDE
+    "local all, deduped = {}, {}\n"
+    "assert(client:subscribe({ '*' }, function(env) all[#all + 1] = env.INFO end))\n"
+    "assert(client:subscribe({ '*' }, function(env) deduped[#deduped + 1] = env.INFO end, { dedupe = true }))\n"
+    "local padding = string.rep('x', 200)\n"
+    "local bodies = {\n"
+    "    '{\"type\":\"windows_changed\",\"space_id\":1,\"windows\":[{\"id\":1,\"title\":\"' .. padding .. '\"}]}',\n"
+    "    '{\"type\":\"windows_changed\",\"space_id\":1,\"windows\":[{\"id\":1,\"title\":\"short\"}]}',\n"
+    "    '{\"type\":\"workspace_changed\",\"workspace\":{\"id\":1,\"name\":\"' .. padding .. '\"}}',\n"
+    "    '{\"type\":\"workspace_changed\",\"workspace\":{\"id\":2}}',\n"
+    "}\n"
+    "local sent, expected, last = {}, {}, {}\n"
+    "for _, index in ipairs({ 1, 1, 3, 1, 2, 3, 3, 2, 2, 4, 1, 4, 4, 3 }) do\n"
+    "    local body = bodies[index]\n"
+    "    local type = body:match('\"type\":\"([^\"]+)\"')\n"
+    "    sent[#sent + 1] = body\n"
+    "    if last[type] ~= body then expected[#expected + 1] = body end\n"
+    "    last[type] = body\n"
+    "    emit(body)\n"
+    "end\n"
+    "settle()\n"
+    "assert(#all == #sent, 'plain subscription: ' .. #all .. ' events')\n"
+    "for i, body in ipairs(sent) do assert(all[i] == body, 'env.INFO differs at ' .. i) end\n"
+    "assert(#deduped == #expected, 'dedupe: ' .. #deduped .. ' events, expected ' .. #expected)\n"
+    "for i, body in ipairs(expected) do assert(deduped[i] == body, 'dedupe differs at ' .. i) end\n"
+    "local stats = client:stats().dedupe\n"
+    "assert(stats.suppressed == #sent - #expected, 'suppressed: ' .. stats.suppressed)\n"
+    "client:disconnect()\n";
+
+static uint32_t test_seed = 7;
+
+static uint32_t test_random(uint32_t n) {
+    test_seed = test_seed * 1103515245u + 12345u;
+    return (test_seed >> 8) % n;
+}
+
+// The first '"' or '\\' one byte at a time, to check rift_scan_string with.
+static const unsigned char* test_naive_scan(const unsigned char *p, const unsigned char *end) {
+    while (p < end && *p != '"' && *p != '\\') p++;
+    return p;
+}
+
+// rift_scan_string against a byte scan for every length up to 48, start
+// offset and position of one quote or backslash. The other bytes are
+// random, high bytes included, and each buffer is exactly its length so
+// ASan catches reads past the end.
+static const char* test_scan_string(void) {
+    for (size_t len = 0; len <= 48; ++len) {
+        unsigned char *buffer = (unsigned char*)malloc(len ? len : 1);
+        for (size_t hit = 0; hit <= len; ++hit) {
+            for (int stop = 0; stop < 2; ++stop) {
+                for (size_t i = 0; i < len; ++i) {
+                    do buffer[i] = (unsigned char)test_random(256); while (buffer[i] == '"' || buffer[i] == '\\');
+                }
+                if (hit < len) buffer[hit] = stop ? '\\' : '"';
+                for (size_t offset = 0; offset <= len; ++offset) {
+                    if (rift_scan_string(buffer + offset, buffer + len) != test_naive_scan(buffer + offset, buffer + len)) {
+                        free(buffer);
+                        return "rift_scan_string disagrees with a byte scan";
+                    }
+                }
+            }
+        }
+        free(buffer);
+    }
+    return NULL;
+}
+
+static size_t test_utf8(unsigned char *out, uint32_t code) {
+    if (code < 0x80) {
+        out[0] = (unsigned char)code;
+        return 1;
+    }
+    if (code < 0x800) {
+        out[0] = (unsigned char)(0xC0 | code >> 6);
+        out[1] = (unsigned char)(0x80 | (code & 0x3F));
+        return 2;
+    }
+    if (code < 0x10000) {
+        out[0] = (unsigned char)(0xE0 | code >> 12);
+        out[1] = (unsigned char)(0x80 | (code >> 6 & 0x3F));
+        out[2] = (unsigned char)(0x80 | (code & 0x3F));
+        return 3;
+    }
+    out[0] = (unsigned char)(0xF0 | code >> 18);
+    out[1] = (unsigned char)(0x80 | (code >> 12 & 0x3F));
+    out[2] = (unsigned char)(0x80 | (code >> 6 & 0x3F));
+    out[3] = (unsigned char)(0x80 | (code & 0x3F));
+    return 4;
+}
+
+// A random code point: ASCII with quotes and backslashes, control
+// characters, or two- to four-byte UTF-8. Never NUL or a lone surrogate.
+static uint32_t test_code_point(void) {
+    switch (test_random(6)) {
+        case 0: return "\"\\/"[test_random(3)];
+        case 1: return 1 + test_random(0x1F);
+        case 2: return 0x80 + test_random(0x780);
+        case 3: {
+            uint32_t code = 0x800 + test_random(0xF800);
+            return code >= 0xD800 && code < 0xE000 ? code - 0x800 : code;
+        }
+        case 4: return 0x10000 + test_random(0x100000);
+        default: return 0x20 + test_random(0x5F);
+    }
+}
+
+// Writes `code` into a JSON string body, escaped when it must be and
+// otherwise at random: short escapes, \\u in either case, surrogate pairs.
+static size_t test_json_escape(char *out, uint32_t code) {
+    static const char *const hex[] = {"0123456789abcdef", "0123456789ABCDEF"};
+    const char *digits = hex[test_random(2)];
+    bool must = code < 0x20 || code == '"' || code == '\\';
+    if (!must && test_random(3)) return test_utf8((unsigned char*)out, code);
+    switch (code) {
+        case '"': case '\\': case '/': out[0] = '\\'; out[1] = (char)code; return 2;
+        case '\b': if (test_random(2)) { memcpy(out, "\\b", 2); return 2; } break;
+        case '\f': if (test_random(2)) { memcpy(out, "\\f", 2); return 2; } break;
+        case '\n': if (test_random(2)) { memcpy(out, "\\n", 2); return 2; } break;
+        case '\r': if (test_random(2)) { memcpy(out, "\\r", 2); return 2; } break;
+        case '\t': if (test_random(2)) { memcpy(out, "\\t", 2); return 2; } break;
+    }
+    uint32_t units[2] = {code, 0};
+    int count = 1;
+    if (code >= 0x10000) {
+        units[0] = 0xD800 | (code - 0x10000) >> 10;
+        units[1] = 0xDC00 | ((code - 0x10000) & 0x3FF);
+        count = 2;
+    }
+    size_t len = 0;
+    for (int i = 0; i < count; ++i) {
+        out[len++] = '\\';
+        out[len++] = 'u';
+        for (int shift = 12; shift >= 0; shift -= 4) out[len++] = digits[units[i] >> shift & 0xF];
+    }
+    return len;
+}
+
+// Parses `len` bytes copied to a buffer of exactly that size. Trailing
+// bytes count as a failure.
+static cJSON* test_parse(const char *text, size_t len) {
+    char *copy = (char*)malloc(len ? len : 1);
+    memcpy(copy, text, len);
+    const char *parse_end = NULL;
+    cJSON *item = cJSON_ParseWithLengthOpts(copy, len, &parse_end, 0);
+    if (item && parse_end != copy + len) {
+        cJSON_Delete(item);
+        item = NULL;
+    }
+    free(copy);
+    return item;
+}
+
+// Random strings through cJSON_Parse, which measures and copies string
+// bodies with rift_scan_string. Each must decode to the UTF-8 it was built
+// from; every truncation of it, and the same text with a stray quote in
+// the body, must fail.
+static const char* test_parse_strings(void) {
+    enum { TEST_CODE_POINTS = 80 };
+    char text[2 + TEST_CODE_POINTS * 12];
+    unsigned char expected[TEST_CODE_POINTS * 4 + 1];
+    for (int round = 0; round < 4000; ++round) {
+        size_t count = test_random(TEST_CODE_POINTS);
+        size_t text_len = 0, expected_len = 0;
+        text[text_len++] = '"';
+        for (size_t i = 0; i < count; ++i) {
+            uint32_t code = test_code_point();
+            text_len += test_json_escape(text + text_len, code);
+            expected_len += test_utf8(expected + expected_len, code);
+        }
+        text[text_len++] = '"';
+
+        cJSON *item = test_parse(text, text_len);
+        bool same = item && cJSON_IsString(item) && strlen(item->valuestring) == expected_len &&
+                    memcmp(item->valuestring, expected, expected_len) == 0;
+        cJSON_Delete(item);
+        if (!same) return "a string decoded differently from what was encoded";
+
+        for (size_t cut = 0; cut < text_len; ++cut) {
+            item = test_parse(text, cut);
+            cJSON_Delete(item);
+            if (item) return "a truncated string parsed";
+        }
+
+        size_t stray = 1 + test_random((uint32_t)text_len - 1);
+        if (stray > 1 && text[stray - 1] == '\\') continue;
+        memmove(text + stray + 1, text + stray, text_len - stray);
+        text[stray] = '"';
+        item = test_parse(text, text_len + 1);
+        cJSON_Delete(item);
+        if (item) return "a string with a stray quote parsed";
+    }
+    return NULL;
+}
+
+// A second client with only a cache, kept until an event drops it, must
+// still see the windows_changed that makes its get_windows stale. The
+// stand-in server sends events to the last connection that subscribed.
+static const char test_cache_script[] =
+    TEST_PRELUDE
+    "local cached = assert(rift.connect({ socket = path }))\n"
+    "cached:set_worker(worker)\n"
+    "assert(cached:set_cache({ ttl_ms = 0 }))\n"
+    "local function first_id() return assert(cached:send_request('{\"get_windows\":{}}')).windows[1].id end\n"
+    "respond('{\"windows\":[{\"id\":1}]}')\n"
+    "assert(first_id() == 1)\n"
+    "respond('{\"windows\":[{\"id\":2}]}')\n"
+    "assert(first_id() == 1, 'not cached')\n"
+    "send('bench_emit', '{\"type\":\"windows_changed\",\"space_id\":1,\"windows\":[{\"id\":2}]}')\n"
+    "local deadline = rift.now_ns() + 5e9\n"
+    "while first_id() ~= 2 do\n"
+    "    assert(cached:pump(10))\n"
+    "    assert(rift.now_ns() < deadline, 'the cached get_windows never went stale')\n"
+    "end\n"
+    "cached:disconnect()\n"
+    "client:disconnect()\n";
+
+// The server hangs up the event stream after a few events. The events sent
+// before must all arrive, then pump reports the close once and the client
+// has no stream left. On the worker path the close happens on the Lua
+// thread after the worker is joined.
+static const char test_eof_script[] =
+    TEST_PRELUDE
+    "for i = 1, 5 do emit('{\"type\":\"workspace_changed\",\"workspace\":{\"id\":' .. i .. '}}') end\n"
+    "send('bench_hangup', 'true')\n"
+    "local deadline = rift.now_ns() + 5e9\n"
+    "local closed\n"
+    "repeat\n"
+    "    local count, err = client:pump(100)\n"
+    "    if not count then closed = err end\n"
+    "    assert(rift.now_ns() < deadline, 'the hangup was never reported')\n"
+    "until closed\n"
+    "assert(closed == 'Event stream closed.', closed)\n"
+    "assert(seen == 5, 'events before the hangup: ' .. seen)\n"
+    "assert(client:pump(10) == 0)\n"
+    "local ok, err = client:unsubscribe('workspace_changed')\n"
+    "assert(not ok and err == 'No active event stream port.', err)\n"
+    "client:disconnect()\n";
+
+// A case is either a Lua script, run inline and on the worker, or a C check
+// that returns NULL or what went wrong.
+typedef struct {
+    const char *name;
+    const char *script;
+    const char* (*check)(void);
+} test_case_t;
+
+static const test_case_t test_cases[] = {
+    {"mirror", test_mirror_script},
+    {"integer_ids", test_integer_ids_script},
+    {"diff", test_diff_script},
+    {"dedupe", test_dedupe_script},
+    {"cache", test_cache_script},
+    {"eof", test_eof_script},
+    {"scan_string", NULL, test_scan_string},
+    {"parse_strings", NULL, test_parse_strings},
+};
+
+static bool test_check(const test_case_t *test) {
+    const char *failure = test->check();
+    if (failure) printf("FAIL %s: %s\n", test->name, failure);
+    else printf("ok   %s\n", test->name);
+    return !failure;
+}
+
+static bool test_run(const test_case_t *test, bool worker) {
+    bench_server_t server;
+    if (!bench_server_open(&server, NULL, NULL, 0, "{}")) {
+        printf("FAIL %s (%s): can't start the server\n", test->name, worker ? "worker" : "inline");
+        return false;
+    }
+
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    char chunk[64];
+    snprintf(chunk, sizeof(chunk), "=%s", test->name);
+    bool ok = luaL_loadbuffer(L, test->script, strlen(test->script), chunk) == LUA_OK;
+    if (ok) {
+        luaL_requiref(L, "rift", luaopen_rift, 0);
+        lua_pushstring(L, server.path);
+        lua_pushboolean(L, worker);
+        ok = lua_pcall(L, 3, 0, 0) == LUA_OK;
+    }
+    if (ok) printf("ok   %s (%s)\n", test->name, worker ? "worker" : "inline");
+    else printf("FAIL %s (%s): %s\n", test->name, worker ? "worker" : "inline", lua_tostring(L, -1));
+    lua_close(L);
+    bench_server_stop(&server);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(test_cases) / sizeof(test_cases[0]); ++i) {
+        if (argc > 1 && strcmp(argv[1], test_cases[i].name) != 0) continue;
+        if (test_cases[i].check) {
+            if (!test_check(&test_cases[i])) failures++;
+            continue;
+        }
+        for (int worker = 0; worker <= 1; ++worker) {
+            if (!test_run(&test_cases[i], worker)) failures++;
+        }
+    }
+    return failures;
+}